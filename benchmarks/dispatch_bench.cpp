@@ -0,0 +1,221 @@
+﻿#include "render/device_dispatch.hpp"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+#include <vector>
+
+/*
+ * Times the device function calls of the frame path through the three ways the engine can make them:
+ * Vulkan-Hpp's default dispatcher, the DeviceDispatch table with the device's own functions, and the
+ * table with the loader's trampolines (LOOM_DISPATCH=loader).
+ *
+ * A draw is the state calls recorded per transparent draw, which are valid outside a render pass, so
+ * no attachments or shaders are needed. A submission is an empty command buffer signaling a timeline.
+ * Runs headless on the first physical device, or the one LOOM_DEVICE_INDEX names.
+ *
+ *     LoomDispatchBench [draws] [submissions] [repetitions]
+ */
+namespace
+{
+struct DrawPushConstants
+{
+    glm::mat4 view_proj;
+    uint32_t  object_buffer;
+    uint32_t  object_index;
+};
+
+struct Bench
+{
+    vk::Instance       instance;
+    vk::PhysicalDevice gpu;
+    vk::Device         device;
+    vk::Queue          queue;
+    uint32_t           queue_family = ~0u;
+    vk::Semaphore      timeline;
+    uint64_t           timeline_value = 0;
+    vk::CommandPool    command_pool;
+    vk::CommandBuffer  draw_cmd;
+    vk::CommandBuffer  empty_cmd;        // Submitted over and over, it is never reset.
+    vk::Buffer         buffer;           // Bound as vertex and index buffer.
+    vk::DeviceMemory   memory;
+    vk::PipelineLayout pipeline_layout;  // Only holds the push constant range.
+};
+
+void create(Bench &bench)
+{
+    static vk::DynamicLoader  loader;
+    PFN_vkGetInstanceProcAddr get_instance_proc_addr = loader.getProcAddress<PFN_vkGetInstanceProcAddr>("vkGetInstanceProcAddr");
+    VULKAN_HPP_DEFAULT_DISPATCHER.init(get_instance_proc_addr);
+
+    vk::ApplicationInfo app_info("LoomDispatchBench", 1, "Loom", 1, VK_API_VERSION_1_3);
+    bench.instance = vk::createInstance(vk::InstanceCreateInfo({}, &app_info));
+    VULKAN_HPP_DEFAULT_DISPATCHER.init(bench.instance);
+
+    std::vector<vk::PhysicalDevice> gpus = bench.instance.enumeratePhysicalDevices();
+    if (gpus.empty())
+    {
+        throw std::runtime_error("No physical device found.");
+    }
+    char const *device_index = std::getenv("LOOM_DEVICE_INDEX");
+    bench.gpu                = gpus[std::min<size_t>(device_index ? std::strtoul(device_index, nullptr, 10) : 0, gpus.size() - 1)];
+
+    std::vector<vk::QueueFamilyProperties> families = bench.gpu.getQueueFamilyProperties();
+    for (uint32_t i = 0; i < families.size() && bench.queue_family == ~0u; i++)
+    {
+        if (families[i].queueFlags & vk::QueueFlagBits::eGraphics)
+        {
+            bench.queue_family = i;
+        }
+    }
+    if (bench.queue_family == ~0u)
+    {
+        throw std::runtime_error("The device has no graphics queue.");
+    }
+
+    float                              priority = 1.0f;
+    vk::DeviceQueueCreateInfo          queue_info({}, bench.queue_family, 1, &priority);
+    vk::PhysicalDeviceVulkan12Features features_12;
+    features_12.timelineSemaphore = VK_TRUE;
+    bench.device                  = bench.gpu.createDevice(vk::DeviceCreateInfo({}, queue_info, {}, {}, nullptr, &features_12));
+    VULKAN_HPP_DEFAULT_DISPATCHER.init(bench.device);
+    bench.queue = bench.device.getQueue(bench.queue_family, 0);
+
+    vk::SemaphoreTypeCreateInfo type_info(vk::SemaphoreType::eTimeline, 0);
+    bench.timeline = bench.device.createSemaphore(vk::SemaphoreCreateInfo({}, &type_info));
+
+    bench.command_pool                  = bench.device.createCommandPool(vk::CommandPoolCreateInfo({}, bench.queue_family));
+    std::vector<vk::CommandBuffer> cmds = bench.device.allocateCommandBuffers(vk::CommandBufferAllocateInfo(bench.command_pool, vk::CommandBufferLevel::ePrimary, 2));
+    bench.draw_cmd                      = cmds[0];
+    bench.empty_cmd                     = cmds[1];
+    bench.empty_cmd.begin(vk::CommandBufferBeginInfo());
+    bench.empty_cmd.end();
+
+    bench.buffer = bench.device.createBuffer(vk::BufferCreateInfo({}, 256, vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eIndexBuffer));
+    vk::MemoryRequirements requirements = bench.device.getBufferMemoryRequirements(bench.buffer);
+    bench.memory                        = bench.device.allocateMemory(vk::MemoryAllocateInfo(requirements.size, static_cast<uint32_t>(std::countr_zero(requirements.memoryTypeBits))));
+    bench.device.bindBufferMemory(bench.buffer, bench.memory, 0);
+
+    vk::PushConstantRange push_constant_range(vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment, 0, sizeof(DrawPushConstants));
+    bench.pipeline_layout = bench.device.createPipelineLayout(vk::PipelineLayoutCreateInfo({}, {}, push_constant_range));
+}
+
+void destroy(Bench &bench)
+{
+    bench.device.waitIdle();
+    bench.device.destroyPipelineLayout(bench.pipeline_layout);
+    bench.device.destroyBuffer(bench.buffer);
+    bench.device.freeMemory(bench.memory);
+    bench.device.destroyCommandPool(bench.command_pool);
+    bench.device.destroySemaphore(bench.timeline);
+    bench.device.destroy();
+    bench.instance.destroy();
+}
+
+/**
+ * @returns The nanoseconds per draw, of the fastest repetition.
+ */
+template <typename Dispatch>
+double time_draws(Bench &bench, Dispatch const &dispatch, uint32_t draws, uint32_t repetitions)
+{
+    DrawPushConstants push_constants{glm::mat4(1.0f), 0, 0};
+    vk::DeviceSize    offset = 0;
+    vk::Rect2D        scissor({0, 0}, {256, 256});
+    double            best   = 0.0;
+
+    for (uint32_t repetition = 0; repetition < repetitions; repetition++)
+    {
+        bench.device.resetCommandPool(bench.command_pool);
+        bench.empty_cmd.begin(vk::CommandBufferBeginInfo());
+        bench.empty_cmd.end();
+
+        auto const start = std::chrono::steady_clock::now();
+        bench.draw_cmd.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit), dispatch);
+        for (uint32_t i = 0; i < draws; i++)
+        {
+            push_constants.object_index = i;
+            bench.draw_cmd.bindVertexBuffers(0, bench.buffer, offset, dispatch);
+            bench.draw_cmd.bindIndexBuffer(bench.buffer, 0, vk::IndexType::eUint32, dispatch);
+            bench.draw_cmd.pushConstants(bench.pipeline_layout, vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment, 0, sizeof(push_constants), &push_constants, dispatch);
+            bench.draw_cmd.setScissor(0, scissor, dispatch);
+        }
+        bench.draw_cmd.end(dispatch);
+        double const nanoseconds = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / draws;
+
+        best = repetition ? std::min(best, nanoseconds) : nanoseconds;
+    }
+    return best;
+}
+
+/**
+ * @returns The microseconds per submission, of the fastest repetition. Waiting for the GPU isn't timed.
+ */
+template <typename Dispatch>
+double time_submissions(Bench &bench, Dispatch const &dispatch, uint32_t submissions, uint32_t repetitions)
+{
+    double best = 0.0;
+
+    for (uint32_t repetition = 0; repetition < repetitions; repetition++)
+    {
+        auto const start = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < submissions; i++)
+        {
+            uint64_t const                  value = ++bench.timeline_value;
+            vk::TimelineSemaphoreSubmitInfo timeline_info({}, value);
+            vk::SubmitInfo                  submit_info({}, {}, bench.empty_cmd, bench.timeline, &timeline_info);
+            bench.queue.submit(submit_info, nullptr, dispatch);
+        }
+        double const microseconds = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / submissions;
+
+        if (bench.device.waitSemaphores(vk::SemaphoreWaitInfo({}, bench.timeline, bench.timeline_value), UINT64_MAX, dispatch) != vk::Result::eSuccess)
+        {
+            throw std::runtime_error("Failed to wait for the submissions.");
+        }
+        best = repetition ? std::min(best, microseconds) : microseconds;
+    }
+    return best;
+}
+}  // namespace
+
+int main(int argc, char **argv)
+{
+    uint32_t const draws       = argc > 1 ? std::max(static_cast<uint32_t>(std::strtoul(argv[1], nullptr, 10)), 1u) : 10000;
+    uint32_t const submissions = argc > 2 ? std::max(static_cast<uint32_t>(std::strtoul(argv[2], nullptr, 10)), 1u) : 1000;
+    uint32_t const repetitions = argc > 3 ? std::max(static_cast<uint32_t>(std::strtoul(argv[3], nullptr, 10)), 1u) : 20;
+
+    Bench bench;
+    try
+    {
+        create(bench);
+
+        DeviceDispatch direct;
+        DeviceDispatch through_loader;
+        direct.load(bench.instance, bench.gpu, bench.device, false);
+        through_loader.load(bench.instance, bench.gpu, bench.device, true);
+
+        std::printf("%s, %u draws and %u submissions, the fastest of %u repetitions\n", bench.gpu.getProperties().deviceName.data(), draws, submissions, repetitions);
+        std::printf("%-26s %10s %14s\n", "", "ns/draw", "us/submission");
+
+        auto const report = [&](char const *name, auto const &dispatch) {
+            double const draw_time   = time_draws(bench, dispatch, draws, repetitions);
+            double const submit_time = time_submissions(bench, dispatch, submissions, repetitions);
+            std::printf("%-26s %10.1f %14.2f\n", name, draw_time, submit_time);
+        };
+        report("default dispatcher", VULKAN_HPP_DEFAULT_DISPATCHER);
+        report("table, device functions", direct);
+        report("table, loader trampolines", through_loader);
+
+        destroy(bench);
+    }
+    catch (std::exception const &e)
+    {
+        std::printf("LoomDispatchBench failed: %s\n", e.what());
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,123 @@
+﻿#include "math/simd_math.hpp"
+#include "render/radix_sort.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <thread>
+#include <vector>
+
+/*
+ * Checks the RadixSorter against std::sort on depth sort keys, then times the two against each other,
+ * on the calling thread alone and on the workers the transparent queue uses.
+ *
+ * The keys are those of the transparent draws, generated from random centers in front of a camera, so
+ * the sort skips the same constant digits as in the frames. The exit code is 1 if the sorts disagree.
+ *
+ *     LoomSortBench [keys] [repetitions]
+ */
+namespace
+{
+std::mt19937 random_engine(1234);
+int          failures = 0;
+
+std::vector<uint64_t> generate_keys(size_t count)
+{
+    std::uniform_real_distribution<float> distribution(-50.0f, 50.0f);
+    std::vector<float>                    centers[3];
+    for (auto &stream : centers)
+    {
+        stream.resize(count);
+        for (float &value : stream)
+        {
+            value = distribution(random_engine);
+        }
+    }
+
+    glm::mat4 const view_proj = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 500.0f) *
+                                glm::lookAt(glm::vec3(0.0f, 20.0f, 120.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+    std::vector<uint64_t> keys(count);
+    math::depth_sort_keys_batch(math::Mat4::from_glm(view_proj), {{centers[0].data(), centers[1].data(), centers[2].data()}}, 0, keys.data(), count);
+    return keys;
+}
+
+void check_sort(RadixSorter &sorter, size_t count)
+{
+    std::vector<uint64_t> const unsorted = generate_keys(count);
+    std::vector<uint64_t>       sorted   = unsorted;
+    std::vector<uint64_t>       expected = unsorted;
+    sorter.sort(sorted);
+    std::sort(expected.begin(), expected.end());
+
+    if (sorted != expected)
+    {
+        std::printf("FAILED: the radix sort on %u threads disagrees with std::sort for %zu keys\n", sorter.get_thread_count(), count);
+        failures++;
+    }
+}
+
+/**
+ * @brief Sorts a copy of the keys every repetition, only the sorting is timed.
+ */
+template <typename Sort>
+double time_milliseconds(std::vector<uint64_t> const &unsorted, uint32_t repetitions, Sort &&sort)
+{
+    std::vector<uint64_t>               keys;
+    std::chrono::steady_clock::duration total{};
+    for (uint32_t i = 0; i < repetitions; i++)
+    {
+        keys             = unsorted;
+        auto const start = std::chrono::steady_clock::now();
+        sort(keys);
+        total += std::chrono::steady_clock::now() - start;
+    }
+    return std::chrono::duration<double, std::milli>(total).count() / repetitions;
+}
+}  // namespace
+
+int main(int argc, char **argv)
+{
+    size_t const   count       = argc > 1 ? std::max<size_t>(std::strtoull(argv[1], nullptr, 10), 1) : 100000;
+    uint32_t const repetitions = argc > 2 ? std::max<uint32_t>(static_cast<uint32_t>(std::strtoul(argv[2], nullptr, 10)), 1) : 100;
+    uint32_t const threads     = std::clamp(std::thread::hardware_concurrency() / 2, 1u, 8u);        // As the transparent queue.
+
+    RadixSorter single;
+    RadixSorter parallel;
+    single.prepare(1);
+    parallel.prepare(threads);
+
+    // Few keys, either side of the parallel threshold, and enough for every thread to have a tail.
+    for (size_t check_count : {size_t(0), size_t(1), size_t(2), size_t(33), RadixSorter::parallel_threshold - 1, RadixSorter::parallel_threshold,
+                               RadixSorter::parallel_threshold * threads + 7})
+    {
+        check_sort(single, check_count);
+        check_sort(parallel, check_count);
+    }
+    if (failures)
+    {
+        std::printf("%d checks failed\n", failures);
+        return 1;
+    }
+    std::printf("The radix sort agrees with std::sort\n");
+
+    std::vector<uint64_t> const unsorted = generate_keys(count);
+    single.reserve(count);
+    parallel.reserve(count);
+
+    double const std_time      = time_milliseconds(unsorted, repetitions, [](std::vector<uint64_t> &keys) { std::sort(keys.begin(), keys.end()); });
+    double const single_time   = time_milliseconds(unsorted, repetitions, [&](std::vector<uint64_t> &keys) { single.sort(keys); });
+    double const parallel_time = time_milliseconds(unsorted, repetitions, [&](std::vector<uint64_t> &keys) { parallel.sort(keys); });
+
+    std::printf("%-26s %8zu keys  %9.3f ms\n", "std::sort", count, std_time);
+    std::printf("%-26s %8zu keys  %9.3f ms  %5.2fx\n", "radix sort, 1 thread", count, single_time, std_time / single_time);
+    std::printf("radix sort, %-2u threads     %8zu keys  %9.3f ms  %5.2fx\n", threads, count, parallel_time, std_time / parallel_time);
+
+    single.destroy();
+    parallel.destroy();
+    return 0;
+}
@@ -0,0 +1,445 @@
+﻿#include "math/simd_math.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+/*
+ * Checks the kernels of src/math against glm on random inputs, then times them against the same work
+ * done with glm.
+ *
+ * The batch kernels are checked at every count up to a few vector widths, so the elements left over
+ * for the scalar tail are covered, and with their output aliasing their input. The exit code is 1 if
+ * a kernel disagrees with glm, so the check can run after changing the kernels.
+ *
+ *     LoomMathBench [elements] [repetitions]
+ */
+namespace
+{
+// Relative to the magnitude of the value, the kernels may round differently than glm, e.g. with FMA.
+constexpr float tolerance = 1e-4f;
+
+std::mt19937   random_engine(1234);
+int            failures = 0;
+volatile float sink     = 0.0f;        // The timed results end up here, so they can't be optimized away.
+
+void consume(float value)
+{
+    sink = sink + value;
+}
+
+float random_float(float min, float max)
+{
+    return std::uniform_real_distribution<float>(min, max)(random_engine);
+}
+
+bool is_close(float value, float expected)
+{
+    return std::abs(value - expected) <= tolerance * (1.0f + std::abs(expected));
+}
+
+bool is_close(glm::mat4 const &value, glm::mat4 const &expected)
+{
+    for (int c = 0; c < 4; c++)
+    {
+        for (int r = 0; r < 4; r++)
+        {
+            if (!is_close(value[c][r], expected[c][r]))
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void check(bool passed, char const *kernel, size_t count)
+{
+    if (!passed)
+    {
+        std::printf("FAILED: %s disagrees with glm for %zu elements\n", kernel, count);
+        failures++;
+    }
+}
+
+/// @brief Diagonally dominant, so it is well conditioned for the inverse.
+glm::mat4 random_matrix()
+{
+    glm::mat4 m;
+    for (int c = 0; c < 4; c++)
+    {
+        for (int r = 0; r < 4; r++)
+        {
+            m[c][r] = random_float(-1.0f, 1.0f) + (c == r ? 4.0f : 0.0f);
+        }
+    }
+    return m;
+}
+
+/// @brief The last row is (0, 0, 0, 1), as transform_aabb expects.
+glm::mat4 random_affine_matrix()
+{
+    glm::mat4 m = random_matrix();
+    m[0][3]     = 0.0f;
+    m[1][3]     = 0.0f;
+    m[2][3]     = 0.0f;
+    m[3][3]     = 1.0f;
+    return m;
+}
+
+/// @brief The inverse of depth_sort_key_scalar, the depth a key was made of.
+float get_key_depth(uint64_t key)
+{
+    uint32_t const ordered = ~static_cast<uint32_t>(key >> 32);
+    uint32_t const bits    = (ordered & 0x80000000u) ? ordered ^ 0x80000000u : ~ordered;
+    float          depth;
+    std::memcpy(&depth, &bits, sizeof(depth));
+    return depth;
+}
+
+uint64_t get_glm_key(float depth, uint32_t index)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &depth, sizeof(bits));
+    uint32_t const ordered = bits ^ ((bits & 0x80000000u) ? 0xffffffffu : 0x80000000u);
+    return (static_cast<uint64_t>(~ordered) << 32) | index;
+}
+
+/// @brief The bounds of the eight transformed corners.
+void transform_corners_glm(glm::mat4 const &m, glm::vec3 const &min, glm::vec3 const &max, glm::vec3 &out_min, glm::vec3 &out_max)
+{
+    out_min = glm::vec3(INFINITY);
+    out_max = glm::vec3(-INFINITY);
+    for (int corner = 0; corner < 8; corner++)
+    {
+        glm::vec3 const p(corner & 1 ? max.x : min.x, corner & 2 ? max.y : min.y, corner & 4 ? max.z : min.z);
+        glm::vec3 const t = glm::vec3(m * glm::vec4(p, 1.0f));
+        out_min           = glm::min(out_min, t);
+        out_max           = glm::max(out_max, t);
+    }
+}
+
+/// @brief The same as transform_aabb, by the center and the extent, to time it against.
+void transform_extent_glm(glm::mat4 const &m, glm::vec3 const &min, glm::vec3 const &max, glm::vec3 &out_min, glm::vec3 &out_max)
+{
+    glm::vec3 const center = glm::vec3(m * glm::vec4((min + max) * 0.5f, 1.0f));
+    glm::mat3 const linear(m);
+    glm::vec3 const extent = glm::mat3(glm::abs(linear[0]), glm::abs(linear[1]), glm::abs(linear[2])) * ((max - min) * 0.5f);
+    out_min                = center - extent;
+    out_max                = center + extent;
+}
+
+/// @brief Random inputs of every kernel, as the kernels take them.
+struct Inputs
+{
+    std::vector<math::Mat4> a;
+    std::vector<math::Mat4> b;
+    std::vector<float>      translation[3];
+    std::vector<float>      rotation[4];
+    std::vector<float>      scale[3];
+    std::vector<float>      min[3];
+    std::vector<float>      max[3];
+    std::vector<float>      position[3];        // In front of the camera of view_proj.
+    glm::mat4               bounds_transform;
+    glm::mat4               view_proj;
+
+    explicit Inputs(size_t count)
+    {
+        bounds_transform = random_affine_matrix();
+        view_proj        = glm::perspective(glm::radians(60.0f), 1.5f, 0.1f, 100.0f) * glm::lookAt(glm::vec3(0.0f, 2.0f, 10.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+        for (size_t i = 0; i < count; i++)
+        {
+            a.push_back(math::Mat4::from_glm(random_matrix()));
+            b.push_back(math::Mat4::from_glm(random_matrix()));
+
+            glm::vec4 const q = glm::normalize(glm::vec4(random_float(-1.0f, 1.0f), random_float(-1.0f, 1.0f), random_float(-1.0f, 1.0f), random_float(0.1f, 1.0f)));
+            for (int c = 0; c < 3; c++)
+            {
+                translation[c].push_back(random_float(-10.0f, 10.0f));
+                scale[c].push_back(random_float(0.1f, 4.0f));
+                min[c].push_back(random_float(-10.0f, 10.0f));
+                max[c].push_back(min[c].back() + random_float(0.0f, 4.0f));
+                position[c].push_back(random_float(-5.0f, 5.0f));
+            }
+            for (int c = 0; c < 4; c++)
+            {
+                rotation[c].push_back(q[c]);
+            }
+        }
+    }
+
+    math::TransformStreams get_transforms() const
+    {
+        return {{translation[0].data(), translation[1].data(), translation[2].data()},
+                {rotation[0].data(), rotation[1].data(), rotation[2].data(), rotation[3].data()},
+                {scale[0].data(), scale[1].data(), scale[2].data()}};
+    }
+
+    math::AabbStreams get_bounds()
+    {
+        return {{min[0].data(), min[1].data(), min[2].data()}, {max[0].data(), max[1].data(), max[2].data()}};
+    }
+
+    math::PointStreams get_points() const
+    {
+        return {{position[0].data(), position[1].data(), position[2].data()}};
+    }
+
+    glm::mat4 get_trs_glm(size_t i) const
+    {
+        glm::quat const rotation_glm(rotation[3][i], rotation[0][i], rotation[1][i], rotation[2][i]);
+        return glm::translate(glm::mat4(1.0f), glm::vec3(translation[0][i], translation[1][i], translation[2][i])) * glm::mat4_cast(rotation_glm) *
+               glm::scale(glm::mat4(1.0f), glm::vec3(scale[0][i], scale[1][i], scale[2][i]));
+    }
+
+    glm::vec3 get_min(size_t i) const
+    {
+        return {min[0][i], min[1][i], min[2][i]};
+    }
+
+    glm::vec3 get_max(size_t i) const
+    {
+        return {max[0][i], max[1][i], max[2][i]};
+    }
+};
+
+void check_single_kernels(size_t count)
+{
+    Inputs inputs(count);
+    bool   multiplied = true, transformed = true, inverted = true, composed = true, bounded = true;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        glm::mat4 const a = inputs.a[i].to_glm();
+        glm::mat4 const b = inputs.b[i].to_glm();
+        multiplied        = multiplied && is_close(math::multiply(inputs.a[i], inputs.b[i]).to_glm(), a * b);
+        inverted          = inverted && is_close(math::inverse(inputs.a[i]).to_glm(), glm::inverse(a));
+
+        glm::vec4 const  v(random_float(-10.0f, 10.0f), random_float(-10.0f, 10.0f), random_float(-10.0f, 10.0f), 1.0f);
+        math::Vec4 const t = math::transform(inputs.a[i], {v.x, v.y, v.z, v.w});
+        glm::vec4 const  expected = a * v;
+        transformed               = transformed && is_close(t.x, expected.x) && is_close(t.y, expected.y) && is_close(t.z, expected.z) && is_close(t.w, expected.w);
+
+        math::Mat4 const trs = math::compose_trs({inputs.translation[0][i], inputs.translation[1][i], inputs.translation[2][i], 0.0f},
+                                                 {inputs.rotation[0][i], inputs.rotation[1][i], inputs.rotation[2][i], inputs.rotation[3][i]},
+                                                 {inputs.scale[0][i], inputs.scale[1][i], inputs.scale[2][i], 0.0f});
+        composed             = composed && is_close(trs.to_glm(), inputs.get_trs_glm(i));
+
+        glm::vec3 expected_min, expected_max;
+        transform_corners_glm(inputs.bounds_transform, inputs.get_min(i), inputs.get_max(i), expected_min, expected_max);
+        math::Aabb const bounds = math::transform_aabb(math::Mat4::from_glm(inputs.bounds_transform),
+                                                       {{inputs.min[0][i], inputs.min[1][i], inputs.min[2][i], 0.0f}, {inputs.max[0][i], inputs.max[1][i], inputs.max[2][i], 0.0f}});
+        for (int c = 0; c < 3; c++)
+        {
+            bounded = bounded && is_close((&bounds.min.x)[c], expected_min[c]) && is_close((&bounds.max.x)[c], expected_max[c]);
+        }
+    }
+
+    check(multiplied, "multiply", count);
+    check(transformed, "transform", count);
+    check(inverted, "inverse", count);
+    check(composed, "compose_trs", count);
+    check(bounded, "transform_aabb", count);
+}
+
+/**
+ * @brief Checks the batch kernels for one count, into separate outputs and in place.
+ */
+void check_batch_kernels(size_t count)
+{
+    Inputs inputs(count);
+
+    std::vector<math::Mat4> products(count);
+    math::multiply_batch(inputs.a.data(), inputs.b.data(), products.data(), count);
+    std::vector<math::Mat4> in_place = inputs.a;
+    math::multiply_batch(in_place.data(), inputs.b.data(), in_place.data(), count);
+    bool multiplied = true;
+    for (size_t i = 0; i < count; i++)
+    {
+        glm::mat4 const expected = inputs.a[i].to_glm() * inputs.b[i].to_glm();
+        multiplied               = multiplied && is_close(products[i].to_glm(), expected) && is_close(in_place[i].to_glm(), expected);
+    }
+    check(multiplied, "multiply_batch", count);
+
+    std::vector<math::Mat4> transforms(count);
+    math::compose_trs_batch(inputs.get_transforms(), transforms.data(), count);
+    bool composed = true;
+    for (size_t i = 0; i < count; i++)
+    {
+        composed = composed && is_close(transforms[i].to_glm(), inputs.get_trs_glm(i));
+    }
+    check(composed, "compose_trs_batch", count);
+
+    std::vector<float> out[6];
+    for (auto &stream : out)
+    {
+        stream.resize(count);
+    }
+    math::AabbStreams const out_bounds = {{out[0].data(), out[1].data(), out[2].data()}, {out[3].data(), out[4].data(), out[5].data()}};
+    math::Mat4 const        m          = math::Mat4::from_glm(inputs.bounds_transform);
+    math::transform_aabb_batch(m, inputs.get_bounds(), out_bounds, count);
+    Inputs const original = inputs;
+    math::transform_aabb_batch(m, inputs.get_bounds(), inputs.get_bounds(), count);
+    bool bounded = true;
+    for (size_t i = 0; i < count; i++)
+    {
+        glm::vec3 expected_min, expected_max;
+        transform_corners_glm(original.bounds_transform, original.get_min(i), original.get_max(i), expected_min, expected_max);
+        for (int c = 0; c < 3; c++)
+        {
+            bounded = bounded && is_close(out[c][i], expected_min[c]) && is_close(out[3 + c][i], expected_max[c]) && is_close(inputs.min[c][i], expected_min[c]) &&
+                      is_close(inputs.max[c][i], expected_max[c]);
+        }
+    }
+    check(bounded, "transform_aabb_batch", count);
+
+    uint32_t const        first_index = 100;
+    std::vector<uint64_t> keys(count);
+    math::depth_sort_keys_batch(math::Mat4::from_glm(inputs.view_proj), inputs.get_points(), first_index, keys.data(), count);
+    bool keyed = true;
+    for (size_t i = 0; i < count; i++)
+    {
+        glm::vec4 const clip = inputs.view_proj * glm::vec4(inputs.position[0][i], inputs.position[1][i], inputs.position[2][i], 1.0f);
+        keyed                = keyed && static_cast<uint32_t>(keys[i]) == first_index + i && is_close(get_key_depth(keys[i]), clip.z / clip.w);
+    }
+    check(keyed, "depth_sort_keys_batch", count);
+}
+
+template <typename Work>
+double time_milliseconds(uint32_t repetitions, Work &&work)
+{
+    auto const start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < repetitions; i++)
+    {
+        work();
+    }
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / repetitions;
+}
+
+void report(char const *kernel, size_t count, double milliseconds, double glm_milliseconds)
+{
+    std::printf("%-22s %8zu elements  %9.3f ms  glm %9.3f ms  %5.2fx\n", kernel, count, milliseconds, glm_milliseconds, glm_milliseconds / milliseconds);
+}
+
+void time_kernels(size_t count, uint32_t repetitions)
+{
+    Inputs                 inputs(count);
+    std::vector<glm::mat4> a_glm(count), b_glm(count), out_glm(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        a_glm[i] = inputs.a[i].to_glm();
+        b_glm[i] = inputs.b[i].to_glm();
+    }
+    std::vector<math::Mat4> out(count);
+
+    double const multiply_time = time_milliseconds(repetitions, [&]() {
+        for (size_t i = 0; i < count; i++)
+        {
+            out[i] = math::multiply(inputs.a[i], inputs.b[i]);
+        }
+    });
+    double const multiply_glm_time = time_milliseconds(repetitions, [&]() {
+        for (size_t i = 0; i < count; i++)
+        {
+            out_glm[i] = a_glm[i] * b_glm[i];
+        }
+    });
+    report("multiply", count, multiply_time, multiply_glm_time);
+    consume(out[count - 1].columns[0].x + out_glm[count - 1][0][0]);
+
+    double const multiply_batch_time = time_milliseconds(repetitions, [&]() { math::multiply_batch(inputs.a.data(), inputs.b.data(), out.data(), count); });
+    report("multiply_batch", count, multiply_batch_time, multiply_glm_time);
+    consume(out[count - 1].columns[0].x);
+
+    double const inverse_time = time_milliseconds(repetitions, [&]() {
+        for (size_t i = 0; i < count; i++)
+        {
+            out[i] = math::inverse(inputs.a[i]);
+        }
+    });
+    double const inverse_glm_time = time_milliseconds(repetitions, [&]() {
+        for (size_t i = 0; i < count; i++)
+        {
+            out_glm[i] = glm::inverse(a_glm[i]);
+        }
+    });
+    report("inverse", count, inverse_time, inverse_glm_time);
+    consume(out[count - 1].columns[0].x + out_glm[count - 1][0][0]);
+
+    double const compose_time     = time_milliseconds(repetitions, [&]() { math::compose_trs_batch(inputs.get_transforms(), out.data(), count); });
+    double const compose_glm_time = time_milliseconds(repetitions, [&]() {
+        for (size_t i = 0; i < count; i++)
+        {
+            out_glm[i] = inputs.get_trs_glm(i);
+        }
+    });
+    report("compose_trs_batch", count, compose_time, compose_glm_time);
+    consume(out[count - 1].columns[0].x + out_glm[count - 1][0][0]);
+
+    std::vector<float> bounds[6];
+    for (auto &stream : bounds)
+    {
+        stream.resize(count);
+    }
+    math::AabbStreams const out_bounds = {{bounds[0].data(), bounds[1].data(), bounds[2].data()}, {bounds[3].data(), bounds[4].data(), bounds[5].data()}};
+    math::Mat4 const        m          = math::Mat4::from_glm(inputs.bounds_transform);
+    std::vector<glm::vec3>  min_glm(count), max_glm(count);
+
+    double const bounds_time     = time_milliseconds(repetitions, [&]() { math::transform_aabb_batch(m, inputs.get_bounds(), out_bounds, count); });
+    double const bounds_glm_time = time_milliseconds(repetitions, [&]() {
+        for (size_t i = 0; i < count; i++)
+        {
+            transform_extent_glm(inputs.bounds_transform, inputs.get_min(i), inputs.get_max(i), min_glm[i], max_glm[i]);
+        }
+    });
+    report("transform_aabb_batch", count, bounds_time, bounds_glm_time);
+    consume(bounds[0][count - 1] + min_glm[count - 1].x);
+
+    std::vector<uint64_t> keys(count);
+    math::Mat4 const      view_proj = math::Mat4::from_glm(inputs.view_proj);
+    double const          keys_time = time_milliseconds(repetitions, [&]() { math::depth_sort_keys_batch(view_proj, inputs.get_points(), 0, keys.data(), count); });
+    double const          keys_glm_time = time_milliseconds(repetitions, [&]() {
+        for (size_t i = 0; i < count; i++)
+        {
+            glm::vec4 const clip = inputs.view_proj * glm::vec4(inputs.position[0][i], inputs.position[1][i], inputs.position[2][i], 1.0f);
+            keys[i]              = get_glm_key(clip.z / clip.w, static_cast<uint32_t>(i));
+        }
+    });
+    report("depth_sort_keys_batch", count, keys_time, keys_glm_time);
+    consume(static_cast<float>(keys[count - 1] & 1));
+}
+}  // namespace
+
+int main(int argc, char **argv)
+{
+    size_t const   count       = argc > 1 ? std::max<size_t>(std::strtoull(argv[1], nullptr, 10), 1) : 10000;
+    uint32_t const repetitions = argc > 2 ? std::max<uint32_t>(static_cast<uint32_t>(std::strtoul(argv[2], nullptr, 10)), 1) : 100;
+
+    std::printf("Math kernels: %s\n", math::get_simd_name());
+
+    // Every count up to four AVX2 widths and one more, then one with a long vector part and a tail.
+    check_single_kernels(1000);
+    for (size_t i = 0; i <= 33; i++)
+    {
+        check_batch_kernels(i);
+    }
+    check_batch_kernels(1003);
+    if (failures)
+    {
+        std::printf("%d checks failed\n", failures);
+        return 1;
+    }
+    std::printf("All kernels agree with glm\n");
+
+    time_kernels(count, repetitions);
+    return 0;
+}
@@ -1,10 +1,40 @@
-#version 450
+﻿#version 450
+#extension GL_EXT_nonuniform_qualifier : require
 
-layout(location = 0) in vec3 fragColor;
+// Variants: TEXTURED samples the object's texture, without it the bindless arrays aren't accessed at all.
+
+// What the fragments show: 0 the shaded color, 1 the texture coordinates, 2 the color without textures.
+layout(constant_id = 0) const uint DEBUG_VIEW = 0;
+
+#ifdef TEXTURED
+// The texture and sampler arrays of the bindless heap.
+layout(set = 0, binding = 0) uniform texture2D textures[];
+layout(set = 0, binding = 1) uniform sampler samplers[];
+#endif
+
+layout(location = 0) in vec4 fragColor;
+layout(location = 1) in vec2 fragTexCoord;
+layout(location = 2) flat in uint fragTexture;
+layout(location = 3) flat in uint fragSampler;
 
 layout(location = 0) out vec4 outColor;
 
 void main()
 {
-	outColor = vec4(fragColor, 1.0);
+	if (DEBUG_VIEW == 1)
+	{
+		outColor = vec4(fragTexCoord, 0.0, 1.0);
+		return;
+	}
+
+	vec3 color = fragColor.rgb;
+#ifdef TEXTURED
+	if (DEBUG_VIEW == 0 && fragTexture != ~0u)
+	{
+		// The indices come from the object data, they may differ between the draws of one call.
+		color *= texture(sampler2D(textures[nonuniformEXT(fragTexture)], samplers[nonuniformEXT(fragSampler)]), fragTexCoord).rgb;
+	}
+#endif
+	// Premultiplied, opaque objects have an alpha of one.
+	outColor = vec4(color * fragColor.a, fragColor.a);
 }
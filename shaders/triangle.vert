@@ -1,9 +1,33 @@
 #version 450
+#extension GL_EXT_nonuniform_qualifier : require
+
+struct ObjectData
+{
+    vec4 tint;
+    uint texture;              // Bindless texture index, ~0u for untextured objects.
+    uint sampler;
+    vec4 placement;            // Offset in xyz and uniform scale in w.
+};
+
+// The storage buffer array of the bindless heap.
+layout(set = 0, binding = 2) readonly buffer ObjectBuffers
+{
+    ObjectData objects[];
+} object_buffers[];
+
+layout(push_constant) uniform DrawParams
+{
+    mat4 view_proj;            // The camera.
+    uint object_buffer;        // Bindless index of the per-object data, indexed by the draw's instance.
+} params;
 
 layout(location = 0) in vec2 inPosition;
 layout(location = 1) in vec3 inColor;
 
-layout(location = 0) out vec3 fragColor;
+layout(location = 0) out vec4 fragColor;
+layout(location = 1) out vec2 fragTexCoord;
+layout(location = 2) flat out uint fragTexture;
+layout(location = 3) flat out uint fragSampler;
 
 // vec2 positions[3] = vec2[](
 //     vec2(0.0, -0.5),
@@ -21,6 +45,11 @@ void main()
 {
     // gl_Position = vec4(positions[gl_VertexIndex], 0.0, 1.0);
     // fragColor = colors[gl_VertexIndex];
-    gl_Position = vec4(inPosition, 0.0, 1.0);
-    fragColor = inColor;
+    ObjectData object = object_buffers[params.object_buffer].objects[gl_InstanceIndex];
+    gl_Position       = params.view_proj * vec4(vec3(inPosition, 0.0) * object.placement.w + object.placement.xyz, 1.0);
+
+    fragColor    = vec4(inColor * object.tint.rgb, object.tint.a);
+    fragTexCoord = inPosition + 0.5;
+    fragTexture  = object.texture;
+    fragSampler  = object.sampler;
 }
@@ -3,10 +3,23 @@
 #include <common/hpp_error.h>
 #include <common/hpp_vk_common.h>
 #include <common/logging.h>
-#include <hpp_glsl_compiler.h>
 #include <platform/filesystem.h>
 #include <platform/window.h>
 
+#include "memory/allocation_counter.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <limits>
+#include <random>
+#include <thread>
+
 // Note: the default dispatcher is instantiated in hpp_api_vulkan_sample.cpp.
 //			 Even though, that file is not part of this sample, it's part of the sample-project!
 
@@ -115,6 +128,59 @@ std::vector<const char *> get_optimal_validation_layers(const std::vector<vk::La
     return {};
 }
 
+/**
+ * @brief Finds the queue family supporting the required flags without any of the excluded ones.
+ * @returns The family index, or ~0u if there is none.
+ */
+uint32_t find_dedicated_queue_family(std::vector<vk::QueueFamilyProperties> const &queue_family_properties, vk::QueueFlags required, vk::QueueFlags excluded)
+{
+    for (uint32_t i = 0; i < vkb::to_u32(queue_family_properties.size()); i++)
+    {
+        vk::QueueFlags flags = queue_family_properties[i].queueFlags;
+        if ((flags & required) == required && !(flags & excluded))
+        {
+            return i;
+        }
+    }
+    return ~0u;
+}
+
+/**
+ * @brief Selects a depth-only format that can be rendered to and sampled from for the depth pyramid.
+ */
+vk::Format select_depth_format(vk::PhysicalDevice gpu)
+{
+    const vk::FormatFeatureFlags required = vk::FormatFeatureFlagBits::eDepthStencilAttachment | vk::FormatFeatureFlagBits::eSampledImage;
+
+    for (vk::Format format : {vk::Format::eD32Sfloat, vk::Format::eD16Unorm})
+    {
+        if ((gpu.getFormatProperties(format).optimalTilingFeatures & required) == required)
+        {
+            return format;
+        }
+    }
+
+    throw std::runtime_error("No sampleable depth format found.");
+}
+
+/**
+ * @brief Selects the MSAA sample count closest to the requested one which color and depth attachments support.
+ */
+vk::SampleCountFlagBits select_sample_count(vk::PhysicalDevice gpu, uint32_t requested)
+{
+    vk::PhysicalDeviceLimits const &limits    = gpu.getProperties().limits;
+    vk::SampleCountFlags const      supported = limits.framebufferColorSampleCounts & limits.framebufferDepthSampleCounts;
+
+    for (uint32_t count = std::bit_floor(std::clamp(requested, 1u, 8u)); count > 1; count >>= 1)
+    {
+        if (supported & static_cast<vk::SampleCountFlagBits>(count))
+        {
+            return static_cast<vk::SampleCountFlagBits>(count);
+        }
+    }
+    return vk::SampleCountFlagBits::e1;
+}
+
 LoomApplication::LoomApplication()
 {
 }
@@ -126,41 +192,56 @@ LoomApplication::~LoomApplication()
 
     teardown_framebuffers();
 
-    for (auto &pfd : per_frame_data)
-    {
-        teardown_per_frame(pfd);
-    }
-
-    per_frame_data.clear();
+    render_service.destroy();
+    frame_capture.destroy();
+    shader_reloader.destroy();
+    pipeline_states.destroy();
+    frame_sync.destroy();
+    frame_arenas.destroy();
 
-    for (auto semaphore : recycled_semaphores)
+    for (auto &buffer : buffer_pool)
     {
-        device.destroySemaphore(semaphore);
+        buffer.clear(device);
     }
+    buffer_pool.clear();
 
-    mVertexBuffer.clear(device);
-    mIndexBuffer.clear(device);
+    occlusion_culling.destroy();
+    transparent_queue.destroy();
+    layout_cache.destroy();
+    texture_streamer.destroy();
+    gpu_profiler.destroy();
 
     if (pipeline)
     {
         device.destroyPipeline(pipeline);
     }
-
-    if (pipeline_layout)
+    if (transparent_pipeline)
     {
-        device.destroyPipelineLayout(pipeline_layout);
+        device.destroyPipeline(transparent_pipeline);
     }
 
+    bindless_heap.destroy();
+
     if (render_pass)
     {
         device.destroyRenderPass(render_pass);
     }
 
+    if (render_pass_resume)
+    {
+        device.destroyRenderPass(render_pass_resume);
+    }
+
     for (auto image_view : swapchain_data.image_views)
     {
         device.destroyImageView(image_view);
     }
 
+    for (auto semaphore : swapchain_data.release_semaphores)
+    {
+        device.destroySemaphore(semaphore);
+    }
+
     if (swapchain_data.swapchain)
     {
         device.destroySwapchainKHR(swapchain_data.swapchain);
@@ -173,6 +254,9 @@ LoomApplication::~LoomApplication()
 
     if (device)
     {
+        graphics_queue.clear(device);
+        compute_queue.clear(device);
+        transfer_queue.clear(device);
         device.destroy();
     }
 
@@ -184,69 +268,109 @@ LoomApplication::~LoomApplication()
     instance.destroy();
 }
 
+/// @brief The vertices of triangle.vert, see vertex_layout.
 struct Vertex
 {
-    glm::vec2 pos;
-    glm::vec3 color;
-
-    static vk::VertexInputBindingDescription getBindingDescription()
-    {
-        vk::VertexInputBindingDescription bindingDescription{};
-
-        bindingDescription.binding   = 0;
-        bindingDescription.stride    = sizeof(Vertex);
-        bindingDescription.inputRate = vk::VertexInputRate::eVertex;
-
-        return bindingDescription;
-    }
-
-    static std::array<vk::VertexInputAttributeDescription, 2> getAttributeDescriptions()
-    {
-        std::array<vk::VertexInputAttributeDescription, 2> attributeDescriptions{};
+    glm::vec2 pos;              // location 0
+    glm::vec3 color;            // location 1
+};
 
-        attributeDescriptions[0].binding  = 0;
-        attributeDescriptions[0].location = 0;
-        attributeDescriptions[0].format   = vk::Format::eR32G32Sfloat;  // vec2
-        attributeDescriptions[0].offset   = offsetof(Vertex, pos);
+/// @brief Where the Vertex members go in triangle.vert, pipelines check it against the shader's inputs.
+constexpr auto vertex_layout = make_vertex_layout<Vertex>(LOOM_VERTEX_ATTRIBUTE(Vertex, pos, 0), LOOM_VERTEX_ATTRIBUTE(Vertex, color, 1));
+static_assert(vertex_layout.is_valid(), "The vertex layout doesn't fit the Vertex struct.");
 
-        attributeDescriptions[1].binding  = 0;
-        attributeDescriptions[1].location = 1;
-        attributeDescriptions[1].format   = vk::Format::eR32G32B32Sfloat;  // vec3
-        attributeDescriptions[1].offset   = offsetof(Vertex, color);
+/// @brief Per-object shader data, laid out to match std430.
+struct ObjectData
+{
+    glm::vec4 tint;
+    uint32_t  texture;            // Bindless texture and sampler indices, the texture is BindlessHeap::invalid_index for untextured objects.
+    uint32_t  sampler;
+    uint32_t  padding[2] = {};
+    glm::vec4 placement;          // Offset in xyz and uniform scale in w, applied to the vertices before the camera.
+};
 
-        return attributeDescriptions;
-    }
+/// @brief The push constants of the scene draws, selecting their resources in the bindless heap.
+struct DrawPushConstants
+{
+    glm::mat4 view_proj;
+    uint32_t  object_buffer;
 };
 
-const std::vector<Vertex> triangleVertices = {
+const std::array<Vertex, 3> triangleVertices = {{
     { {0.5f, 0.5f}, {1.0f, 0.0f, 0.0f}}, // 右下
     {{-0.5f, 0.5f}, {0.0f, 0.0f, 1.0f}}, // 左下
     {{0.0f, -0.5f}, {0.0f, 1.0f, 0.0f}}, // 上方
-};
+}};
 
-const std::vector<Vertex> vertices = {
+const std::array<Vertex, 4> vertices = {{
     { {0.5f, -0.5f}, {1.0f, 0.0f, 0.0f}}, // 右上角
     {  {0.5f, 0.5f}, {0.0f, 1.0f, 0.0f}}, // 右下角
     { {-0.5f, 0.5f}, {0.0f, 0.0f, 1.0f}}, // 左下角
     {{-0.5f, -0.5f}, {0.0f, 1.0f, 1.0f}}  // 左上角
-};
+}};
 
-const std::vector<uint32_t> indeies =
+const std::array<uint32_t, 6> indeies =
 {
     0, 1, 3,
     1, 2, 3
 };
 
+// The features of the shaders, a pipeline selects the variant of a shader by the bits of its key.
+const std::vector<ShaderPermutation> shader_permutations = {
+    {"triangle.vert",         {}},
+    {"triangle.frag",         {"TEXTURED"}},
+    {"hiz_reduce.comp",       {}},
+    {"hiz_cull.comp",         {}},
+    {"radix_sort.comp",       {}},
+    {"transparent_sort.comp", {}}
+};
+
+constexpr VariantKey textured_variant     = 1;        // triangle.frag with TEXTURED.
+constexpr char       shader_bundle_path[] = "shaders/loom.spvb";
+constexpr float      transparent_scale    = 0.25f;    // Of the transparent quads.
+
 bool LoomApplication::prepare(const vkb::ApplicationOptions &options)
 {
     if (Application::prepare(options))
     {
+        startup.mark("application");
+        if (char const *stats_path = std::getenv("LOOM_STARTUP_STATS"))
+        {
+            startup_stats_path = stats_path;
+        }
+
+        // Stages which don't depend on each other run concurrently. The shader bundle only needs the files, it is
+        // opened, or baked again when a source is newer than it, while the device and the swapchain are created.
+        std::future<void> shader_bundle_loaded = startup.start("shader bundle", [this]() {
+            bool bundle_ready = is_shader_bundle_current(shader_bundle_path, "shaders", shader_permutations) && shader_bundle.open(shader_bundle_path, shader_permutations);
+            if (!bundle_ready)
+            {
+                bundle_ready = bake_shader_bundle(shader_bundle_path, shader_permutations) && shader_bundle.open(shader_bundle_path, shader_permutations);
+            }
+            if (!bundle_ready)
+            {
+                throw std::runtime_error("failed to load the shader bundle!");
+            }
+        });
+
         instance = create_instance({VK_KHR_SURFACE_EXTENSION_NAME}, {});
 #if defined(VKB_DEBUG) || defined(VKB_VALIDATION_LAYERS)
         debug_utils_messenger = instance.createDebugUtilsMessengerEXT(debug_utils_create_info);
 #endif
 
         select_physical_device_and_surface();
+        startup.mark("instance");
+
+        // The scene texture is read and decoded for the formats the GPU samples while the device is set up,
+        // it is only streamed in once the streamer is ready.
+        char const                  *texture_path      = "assets/textures/loom.ktx2";
+        bool const                   has_scene_texture = std::filesystem::exists(texture_path);
+        TextureStreamer::TextureFile scene_texture_file;
+        std::future<void>            scene_texture_read;
+        if (has_scene_texture)
+        {
+            scene_texture_read = startup.start("scene texture", [&]() { scene_texture_file = TextureStreamer::read(gpu, texture_path); });
+        }
 
         const vkb::Window::Extent &extent = options.window->get_extent();
         swapchain_data.extent.width       = extent.width;
@@ -255,27 +379,257 @@ bool LoomApplication::prepare(const vkb::ApplicationOptions &options)
         // create a device
         device = create_device({VK_KHR_SWAPCHAIN_EXTENSION_NAME});
 
-        // get the (graphics) queue
-        queue = device.getQueue(graphics_queue_index, 0);
+        // The frame path calls the device functions through a table of its own. LOOM_DISPATCH=loader fills it with the
+        // loader's trampolines instead, to compare what they cost.
+        char const *dispatch_mode = std::getenv("LOOM_DISPATCH");
+        device_dispatch.load(instance, gpu, device, dispatch_mode && std::string_view(dispatch_mode) == "loader");
+
+        // get the queues, the dedicated ones only exist if the device has such families
+        graphics_queue = GpuQueue::CreateGpuQueue(device, graphics_queue_index);
+        if (compute_queue_index != ~0u)
+        {
+            compute_queue = GpuQueue::CreateGpuQueue(device, compute_queue_index);
+        }
+        if (transfer_queue_index != ~0u)
+        {
+            transfer_queue = GpuQueue::CreateGpuQueue(device, transfer_queue_index);
+        }
+
+        // Frames alternate between the devices of a group if each of them can present its own images.
+        frame_devices = 1;
+        if (device_group.size() > 1)
+        {
+            vk::DeviceGroupPresentCapabilitiesKHR present_capabilities = device.getGroupPresentCapabilitiesKHR();
+            vk::DeviceGroupPresentModeFlagsKHR    surface_modes        = device.getGroupSurfacePresentModesKHR(surface);
+
+            bool local_present = (present_capabilities.modes & surface_modes & vk::DeviceGroupPresentModeFlagBitsKHR::eLocal) == vk::DeviceGroupPresentModeFlagBitsKHR::eLocal;
+            for (uint32_t i = 0; i < device_group.size(); i++)
+            {
+                local_present = local_present && (present_capabilities.presentMask[i] & (1u << i));
+            }
+
+            frame_devices = local_present ? vkb::to_u32(device_group.size()) : 1;
+            if (frame_devices > 1 && !check_device_group(gpu, device, graphics_queue, frame_devices))
+            {
+                LOGW("Device group self-check failed, rendering on the first device alone.");
+                frame_devices = 1;
+            }
+            LOGI("Alternate-frame rendering on {} of {} devices in the group.", frame_devices, device_group.size());
+        }
+        startup.mark("device");
+
+        memory_budget.prepare(gpu, has_memory_budget);
+        if (char const *stats_path = std::getenv("LOOM_MEMORY_STATS"))
+        {
+            memory_stats_path = stats_path;
+        }
+
+        gpu_profiler.prepare(gpu, device, device_dispatch);
+        layout_cache.prepare(device);
+        frame_sync.prepare(device, device_dispatch, graphics_queue, frames_in_flight);
+        frame_arenas.prepare(frames_in_flight);
+        startup.mark("frame resources");
+
+        // LOOM_CAPTURE names a directory the frames are written into, every LOOM_CAPTURE_INTERVAL frames as
+        // LOOM_CAPTURE_FORMAT, png, exr or raw. The swapchain images then are transfer sources.
+        if (char const *capture_dir = std::getenv("LOOM_CAPTURE"))
+        {
+            capture_output = capture_dir;
+        }
 
         init_swapchain();
 
         // Create the necessary objects for rendering.
-        render_pass = create_render_pass();
+        color_format = swapchain_data.format;
+        depth_format = select_depth_format(gpu);
+
+        if (!capture_output.empty())
+        {
+            ImageFileFormat capture_format = ImageFileFormat::ePng;
+            char const     *format_name    = std::getenv("LOOM_CAPTURE_FORMAT");
+            if (format_name && !parse_image_file_format(format_name, capture_format))
+            {
+                LOGW("LOOM_CAPTURE_FORMAT={} is neither png, exr nor raw, capturing png.", format_name);
+            }
+            char const    *interval     = std::getenv("LOOM_CAPTURE_INTERVAL");
+            uint32_t const thread_count = std::clamp(std::thread::hardware_concurrency() / 4, 1u, 4u);
+            frame_capture.prepare(gpu, device, device_dispatch, graphics_queue, color_format, capture_output, capture_format, interval ? static_cast<uint32_t>(std::strtoul(interval, nullptr, 10)) : 1,
+                                  frames_in_flight + thread_count + 1, thread_count);
+        }
+
+        if (char const *samples = std::getenv("LOOM_MSAA"))
+        {
+            msaa_sample_count = static_cast<uint32_t>(std::strtoul(samples, nullptr, 10));
+        }
+        msaa_samples = select_sample_count(gpu, msaa_sample_count);
+        LOGI("MSAA: {}x, {}x requested", static_cast<uint32_t>(msaa_samples), msaa_sample_count);
+
+        // Multisampled depth is resolved to its farthest sample where supported, which keeps the depth pyramid conservative.
+        // Resolving sample zero is always supported.
+        auto resolve_properties = gpu.getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceDepthStencilResolveProperties>();
+        depth_resolve_mode      = (resolve_properties.get<vk::PhysicalDeviceDepthStencilResolveProperties>().supportedDepthResolveModes & vk::ResolveModeFlagBits::eMax)
+                                      ? vk::ResolveModeFlagBits::eMax
+                                      : vk::ResolveModeFlagBits::eSampleZero;
+        startup.mark("swapchain");
+
+        // Dynamic rendering renders straight into the image views, only the fallback needs render pass objects.
+        if (!dynamic_rendering)
+        {
+            render_pass        = create_render_pass(false);
+            render_pass_resume = create_render_pass(true);
+        }
+
+        vertex_buffer = buffer_pool.create(BufferData::CreateBufferData(gpu, device, MemoryCategory::eMeshes, sizeof(vertices[0]) * vertices.size(), vk::BufferUsageFlagBits::eVertexBuffer));
+        buffer_pool.get(vertex_buffer).upload(vertices);
+
+        index_buffer = buffer_pool.create(BufferData::CreateBufferData(gpu, device, MemoryCategory::eMeshes, sizeof(indeies[0]) * indeies.size(), vk::BufferUsageFlagBits::eIndexBuffer));
+        buffer_pool.get(index_buffer).upload(indeies);
+
+        // All pipelines share the layout of the bindless heap, draws select their resources through push constants.
+        bindless_heap.prepare(gpu, device, device_dispatch, frame_sync);
+        pipeline_layout = bindless_heap.get_pipeline_layout();
+        startup.mark("buffers");
+
+        // The quad is the only object for now, its vertices are in clip space of the identity camera.
+        scene_objects = {
+            {glm::vec4(-0.5f, -0.5f, 0.0f, 1.0f), glm::vec4(0.5f, 0.5f, 0.0f, 1.0f), static_cast<uint32_t>(indeies.size()), 0, 0}
+        };
+
+        // LOOM_TRANSPARENT_OBJECTS scatters that many translucent quads in front of and behind the opaque one. Their object
+        // data follows the opaque objects'. LOOM_TRANSPARENT_SORT=gpu sorts them on the GPU instead of the CPU.
+        if (char const *transparent_objects = std::getenv("LOOM_TRANSPARENT_OBJECTS"))
+        {
+            uint32_t const                        count = static_cast<uint32_t>(std::strtoul(transparent_objects, nullptr, 10));
+            std::mt19937                          random(count);
+            std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+            std::vector<TransparentObject> objects;
+            for (uint32_t i = 0; i < count; i++)
+            {
+                glm::vec4 center(unit(random) * 2.0f - 1.0f, unit(random) * 2.0f - 1.0f, unit(random), 1.0f);
+                objects.push_back({center, static_cast<uint32_t>(indeies.size()), 0, 0, static_cast<uint32_t>(scene_objects.size()) + i});
+                transparent_tints.emplace_back(unit(random), unit(random), unit(random), 0.25f + 0.5f * unit(random));
+            }
+            transparent_queue.prepare(objects, std::clamp(std::thread::hardware_concurrency() / 2, 1u, 8u), device_dispatch);
+        }
+
+        // LOOM_RENDER_SERVICE names a directory, the application then renders the jobs read from stdin into it
+        // instead of rendering to the window.
+        if (char const *service_dir = std::getenv("LOOM_RENDER_SERVICE"))
+        {
+            service_output = service_dir;
+        }
+
+        // The object data references streamed textures, whose bindless indices change with their residency,
+        // so every frame slot has its own copy which is rewritten each frame. The render service renders a
+        // batch of jobs per frame, each with its own copy.
+        for (uint32_t i = 0; i < frames_in_flight * get_object_data_slots(); i++)
+        {
+            object_data_buffers.push_back(buffer_pool.create(BufferData::CreateBufferData(gpu, device, MemoryCategory::eOther, sizeof(ObjectData) * get_object_count(), vk::BufferUsageFlagBits::eStorageBuffer)));
+            object_data_indices.push_back(bindless_heap.register_buffer(buffer_pool.get(object_data_buffers.back()).buffer));
+        }
+
+        // Textures are uploaded on the transfer queue where there is one.
+        if (char const *budget_mb = std::getenv("LOOM_TEXTURE_BUDGET_MB"))
+        {
+            texture_budget = std::strtoull(budget_mb, nullptr, 10) * 1024 * 1024;
+        }
+        texture_streamer.prepare(gpu, device, device_dispatch, transfer_queue ? transfer_queue : graphics_queue, graphics_queue_index, bindless_heap, frame_sync, frame_arenas, texture_budget);
+
+        if (has_scene_texture)
+        {
+            scene_texture_read.get();
+            scene_texture = texture_streamer.add(std::move(scene_texture_file));
+        }
+        else
+        {
+            LOGW("Texture {} not found, objects are untextured.", texture_path);
+        }
+        startup.mark("textures");
+
+        // LOOM_FRAME_RATE paces the frames to a target rate, instead of rendering as fast as the swapchain allows.
+        if (char const *frame_rate = std::getenv("LOOM_FRAME_RATE"))
+        {
+            frame_pacer.set_target_rate(std::strtod(frame_rate, nullptr));
+            LOGI("Frame pacing: {:.1f} frames per second", frame_pacer.get_target_rate());
+        }
 
-        mVertexBuffer = BufferData::CreateBufferData(gpu, device, sizeof(vertices[0]) * vertices.size(), vk::BufferUsageFlagBits::eVertexBuffer);
-        mVertexBuffer.upload(device, vertices);
+        if (char const *view = std::getenv("LOOM_DEBUG_VIEW"))
+        {
+            debug_view = static_cast<uint32_t>(std::strtoul(view, nullptr, 10));
+        }
 
-        mIndexBuffer = BufferData::CreateBufferData(gpu, device, sizeof(indeies[0]) * indeies.size(), vk::BufferUsageFlagBits::eIndexBuffer);
-        mIndexBuffer.upload(device, indeies);
+        // Untextured scenes use the variant which doesn't sample at all, the scenes of render jobs may be textured.
+        VariantKey scene_variant     = scene_texture != ~0u || !service_output.empty() ? textured_variant : 0;
+        scene_state.fragment_variant = scene_variant;
+
+        // Transparent objects blend over what is behind them, and don't hide each other.
+        transparent_state             = scene_state;
+        transparent_state.blend_mode  = BlendMode::eAlpha;
+        transparent_state.depth_write = VK_FALSE;
+
+        shader_bundle_loaded.get();
+        startup.mark("waiting for the shader bundle");
+
+        // The pipelines of the last run are created in the background right away, the scene's own pipelines
+        // are created up front, they are drawn with until the cache has them. A stand-in must have the state
+        // it stands in for, the transparent draws can't fall back to the opaque pipeline. Both are compiled
+        // while the compute pipelines and the render graph are created.
+        pipeline_states.prepare(device, frame_sync, [this](GraphicsPipelineState const &state) { return build_pipeline_state(state); }, "cache");
+        std::future<void> scene_pipeline_built = startup.start("scene pipelines", [this]() {
+            pipeline = build_pipeline_state(scene_state);
+            if (!transparent_queue.is_empty())
+            {
+                transparent_pipeline = build_pipeline_state(transparent_state);
+            }
+        });
+        pipeline_states.prewarm();
 
-        // Create a blank pipeline layout.
-        // We are not binding any resources to the pipeline in this first sample.
-        pipeline_layout = device.createPipelineLayout({});
+        // Culling runs on the async compute queue where there is one, the draws it emits on the graphics queue.
+        std::vector<uint32_t> culling_queue_families = {graphics_queue_index};
+        if (compute_queue)
+        {
+            culling_queue_families.push_back(compute_queue_index);
+        }
+        occlusion_culling.prepare(gpu, device, device_dispatch, layout_cache, shader_bundle.get_spirv("hiz_reduce.comp", 0), shader_bundle.get_spirv("hiz_cull.comp", 0), scene_objects,
+                                  culling_queue_families);
 
-        pipeline = create_graphics_pipeline();
+        char const *transparent_sort = std::getenv("LOOM_TRANSPARENT_SORT");
+        if (transparent_sort && std::string_view(transparent_sort) == "gpu")
+        {
+            transparent_queue.prepare_gpu_sort(gpu, device, layout_cache, shader_bundle.get_spirv("transparent_sort.comp", 0), shader_bundle.get_spirv("radix_sort.comp", 0));
+        }
+        startup.mark("compute pipelines");
 
         init_framebuffers();
+
+        if (!service_output.empty())
+        {
+            render_service.prepare(gpu, device, graphics_queue, frame_sync, frame_arenas, {color_format, depth_format, msaa_samples, render_pass}, service_output);
+        }
+        startup.mark("render graph");
+
+        scene_pipeline_built.get();
+        startup.mark("waiting for the scene pipelines");
+
+        // Edited shaders are recompiled in the background, the frame picks up the new pipeline when it is ready.
+        // The working directory is the source root, see main.cpp.
+        shader_reloader.prepare(device, frame_sync);
+        std::vector<ShaderSource> scene_shaders = {
+            {"triangle.vert", {}},
+            {"triangle.frag", get_variant_defines(shader_permutations[1], scene_variant)}
+        };
+        if (transparent_pipeline)
+        {
+            shader_reloader.add_pipeline(transparent_pipeline, scene_shaders, [this](std::vector<vk::ShaderModule> const &modules, std::vector<ShaderReflection> const &reflections) {
+                return create_graphics_pipeline(modules, reflections, transparent_state);
+            });
+        }
+        shader_reloader.add_pipeline(pipeline, std::move(scene_shaders), [this](std::vector<vk::ShaderModule> const &modules, std::vector<ShaderReflection> const &reflections) {
+            return create_graphics_pipeline(modules, reflections, scene_state);
+        });
+        shader_reloader.start("shaders");
+        startup.mark("shader reloader");
     }
 
     return true;
@@ -283,28 +637,79 @@ bool LoomApplication::prepare(const vkb::ApplicationOptions &options)
 
 void LoomApplication::update(float delta_time)
 {
+    if (!service_output.empty())
+    {
+        serve_render_jobs();
+        return;
+    }
+
+    // The frame starts at the target rate, its work only begins afterwards.
+    frame_pacer.wait();
+
+    // Transient data of the frame belongs into the frame arenas, the heap allocations of the render thread are counted.
+    uint64_t allocations = get_heap_allocation_count();
+    draw_frame();
+    allocations = get_heap_allocation_count() - allocations;
+
+    // The startup ends with the first frame presented.
+    if (!startup.is_finished())
+    {
+        startup.finish(startup_stats_path);
+    }
+
+    report_statistics(allocations);
+}
+
+void LoomApplication::draw_frame()
+{
+    // Wait until the frame which used this frame slot before has completed on the GPU.
+    frame_sync.begin_frame();
+    frame_arenas.begin_frame(frame_sync.get_frame_index());
+    frame_capture.begin_frame(frame_sync.get_frame_number());
+
+    // The cached pipelines are created from the shader bundle, which doesn't know about edited shaders.
+    // Once a shader is reloaded, the scene sticks to the reloaded pipeline until the next start.
+    if (shader_reloader.update())
+    {
+        pipeline_states.clear();
+        pipeline_states.set_enabled(false);
+    }
+    resolve_pipelines();
+
+    update_object_data();
+
     vk::Result res;
     uint32_t   index;
     std::tie(res, index) = acquire_next_image();
 
-    // Handle outdated error in acquire.
-    if (res == vk::Result::eSuboptimalKHR || res == vk::Result::eErrorOutOfDateKHR)
+    // Handle outdated error in acquire. A suboptimal image already signals the acquire semaphore, so it is
+    // still rendered and presented, and the swapchain is recreated after presenting it.
+    if (res == vk::Result::eErrorOutOfDateKHR)
     {
         resize(swapchain_data.extent.width, swapchain_data.extent.height);
         std::tie(res, index) = acquire_next_image();
     }
 
-    if (res != vk::Result::eSuccess)
+    if (res != vk::Result::eSuccess && res != vk::Result::eSuboptimalKHR)
     {
-        queue.waitIdle();
+        device.waitIdle();
         return;
     }
 
+    // The acquire may have blocked, the camera follows the input up to right before the frame is submitted.
+    // The transparent draws are sorted for the latched camera.
+    latch_input();
+    if (!transparent_queue.is_gpu_sorted())
+    {
+        transparent_queue.sort(view_proj);
+    }
     render(index);
 
-    // Present swapchain image
-    vk::PresentInfoKHR present_info(per_frame_data[index].swapchain_release_semaphore, swapchain_data.swapchain, index);
-    res = queue.presentKHR(present_info);
+    // Present swapchain image, with a device group from the device which rendered it.
+    uint32_t                      device_mask = get_frame_device_mask();
+    vk::DeviceGroupPresentInfoKHR device_group_present(device_mask, vk::DeviceGroupPresentModeFlagBitsKHR::eLocal);
+    vk::PresentInfoKHR            present_info(swapchain_data.release_semaphores[index], swapchain_data.swapchain, index, {}, device_mask ? &device_group_present : nullptr);
+    res = graphics_queue.queue.presentKHR(present_info, device_dispatch);
 
     // Handle Outdated error in present.
     if (res == vk::Result::eSuboptimalKHR || res == vk::Result::eErrorOutOfDateKHR)
@@ -341,79 +746,221 @@ bool LoomApplication::resize(const uint32_t, const uint32_t)
 }
 
 /**
- * @brief Acquires an image from the swapchain.
+ * @brief Tracks the camera input: the arrow keys and dragging with the left mouse button pan the view.
+ */
+void LoomApplication::input_event(const vkb::InputEvent &input_event)
+{
+    if (input_event.get_source() == vkb::EventSource::Keyboard)
+    {
+        auto const &key_event = static_cast<vkb::KeyInputEvent const &>(input_event);
+        if (key_event.get_action() == vkb::KeyAction::Down || key_event.get_action() == vkb::KeyAction::Up)
+        {
+            // Clip space y points down.
+            float const pressed = key_event.get_action() == vkb::KeyAction::Down ? 1.0f : -1.0f;
+            switch (key_event.get_code())
+            {
+                case vkb::KeyCode::Left:
+                    pan_keys.x -= pressed;
+                    break;
+                case vkb::KeyCode::Right:
+                    pan_keys.x += pressed;
+                    break;
+                case vkb::KeyCode::Up:
+                    pan_keys.y -= pressed;
+                    break;
+                case vkb::KeyCode::Down:
+                    pan_keys.y += pressed;
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+    else if (input_event.get_source() == vkb::EventSource::Mouse)
+    {
+        auto const &mouse_event = static_cast<vkb::MouseButtonInputEvent const &>(input_event);
+        glm::vec2   position(mouse_event.get_pos_x(), mouse_event.get_pos_y());
+        if (dragging)
+        {
+            drag_delta += position - cursor;
+        }
+        cursor = position;
+
+        if (mouse_event.get_button() == vkb::MouseButton::Left && mouse_event.get_action() != vkb::MouseAction::Move)
+        {
+            dragging = mouse_event.get_action() == vkb::MouseAction::Down;
+        }
+    }
+
+    Application::input_event(input_event);
+}
+
+/**
+ * @brief Applies the input to the camera, right before the frame is recorded and submitted.
+ *
+ * The held keys pan by the time since the last latch rather than by the frame's delta time, so the
+ * view is as current as the submission, however long the frame waited for the pacer, the previous
+ * frames or the swapchain.
+ */
+void LoomApplication::latch_input()
+{
+    // Clip space units per second.
+    constexpr float key_pan_speed = 1.0f;
+
+    FramePacer::Clock::time_point const now     = FramePacer::Clock::now();
+    float const                         elapsed = latch_time == FramePacer::Clock::time_point() ? 0.0f : std::chrono::duration<float>(now - latch_time).count();
+    latch_time = now;
+
+    // A drag is in pixels of the swapchain, which has no extent while the window is minimized.
+    glm::vec2 const extent(swapchain_data.extent.width, swapchain_data.extent.height);
+    camera_pan += glm::clamp(pan_keys, -1.0f, 1.0f) * key_pan_speed * elapsed;
+    if (extent.x != 0.0f && extent.y != 0.0f)
+    {
+        camera_pan += drag_delta * 2.0f / extent;
+    }
+    drag_delta = glm::vec2(0.0f);
+
+    view_proj    = glm::mat4(1.0f);
+    view_proj[3] = glm::vec4(camera_pan, 0.0f, 1.0f);
+}
+
+/**
+ * @returns The device of the group the current frame runs on, 0 without alternate-frame rendering.
+ */
+uint32_t LoomApplication::get_frame_device_mask() const
+{
+    return frame_devices > 1 ? 1u << (frame_sync.get_frame_number() % frame_devices) : 0;
+}
+
+/**
+ * @brief Acquires an image from the swapchain, signaling the acquire semaphore of the current frame.
  * @param[out] image The swapchain index for the acquired image.
  * @returns Vulkan result code
  */
 std::pair<vk::Result, uint32_t> LoomApplication::acquire_next_image()
 {
-    vk::Semaphore acquire_semaphore;
-    if (recycled_semaphores.empty())
+    // The semaphore is free to use, the frame which waited on it last has completed.
+    vk::Result res;
+    uint32_t   image;
+    if (uint32_t device_mask = get_frame_device_mask())
     {
-        acquire_semaphore = device.createSemaphore({});
+        // The image is acquired for the device which renders and presents it.
+        std::tie(res, image) = device.acquireNextImage2KHR(vk::AcquireNextImageInfoKHR(swapchain_data.swapchain, UINT64_MAX, frame_sync.get_acquire_semaphore(), {}, device_mask), device_dispatch);
     }
     else
     {
-        acquire_semaphore = recycled_semaphores.back();
-        recycled_semaphores.pop_back();
+        std::tie(res, image) = device.acquireNextImageKHR(swapchain_data.swapchain, UINT64_MAX, frame_sync.get_acquire_semaphore(), {}, device_dispatch);
     }
 
-    vk::Result res;
-    uint32_t   image;
-    std::tie(res, image) = device.acquireNextImageKHR(swapchain_data.swapchain, UINT64_MAX, acquire_semaphore);
+    return {res, image};
+}
 
-    if (res != vk::Result::eSuccess)
+vk::Device LoomApplication::create_device(const std::vector<const char *> &required_device_extensions)
+{
+    std::vector<vk::ExtensionProperties> device_extensions = gpu.enumerateDeviceExtensionProperties();
+
+    if (!validate_extensions(required_device_extensions, device_extensions))
     {
-        recycled_semaphores.push_back(acquire_semaphore);
-        return {res, image};
+        throw std::runtime_error("Required device extensions are missing, will try without.");
     }
 
-    // If we have outstanding fences for this swapchain image, wait for them to complete first.
-    // After begin frame returns, it is safe to reuse or delete resources which
-    // were used previously.
-    //
-    // We wait for fences which completes N frames earlier, so we do not stall,
-    // waiting for all GPU work to complete before this returns.
-    // Normally, this doesn't really block at all,
-    // since we're waiting for old frames to have been completed, but just in case.
-    if (per_frame_data[image].queue_submit_fence)
+    // Submissions to different queues are synchronized with timeline semaphores.
+    uint32_t api_version = gpu.getProperties().apiVersion;
+    if (api_version < VK_API_VERSION_1_2)
     {
-        (void)device.waitForFences(per_frame_data[image].queue_submit_fence, true, UINT64_MAX);
-        device.resetFences(per_frame_data[image].queue_submit_fence);
+        throw std::runtime_error("Vulkan 1.2 is required.");
     }
 
-    if (per_frame_data[image].primary_command_pool)
+    // Dynamic rendering is core in Vulkan 1.3 and an extension before, without it the render passes are used.
+    // LOOM_RENDER_PASSES forces the render passes.
+    std::vector<const char *> enabled_extensions(required_device_extensions);
+    bool                      core_dynamic_rendering = api_version >= VK_API_VERSION_1_3;
+    dynamic_rendering                                = false;
+    if ((core_dynamic_rendering || validate_extensions({VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME}, device_extensions)) && !std::getenv("LOOM_RENDER_PASSES"))
+    {
+        auto supported_rendering = gpu.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceDynamicRenderingFeatures>();
+        dynamic_rendering        = supported_rendering.get<vk::PhysicalDeviceDynamicRenderingFeatures>().dynamicRendering;
+    }
+    if (dynamic_rendering && !core_dynamic_rendering)
     {
-        device.resetCommandPool(per_frame_data[image].primary_command_pool);
+        enabled_extensions.push_back(VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME);
     }
+    LOGI("Rendering with {}.", dynamic_rendering ? "dynamic rendering" : "render passes");
 
-    // Recycle the old semaphore back into the semaphore manager.
-    vk::Semaphore old_semaphore = per_frame_data[image].swapchain_acquire_semaphore;
+    // The driver reports the memory budget of the process where it can, otherwise the budget is estimated.
+    has_memory_budget = validate_extensions({VK_EXT_MEMORY_BUDGET_EXTENSION_NAME}, device_extensions);
+    if (has_memory_budget)
+    {
+        enabled_extensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+    }
 
-    if (old_semaphore)
+    auto                                      supported_features = gpu.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceVulkan12Features>();
+    vk::PhysicalDeviceFeatures const         &supported          = supported_features.get<vk::PhysicalDeviceFeatures2>().features;
+    vk::PhysicalDeviceVulkan12Features const &supported12        = supported_features.get<vk::PhysicalDeviceVulkan12Features>();
+    if (!supported12.timelineSemaphore)
     {
-        recycled_semaphores.push_back(old_semaphore);
+        throw std::runtime_error("Timeline semaphores are not supported.");
     }
 
-    per_frame_data[image].swapchain_acquire_semaphore = acquire_semaphore;
+    // The bindless heap is made of partially bound, update-after-bind descriptor arrays.
+    if (!supported12.runtimeDescriptorArray || !supported12.descriptorBindingPartiallyBound || !supported12.descriptorBindingUpdateUnusedWhilePending ||
+        !supported12.descriptorBindingSampledImageUpdateAfterBind || !supported12.descriptorBindingStorageBufferUpdateAfterBind ||
+        !supported12.shaderSampledImageArrayNonUniformIndexing || !supported12.shaderStorageBufferArrayNonUniformIndexing)
+    {
+        throw std::runtime_error("Descriptor indexing is not supported.");
+    }
 
-    return {vk::Result::eSuccess, image};
-}
+    vk::StructureChain<vk::DeviceCreateInfo, vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceVulkan12Features, vk::PhysicalDeviceDynamicRenderingFeatures, vk::DeviceGroupDeviceCreateInfo>
+        device_chain;
+
+    // Occlusion culling emits all indirect draws in one call where supported, starting at their object index as instance.
+    vk::PhysicalDeviceFeatures &features = device_chain.get<vk::PhysicalDeviceFeatures2>().features;
+    features.multiDrawIndirect           = supported.multiDrawIndirect;
+    features.drawIndirectFirstInstance   = supported.drawIndirectFirstInstance;
+
+    // Streamed textures are filtered anisotropically where supported.
+    features.samplerAnisotropy = supported.samplerAnisotropy;
+
+    // Timeline semaphores for the queues, host query resets for the GPU profiler and descriptor indexing for the bindless heap.
+    vk::PhysicalDeviceVulkan12Features &features12           = device_chain.get<vk::PhysicalDeviceVulkan12Features>();
+    features12.timelineSemaphore                             = true;
+    features12.hostQueryReset                                = supported12.hostQueryReset;
+    features12.runtimeDescriptorArray                        = true;
+    features12.descriptorBindingPartiallyBound               = true;
+    features12.descriptorBindingUpdateUnusedWhilePending     = true;
+    features12.descriptorBindingSampledImageUpdateAfterBind  = true;
+    features12.descriptorBindingStorageBufferUpdateAfterBind = true;
+    features12.shaderSampledImageArrayNonUniformIndexing     = true;
+    features12.shaderStorageBufferArrayNonUniformIndexing    = true;
+
+    device_chain.get<vk::PhysicalDeviceDynamicRenderingFeatures>().dynamicRendering = true;
+    if (!dynamic_rendering)
+    {
+        device_chain.unlink<vk::PhysicalDeviceDynamicRenderingFeatures>();
+    }
 
-vk::Device LoomApplication::create_device(const std::vector<const char *> &required_device_extensions)
-{
-    std::vector<vk::ExtensionProperties> device_extensions = gpu.enumerateDeviceExtensionProperties();
+    // A device group becomes one logical device, the selected device is the first of the group.
+    device_chain.get<vk::DeviceGroupDeviceCreateInfo>().setPhysicalDevices(device_group);
+    if (device_group.size() == 1)
+    {
+        device_chain.unlink<vk::DeviceGroupDeviceCreateInfo>();
+    }
 
-    if (!validate_extensions(required_device_extensions, device_extensions))
+    // Create one queue for graphics, and one for each dedicated compute or transfer family.
+    float                                  queue_priority = 1.0f;
+    std::vector<vk::DeviceQueueCreateInfo> queue_infos;
+    for (uint32_t family_index : {graphics_queue_index, compute_queue_index, transfer_queue_index})
     {
-        throw std::runtime_error("Required device extensions are missing, will try without.");
+        if (family_index != ~0u)
+        {
+            queue_infos.push_back({{}, family_index, 1, &queue_priority});
+        }
     }
 
-    // Create a device with one queue
-    float                     queue_priority = 1.0f;
-    vk::DeviceQueueCreateInfo queue_info({}, graphics_queue_index, 1, &queue_priority);
-    vk::DeviceCreateInfo      device_info({}, queue_info, {}, required_device_extensions);
-    vk::Device                device = gpu.createDevice(device_info);
+    vk::DeviceCreateInfo &device_info = device_chain.get<vk::DeviceCreateInfo>();
+    device_info.setQueueCreateInfos(queue_infos);
+    device_info.setPEnabledExtensionNames(enabled_extensions);
+    vk::Device device = gpu.createDevice(device_info);
 
     // initialize function pointers for device
     VULKAN_HPP_DEFAULT_DISPATCHER.init(device);
@@ -421,48 +968,125 @@ vk::Device LoomApplication::create_device(const std::vector<const char *> &requi
     return device;
 }
 
-vk::Pipeline LoomApplication::create_graphics_pipeline()
+/**
+ * @brief Creates the pipeline of a state from the shader bundle. Called on the pipeline state cache's workers.
+ * @param state The state, program 0 is the scene's triangle shaders.
+ */
+vk::Pipeline LoomApplication::build_pipeline_state(GraphicsPipelineState const &state)
 {
-    std::vector<vk::PipelineShaderStageCreateInfo> shader_stages{
-        vk::PipelineShaderStageCreateInfo({}, vk::ShaderStageFlagBits::eVertex, create_shader_module("triangle.vert"), "main"),
-        vk::PipelineShaderStageCreateInfo({}, vk::ShaderStageFlagBits::eFragment, create_shader_module("triangle.frag"), "main")};
-
-    vk::PipelineVertexInputStateCreateInfo vertex_input;
-
-    auto bindingDescription = Vertex::getBindingDescription();
-    auto attributeDescriptions = Vertex::getAttributeDescriptions();
-
-    vertex_input.vertexBindingDescriptionCount = 1;
-    vertex_input.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
-    vertex_input.pVertexBindingDescriptions = &bindingDescription;
-    vertex_input.pVertexAttributeDescriptions = attributeDescriptions.data();
-
-    // Our attachment will write to all color channels, but no blending is enabled.
-    vk::PipelineColorBlendAttachmentState blend_attachment;
-    blend_attachment.colorWriteMask = vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG | vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA;
-
-    // Disable all depth testing.
-    vk::PipelineDepthStencilStateCreateInfo depth_stencil;
-
-    vk::Pipeline pipeline = vkb::common::create_graphics_pipeline(device,
-                                                                  nullptr,
-                                                                  shader_stages,
-                                                                  vertex_input,
-                                                                  vk::PrimitiveTopology::eTriangleList,  // We will use triangle lists to draw geometry.
-                                                                  0,
-                                                                  vk::PolygonMode::eFill,
-                                                                  vk::CullModeFlagBits::eBack,
-                                                                  vk::FrontFace::eClockwise,  // pk: default CounterClockwise in OpenGL
-                                                                  {blend_attachment},
-                                                                  depth_stencil,
-                                                                  pipeline_layout,  // We need to specify the pipeline layout
-                                                                  render_pass);     // and the render pass up front as well
+    if (state.program != 0 || state.vertex_layout != 0 || state.render_pass != 0)
+    {
+        throw std::runtime_error("unknown program, vertex layout or render pass in pipeline state!");
+    }
+
+    // The vertex input and the bindings are reflected from the shaders when they are loaded.
+    std::vector<ShaderReflection> reflections = {reflect_shader(shader_bundle.get_spirv("triangle.vert", state.vertex_variant)),
+                                                 reflect_shader(shader_bundle.get_spirv("triangle.frag", state.fragment_variant))};
+    std::vector<vk::ShaderModule> modules     = {create_shader_module("triangle.vert", state.vertex_variant),
+                                                 create_shader_module("triangle.frag", state.fragment_variant)};
+
+    vk::Pipeline state_pipeline;
+    try
+    {
+        state_pipeline = create_graphics_pipeline(modules, reflections, state);
+    }
+    catch (...)
+    {
+        for (auto module : modules)
+        {
+            device.destroyShaderModule(module);
+        }
+        throw;
+    }
 
     // Pipeline is baked, we can delete the shader modules now.
-    device.destroyShaderModule(shader_stages[0].module);
-    device.destroyShaderModule(shader_stages[1].module);
+    for (auto module : modules)
+    {
+        device.destroyShaderModule(module);
+    }
+
+    return state_pipeline;
+}
+
+/**
+ * @brief Creates the scene pipeline. Also called on the worker threads of the shader reloader and the pipeline
+ *        state cache, so it may only read state which stays the same after prepare.
+ * @param modules The vertex and fragment shader.
+ * @param reflections The interfaces of the shaders, the vertex input is derived from them.
+ * @param state The fixed function state of the pipeline.
+ */
+vk::Pipeline LoomApplication::create_graphics_pipeline(std::vector<vk::ShaderModule> const &modules, std::vector<ShaderReflection> const &reflections,
+                                                       GraphicsPipelineState const &state)
+{
+    // All scene shaders use the bindless heap's layout instead of one of their own.
+    for (auto const &reflection : reflections)
+    {
+        if (!bindless_heap.is_compatible(reflection))
+        {
+            throw std::runtime_error("scene shader doesn't match the bindless layout!");
+        }
+    }
+
+    // The debug view is a specialization constant, it needs no variant of its own.
+    SpecializationConstants fragment_constants;
+    fragment_constants.set(0, debug_view);
+
+    std::vector<vk::PipelineShaderStageCreateInfo> shader_stages{
+        vk::PipelineShaderStageCreateInfo({}, vk::ShaderStageFlagBits::eVertex, modules[0], "main"),
+        vk::PipelineShaderStageCreateInfo({}, vk::ShaderStageFlagBits::eFragment, modules[1], "main", fragment_constants.get_info())};
+
+    if (!vertex_layout.matches(reflections[0]))
+    {
+        throw std::runtime_error("vertex shader inputs don't match the Vertex struct!");
+    }
+
+    vk::VertexInputBindingDescription      bindingDescription    = vertex_layout.get_binding(0);
+    auto                                   attributeDescriptions = vertex_layout.get_attributes(0);
+    vk::PipelineVertexInputStateCreateInfo vertex_input({}, bindingDescription, attributeDescriptions);
+
+    vk::PipelineColorBlendAttachmentState blend_attachment = get_blend_attachment(state.blend_mode);
+
+    // By default depth test and write, so objects drawn after culling are hidden by the ones drawn before.
+    vk::PipelineDepthStencilStateCreateInfo depth_stencil({}, state.depth_test, state.depth_write, state.depth_compare);
+
+    vk::PipelineInputAssemblyStateCreateInfo input_assembly({}, state.topology, false);
+
+    // Viewport and scissor are set dynamically.
+    vk::PipelineViewportStateCreateInfo viewport_state({}, 1, nullptr, 1, nullptr);
+    std::array<vk::DynamicState, 2>     dynamic_states = {vk::DynamicState::eViewport, vk::DynamicState::eScissor};
+    vk::PipelineDynamicStateCreateInfo  dynamic_state({}, dynamic_states);
+
+    vk::PipelineRasterizationStateCreateInfo rasterization_state;
+    rasterization_state.polygonMode = state.polygon_mode;
+    rasterization_state.cullMode    = state.cull_mode;
+    rasterization_state.frontFace   = state.front_face;  // pk: default CounterClockwise in OpenGL
+    rasterization_state.lineWidth   = 1.0f;
+
+    vk::PipelineMultisampleStateCreateInfo multisample_state({}, msaa_samples);
+    vk::PipelineColorBlendStateCreateInfo  color_blend_state({}, false, vk::LogicOp::eClear, blend_attachment);
+
+    // With dynamic rendering the pipeline names the formats of its attachments, otherwise the render pass it is used in.
+    vk::StructureChain<vk::GraphicsPipelineCreateInfo, vk::PipelineRenderingCreateInfo> pipeline_chain(
+        vk::GraphicsPipelineCreateInfo({},
+                                       shader_stages,
+                                       &vertex_input,
+                                       &input_assembly,
+                                       nullptr,
+                                       &viewport_state,
+                                       &rasterization_state,
+                                       &multisample_state,
+                                       &depth_stencil,
+                                       &color_blend_state,
+                                       &dynamic_state,
+                                       pipeline_layout,
+                                       dynamic_rendering ? nullptr : render_pass),
+        vk::PipelineRenderingCreateInfo(0, color_format, depth_format));
+    if (!dynamic_rendering)
+    {
+        pipeline_chain.unlink<vk::PipelineRenderingCreateInfo>();
+    }
 
-    return pipeline;
+    return device.createGraphicsPipeline(pipeline_states.get_pipeline_cache(), pipeline_chain.get<vk::GraphicsPipelineCreateInfo>()).value;
 }
 
 vk::ImageView LoomApplication::create_image_view(vk::Image image)
@@ -541,7 +1165,8 @@ vk::Instance LoomApplication::create_instance(std::vector<const char *> const &r
         throw std::runtime_error("Required validation layers are missing.");
     }
 
-    vk::ApplicationInfo app("HPP Hello Triangle", {}, "Vulkan Samples", {}, VK_MAKE_VERSION(1, 0, 0));
+    // Vulkan 1.2 devices are still supported, 1.3 makes dynamic rendering core.
+    vk::ApplicationInfo app("HPP Hello Triangle", {}, "Vulkan Samples", {}, VK_API_VERSION_1_3);
 
     vk::InstanceCreateInfo instance_info({}, &app, requested_validation_layers, active_instance_extensions);
 
@@ -577,87 +1202,98 @@ vk::Instance LoomApplication::create_instance(std::vector<const char *> const &r
     return instance;
 }
 
-vk::RenderPass LoomApplication::create_render_pass()
-{
-    vk::AttachmentDescription attachment({},
-                                         swapchain_data.format,            // Backbuffer format
-                                         vk::SampleCountFlagBits::e1,      // Not multisampled
-                                         vk::AttachmentLoadOp::eClear,     // When starting the frame, we want tiles to be cleared
-                                         vk::AttachmentStoreOp::eStore,    // When ending the frame, we want tiles to be written out
-                                         vk::AttachmentLoadOp::eDontCare,  // Don't care about stencil since we're not using it
-                                         vk::AttachmentStoreOp::eDontCare,
-                                         vk::ImageLayout::eUndefined,       // The image layout will be undefined when the render pass begins
-                                         vk::ImageLayout::ePresentSrcKHR);  // After the render pass is complete, we will transition to ePresentSrcKHR layout
-
-    // We have one subpass. This subpass has one color attachment.
-    // While executing this subpass, the attachment will be in attachment optimal layout.
-    vk::AttachmentReference color_ref(0, vk::ImageLayout::eColorAttachmentOptimal);
-
-    // We will end up with two transitions.
-    // The first one happens right before we start subpass #0, where
-    // eUndefined is transitioned into eColorAttachmentOptimal.
-    // The final layout in the render pass attachment states ePresentSrcKHR, so we
-    // will get a final transition from eColorAttachmentOptimal to ePresetSrcKHR.
-    vk::SubpassDescription subpass({}, vk::PipelineBindPoint::eGraphics, {}, color_ref);
-
-    // Create a dependency to external events.
-    // We need to wait for the WSI semaphore to signal.
-    // Only pipeline stages which depend on eColorAttachmentOutput will
-    // actually wait for the semaphore, so we must also wait for that pipeline stage.
-    vk::SubpassDependency dependency(/*srcSubpass   */ VK_SUBPASS_EXTERNAL,
-                                     /*dstSubpass   */ 0,
-                                     /*srcStageMask */ vk::PipelineStageFlagBits::eColorAttachmentOutput,
-                                     /*dstStageMask */ vk::PipelineStageFlagBits::eColorAttachmentOutput,
-                                     // Since we changed the image layout, we need to make the memory visible to
-                                     // color attachment to modify.
-                                     /*srcAccessMask*/ {},
-                                     /*dstAccessMask*/ vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eColorAttachmentWrite);
+/**
+ * @brief Creates one of the two main render passes.
+ * @param resume false for the pass clearing the attachments, true for the pass continuing into them after the late culling phase.
+ *
+ * The render graph transitions the attachments before and after the passes, so they start and end in attachment layout.
+ * With MSAA, the scene is drawn into multisampled attachments, which the first pass stores for the second. The first
+ * pass resolves the depth the depth pyramid is built from, the second the color into the swapchain image, as with
+ * dynamic rendering. Both passes have the same attachments, and render passes of a single subpass are compatible
+ * whatever they resolve, so they share the pipelines.
+ */
+vk::RenderPass LoomApplication::create_render_pass(bool resume)
+{
+    bool const                 multisampled = msaa_samples != vk::SampleCountFlagBits::e1;
+    vk::AttachmentLoadOp const load_op      = resume ? vk::AttachmentLoadOp::eLoad : vk::AttachmentLoadOp::eClear;  // The first pass clears, the second continues
+
+    std::vector<vk::AttachmentDescription2> attachments;
+
+    // With MSAA, the multisampled color is only kept for the second pass, the swapchain image is written by its resolve.
+    attachments.push_back(vk::AttachmentDescription2({},
+                                                     color_format,
+                                                     msaa_samples,
+                                                     load_op,
+                                                     multisampled && resume ? vk::AttachmentStoreOp::eDontCare : vk::AttachmentStoreOp::eStore,
+                                                     vk::AttachmentLoadOp::eDontCare,  // Don't care about stencil since we're not using it
+                                                     vk::AttachmentStoreOp::eDontCare,
+                                                     vk::ImageLayout::eColorAttachmentOptimal,
+                                                     vk::ImageLayout::eColorAttachmentOptimal));
+
+    // The first pass stores depth so the depth pyramid can be built from it, the second pass only tests against it.
+    attachments.push_back(vk::AttachmentDescription2({},
+                                                     depth_format,
+                                                     msaa_samples,
+                                                     load_op,
+                                                     resume ? vk::AttachmentStoreOp::eDontCare : vk::AttachmentStoreOp::eStore,
+                                                     vk::AttachmentLoadOp::eDontCare,
+                                                     vk::AttachmentStoreOp::eDontCare,
+                                                     vk::ImageLayout::eDepthStencilAttachmentOptimal,
+                                                     vk::ImageLayout::eDepthStencilAttachmentOptimal));
+
+    // We have one subpass with one color and one depth attachment.
+    // While executing this subpass, the attachments will be in attachment optimal layout.
+    vk::AttachmentReference2 color_ref(0, vk::ImageLayout::eColorAttachmentOptimal, vk::ImageAspectFlagBits::eColor);
+    vk::AttachmentReference2 depth_ref(1, vk::ImageLayout::eDepthStencilAttachmentOptimal, vk::ImageAspectFlagBits::eDepth);
+    vk::AttachmentReference2 color_resolve_ref(resume ? 2 : VK_ATTACHMENT_UNUSED, vk::ImageLayout::eColorAttachmentOptimal, vk::ImageAspectFlagBits::eColor);
+    vk::AttachmentReference2 depth_resolve_ref(3, vk::ImageLayout::eDepthStencilAttachmentOptimal, vk::ImageAspectFlagBits::eDepth);
+
+    vk::SubpassDescription2                   subpass({}, vk::PipelineBindPoint::eGraphics, 0, {}, color_ref, {}, &depth_ref);
+    vk::SubpassDescriptionDepthStencilResolve depth_resolve(depth_resolve_mode, vk::ResolveModeFlagBits::eNone, &depth_resolve_ref);
+
+    if (multisampled)
+    {
+        // Each resolve target is only referenced by the pass resolving into it, the other pass leaves it untouched.
+        attachments.push_back(vk::AttachmentDescription2({},
+                                                         color_format,
+                                                         vk::SampleCountFlagBits::e1,
+                                                         vk::AttachmentLoadOp::eDontCare,
+                                                         resume ? vk::AttachmentStoreOp::eStore : vk::AttachmentStoreOp::eDontCare,
+                                                         vk::AttachmentLoadOp::eDontCare,
+                                                         vk::AttachmentStoreOp::eDontCare,
+                                                         vk::ImageLayout::eColorAttachmentOptimal,
+                                                         vk::ImageLayout::eColorAttachmentOptimal));
+        attachments.push_back(vk::AttachmentDescription2({},
+                                                         depth_format,
+                                                         vk::SampleCountFlagBits::e1,
+                                                         vk::AttachmentLoadOp::eDontCare,
+                                                         resume ? vk::AttachmentStoreOp::eDontCare : vk::AttachmentStoreOp::eStore,
+                                                         vk::AttachmentLoadOp::eDontCare,
+                                                         vk::AttachmentStoreOp::eDontCare,
+                                                         vk::ImageLayout::eDepthStencilAttachmentOptimal,
+                                                         vk::ImageLayout::eDepthStencilAttachmentOptimal));
+
+        subpass.setResolveAttachments(color_resolve_ref);
+        if (!resume)
+        {
+            subpass.setPNext(&depth_resolve);
+        }
+    }
 
     // Finally, create the renderpass.
-    vk::RenderPassCreateInfo rp_info({}, attachment, subpass, dependency);
-    return device.createRenderPass(rp_info);
+    vk::RenderPassCreateInfo2 rp_info({}, attachments, subpass);
+    return device.createRenderPass2(rp_info);
 }
 
 /**
- * @brief Helper function to load a shader module.
- * @param path The path for the shader (relative to the assets directory).
- * @returns A vk::ShaderModule handle. Aborts execution if shader creation fails.
+ * @brief Helper function to load a shader module from the shader bundle.
+ * @param path The path for the shader (relative to the shaders directory).
+ * @param variant The variant key of the shader's features.
+ * @returns A vk::ShaderModule handle, null if the bundle has no such variant.
  */
-vk::ShaderModule LoomApplication::create_shader_module(const char *path)
-{
-    static const std::map<std::string, vk::ShaderStageFlagBits> shader_stage_map = {
-        {"comp",                vk::ShaderStageFlagBits::eCompute},
-        {"frag",               vk::ShaderStageFlagBits::eFragment},
-        {"geom",               vk::ShaderStageFlagBits::eGeometry},
-        {"tesc",    vk::ShaderStageFlagBits::eTessellationControl},
-        {"tese", vk::ShaderStageFlagBits::eTessellationEvaluation},
-        {"vert",                 vk::ShaderStageFlagBits::eVertex}
-    };
-    vkb::HPPGLSLCompiler glsl_compiler;
-
-    auto buffer = vkb::fs::read_shader_binary(path);
-
-    std::string file_ext = path;
-
-    // Extract extension name from the glsl shader file
-    file_ext = file_ext.substr(file_ext.find_last_of(".") + 1);
-
-    std::vector<uint32_t> spirvCode;
-    std::string           info_log;
-
-    // Compile the GLSL source
-    auto stageIt = shader_stage_map.find(file_ext);
-    if (stageIt == shader_stage_map.end())
-    {
-        throw std::runtime_error("File extension `" + file_ext + "` does not have a vulkan shader stage.");
-    }
-    if (!glsl_compiler.compile_to_spirv(stageIt->second, buffer, "main", {}, spirvCode, info_log))
-    {
-        LOGE("Failed to compile shader, Error: {}", info_log.c_str());
-        return nullptr;
-    }
-
-    return device.createShaderModule({{}, spirvCode});
+vk::ShaderModule LoomApplication::create_shader_module(const char *path, VariantKey variant)
+{
+    return shader_bundle.create_shader_module(device, path, variant);
 }
 
 vk::SwapchainKHR
@@ -717,21 +1353,61 @@ LoomApplication::create_swapchain(vk::Extent2D const &swapchain_extent, vk::Surf
     swapchain_create_info.clipped            = true;
     swapchain_create_info.oldSwapchain       = old_swapchain;
 
+    // Frame capture copies out of the images, which is the only usage it adds.
+    if (!capture_output.empty())
+    {
+        if (surface_properties.supportedUsageFlags & vk::ImageUsageFlagBits::eTransferSrc)
+        {
+            swapchain_create_info.imageUsage |= vk::ImageUsageFlagBits::eTransferSrc;
+        }
+        else
+        {
+            LOGW("Frame capture: the swapchain images can't be copied from, capture is disabled.");
+            capture_output.clear();
+        }
+    }
+
+    // Each device of a group presents the images it rendered.
+    vk::DeviceGroupSwapchainCreateInfoKHR device_group_info(vk::DeviceGroupPresentModeFlagBitsKHR::eLocal);
+    if (frame_devices > 1)
+    {
+        swapchain_create_info.pNext = &device_group_info;
+    }
+
     return device.createSwapchainKHR(swapchain_create_info);
 }
 
 /**
- * @brief Initializes the Vulkan framebuffers.
+ * @brief Initializes the render graph and the Vulkan framebuffers, there are none with dynamic rendering.
  */
 void LoomApplication::init_framebuffers()
 {
     assert(swapchain_data.framebuffers.empty());
 
-    // Create framebuffer for each swapchain image view
+    // The depth attachment is owned by the render graph, which is sized after the swapchain.
+    build_render_graph();
+
+    vk::ImageView depth_view = render_graph.get_image_view(depth_resource);
+
+    // The depth pyramid is sized after the depth attachment.
+    occlusion_culling.resize(depth_view, swapchain_data.extent);
+
+    if (dynamic_rendering)
+    {
+        return;
+    }
+
+    // Create framebuffer for each swapchain image view, in the order of the attachments of create_render_pass.
     for (auto &image_view : swapchain_data.image_views)
     {
+        std::vector<vk::ImageView> attachments = {image_view, depth_view};
+        if (msaa_samples != vk::SampleCountFlagBits::e1)
+        {
+            attachments = {render_graph.get_image_view(msaa_color_resource), render_graph.get_image_view(msaa_depth_resource), image_view, depth_view};
+        }
+
         // create the framebuffer.
-        swapchain_data.framebuffers.push_back(vkb::common::create_framebuffer(device, render_pass, {image_view}, swapchain_data.extent));
+        swapchain_data.framebuffers.push_back(vkb::common::create_framebuffer(device, render_pass, attachments, swapchain_data.extent));
     }
 }
 
@@ -757,14 +1433,13 @@ void LoomApplication::init_swapchain()
             device.destroyImageView(image_view);
         }
 
-        size_t image_count = device.getSwapchainImagesKHR(old_swapchain).size();
-
-        for (size_t i = 0; i < image_count; i++)
+        for (vk::Semaphore semaphore : swapchain_data.release_semaphores)
         {
-            teardown_per_frame(per_frame_data[i]);
+            device.destroySemaphore(semaphore);
         }
 
         swapchain_data.image_views.clear();
+        swapchain_data.release_semaphores.clear();
 
         device.destroySwapchainKHR(old_swapchain);
     }
@@ -773,197 +1448,653 @@ void LoomApplication::init_swapchain()
     swapchain_data.format = surface_format.format;
 
     /// The swapchain images.
-    std::vector<vk::Image> swapchain_images = device.getSwapchainImagesKHR(swapchain_data.swapchain);
-    size_t                 image_count      = swapchain_images.size();
-
-    // Initialize per-frame resources.
-    // Every swapchain image has its own command pool and fence manager.
-    // This makes it very easy to keep track of when we can reset command buffers and such.
-    per_frame_data.clear();
-    per_frame_data.resize(image_count);
-
-    for (size_t frame = 0; frame < image_count; frame++)
-    {
-        auto &pfd                  = per_frame_data[frame];
-        pfd.queue_submit_fence     = device.createFence({vk::FenceCreateFlagBits::eSignaled});
-        pfd.primary_command_pool   = device.createCommandPool({vk::CommandPoolCreateFlagBits::eTransient, graphics_queue_index});
-        pfd.primary_command_buffer = vkb::common::allocate_command_buffer(device, pfd.primary_command_pool);
-    }
+    swapchain_data.images = device.getSwapchainImagesKHR(swapchain_data.swapchain);
+    size_t image_count    = swapchain_data.images.size();
 
     for (size_t i = 0; i < image_count; i++)
     {
         // Create an image view which we can render into.
-        swapchain_data.image_views.push_back(create_image_view(swapchain_images[i]));
+        swapchain_data.image_views.push_back(create_image_view(swapchain_data.images[i]));
+
+        // Presentation of an image has finished by the time it is acquired again, so its semaphore can be reused then.
+        swapchain_data.release_semaphores.push_back(device.createSemaphore({}));
     }
 }
 
 /**
- * @brief Render to the specified swapchain image.
- * @param swapchain_index The swapchain index for the image being rendered.
+ * @brief Declares the passes of a frame and compiles them into the render graph.
  */
-void LoomApplication::render(uint32_t swapchain_index)
+void LoomApplication::build_render_graph()
 {
-    // Render to this framebuffer.
-    vk::Framebuffer framebuffer = swapchain_data.framebuffers[swapchain_index];
+    RenderGraph::ImageDesc depth_desc;
+    depth_desc.format = depth_format;
+    depth_desc.extent = swapchain_data.extent;
+    depth_desc.aspect = vk::ImageAspectFlagBits::eDepth;
+
+    // The swapchain image is available once the acquire semaphore was waited on, and is presented afterwards.
+    backbuffer_resource = render_graph.import_image("backbuffer",
+                                                    vk::ImageAspectFlagBits::eColor,
+                                                    vk::ImageLayout::eUndefined,
+                                                    vk::ImageLayout::ePresentSrcKHR,
+                                                    vk::PipelineStageFlagBits::eColorAttachmentOutput);
+    depth_resource      = render_graph.create_image("depth", depth_desc);
+
+    // The multisampled attachments are stored by phase one and loaded by phase two, so the late draws test against
+    // and blend over the early ones at every sample. They can't be transient, lazily allocated memory would be
+    // committed in full anyway.
+    bool const multisampled = msaa_samples != vk::SampleCountFlagBits::e1;
+    if (multisampled)
+    {
+        RenderGraph::ImageDesc msaa_desc;
+        msaa_desc.format    = color_format;
+        msaa_desc.extent    = swapchain_data.extent;
+        msaa_desc.aspect    = vk::ImageAspectFlagBits::eColor;
+        msaa_desc.samples   = msaa_samples;
+        msaa_color_resource = render_graph.create_image("msaa_color", msaa_desc);
+
+        msaa_desc.format    = depth_format;
+        msaa_desc.aspect    = vk::ImageAspectFlagBits::eDepth;
+        msaa_depth_resource = render_graph.create_image("msaa_depth", msaa_desc);
+    }
+
+    // Both draw phases declare the same attachments, with MSAA the backbuffer and the depth are resolve targets.
+    auto write_scene_attachments = [&](RenderGraph::PassBuilder pass)
+    {
+        pass.write(backbuffer_resource, RenderGraph::Access::eColorAttachment);
+        if (multisampled)
+        {
+            pass.write(msaa_color_resource, RenderGraph::Access::eColorAttachment)
+                .write(msaa_depth_resource, RenderGraph::Access::eDepthAttachment)
+                .write(depth_resource, RenderGraph::Access::eDepthResolve);
+        }
+        else
+        {
+            pass.write(depth_resource, RenderGraph::Access::eDepthAttachment);
+        }
+    };
 
-    // Allocate or re-use a primary command buffer.
-    vk::CommandBuffer cmd = per_frame_data[swapchain_index].primary_command_buffer;
+    RenderGraph::ResourceHandle visibility  = render_graph.import_buffer("visibility", occlusion_culling.get_visibility_buffer());
+    RenderGraph::ResourceHandle early_draws = render_graph.import_buffer("early_draws", occlusion_culling.get_early_draw_buffer());
+    RenderGraph::ResourceHandle late_draws  = render_graph.import_buffer("late_draws", occlusion_culling.get_late_draw_buffer());
 
-    // We will only submit this once before it's recycled.
-    vk::CommandBufferBeginInfo begin_info(vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
+    render_graph.set_output(backbuffer_resource);
+
+    // Phase one: draw what was visible last frame. The culling passes run on the async compute queue, so the
+    // early cull of a frame overlaps the late draw of the previous one.
+    render_graph.add_pass("early_cull", [this](RenderGraphContext const &context) { occlusion_culling.record_early_cull(context.cmd, view_proj, get_frame_device_mask()); }, RenderGraph::QueueType::eAsyncCompute)
+        .read(visibility, RenderGraph::Access::eStorageCompute)
+        .write(early_draws, RenderGraph::Access::eStorageCompute);
+
+    write_scene_attachments(
+        render_graph.add_pass("early_draw", [this](RenderGraphContext const &context) { record_scene_pass(context.cmd, get_swapchain_view(context.swapchain_index), false); })
+            .read(early_draws, RenderGraph::Access::eIndirectBuffer));
+
+    // Phase two: build the depth pyramid from phase one, and draw what just became visible.
+    render_graph.add_pass("late_cull", [this](RenderGraphContext const &context) { occlusion_culling.record_late_cull(context.cmd, view_proj); }, RenderGraph::QueueType::eAsyncCompute)
+        .read(depth_resource, RenderGraph::Access::eSampledCompute)
+        .write(visibility, RenderGraph::Access::eStorageCompute)
+        .write(late_draws, RenderGraph::Access::eStorageCompute);
+
+    // The transparent draws follow the late draws. Sorting them on the GPU runs on the graphics queue right before.
+    RenderGraph::ResourceHandle transparent_draws = ~0u;
+    if (transparent_queue.is_gpu_sorted())
+    {
+        transparent_draws = render_graph.import_buffer("transparent_draws", transparent_queue.get_draw_buffer());
+        render_graph.add_pass("transparent_sort", [this](RenderGraphContext const &context) { transparent_queue.record_gpu_sort(context.cmd, view_proj); })
+            .write(transparent_draws, RenderGraph::Access::eStorageCompute);
+    }
+
+    RenderGraph::PassBuilder late_draw =
+        render_graph.add_pass("late_draw", [this](RenderGraphContext const &context) { record_scene_pass(context.cmd, get_swapchain_view(context.swapchain_index), true); })
+            .read(late_draws, RenderGraph::Access::eIndirectBuffer);
+    if (transparent_queue.is_gpu_sorted())
+    {
+        late_draw.read(transparent_draws, RenderGraph::Access::eIndirectBuffer);
+    }
+    write_scene_attachments(late_draw);
+
+    // The captured frames are copied out of the backbuffer at the end of the frame, the copy doesn't feed an output.
+    if (frame_capture.is_enabled())
+    {
+        frame_capture.resize(swapchain_data.extent);
+        render_graph.add_pass("capture", [this](RenderGraphContext const &context) { frame_capture.record(context.cmd, swapchain_data.images[context.swapchain_index]); })
+            .read(backbuffer_resource, RenderGraph::Access::eTransferSrc)
+            .side_effect();
+    }
+
+    render_graph.compile(gpu, device, device_dispatch, frame_sync.get_frames_in_flight(), graphics_queue, compute_queue, &gpu_profiler);
+}
+
+/**
+ * @brief The attachments of the frame rendering into a swapchain image.
+ */
+SceneView LoomApplication::get_swapchain_view(uint32_t swapchain_index) const
+{
+    SceneView view;
+    view.extent        = swapchain_data.extent;
+    view.color         = swapchain_data.image_views[swapchain_index];
+    view.depth         = render_graph.get_image_view(depth_resource);
+    view.view_proj     = view_proj;
+    view.object_buffer = object_data_indices[frame_sync.get_frame_index()];
+    if (msaa_samples != vk::SampleCountFlagBits::e1)
+    {
+        view.msaa_color = render_graph.get_image_view(msaa_color_resource);
+        view.msaa_depth = render_graph.get_image_view(msaa_depth_resource);
+    }
+    if (!dynamic_rendering)
+    {
+        view.framebuffer = swapchain_data.framebuffers[swapchain_index];
+    }
+    return view;
+}
 
-    cmd.begin(begin_info);
+/**
+ * @brief Looks up the pipelines of the frame's states once, instead of on every bind. Their own
+ *        pipelines stand in until the cache has created the ones of their states.
+ */
+void LoomApplication::resolve_pipelines()
+{
+    frame_pipeline             = pipeline_states.get(scene_state, pipeline);
+    frame_transparent_pipeline = transparent_pipeline ? pipeline_states.get(transparent_state, transparent_pipeline) : nullptr;
+}
 
-    // Set clear color values.
-    vk::ClearValue clear_value;
-    clear_value.color = vk::ClearColorValue(std::array<float, 4>({
+/**
+ * @brief Records one of the two scene render passes.
+ * @param view The attachments, the camera and the object data.
+ * @param resume false for phase one, which clears the attachments, true for phase two.
+ */
+void LoomApplication::record_scene_pass(vk::CommandBuffer cmd, SceneView const &view, bool resume)
+{
+    // Set clear color and depth values.
+    std::array<vk::ClearValue, 2> clear_values;
+    clear_values[0].color        = vk::ClearColorValue(std::array<float, 4>({
         {0.01f, 0.01f, 0.033f, 1.0f}
     }));
+    clear_values[1].depthStencil = vk::ClearDepthStencilValue(1.0f, 0);
 
-    vk::RenderPassBeginInfo rp_begin(render_pass, framebuffer, {
-                                                                   {                          0,                            0},
-                                                                   {swapchain_data.extent.width, swapchain_data.extent.height}
-    },
-                                     clear_value);
+    vk::Rect2D render_area({0, 0}, view.extent);
 
-    cmd.beginRenderPass(rp_begin, vk::SubpassContents::eInline);
+    if (dynamic_rendering)
+    {
+        // The first pass clears and stores depth for the depth pyramid, the second continues and only tests against it.
+        vk::AttachmentLoadOp        load_op = resume ? vk::AttachmentLoadOp::eLoad : vk::AttachmentLoadOp::eClear;
+        vk::RenderingAttachmentInfo color_attachment(view.color,
+                                                     vk::ImageLayout::eColorAttachmentOptimal,
+                                                     vk::ResolveModeFlagBits::eNone,
+                                                     {},
+                                                     vk::ImageLayout::eUndefined,
+                                                     load_op,
+                                                     vk::AttachmentStoreOp::eStore,
+                                                     clear_values[0]);
+        vk::RenderingAttachmentInfo depth_attachment(view.depth,
+                                                     vk::ImageLayout::eDepthStencilAttachmentOptimal,
+                                                     vk::ResolveModeFlagBits::eNone,
+                                                     {},
+                                                     vk::ImageLayout::eUndefined,
+                                                     load_op,
+                                                     resume ? vk::AttachmentStoreOp::eDontCare : vk::AttachmentStoreOp::eStore,
+                                                     clear_values[1]);
+
+        // With MSAA, phase one resolves the depth for the depth pyramid and phase two the color for presentation.
+        // The multisampled attachments are only stored for phase two.
+        if (msaa_samples != vk::SampleCountFlagBits::e1)
+        {
+            color_attachment.setImageView(view.msaa_color);
+            color_attachment.setStoreOp(resume ? vk::AttachmentStoreOp::eDontCare : vk::AttachmentStoreOp::eStore);
+            depth_attachment.setImageView(view.msaa_depth);
+            if (resume)
+            {
+                color_attachment.setResolveMode(vk::ResolveModeFlagBits::eAverage)
+                    .setResolveImageView(view.color)
+                    .setResolveImageLayout(vk::ImageLayout::eColorAttachmentOptimal);
+            }
+            else
+            {
+                depth_attachment.setResolveMode(depth_resolve_mode)
+                    .setResolveImageView(view.depth)
+                    .setResolveImageLayout(vk::ImageLayout::eDepthStencilAttachmentOptimal);
+            }
+        }
 
-    cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline);
+        cmd.beginRendering(vk::RenderingInfo({}, render_area, 1, 0, color_attachment, &depth_attachment), device_dispatch);
+    }
+    else
+    {
+        vk::RenderPassBeginInfo rp_begin(resume ? render_pass_resume : render_pass, view.framebuffer, render_area, clear_values);
 
-    vk::Buffer vertexBuffers[] = { mVertexBuffer.buffer };
-    vk::DeviceSize offsets[] = { 0 };
-    cmd.bindVertexBuffers(0, 1, vertexBuffers, offsets);
-    cmd.bindIndexBuffer(mIndexBuffer.buffer, 0, vk::IndexType::eUint32);
+        cmd.beginRenderPass(rp_begin, vk::SubpassContents::eInline, device_dispatch);
+    }
 
-    // Set viewport & scissor dynamically
-    vk::Viewport vp(0.0f, 0.0f, static_cast<float>(swapchain_data.extent.width), static_cast<float>(swapchain_data.extent.height), 0.0f, 1.0f);
-    cmd.setViewport(0, vp);
-    vk::Rect2D scissor({0, 0}, {swapchain_data.extent.width, swapchain_data.extent.height});
-    cmd.setScissor(0, scissor);
+    cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, frame_pipeline, device_dispatch);
 
-    // Draw vertices with one instance.
-    //cmd.draw(3, 1, 0, 0);
-    cmd.drawIndexed(indeies.size(), 1, 0, 0, 0);
+    // One descriptor set for everything, the draws find their object data through the push constants.
+    DrawPushConstants push_constants;
+    push_constants.view_proj     = view.view_proj;
+    push_constants.object_buffer = view.object_buffer;
 
-    cmd.endRenderPass();
+    bindless_heap.bind(cmd, vk::PipelineBindPoint::eGraphics);
+    bindless_heap.push_constants(cmd, push_constants);
+
+    vk::Buffer vertexBuffers[] = { buffer_pool.get(vertex_buffer).buffer };
+    vk::DeviceSize offsets[] = { 0 };
+    cmd.bindVertexBuffers(0, 1, vertexBuffers, offsets, device_dispatch);
+    cmd.bindIndexBuffer(buffer_pool.get(index_buffer).buffer, 0, vk::IndexType::eUint32, device_dispatch);
+
+    // Set viewport & scissor dynamically
+    vk::Viewport vp(0.0f, 0.0f, static_cast<float>(view.extent.width), static_cast<float>(view.extent.height), 0.0f, 1.0f);
+    cmd.setViewport(0, vp, device_dispatch);
+    cmd.setScissor(0, render_area, device_dispatch);
 
-    cmd.end();
+    if (!view.culled)
+    {
+        // Without culling, phase one draws every object, the instance selects its object data like the culled draws.
+        for (uint32_t i = 0; i < scene_objects.size() && !resume; i++)
+        {
+            cmd.drawIndexed(scene_objects[i].index_count, 1, scene_objects[i].first_index, scene_objects[i].vertex_offset, i, device_dispatch);
+        }
+    }
+    else if (resume)
+    {
+        occlusion_culling.draw_late(cmd);
+    }
+    else
+    {
+        occlusion_culling.draw_early(cmd);
+    }
 
-    // Submit it to the queue with a release semaphore.
-    if (!per_frame_data[swapchain_index].swapchain_release_semaphore)
+    // The transparent draws blend over everything opaque, from the farthest to the nearest. Culled frames are
+    // GPU-driven and draw what the GPU sorted, if it does.
+    if (resume && !transparent_queue.is_empty())
     {
-        per_frame_data[swapchain_index].swapchain_release_semaphore = device.createSemaphore({});
+        cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, frame_transparent_pipeline, device_dispatch);
+        if (view.culled && transparent_queue.is_gpu_sorted())
+        {
+            transparent_queue.draw_gpu_sorted(cmd);
+        }
+        else
+        {
+            transparent_queue.draw(cmd);
+        }
     }
 
-    vk::PipelineStageFlags wait_stage{VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
+    if (dynamic_rendering)
+    {
+        cmd.endRendering(device_dispatch);
+    }
+    else
+    {
+        cmd.endRenderPass(device_dispatch);
+    }
+}
 
-    vk::SubmitInfo info(per_frame_data[swapchain_index].swapchain_acquire_semaphore, wait_stage, cmd,
-                        per_frame_data[swapchain_index].swapchain_release_semaphore);
-    // Submit command buffer to graphics queue
-    queue.submit(info, per_frame_data[swapchain_index].queue_submit_fence);
+/**
+ * @brief Render to the specified swapchain image.
+ * @param swapchain_index The swapchain index for the image being rendered.
+ */
+void LoomApplication::render(uint32_t swapchain_index)
+{
+    // The render graph records all passes and the barriers between them, and submits them to their queues.
+    // Its command buffers are per frame slot, which begin_frame made reusable.
+    RenderGraphFrame frame;
+    frame.frame_index      = frame_sync.get_frame_index();
+    frame.swapchain_index  = swapchain_index;
+    frame.wait_semaphore   = frame_sync.get_acquire_semaphore();
+    frame.wait_stage       = vk::PipelineStageFlagBits::eColorAttachmentOutput;
+    frame.signal_semaphore = swapchain_data.release_semaphores[swapchain_index];
+
+    // Sampling waits for the texture uploads on the transfer queue.
+    frame.dependency_semaphore = texture_streamer.get_upload_semaphore();
+    frame.dependency_value     = texture_streamer.get_upload_value();
+    frame.dependency_stage     = vk::PipelineStageFlagBits::eFragmentShader;
+    frame.device_mask          = get_frame_device_mask();
+
+    render_graph.set_imported_image(backbuffer_resource, swapchain_data.images[swapchain_index]);
+    uint64_t value = render_graph.submit(frame);
+    frame_capture.end_frame(value);
+    frame_sync.end_frame(value);
 }
 
 /**
- * @brief Select a physical device.
+ * @brief Selects the best suited physical device, or the one LOOM_DEVICE_INDEX names by its enumeration index.
+ *
+ * With LOOM_MULTI_GPU=afr, a device which is part of a device group is preferred, and the frames
+ * alternate between the physical devices of its group. Whether each device runs its own frames is
+ * checked once the device exists, see check_device_group. Software drivers such as lavapipe report
+ * every device in a group of its own, they exercise the ranking, LOOM_DEVICE_INDEX and the fallback
+ * to a single device, while alternate frames need a driver grouping several devices.
  */
 void LoomApplication::select_physical_device_and_surface()
 {
     std::vector<vk::PhysicalDevice> gpus = instance.enumeratePhysicalDevices();
+    if (gpus.empty())
+    {
+        throw std::runtime_error("No physical device found.");
+    }
 
-    bool found_graphics_queue_index = false;
-    for (size_t i = 0; i < gpus.size() && !found_graphics_queue_index; i++)
+    // The surface belongs to the instance, the device is only used to pick a display where there are several.
+    surface = static_cast<vk::SurfaceKHR>(window->create_surface(static_cast<VkInstance>(instance), static_cast<VkPhysicalDevice>(gpus[0])));
+    if (!surface)
     {
-        gpu = gpus[i];
+        throw std::runtime_error("Failed to create window surface.");
+    }
 
-        std::vector<vk::QueueFamilyProperties> queue_family_properties = gpu.getQueueFamilyProperties();
+    std::vector<DeviceCandidate> candidates =
+        rank_physical_devices(instance, [this](vk::PhysicalDevice candidate, uint32_t family) { return candidate.getSurfaceSupportKHR(family, surface); });
+    log_device_candidates(candidates);
 
-        if (queue_family_properties.empty())
-        {
-            throw std::runtime_error("No queue family found.");
-        }
+    char const *multi_gpu     = std::getenv("LOOM_MULTI_GPU");
+    bool const  afr_requested = multi_gpu && std::string(multi_gpu) == "afr";
 
-        if (surface)
+    auto selected = std::find_if(candidates.begin(), candidates.end(), [afr_requested](DeviceCandidate const &candidate) {
+        return candidate.is_usable() && (!afr_requested || candidate.group_size > 1);
+    });
+    if (selected == candidates.end())
+    {
+        selected = candidates.begin();
+    }
+
+    if (char const *device_index = std::getenv("LOOM_DEVICE_INDEX"))
+    {
+        uint32_t index = static_cast<uint32_t>(std::strtoul(device_index, nullptr, 10));
+        selected       = std::find_if(candidates.begin(), candidates.end(), [index](DeviceCandidate const &candidate) { return candidate.index == index; });
+        if (selected == candidates.end())
         {
-            instance.destroySurfaceKHR(surface);
+            throw std::runtime_error("LOOM_DEVICE_INDEX names no physical device.");
         }
+    }
+
+    if (!selected->is_usable())
+    {
+        LOGE("Physical device {} is not suitable: {}.", selected->name, selected->rejection);
+        throw std::runtime_error("No suitable physical device found.");
+    }
+
+    gpu                  = selected->gpu;
+    graphics_queue_index = selected->queue_index;
+    LOGI("Selected physical device [{}] {}.", selected->index, selected->name);
 
-        surface = static_cast<vk::SurfaceKHR>(window->create_surface(static_cast<VkInstance>(instance), static_cast<VkPhysicalDevice>(gpu)));
-        if (!surface)
+    // Dedicated families let compute work and uploads overlap graphics work.
+    std::vector<vk::QueueFamilyProperties> queue_family_properties = gpu.getQueueFamilyProperties();
+    compute_queue_index  = find_dedicated_queue_family(queue_family_properties, vk::QueueFlagBits::eCompute, vk::QueueFlagBits::eGraphics);
+    transfer_queue_index = find_dedicated_queue_family(queue_family_properties, vk::QueueFlagBits::eTransfer, vk::QueueFlagBits::eGraphics | vk::QueueFlagBits::eCompute);
+
+    // The logical device spans the whole group, whether the frames can alternate is known once it exists.
+    device_group = {gpu};
+    if (afr_requested)
+    {
+        device_group = find_device_group(instance, gpu);
+        if (device_group.size() == 1)
         {
-            throw std::runtime_error("Failed to create window surface.");
+            LOGW("LOOM_MULTI_GPU=afr: {} is not part of a device group, rendering on it alone.", selected->name);
         }
+    }
+}
+
+/**
+ * @brief Tears down the framebuffers. If our swapchain changes, we will call this, and create a new swapchain.
+ */
+void LoomApplication::teardown_framebuffers()
+{
+    // Wait until device is idle before teardown, work may still run on any of the queues.
+    device.waitIdle();
 
-        for (uint32_t j = 0; j < vkb::to_u32(queue_family_properties.size()); j++)
+    for (auto &framebuffer : swapchain_data.framebuffers)
+    {
+        device.destroyFramebuffer(framebuffer);
+    }
+
+    swapchain_data.framebuffers.clear();
+
+    render_graph.reset();
+}
+
+/**
+ * @brief Requests the textures of the visible objects by their screen-space size, advances texture
+ *        streaming and writes the object data of the frame slot.
+ */
+void LoomApplication::update_object_data()
+{
+    if (scene_texture != ~0u)
+    {
+        for (auto const &object : scene_objects)
         {
-            vk::Bool32 supports_present = gpu.getSurfaceSupportKHR(j, surface);
+            // The projected size of the bounds, objects behind the camera or off screen request nothing.
+            glm::vec2 ndc_min(std::numeric_limits<float>::max());
+            glm::vec2 ndc_max(std::numeric_limits<float>::lowest());
+            bool      in_front = true;
+            for (uint32_t corner = 0; corner < 8 && in_front; corner++)
+            {
+                glm::vec4 position(corner & 1 ? object.aabb_max.x : object.aabb_min.x,
+                                   corner & 2 ? object.aabb_max.y : object.aabb_min.y,
+                                   corner & 4 ? object.aabb_max.z : object.aabb_min.z,
+                                   1.0f);
+                glm::vec4 clip = view_proj * position;
+                in_front       = clip.w > 0.0f;
+                ndc_min        = glm::min(ndc_min, glm::vec2(clip) / clip.w);
+                ndc_max        = glm::max(ndc_max, glm::vec2(clip) / clip.w);
+            }
 
-            // Find a queue family which supports graphics and presentation.
-            if ((queue_family_properties[j].queueFlags & vk::QueueFlagBits::eGraphics) && supports_present)
+            bool on_screen = ndc_min.x < 1.0f && ndc_min.y < 1.0f && ndc_max.x > -1.0f && ndc_max.y > -1.0f;
+            if (in_front && on_screen)
             {
-                graphics_queue_index       = j;
-                found_graphics_queue_index = true;
-                break;
+                glm::vec2 size = (ndc_max - ndc_min) * 0.5f * glm::vec2(swapchain_data.extent.width, swapchain_data.extent.height);
+                texture_streamer.request(scene_texture, std::max(size.x, size.y));
             }
         }
     }
 
-    if (!found_graphics_queue_index)
+    update_texture_streaming();
+
+    // The GPU finished reading the object data of the frame slot with the slot's last frame.
+    write_object_data(frame_sync.get_frame_index(), scene_texture);
+}
+
+/**
+ * @brief Fits the texture budget into the memory budget and advances texture streaming.
+ */
+void LoomApplication::update_texture_streaming()
+{
+    // Streamed textures give way when the device runs low on memory, e.g. because other processes need it.
+    memory_budget.update();
+    int64_t texture_limit = static_cast<int64_t>(get_device_memory_usage(MemoryCategory::eTextures)) + memory_budget.get_headroom();
+    texture_streamer.set_budget(std::min(texture_budget, static_cast<vk::DeviceSize>(std::max<int64_t>(texture_limit, 0))));
+
+    texture_streamer.update();
+}
+
+/**
+ * @brief Writes the object data in place, all objects are drawn with one texture.
+ * @param slot The object data of a frame slot, or of a render job of the frame slot's batch.
+ * @param texture The texture, ~0u for none.
+ */
+void LoomApplication::write_object_data(uint32_t slot, TextureStreamer::TextureHandle texture)
+{
+    std::span<ObjectData>              object_data         = buffer_pool.get(object_data_buffers[slot]).view<ObjectData>(0, get_object_count());
+    std::span<TransparentObject const> transparent_objects = transparent_queue.get_objects();
+    for (size_t i = 0; i < object_data.size(); i++)
+    {
+        ObjectData &object = object_data[i];
+        if (i < scene_objects.size())
+        {
+            object.tint      = glm::vec4(1.0f);
+            object.placement = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+        }
+        else
+        {
+            size_t const transparent = i - scene_objects.size();
+            object.tint              = transparent_tints[transparent];
+            object.placement         = glm::vec4(glm::vec3(transparent_objects[transparent].center), transparent_scale);
+        }
+        object.texture = texture != ~0u ? texture_streamer.get_bindless_index(texture) : BindlessHeap::invalid_index;
+        object.sampler = texture_streamer.get_sampler_index();
+    }
+}
+
+/**
+ * @returns The objects with object data, the opaque ones followed by the transparent ones.
+ */
+uint32_t LoomApplication::get_object_count() const
+{
+    return static_cast<uint32_t>(scene_objects.size() + transparent_tints.size());
+}
+
+/**
+ * @returns The object data copies per frame slot, one per job of a render service batch.
+ */
+uint32_t LoomApplication::get_object_data_slots() const
+{
+    return service_output.empty() ? 1 : RenderService::max_batch;
+}
+
+/**
+ * @brief Renders the next batch of render service jobs instead of a frame. Closes the application once
+ *        stdin was closed and all jobs were rendered.
+ */
+void LoomApplication::serve_render_jobs()
+{
+    render_service.update([this](RenderJob const &job) { return is_job_scene_ready(job); });
+
+    // The scenes of waiting jobs keep streaming in.
+    update_texture_streaming();
+
+    if (!render_service.has_batch())
     {
-        LOGE("Did not find suitable queue which supports graphics and presentation.");
+        if (render_service.is_finished())
+        {
+            close();
+        }
+        else
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return;
     }
+
+    // A batch is a frame of its own, it uses the object data, the targets and the arenas of the frame slot.
+    frame_sync.begin_frame();
+    frame_arenas.begin_frame(frame_sync.get_frame_index());
+    resolve_pipelines();
+    uint64_t value = render_service.submit_batch(
+        [this](vk::CommandBuffer cmd, SceneView const &view, RenderJob const &job, uint32_t job_index, bool resume) {
+            uint32_t const slot = frame_sync.get_frame_index() * RenderService::max_batch + job_index;
+            if (!resume)
+            {
+                auto texture = job_textures.find(job.scene);
+                write_object_data(slot, texture != job_textures.end() ? texture->second : ~0u);
+            }
+
+            SceneView job_view     = view;
+            job_view.object_buffer = object_data_indices[slot];
+            if (resume)
+            {
+                transparent_queue.sort(job_view.view_proj);
+            }
+            record_scene_pass(cmd, job_view, resume);
+        },
+        !transparent_queue.is_empty(),
+        texture_streamer.get_upload_semaphore(),
+        texture_streamer.get_upload_value());
+    frame_sync.end_frame(value);
 }
 
 /**
- * @brief Tears down the framebuffers. If our swapchain changes, we will call this, and create a new swapchain.
+ * @brief Loads the scene of a render job and streams it in at the job's resolution.
+ * @returns Whether the scene is resident at the job's resolution.
  */
-void LoomApplication::teardown_framebuffers()
+bool LoomApplication::is_job_scene_ready(RenderJob const &job)
 {
-    // Wait until device is idle before teardown.
-    queue.waitIdle();
+    if (job.scene.empty())
+    {
+        return true;
+    }
 
-    for (auto &framebuffer : swapchain_data.framebuffers)
+    auto [texture, inserted] = job_textures.try_emplace(job.scene, ~0u);
+    if (inserted)
     {
-        device.destroyFramebuffer(framebuffer);
+        if (std::filesystem::exists(job.scene))
+        {
+            texture->second = texture_streamer.load(job.scene);
+        }
+        else
+        {
+            LOGW("Render service: scene {} not found, its jobs are rendered untextured.", job.scene);
+        }
+    }
+    if (texture->second == ~0u)
+    {
+        return true;
     }
 
-    swapchain_data.framebuffers.clear();
+    texture_streamer.request(texture->second, static_cast<float>(std::max(job.extent.width, job.extent.height)));
+    TextureStats stats = texture_streamer.get_stats(texture->second);
+    return stats.resident_mip <= stats.desired_mip;
 }
 
 /**
- * @brief Tears down the frame data.
- * @param per_frame_data The data of a frame.
+ * @brief Logs the statistics of the subsystems periodically, outside of the frame whose allocations are counted.
+ * @param frame_allocations The heap allocations made during the frame.
  */
-void LoomApplication::teardown_per_frame(FrameData &per_frame_data)
+void LoomApplication::report_statistics(uint64_t frame_allocations)
 {
-    if (per_frame_data.queue_submit_fence)
+    if (frame_allocations)
     {
-        device.destroyFence(per_frame_data.queue_submit_fence);
-        per_frame_data.queue_submit_fence = nullptr;
+        escaped_allocations += frame_allocations;
+        allocating_frames++;
     }
 
-    if (per_frame_data.primary_command_buffer)
+    gpu_profiler.report();
+
+    if (frame_sync.get_frame_number() % report_interval != 0)
     {
-        device.freeCommandBuffers(per_frame_data.primary_command_pool, per_frame_data.primary_command_buffer);
-        per_frame_data.primary_command_buffer = nullptr;
+        return;
     }
 
-    if (per_frame_data.primary_command_pool)
+    if (scene_texture != ~0u)
     {
-        device.destroyCommandPool(per_frame_data.primary_command_pool);
-        per_frame_data.primary_command_pool = nullptr;
+        texture_streamer.log_statistics();
     }
 
-    if (per_frame_data.swapchain_acquire_semaphore)
+    frame_capture.log_statistics();
+    transparent_queue.log_statistics();
+
+    // What recording and submitting costs the CPU, compare it across LOOM_DISPATCH.
+    RenderGraph::CpuTimings const &cpu_timings = render_graph.get_cpu_timings();
+    if (cpu_timings.submissions)
     {
-        device.destroySemaphore(per_frame_data.swapchain_acquire_semaphore);
-        per_frame_data.swapchain_acquire_semaphore = nullptr;
+        LOGI("Frame path: {:.1f} us recording and {:.1f} us submitting per frame, {:.1f} us per submission, the device functions {}",
+             std::chrono::duration<double, std::micro>(cpu_timings.recording).count() / cpu_timings.frames,
+             std::chrono::duration<double, std::micro>(cpu_timings.submitting).count() / cpu_timings.frames,
+             std::chrono::duration<double, std::micro>(cpu_timings.submitting).count() / cpu_timings.submissions,
+             device_dispatch.is_through_loader() ? "called through the loader's trampolines" : "called directly");
+    }
+    render_graph.reset_cpu_timings();
+
+    // The time between frame starts, its deviation shows uneven pacing, with or without a target rate.
+    FramePacer::Statistics const pacing = frame_pacer.get_statistics();
+    LOGI("Frame pacing: {:.2f} ms mean frame time, {:.3f} ms standard deviation, {:.2f} to {:.2f} ms, {} dropped, {:.2f} ms slept and {:.2f} ms spun per frame",
+         pacing.mean,
+         std::sqrt(pacing.variance),
+         pacing.min,
+         pacing.max,
+         pacing.dropped,
+         pacing.frames ? pacing.slept / pacing.frames : 0.0,
+         pacing.frames ? pacing.spun / pacing.frames : 0.0);
+    frame_pacer.reset_statistics();
+
+    memory_budget.log_statistics();
+    if (!memory_stats_path.empty())
+    {
+        std::ofstream(memory_stats_path, std::ios::trunc) << memory_budget.to_json() << "\n";
     }
 
-    if (per_frame_data.swapchain_release_semaphore)
+    LOGI("Frame arenas: {:.1f} KiB used this frame, {:.1f} KiB reserved", frame_arenas.get_used_bytes() / 1024.0, frame_arenas.get_capacity() / 1024.0);
+    if (escaped_allocations)
     {
-        device.destroySemaphore(per_frame_data.swapchain_release_semaphore);
-        per_frame_data.swapchain_release_semaphore = nullptr;
+        LOGW("{} heap allocations in {} of the last {} frames, the frame path should only use the frame arenas.", escaped_allocations, allocating_frames, report_interval);
     }
+
+    escaped_allocations = 0;
+    allocating_frames   = 0;
 }
 
 std::unique_ptr<vkb::Application> create_loom_app()
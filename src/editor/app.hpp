@@ -3,86 +3,33 @@
 #define VKB_DEBUG
 
 #include <platform/application.h>
+#include <platform/input_events.h>
 
 #include <vulkan/vulkan.hpp>
 
-static uint32_t findMemoryType(vk::PhysicalDeviceMemoryProperties const& memoryProperties, uint32_t typeBits, vk::MemoryPropertyFlags requirementsMask)
-{
-    uint32_t typeIndex = uint32_t(~0);
-    for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++)
-    {
-        if ((typeBits & 1) && ((memoryProperties.memoryTypes[i].propertyFlags & requirementsMask) == requirementsMask))
-        {
-            typeIndex = i;
-            break;
-        }
-        typeBits >>= 1;
-    }
-    assert(typeIndex != uint32_t(~0));
-    return typeIndex;
-}
-
-class BufferData
-{
-public:
-    vk::Buffer                 buffer;
-    vk::DeviceMemory           deviceMemory;
-
-    static BufferData CreateBufferData(vk::PhysicalDevice const &physicalDevice,
-                          vk::Device const         &device,
-                          vk::DeviceSize            size,
-                          vk::BufferUsageFlags      usage,
-                          vk::MemoryPropertyFlags   propertyFlags = vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent)
-    {
-        BufferData bufferData;
-
-        vk::BufferCreateInfo bufferInfo{};
-        bufferInfo.size = size;
-        bufferInfo.usage = usage;
-        bufferInfo.sharingMode = vk::SharingMode::eExclusive;
-
-        if (device.createBuffer(&bufferInfo, nullptr, &bufferData.buffer) != vk::Result::eSuccess)
-        {
-            throw std::runtime_error("failed to create vertex buffer!");
-        }
-
-        // alloc gpu mem
-
-        vk::MemoryRequirements memRequirements;
-        device.getBufferMemoryRequirements(bufferData.buffer, &memRequirements);
-
-        vk::MemoryAllocateInfo allocInfo{};
-        allocInfo.allocationSize = memRequirements.size;
-        allocInfo.memoryTypeIndex = findMemoryType(physicalDevice.getMemoryProperties(), memRequirements.memoryTypeBits, propertyFlags);
-
-        if (device.allocateMemory(&allocInfo, nullptr, &bufferData.deviceMemory) != vk::Result::eSuccess)
-        {
-            throw std::runtime_error("failed to allocate buffer memory!");
-        }
-
-        device.bindBufferMemory(bufferData.buffer, bufferData.deviceMemory, 0);
-
-        return bufferData;
-    }
-
-    void clear(const vk::Device& device)
-    {
-        if (buffer)
-            device.destroyBuffer(buffer);
-
-        if (deviceMemory)
-            device.freeMemory(deviceMemory);
-    }
-
-    template <typename DataType>
-    void upload(const vk::Device& device, std::vector<DataType> const& data)
-    {
-        size_t size = sizeof(DataType) * data.size();
-        void* dataPtr = device.mapMemory(deviceMemory, 0, size);
-        memcpy(dataPtr, data.data(), (size_t)size);
-        device.unmapMemory(deviceMemory);
-    }
-};
+#include "editor/render_service.hpp"
+#include "editor/startup_timeline.hpp"
+#include "memory/frame_arena.hpp"
+#include "render/bindless_heap.hpp"
+#include "render/device_dispatch.hpp"
+#include "render/device_selection.hpp"
+#include "render/frame_capture.hpp"
+#include "render/frame_pacer.hpp"
+#include "render/frame_sync.hpp"
+#include "render/gpu_memory.hpp"
+#include "render/gpu_resources.hpp"
+#include "render/hiz_culling.hpp"
+#include "render/layout_cache.hpp"
+#include "render/pipeline_state_cache.hpp"
+#include "render/render_graph.hpp"
+#include "render/shader_reloader.hpp"
+#include "render/shader_variants.hpp"
+#include "render/texture_streamer.hpp"
+#include "render/transparent_queue.hpp"
+#include "render/vertex_layout.hpp"
+
+#include <string>
+#include <unordered_map>
 
 class LoomApplication : public vkb::Application
 {
@@ -91,17 +38,10 @@ class LoomApplication : public vkb::Application
         vk::Extent2D                 extent;                           // The swapchain extent
         vk::Format                   format = vk::Format::eUndefined;  // Pixel format of the swapchain.
         vk::SwapchainKHR             swapchain;                        // The swapchain.
+        std::vector<vk::Image>       images;                           // The swapchain images.
         std::vector<vk::ImageView>   image_views;                      // The image view for each swapchain image.
         std::vector<vk::Framebuffer> framebuffers;                     // The framebuffer for each swapchain image view.
-    };
-
-    struct FrameData
-    {
-        vk::Fence         queue_submit_fence;
-        vk::CommandPool   primary_command_pool;
-        vk::CommandBuffer primary_command_buffer;
-        vk::Semaphore     swapchain_acquire_semaphore;
-        vk::Semaphore     swapchain_release_semaphore;
+        std::vector<vk::Semaphore>   release_semaphores;               // Signaled when rendering to each image finished, waited on by presentation.
     };
 
    public:
@@ -113,38 +53,120 @@ class LoomApplication : public vkb::Application
     virtual bool prepare(const vkb::ApplicationOptions &options) override;
     virtual bool resize(const uint32_t width, const uint32_t height) override;
     virtual void update(float delta_time) override;
+    virtual void input_event(const vkb::InputEvent &input_event) override;
 
     std::pair<vk::Result, uint32_t> acquire_next_image();
+    vk::Pipeline                    build_pipeline_state(GraphicsPipelineState const &state);
+    void                            build_render_graph();
     vk::Device                      create_device(const std::vector<const char *> &required_device_extensions);
-    vk::Pipeline                    create_graphics_pipeline();
+    vk::Pipeline                    create_graphics_pipeline(std::vector<vk::ShaderModule> const &modules, std::vector<ShaderReflection> const &reflections,
+                                                             GraphicsPipelineState const &state);
     vk::ImageView                   create_image_view(vk::Image image);
     vk::Instance                    create_instance(std::vector<const char *> const &required_instance_extensions, std::vector<const char *> const &required_validation_layers);
-    vk::RenderPass                  create_render_pass();
-    vk::ShaderModule                create_shader_module(const char *path);
+    vk::RenderPass                  create_render_pass(bool resume);
+    vk::ShaderModule                create_shader_module(const char *path, VariantKey variant = 0);
     vk::SwapchainKHR                create_swapchain(vk::Extent2D const &swapchain_extent, vk::SurfaceFormatKHR surface_format, vk::SwapchainKHR old_swapchain);
+    void                            draw_frame();
+    uint32_t                        get_frame_device_mask() const;
+    uint32_t                        get_object_count() const;
+    uint32_t                        get_object_data_slots() const;
+    SceneView                       get_swapchain_view(uint32_t swapchain_index) const;
     void                            init_framebuffers();
     void                            init_swapchain();
+    bool                            is_job_scene_ready(RenderJob const &job);
+    void                            latch_input();
+    void                            record_scene_pass(vk::CommandBuffer cmd, SceneView const &view, bool resume);
     void                            render(uint32_t swapchain_index);
+    void                            report_statistics(uint64_t frame_allocations);
+    void                            resolve_pipelines();
     void                            select_physical_device_and_surface();
+    void                            serve_render_jobs();
     void                            teardown_framebuffers();
-    void                            teardown_per_frame(FrameData &per_frame_data);
+    void                            update_object_data();
+    void                            update_texture_streaming();
+    void                            write_object_data(uint32_t slot, TextureStreamer::TextureHandle texture);
 
    private:
-    vk::Instance               instance;               // The Vulkan instance.
-    vk::PhysicalDevice         gpu;                    // The Vulkan physical device.
-    vk::Device                 device;                 // The Vulkan device.
-    vk::Queue                  queue;                  // The Vulkan device queue.
-    SwapchainData              swapchain_data;         // The swapchain state.
-    vk::SurfaceKHR             surface;                // The surface we will render to.
-    uint32_t                   graphics_queue_index;   // The queue family index where graphics work will be submitted.
-    vk::RenderPass             render_pass;            // The renderpass description.
-    vk::PipelineLayout         pipeline_layout;        // The pipeline layout for resources.
-    vk::Pipeline               pipeline;               // The graphics pipeline.
-    BufferData                 mVertexBuffer;
-    BufferData                 mIndexBuffer;
-    vk::DebugUtilsMessengerEXT debug_utils_messenger;  // The debug utils messenger.
-    std::vector<vk::Semaphore> recycled_semaphores;    // A set of semaphores that can be reused.
-    std::vector<FrameData>     per_frame_data;         // A set of per-frame data.
+    vk::Instance                     instance;                                    // The Vulkan instance.
+    vk::PhysicalDevice               gpu;                                         // The Vulkan physical device.
+    vk::Device                       device;                                      // The Vulkan device.
+    DeviceDispatch                   device_dispatch;                             // The device functions the frames are recorded and submitted with.
+    std::vector<vk::PhysicalDevice>  device_group;                                // The physical devices of the device, the selected one first.
+    uint32_t                         frame_devices       = 1;                     // The devices of the group frames alternate between, LOOM_MULTI_GPU=afr.
+    GpuQueue                         graphics_queue;                              // The queue graphics work is submitted and presented on.
+    GpuQueue                         compute_queue;                               // A dedicated async compute queue, invalid if the device has none.
+    GpuQueue                         transfer_queue;                              // A dedicated transfer queue, invalid if the device has none.
+    SwapchainData                    swapchain_data;                              // The swapchain state.
+    vk::SurfaceKHR                   surface;                                     // The surface we will render to.
+    uint32_t                         graphics_queue_index;                        // The queue family index where graphics work will be submitted.
+    uint32_t                         compute_queue_index;                         // The queue family index of the async compute queue, or ~0u.
+    uint32_t                         transfer_queue_index;                        // The queue family index of the transfer queue, or ~0u.
+    vk::RenderPass                   render_pass;                                 // The renderpass clearing the attachments, used for the first culling phase, null with dynamic rendering.
+    vk::RenderPass                   render_pass_resume;                          // The renderpass continuing into the attachments after the late culling phase.
+    bool                             dynamic_rendering   = false;                 // Renders into the image views without render passes and framebuffers.
+    vk::Format                       color_format;                                // The format of the color attachment, the swapchain's.
+    vk::Format                       depth_format;                                // The format of the depth attachment.
+    uint32_t                         msaa_sample_count   = 4;                     // The MSAA samples requested, LOOM_MSAA overrides it.
+    vk::SampleCountFlagBits          msaa_samples;                                // The MSAA samples used, clamped to what the device supports.
+    vk::ResolveModeFlagBits          depth_resolve_mode;                          // How multisampled depth is resolved for the depth pyramid.
+    BindlessHeap                     bindless_heap;                               // All shader resources, addressed by index.
+    vk::PipelineLayout               pipeline_layout;                             // The pipeline layout of the bindless heap, owned by it.
+    vk::Pipeline                     pipeline;                                    // The graphics pipeline, used while the cache creates the one of a state.
+    vk::Pipeline                     transparent_pipeline;                        // Of transparent_state, used while the cache creates it, null without transparent objects.
+    PipelineStateCache               pipeline_states;                             // Creates the pipelines by state in the background.
+    vk::Pipeline                     frame_pipeline;                              // The pipelines the frame draws with, resolved once at its start.
+    vk::Pipeline                     frame_transparent_pipeline;
+    GraphicsPipelineState            scene_state;                                 // The state the scene is drawn with.
+    GraphicsPipelineState            transparent_state;                           // The scene's state with alpha blending and without depth writes.
+    LayoutCache                      layout_cache;                                // Deduplicates the layouts the shaders declare.
+    ShaderBundle                     shader_bundle;                               // The precompiled variants of all shaders.
+    ShaderReloader                   shader_reloader;                             // Rebuilds the pipelines when their shaders change.
+    uint32_t                         debug_view          = 0;                     // What the scene shows, see triangle.frag, LOOM_DEBUG_VIEW overrides it.
+    HandlePool<BufferData>           buffer_pool;                                 // Owns all buffers of the application, referenced by handle.
+    BufferHandle                     vertex_buffer;
+    BufferHandle                     index_buffer;
+    std::vector<BufferHandle>        object_data_buffers;                         // Per-object shader data of each frame slot, indexed by the draw's instance.
+    std::vector<BindlessHeap::Index> object_data_indices;                         // The bindless indices of the object data buffers.
+    std::vector<CullObject>          scene_objects;                               // The bounds and draws of the objects.
+    HiZCulling                       occlusion_culling;                           // Two-phase hierarchical-Z occlusion culling.
+    TransparentQueue                 transparent_queue;                           // Sorts the transparent objects from far to near, LOOM_TRANSPARENT_OBJECTS adds them.
+    std::vector<glm::vec4>           transparent_tints;                           // The tint of each transparent object, alpha is its opacity.
+    TextureStreamer                  texture_streamer;                            // Streams texture mips by screen-space demand.
+    TextureStreamer::TextureHandle   scene_texture       = ~0u;                   // The texture of the objects, ~0u if there is none.
+    vk::DeviceSize                   texture_budget      = 256ull * 1024 * 1024;  // The memory streamed textures may use, LOOM_TEXTURE_BUDGET_MB overrides it.
+    MemoryBudget                     memory_budget;                               // The device memory budget, the texture budget shrinks to stay within it.
+    bool                             has_memory_budget   = false;                 // Whether the driver reports the budget through VK_EXT_memory_budget.
+    std::string                      memory_stats_path;                           // LOOM_MEMORY_STATS names a file the memory statistics are written to as JSON.
+    std::string                      service_output;                              // LOOM_RENDER_SERVICE names the directory of the render service, empty for the window.
+    RenderService                    render_service;                              // Renders the jobs read from stdin instead of the frames.
+    std::string                      capture_output;                              // LOOM_CAPTURE names a directory the frames are captured into, empty for none.
+    FrameCapture                     frame_capture;                               // Reads the frames back and writes them as images.
+    glm::mat4                        view_proj{1.0f};                             // The geometry is authored in clip space for now, the camera only pans.
+    glm::vec2                        camera_pan{0.0f};                            // The pan of the camera in clip space, latched into view_proj.
+    glm::vec2                        pan_keys{0.0f};                              // The direction of the held arrow keys.
+    glm::vec2                        drag_delta{0.0f};                            // The cursor movement while dragging since the last latch, in pixels.
+    glm::vec2                        cursor{0.0f};
+    bool                             dragging            = false;
+    FramePacer                       frame_pacer;                                 // Paces the frames to LOOM_FRAME_RATE.
+    StartupTimeline                  startup;                                     // Times prepare and the first frame.
+    std::string                      startup_stats_path;                          // LOOM_STARTUP_STATS names a file the startup timeline is written to as JSON.
+    FramePacer::Clock::time_point    latch_time;                                  // When the input was last latched, held keys pan by the time since.
+    RenderGraph                      render_graph;                                // The passes of a frame, rebuilt when the swapchain changes.
+    RenderGraph::ResourceHandle      backbuffer_resource;                         // The swapchain image in the render graph.
+    RenderGraph::ResourceHandle      depth_resource;                              // The depth attachment in the render graph, the resolved one with MSAA.
+    RenderGraph::ResourceHandle      msaa_color_resource;                         // The multisampled color attachment, only with MSAA.
+    RenderGraph::ResourceHandle      msaa_depth_resource;                         // The multisampled depth attachment, only with MSAA.
+    GpuProfiler                      gpu_profiler;                                // Times the render graph passes on all queues.
+    vk::DebugUtilsMessengerEXT       debug_utils_messenger;                       // The debug utils messenger.
+    FrameSync                        frame_sync;                                  // Paces the frames in flight on the graphics timeline.
+    uint32_t                         frames_in_flight    = 2;                     // The number of frames the CPU may record ahead of the GPU.
+    FrameArenas                      frame_arenas;                                // Transient CPU data of the frames in flight, per thread.
+    uint32_t                         report_interval     = 300;                   // Frames between statistics reports.
+    uint64_t                         escaped_allocations = 0;                     // Heap allocations during the frames since the last report.
+    uint32_t                         allocating_frames   = 0;                     // Frames with heap allocations since the last report.
+
+    // The scenes of the render jobs by their files, ~0u if a file doesn't exist.
+    std::unordered_map<std::string, TextureStreamer::TextureHandle> job_textures;
 
 #if defined(VKB_DEBUG) || defined(VKB_VALIDATION_LAYERS)
     vk::DebugUtilsMessengerCreateInfoEXT debug_utils_create_info;
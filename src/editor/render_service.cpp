@@ -0,0 +1,469 @@
+﻿#include "editor/render_service.hpp"
+
+#include "render/image_encoding.hpp"
+
+#include <common/logging.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+namespace
+{
+// Jobs whose scene doesn't get ready, e.g. because its textures don't fit into the budget, are rendered anyway after this many updates.
+constexpr uint32_t max_scene_wait = 300;
+
+// Seconds between the throughput reports.
+constexpr double report_interval = 5.0;
+
+/**
+ * @brief Parses a job line, see RenderService.
+ * @returns Whether the line is a valid job.
+ */
+bool parse_job(std::string const &line, RenderJob &job)
+{
+    std::istringstream tokens(line);
+    std::string        token;
+    while (tokens >> token)
+    {
+        size_t const separator = token.find('=');
+        if (separator == std::string::npos)
+        {
+            return false;
+        }
+        std::string const key   = token.substr(0, separator);
+        std::string const value = token.substr(separator + 1);
+
+        if (key == "id")
+        {
+            job.id = value;
+        }
+        else if (key == "scene")
+        {
+            job.scene = value;
+        }
+        else if (key == "width" || key == "height")
+        {
+            uint32_t size = static_cast<uint32_t>(std::strtoul(value.c_str(), nullptr, 10));
+            (key == "width" ? job.extent.width : job.extent.height) = size;
+        }
+        else if (key == "camera")
+        {
+            std::istringstream values(value);
+            float             *elements = &job.view_proj[0][0];
+            for (uint32_t i = 0; i < 16; i++)
+            {
+                char comma = ',';
+                if (!(values >> elements[i]) || (i < 15 && !(values >> comma)) || comma != ',')
+                {
+                    return false;
+                }
+            }
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    // The id names the output file, it must not leave the output directory.
+    bool const safe_id = !job.id.empty() && job.id[0] != '.' && std::all_of(job.id.begin(), job.id.end(), [](char c) {
+        return std::isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '-' || c == '.';
+    });
+    return safe_id && job.extent.width > 0 && job.extent.height > 0 && job.extent.width <= 16384 && job.extent.height <= 16384;
+}
+
+vk::ImageMemoryBarrier transition(vk::Image image, vk::ImageAspectFlags aspect, vk::AccessFlags src_access, vk::AccessFlags dst_access, vk::ImageLayout old_layout,
+                                  vk::ImageLayout new_layout)
+{
+    return vk::ImageMemoryBarrier(src_access, dst_access, old_layout, new_layout, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, image, {aspect, 0, 1, 0, 1});
+}
+}  // namespace
+
+/**
+ * @brief Starts reading jobs from stdin and writing images.
+ * @param frame_arenas Switched to the frame slot with the frame sync, the recording of a batch allocates from them.
+ * @param format The attachments of the scene's pipelines, the color must be 8-bit RGBA or BGRA.
+ * @param output_dir The directory the images are written to, created if it doesn't exist.
+ */
+void RenderService::prepare(vk::PhysicalDevice gpu, vk::Device device, GpuQueue &queue, FrameSync &frame_sync, FrameArenas &frame_arenas, TargetFormat const &format,
+                            std::string const &output_dir)
+{
+    if (!is_png_encodable(format.color))
+    {
+        throw std::runtime_error("The render service needs an 8-bit RGBA or BGRA color format.");
+    }
+
+    this->gpu          = gpu;
+    this->device       = device;
+    this->queue        = &queue;
+    this->frame_sync   = &frame_sync;
+    this->frame_arenas = &frame_arenas;
+    this->format       = format;
+    this->output_dir   = output_dir;
+    std::filesystem::create_directories(output_dir);
+
+    batches.resize(frame_sync.get_frames_in_flight());
+    for (auto &batch : batches)
+    {
+        batch.command_pool = device.createCommandPool(vk::CommandPoolCreateInfo({}, queue.familyIndex));
+        batch.cmd          = device.allocateCommandBuffers(vk::CommandBufferAllocateInfo(batch.command_pool, vk::CommandBufferLevel::ePrimary, 1)).front();
+    }
+
+    // A blocking read can't be interrupted, so the reader is detached and shares the intake with the service.
+    intake = std::make_shared<Intake>();
+    std::thread([intake = intake] {
+        std::string line;
+        while (std::getline(std::cin, line))
+        {
+            std::lock_guard lock(intake->mutex);
+            intake->lines.push_back(std::move(line));
+        }
+        std::lock_guard lock(intake->mutex);
+        intake->closed = true;
+    }).detach();
+
+    writer      = std::thread(&RenderService::write_images, this);
+    report_time = std::chrono::steady_clock::now();
+    LOGI("Render service: reading jobs from stdin, writing images to {}.", output_dir);
+}
+
+/**
+ * @brief Writes the images of the completed jobs and releases everything. The device must be idle.
+ */
+void RenderService::destroy()
+{
+    if (batches.empty())
+    {
+        return;
+    }
+
+    for (auto &batch : batches)
+    {
+        if (batch.value)
+        {
+            collect(batch);
+        }
+        for (auto &target : batch.targets)
+        {
+            clear_target(target);
+        }
+        device.destroyCommandPool(batch.command_pool);
+    }
+    batches.clear();
+
+    {
+        std::lock_guard lock(writer_mutex);
+        stopping = true;
+    }
+    writer_signal.notify_one();
+    writer.join();
+}
+
+/**
+ * @brief Takes the new jobs, collects the images of completed batches and selects the jobs of the next batch.
+ * @param is_ready Whether the scene of a job is ready. Called every update until it is, which lets the
+ *                 scene stream in at the job's resolution.
+ */
+void RenderService::update(ReadyFunc const &is_ready)
+{
+    {
+        std::lock_guard lock(intake->mutex);
+        for (auto &line : intake->lines)
+        {
+            RenderJob job;
+            if (parse_job(line, job))
+            {
+                pending.push_back(std::move(job));
+            }
+            else if (!line.empty())
+            {
+                LOGE("Render service: invalid job \"{}\".", line);
+            }
+        }
+        intake->lines.clear();
+    }
+
+    uint64_t const completed_value = device.getSemaphoreCounterValue(queue->timeline);
+    for (auto &batch : batches)
+    {
+        if (batch.value && batch.value <= completed_value)
+        {
+            collect(batch);
+        }
+    }
+
+    next.clear();
+    for (auto job = pending.begin(); job != pending.end() && next.size() < max_batch;)
+    {
+        bool const ready = is_ready(*job) || ++job->waited > max_scene_wait;
+        if (ready && job->waited > max_scene_wait)
+        {
+            LOGW("Render service: the scene {} of job {} is not ready, rendering it anyway.", job->scene, job->id);
+        }
+
+        if (ready)
+        {
+            next.push_back(std::move(*job));
+            job = pending.erase(job);
+        }
+        else
+        {
+            ++job;
+        }
+    }
+
+    auto const   now     = std::chrono::steady_clock::now();
+    double const seconds = std::chrono::duration<double>(now - report_time).count();
+    if (seconds >= report_interval && completed != reported)
+    {
+        LOGI("Render service: {:.1f} jobs/s, {} jobs in {} batches completed, {} pending", (completed - reported) / seconds, completed, submitted, pending.size());
+        reported    = completed;
+        report_time = now;
+    }
+    else if (completed == reported)
+    {
+        report_time = now;
+    }
+}
+
+bool RenderService::has_batch() const
+{
+    return !next.empty();
+}
+
+/**
+ * @brief Renders the jobs of the next batch in one submission on the graphics queue.
+ *
+ * Called between FrameSync::begin_frame and end_frame, the batch belongs to the frame slot, whose
+ * previous batch has completed. The frame arenas must have begun the same frame slot.
+ * @param draw Records a scene pass of a job: phase one, and phase two with MSAA or when resume is set.
+ * @param resume Whether phase two draws, e.g. the transparent objects. With MSAA it is always recorded, it resolves the color.
+ * @param dependency_semaphore A timeline waited on before the fragment shaders, e.g. of texture uploads.
+ * @returns The graphics timeline value the batch signals.
+ */
+uint64_t RenderService::submit_batch(DrawFunc const &draw, bool resume, vk::Semaphore dependency_semaphore, uint64_t dependency_value)
+{
+    Batch &batch = batches[frame_sync->get_frame_index()];
+    if (batch.value)
+    {
+        collect(batch);
+    }
+    batch.jobs.swap(next);
+    next.clear();
+
+    device.resetCommandPool(batch.command_pool);
+    batch.cmd.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+
+    bool const multisampled = format.samples != vk::SampleCountFlagBits::e1;
+
+    // The previous contents are discarded, the barriers only order against the previous batch of the slot.
+    // Up to four attachments per job, reserved so the arena isn't left with the storage of a regrowth.
+    LinearArena                         &arena = frame_arenas->get_thread_arena();
+    ArenaVector<vk::ImageMemoryBarrier> barriers{ArenaAllocator<vk::ImageMemoryBarrier>(arena)};
+    ArenaVector<SceneView>              views(batch.jobs.size(), ArenaAllocator<SceneView>(arena));
+    barriers.reserve(batch.jobs.size() * 4);
+    for (uint32_t i = 0; i < batch.jobs.size(); i++)
+    {
+        Target &target = batch.targets[i];
+        prepare_target(target, batch.jobs[i].extent);
+
+        for (ImageData const *image : {&target.color, &target.msaa_color})
+        {
+            if (image->image)
+            {
+                barriers.push_back(transition(image->image, vk::ImageAspectFlagBits::eColor, vk::AccessFlagBits::eColorAttachmentWrite,
+                                              vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eColorAttachmentWrite, vk::ImageLayout::eUndefined,
+                                              vk::ImageLayout::eColorAttachmentOptimal));
+            }
+        }
+        for (ImageData const *image : {&target.depth, &target.msaa_depth})
+        {
+            if (image->image)
+            {
+                barriers.push_back(transition(image->image, vk::ImageAspectFlagBits::eDepth, vk::AccessFlagBits::eDepthStencilAttachmentWrite,
+                                              vk::AccessFlagBits::eDepthStencilAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentWrite, vk::ImageLayout::eUndefined,
+                                              vk::ImageLayout::eDepthStencilAttachmentOptimal));
+            }
+        }
+
+        views[i].extent      = batch.jobs[i].extent;
+        views[i].color       = target.color.view;
+        views[i].depth       = target.depth.view;
+        views[i].msaa_color  = target.msaa_color.view;
+        views[i].msaa_depth  = target.msaa_depth.view;
+        views[i].framebuffer = target.framebuffer;
+        views[i].view_proj   = batch.jobs[i].view_proj;
+        views[i].culled      = false;
+    }
+
+    vk::PipelineStageFlags const attachment_stages =
+        vk::PipelineStageFlagBits::eColorAttachmentOutput | vk::PipelineStageFlagBits::eEarlyFragmentTests | vk::PipelineStageFlagBits::eLateFragmentTests;
+    batch.cmd.pipelineBarrier(attachment_stages | vk::PipelineStageFlagBits::eTransfer, attachment_stages, {}, {}, {}, barriers);
+
+    for (uint32_t i = 0; i < batch.jobs.size(); i++)
+    {
+        draw(batch.cmd, views[i], batch.jobs[i], i, false);
+    }
+
+    // Phase two continues into the attachments of phase one, it draws what comes after the opaque objects
+    // and resolves the multisampled color.
+    if (resume || multisampled)
+    {
+        vk::MemoryBarrier phase_barrier(vk::AccessFlagBits::eColorAttachmentWrite | vk::AccessFlagBits::eDepthStencilAttachmentWrite,
+                                        vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eColorAttachmentWrite |
+                                            vk::AccessFlagBits::eDepthStencilAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentWrite);
+        batch.cmd.pipelineBarrier(attachment_stages, attachment_stages, {}, phase_barrier, {}, {});
+
+        for (uint32_t i = 0; i < batch.jobs.size(); i++)
+        {
+            draw(batch.cmd, views[i], batch.jobs[i], i, true);
+        }
+    }
+
+    barriers.clear();
+    for (uint32_t i = 0; i < batch.jobs.size(); i++)
+    {
+        barriers.push_back(transition(batch.targets[i].color.image, vk::ImageAspectFlagBits::eColor, vk::AccessFlagBits::eColorAttachmentWrite,
+                                      vk::AccessFlagBits::eTransferRead, vk::ImageLayout::eColorAttachmentOptimal, vk::ImageLayout::eTransferSrcOptimal));
+    }
+    batch.cmd.pipelineBarrier(vk::PipelineStageFlagBits::eColorAttachmentOutput, vk::PipelineStageFlagBits::eTransfer, {}, {}, {}, barriers);
+
+    for (uint32_t i = 0; i < batch.jobs.size(); i++)
+    {
+        Target const &target = batch.targets[i];
+        vk::BufferImageCopy region(0, 0, 0, {vk::ImageAspectFlagBits::eColor, 0, 0, 1}, {0, 0, 0}, vk::Extent3D(target.color.extent, 1));
+        batch.cmd.copyImageToBuffer(target.color.image, vk::ImageLayout::eTransferSrcOptimal, target.readback.buffer, region);
+    }
+
+    vk::MemoryBarrier host_barrier(vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eHostRead);
+    batch.cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eHost, {}, host_barrier, {}, {});
+    batch.cmd.end();
+
+    batch.value = queue->next_value();
+
+    vk::PipelineStageFlags          wait_stage = vk::PipelineStageFlagBits::eFragmentShader;
+    uint32_t const                  wait_count = dependency_semaphore ? 1 : 0;
+    vk::TimelineSemaphoreSubmitInfo timeline_info(wait_count, &dependency_value, 1, &batch.value);
+    vk::SubmitInfo                  submit_info(wait_count, &dependency_semaphore, &wait_stage, 1, &batch.cmd, 1, &queue->timeline, &timeline_info);
+    queue->queue.submit(submit_info);
+
+    submitted++;
+    return batch.value;
+}
+
+/**
+ * @returns Whether stdin was closed and all jobs were rendered. Their images may still be written.
+ */
+bool RenderService::is_finished() const
+{
+    std::lock_guard lock(intake->mutex);
+    return intake->closed && intake->lines.empty() && pending.empty() && next.empty() &&
+           std::none_of(batches.begin(), batches.end(), [](Batch const &batch) { return batch.value != 0; });
+}
+
+/**
+ * @brief Hands the images of a completed batch to the writer.
+ */
+void RenderService::collect(Batch &batch)
+{
+    for (uint32_t i = 0; i < batch.jobs.size(); i++)
+    {
+        RenderJob const   &job    = batch.jobs[i];
+        size_t const       size   = size_t(job.extent.width) * job.extent.height * 4;
+        std::span<uint8_t> pixels = batch.targets[i].readback.view<uint8_t>(0, size);
+
+        Image image{(std::filesystem::path(output_dir) / (job.id + ".png")).string(), job.extent, std::vector<uint8_t>(pixels.begin(), pixels.end())};
+        {
+            std::lock_guard lock(writer_mutex);
+            images.push_back(std::move(image));
+        }
+        writer_signal.notify_one();
+    }
+
+    completed += batch.jobs.size();
+    batch.jobs.clear();
+    batch.value = 0;
+}
+
+/**
+ * @brief Creates the attachments and the readback buffer of a target, unless they already have the extent.
+ */
+void RenderService::prepare_target(Target &target, vk::Extent2D const &extent)
+{
+    if (target.color.image && target.color.extent == extent)
+    {
+        return;
+    }
+    clear_target(target);
+
+    target.color = ImageData::CreateImageData(gpu, device, MemoryCategory::eRenderTargets, format.color, extent, 1,
+                                              vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransferSrc, vk::ImageAspectFlagBits::eColor);
+    target.depth = ImageData::CreateImageData(gpu, device, MemoryCategory::eRenderTargets, format.depth, extent, 1, vk::ImageUsageFlagBits::eDepthStencilAttachment,
+                                              vk::ImageAspectFlagBits::eDepth);
+
+    std::vector<vk::ImageView> attachments = {target.color.view, target.depth.view};
+    if (format.samples != vk::SampleCountFlagBits::e1)
+    {
+        target.msaa_color = ImageData::CreateImageData(gpu, device, MemoryCategory::eRenderTargets, format.color, extent, 1,
+                                                       vk::ImageUsageFlagBits::eColorAttachment,
+                                                       vk::ImageAspectFlagBits::eColor, vk::MemoryPropertyFlagBits::eDeviceLocal, {}, format.samples);
+        target.msaa_depth = ImageData::CreateImageData(gpu, device, MemoryCategory::eRenderTargets, format.depth, extent, 1,
+                                                       vk::ImageUsageFlagBits::eDepthStencilAttachment,
+                                                       vk::ImageAspectFlagBits::eDepth, vk::MemoryPropertyFlagBits::eDeviceLocal, {}, format.samples);
+        attachments = {target.msaa_color.view, target.msaa_depth.view, target.color.view, target.depth.view};
+    }
+
+    if (format.render_pass)
+    {
+        target.framebuffer = device.createFramebuffer(vk::FramebufferCreateInfo({}, format.render_pass, attachments, extent.width, extent.height, 1));
+    }
+
+    target.readback = BufferData::CreateBufferData(gpu, device, MemoryCategory::eStaging, vk::DeviceSize(extent.width) * extent.height * 4,
+                                                   vk::BufferUsageFlagBits::eTransferDst);
+}
+
+void RenderService::clear_target(Target &target)
+{
+    if (target.framebuffer)
+    {
+        device.destroyFramebuffer(target.framebuffer);
+    }
+    target.color.clear(device);
+    target.depth.clear(device);
+    target.msaa_color.clear(device);
+    target.msaa_depth.clear(device);
+    target.readback.clear(device);
+    target.framebuffer = nullptr;
+}
+
+/**
+ * @brief The writer thread, encodes the collected images and writes them until the service stops.
+ */
+void RenderService::write_images()
+{
+    std::unique_lock lock(writer_mutex);
+    while (true)
+    {
+        writer_signal.wait(lock, [this] { return stopping || !images.empty(); });
+        if (images.empty())
+        {
+            return;
+        }
+
+        Image image = std::move(images.front());
+        images.pop_front();
+        lock.unlock();
+
+        if (!write_file_atomically(image.path, encode_png(format.color, image.extent, image.pixels.data(), image.pixels.size())))
+        {
+            LOGE("Render service: failed to write {}", image.path);
+        }
+
+        lock.lock();
+    }
+}
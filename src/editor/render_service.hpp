@@ -0,0 +1,146 @@
+﻿#pragma once
+
+#include "memory/frame_arena.hpp"
+#include "render/frame_sync.hpp"
+#include "render/gpu_resources.hpp"
+
+#include <glm/glm.hpp>
+#include <vulkan/vulkan.hpp>
+
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/// @brief A preview image to render.
+struct RenderJob
+{
+    std::string  id;                        // Names the image, which is written as <output>/<id>.png.
+    std::string  scene;                     // The scene file. For now the objects are drawn with it as their texture.
+    glm::mat4    view_proj{1.0f};           // The camera.
+    vk::Extent2D extent{256, 256};
+    uint32_t     waited = 0;                // The updates the job waited for its scene.
+};
+
+/// @brief The attachments a scene pass renders into, and how it draws.
+struct SceneView
+{
+    vk::Extent2D    extent;
+    vk::ImageView   color;                  // Written by the resolve with MSAA.
+    vk::ImageView   depth;                  // Written by the resolve with MSAA, the depth pyramid is built from it.
+    vk::ImageView   msaa_color;             // The multisampled attachments, only with MSAA.
+    vk::ImageView   msaa_depth;
+    vk::Framebuffer framebuffer;            // The attachments in the order of the render passes, null with dynamic rendering.
+    glm::mat4       view_proj{1.0f};
+    uint32_t        object_buffer = 0;      // The bindless index of the object data.
+    bool            culled        = true;   // The draws come from occlusion culling, otherwise phase one draws every object.
+};
+
+/**
+ * @brief Renders preview images for jobs read from stdin, while the device, the pipelines and the textures stay warm.
+ *
+ * Every line on stdin is a job of space-separated key=value pairs, all but the id are optional:
+ *
+ *     id=chair scene=assets/textures/loom.ktx2 width=256 height=256 camera=<16 comma-separated floats, column-major>
+ *
+ * A job waits until its scene is ready, then up to max_batch jobs are recorded into one submission.
+ * Each job renders into offscreen attachments of its resolution, which are copied into a host-visible
+ * readback buffer. Submitted batches are polled on the graphics timeline. The images of completed
+ * batches are encoded and written on a worker thread, and renamed into place once complete, so
+ * whoever watches the output directory never sees a partial file.
+ */
+class RenderService
+{
+public:
+    static constexpr uint32_t max_batch = 8;
+
+    /// @brief What the scene's pipelines render into, the offscreen attachments match it.
+    struct TargetFormat
+    {
+        vk::Format              color;
+        vk::Format              depth;
+        vk::SampleCountFlagBits samples;
+        vk::RenderPass          render_pass;  // The framebuffers are created for it, null with dynamic rendering.
+    };
+
+    using ReadyFunc = std::function<bool(RenderJob const &job)>;
+    using DrawFunc  = std::function<void(vk::CommandBuffer cmd, SceneView const &view, RenderJob const &job, uint32_t job_index, bool resume)>;
+
+    void prepare(vk::PhysicalDevice gpu, vk::Device device, GpuQueue &queue, FrameSync &frame_sync, FrameArenas &frame_arenas, TargetFormat const &format,
+                 std::string const &output_dir);
+    void destroy();
+
+    void     update(ReadyFunc const &is_ready);
+    bool     has_batch() const;
+    uint64_t submit_batch(DrawFunc const &draw, bool resume, vk::Semaphore dependency_semaphore, uint64_t dependency_value);
+    bool     is_finished() const;
+
+private:
+    struct Target
+    {
+        ImageData       color;
+        ImageData       depth;
+        ImageData       msaa_color;
+        ImageData       msaa_depth;
+        vk::Framebuffer framebuffer;
+        BufferData      readback;
+    };
+
+    /// @brief The batch of a frame slot, its targets are reused by the next batch of the slot.
+    struct Batch
+    {
+        std::vector<RenderJob>        jobs;
+        std::array<Target, max_batch> targets;
+        vk::CommandPool               command_pool;
+        vk::CommandBuffer             cmd;
+        uint64_t                      value = 0;  // The timeline value the batch signals, 0 once its images were collected.
+    };
+
+    /// @brief The lines read from stdin, shared with the reader thread, which may outlive the service blocked in a read.
+    struct Intake
+    {
+        std::mutex              mutex;
+        std::deque<std::string> lines;
+        bool                    closed = false;
+    };
+
+    struct Image
+    {
+        std::string          path;
+        vk::Extent2D         extent;
+        std::vector<uint8_t> pixels;
+    };
+
+    void collect(Batch &batch);
+    void prepare_target(Target &target, vk::Extent2D const &extent);
+    void clear_target(Target &target);
+    void write_images();
+
+private:
+    vk::PhysicalDevice                    gpu;
+    vk::Device                            device;
+    GpuQueue                             *queue      = nullptr;
+    FrameSync                            *frame_sync   = nullptr;
+    FrameArenas                          *frame_arenas = nullptr;       // The transient data of a batch lives in them.
+    TargetFormat                          format;
+    std::string                           output_dir;
+    std::shared_ptr<Intake>               intake;
+    std::deque<RenderJob>                 pending;               // Jobs waiting for their scene, in arrival order.
+    std::vector<RenderJob>                next;                  // The jobs of the next batch, their scenes are ready.
+    std::vector<Batch>                    batches;               // Indexed by frame slot.
+    std::thread                           writer;
+    std::mutex                            writer_mutex;
+    std::condition_variable               writer_signal;
+    std::deque<Image>                     images;                // Waiting for the writer.
+    bool                                  stopping   = false;
+    uint64_t                              completed  = 0;        // The jobs whose images were collected.
+    uint64_t                              submitted  = 0;        // The batches submitted.
+    uint64_t                              reported   = 0;        // The completed jobs at the last report.
+    std::chrono::steady_clock::time_point report_time;
+};
@@ -0,0 +1,98 @@
+﻿#include "editor/startup_timeline.hpp"
+
+#include <common/logging.h>
+
+#include <algorithm>
+#include <fstream>
+
+namespace
+{
+double to_milliseconds(std::chrono::steady_clock::duration duration)
+{
+    return std::chrono::duration<double, std::milli>(duration).count();
+}
+}  // namespace
+
+StartupTimeline::StartupTimeline() :
+    creation(Clock::now()), last_mark(creation)
+{
+}
+
+/**
+ * @brief Ends the current stage of the calling thread, the next one begins.
+ */
+void StartupTimeline::mark(std::string name)
+{
+    Clock::time_point const now = Clock::now();
+    add(std::move(name), last_mark, now, false);
+    last_mark = now;
+}
+
+/**
+ * @brief Runs a stage on a thread of its own.
+ * @returns The future to wait for the stage with, it rethrows what the stage threw.
+ */
+std::future<void> StartupTimeline::start(std::string name, std::function<void()> work)
+{
+    return std::async(std::launch::async, [this, name = std::move(name), work = std::move(work)]() mutable {
+        Clock::time_point const begin = Clock::now();
+        work();
+        add(std::move(name), begin, Clock::now(), true);
+    });
+}
+
+/**
+ * @brief Logs the stages and the time to the first frame. Call once the first frame was presented,
+ *        after all concurrent stages were waited for.
+ * @param stats_path The file the timeline is written to as JSON, empty for none.
+ */
+void StartupTimeline::finish(std::string const &stats_path)
+{
+    Clock::duration const first_frame = Clock::now() - creation;
+    finished                          = true;
+
+    std::lock_guard lock(mutex);
+    std::sort(stages.begin(), stages.end(), [](Stage const &a, Stage const &b) { return a.begin < b.begin; });
+
+    LOGI("Startup: {:.1f} ms to the first frame", to_milliseconds(first_frame));
+    for (auto const &stage : stages)
+    {
+        LOGI("  {:8.1f} - {:8.1f} ms  {}{}", to_milliseconds(stage.begin), to_milliseconds(stage.end), stage.name, stage.concurrent ? " (concurrent)" : "");
+    }
+
+    if (!stats_path.empty())
+    {
+        std::ofstream(stats_path, std::ios::trunc) << to_json(first_frame) << "\n";
+    }
+}
+
+bool StartupTimeline::is_finished() const
+{
+    return finished;
+}
+
+void StartupTimeline::add(std::string name, Clock::time_point begin, Clock::time_point end, bool concurrent)
+{
+    std::lock_guard lock(mutex);
+    stages.push_back({std::move(name), begin - creation, end - creation, concurrent});
+}
+
+std::string StartupTimeline::to_json(Clock::duration first_frame) const
+{
+    std::string json = "{\"first_frame_ms\":" + std::to_string(to_milliseconds(first_frame));
+
+    json += ",\"stages\":[";
+    for (size_t i = 0; i < stages.size(); i++)
+    {
+        Stage const &stage = stages[i];
+        json += i ? ",{" : "{";
+        json += "\"name\":\"" + stage.name + "\"";
+        json += ",\"begin_ms\":" + std::to_string(to_milliseconds(stage.begin));
+        json += ",\"end_ms\":" + std::to_string(to_milliseconds(stage.end));
+        json += ",\"concurrent\":";
+        json += stage.concurrent ? "true}" : "false}";
+    }
+    json += "]}";
+
+    return json;
+}
@@ -0,0 +1,51 @@
+﻿#pragma once
+
+#include <chrono>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Times the startup of the application by stage, up to the first frame.
+ *
+ * The stages of the calling thread follow each other, mark() ends the current one. Stages which don't
+ * depend on it run concurrently: start() runs one on a thread of its own, and the stage needing its
+ * result waits for the returned future, which rethrows what the stage threw. The future also waits when
+ * it is destroyed, so a stage may reference the locals of the scope that started it.
+ *
+ * finish() logs when every stage began and ended since the timeline was created, and the time to the
+ * first frame. The same timeline is written as JSON, to compare startups across changes.
+ */
+class StartupTimeline
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    StartupTimeline();
+
+    void              mark(std::string name);
+    std::future<void> start(std::string name, std::function<void()> work);
+    void              finish(std::string const &stats_path);
+    bool              is_finished() const;
+
+private:
+    struct Stage
+    {
+        std::string     name;
+        Clock::duration begin{};        // Since the timeline was created.
+        Clock::duration end{};
+        bool            concurrent = false;
+    };
+
+    void        add(std::string name, Clock::time_point begin, Clock::time_point end, bool concurrent);
+    std::string to_json(Clock::duration first_frame) const;
+
+private:
+    Clock::time_point  creation;
+    Clock::time_point  last_mark;                 // The begin of the current stage of the calling thread.
+    std::mutex         mutex;                     // Guards the stages, concurrent ones are added from their threads.
+    std::vector<Stage> stages;
+    bool               finished = false;
+};
@@ -0,0 +1,713 @@
+﻿#include "math/simd_math.hpp"
+
+#include <cmath>
+#include <cstring>
+
+#if defined(LOOM_SIMD_SSE4)
+#    include <immintrin.h>
+#endif
+
+namespace math
+{
+static_assert(sizeof(Mat4) == sizeof(glm::mat4), "Mat4 must match the layout of glm::mat4.");
+
+namespace
+{
+float get(Vec4 const &v, int i)
+{
+    return (&v.x)[i];
+}
+
+#if !defined(LOOM_SIMD_SSE4)
+float &get(Vec4 &v, int i)
+{
+    return (&v.x)[i];
+}
+
+Mat4 multiply_scalar(Mat4 const &a, Mat4 const &b)
+{
+    Mat4 out;
+    for (int c = 0; c < 4; c++)
+    {
+        for (int r = 0; r < 4; r++)
+        {
+            get(out.columns[c], r) = get(a.columns[0], r) * b.columns[c].x + get(a.columns[1], r) * b.columns[c].y + get(a.columns[2], r) * b.columns[c].z +
+                                     get(a.columns[3], r) * b.columns[c].w;
+        }
+    }
+    return out;
+}
+
+/**
+ * @brief The inverse by cofactors. It works on either storage order, since inverting the transpose gives the transposed inverse.
+ */
+Mat4 inverse_scalar(Mat4 const &matrix)
+{
+    float const *m = &matrix.columns[0].x;
+    float        inv[16];
+
+    inv[0]  = m[5] * m[10] * m[15] - m[5] * m[11] * m[14] - m[9] * m[6] * m[15] + m[9] * m[7] * m[14] + m[13] * m[6] * m[11] - m[13] * m[7] * m[10];
+    inv[4]  = -m[4] * m[10] * m[15] + m[4] * m[11] * m[14] + m[8] * m[6] * m[15] - m[8] * m[7] * m[14] - m[12] * m[6] * m[11] + m[12] * m[7] * m[10];
+    inv[8]  = m[4] * m[9] * m[15] - m[4] * m[11] * m[13] - m[8] * m[5] * m[15] + m[8] * m[7] * m[13] + m[12] * m[5] * m[11] - m[12] * m[7] * m[9];
+    inv[12] = -m[4] * m[9] * m[14] + m[4] * m[10] * m[13] + m[8] * m[5] * m[14] - m[8] * m[6] * m[13] - m[12] * m[5] * m[10] + m[12] * m[6] * m[9];
+    inv[1]  = -m[1] * m[10] * m[15] + m[1] * m[11] * m[14] + m[9] * m[2] * m[15] - m[9] * m[3] * m[14] - m[13] * m[2] * m[11] + m[13] * m[3] * m[10];
+    inv[5]  = m[0] * m[10] * m[15] - m[0] * m[11] * m[14] - m[8] * m[2] * m[15] + m[8] * m[3] * m[14] + m[12] * m[2] * m[11] - m[12] * m[3] * m[10];
+    inv[9]  = -m[0] * m[9] * m[15] + m[0] * m[11] * m[13] + m[8] * m[1] * m[15] - m[8] * m[3] * m[13] - m[12] * m[1] * m[11] + m[12] * m[3] * m[9];
+    inv[13] = m[0] * m[9] * m[14] - m[0] * m[10] * m[13] - m[8] * m[1] * m[14] + m[8] * m[2] * m[13] + m[12] * m[1] * m[10] - m[12] * m[2] * m[9];
+    inv[2]  = m[1] * m[6] * m[15] - m[1] * m[7] * m[14] - m[5] * m[2] * m[15] + m[5] * m[3] * m[14] + m[13] * m[2] * m[7] - m[13] * m[3] * m[6];
+    inv[6]  = -m[0] * m[6] * m[15] + m[0] * m[7] * m[14] + m[4] * m[2] * m[15] - m[4] * m[3] * m[14] - m[12] * m[2] * m[7] + m[12] * m[3] * m[6];
+    inv[10] = m[0] * m[5] * m[15] - m[0] * m[7] * m[13] - m[4] * m[1] * m[15] + m[4] * m[3] * m[13] + m[12] * m[1] * m[7] - m[12] * m[3] * m[5];
+    inv[14] = -m[0] * m[5] * m[14] + m[0] * m[6] * m[13] + m[4] * m[1] * m[14] - m[4] * m[2] * m[13] - m[12] * m[1] * m[6] + m[12] * m[2] * m[5];
+    inv[3]  = -m[1] * m[6] * m[11] + m[1] * m[7] * m[10] + m[5] * m[2] * m[11] - m[5] * m[3] * m[10] - m[9] * m[2] * m[7] + m[9] * m[3] * m[6];
+    inv[7]  = m[0] * m[6] * m[11] - m[0] * m[7] * m[10] - m[4] * m[2] * m[11] + m[4] * m[3] * m[10] + m[8] * m[2] * m[7] - m[8] * m[3] * m[6];
+    inv[11] = -m[0] * m[5] * m[11] + m[0] * m[7] * m[9] + m[4] * m[1] * m[11] - m[4] * m[3] * m[9] - m[8] * m[1] * m[7] + m[8] * m[3] * m[5];
+    inv[15] = m[0] * m[5] * m[10] - m[0] * m[6] * m[9] - m[4] * m[1] * m[10] + m[4] * m[2] * m[9] + m[8] * m[1] * m[6] - m[8] * m[2] * m[5];
+
+    float inv_det = 1.0f / (m[0] * inv[0] + m[1] * inv[4] + m[2] * inv[8] + m[3] * inv[12]);
+
+    Mat4 out;
+    for (int i = 0; i < 16; i++)
+    {
+        (&out.columns[0].x)[i] = inv[i] * inv_det;
+    }
+    return out;
+}
+
+#endif
+
+/**
+ * @brief Writes one TRS transform, shared by the single and batch versions for the leftover elements.
+ */
+Mat4 compose_trs_scalar(float tx, float ty, float tz, float qx, float qy, float qz, float qw, float sx, float sy, float sz)
+{
+    float xx = qx * qx, yy = qy * qy, zz = qz * qz;
+    float xy = qx * qy, xz = qx * qz, yz = qy * qz;
+    float wx = qw * qx, wy = qw * qy, wz = qw * qz;
+
+    Mat4 out;
+    out.columns[0] = {(1.0f - 2.0f * (yy + zz)) * sx, 2.0f * (xy + wz) * sx, 2.0f * (xz - wy) * sx, 0.0f};
+    out.columns[1] = {2.0f * (xy - wz) * sy, (1.0f - 2.0f * (xx + zz)) * sy, 2.0f * (yz + wx) * sy, 0.0f};
+    out.columns[2] = {2.0f * (xz + wy) * sz, 2.0f * (yz - wx) * sz, (1.0f - 2.0f * (xx + yy)) * sz, 0.0f};
+    out.columns[3] = {tx, ty, tz, 1.0f};
+    return out;
+}
+
+/**
+ * @brief Transforms the center and the extent, the extent by the absolute of the upper 3x3 (Arvo).
+ */
+void transform_aabb_scalar(Mat4 const &m, float const *min, float const *max, float *out_min, float *out_max)
+{
+    float center[3], extent[3];
+    for (int i = 0; i < 3; i++)
+    {
+        center[i] = (min[i] + max[i]) * 0.5f;
+        extent[i] = (max[i] - min[i]) * 0.5f;
+    }
+
+    for (int r = 0; r < 3; r++)
+    {
+        float c = get(m.columns[3], r);
+        float e = 0.0f;
+        for (int i = 0; i < 3; i++)
+        {
+            c += get(m.columns[i], r) * center[i];
+            e += std::fabs(get(m.columns[i], r)) * extent[i];
+        }
+        out_min[r] = c - e;
+        out_max[r] = c + e;
+    }
+}
+
+/**
+ * @brief The key of a point at a depth, which sorts ascending from the farthest to the nearest point.
+ *
+ * Flipping the sign bit of positive floats and all bits of negative ones orders their bits like the
+ * floats, inverting that orders them from far to near. The index breaks ties and finds the point again.
+ */
+uint64_t depth_sort_key_scalar(float depth, uint32_t index)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &depth, sizeof(bits));
+    uint32_t const ordered = bits ^ ((bits & 0x80000000u) ? 0xffffffffu : 0x80000000u);
+    return (static_cast<uint64_t>(~ordered) << 32) | index;
+}
+
+#if defined(LOOM_SIMD_SSE4)
+__m128 load(Vec4 const &v)
+{
+    return _mm_load_ps(&v.x);
+}
+
+void store(Vec4 &v, __m128 value)
+{
+    _mm_store_ps(&v.x, value);
+}
+
+__m128 madd(__m128 a, __m128 b, __m128 c)
+{
+#    if defined(LOOM_SIMD_AVX2)
+    return _mm_fmadd_ps(a, b, c);
+#    else
+    return _mm_add_ps(_mm_mul_ps(a, b), c);
+#    endif
+}
+
+template <int I>
+__m128 splat(__m128 v)
+{
+    return _mm_shuffle_ps(v, v, _MM_SHUFFLE(I, I, I, I));
+}
+
+/// @returns The linear combination of the columns of m by the components of v.
+__m128 combine(Mat4 const &m, __m128 v)
+{
+    __m128 r = _mm_mul_ps(load(m.columns[0]), splat<0>(v));
+    r        = madd(load(m.columns[1]), splat<1>(v), r);
+    r        = madd(load(m.columns[2]), splat<2>(v), r);
+    return madd(load(m.columns[3]), splat<3>(v), r);
+}
+
+Mat4 multiply_sse(Mat4 const &a, Mat4 const &b)
+{
+    Mat4 out;
+    for (int c = 0; c < 4; c++)
+    {
+        store(out.columns[c], combine(a, load(b.columns[c])));
+    }
+    return out;
+}
+
+// 2x2 blocks of the matrix, stored as (m00, m01, m10, m11).
+__m128 mat2_mul(__m128 a, __m128 b)
+{
+    return _mm_add_ps(_mm_mul_ps(a, _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 3, 0))), _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1)), _mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 2, 1, 2))));
+}
+
+// The adjugate of a, times b.
+__m128 mat2_adj_mul(__m128 a, __m128 b)
+{
+    return _mm_sub_ps(_mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(0, 0, 3, 3)), b), _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 2, 1, 1)), _mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 0, 3, 2))));
+}
+
+// a times the adjugate of b.
+__m128 mat2_mul_adj(__m128 a, __m128 b)
+{
+    return _mm_sub_ps(_mm_mul_ps(a, _mm_shuffle_ps(b, b, _MM_SHUFFLE(0, 3, 0, 3))), _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1)), _mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 2, 1, 2))));
+}
+
+/**
+ * @brief The inverse by 2x2 blocks. Like the scalar version, it doesn't matter that the columns are treated as rows.
+ */
+Mat4 inverse_sse(Mat4 const &m)
+{
+    __m128 c0 = load(m.columns[0]);
+    __m128 c1 = load(m.columns[1]);
+    __m128 c2 = load(m.columns[2]);
+    __m128 c3 = load(m.columns[3]);
+
+    __m128 a = _mm_movelh_ps(c0, c1);
+    __m128 b = _mm_movehl_ps(c1, c0);
+    __m128 c = _mm_movelh_ps(c2, c3);
+    __m128 d = _mm_movehl_ps(c3, c2);
+
+    // The determinants of the blocks as (|a|, |b|, |c|, |d|).
+    __m128 det_sub = _mm_sub_ps(_mm_mul_ps(_mm_shuffle_ps(c0, c2, _MM_SHUFFLE(2, 0, 2, 0)), _mm_shuffle_ps(c1, c3, _MM_SHUFFLE(3, 1, 3, 1))),
+                                _mm_mul_ps(_mm_shuffle_ps(c0, c2, _MM_SHUFFLE(3, 1, 3, 1)), _mm_shuffle_ps(c1, c3, _MM_SHUFFLE(2, 0, 2, 0))));
+    __m128 det_a   = splat<0>(det_sub);
+    __m128 det_b   = splat<1>(det_sub);
+    __m128 det_c   = splat<2>(det_sub);
+    __m128 det_d   = splat<3>(det_sub);
+
+    __m128 d_c = mat2_adj_mul(d, c);
+    __m128 a_b = mat2_adj_mul(a, b);
+    __m128 x   = _mm_sub_ps(_mm_mul_ps(det_d, a), mat2_mul(b, d_c));
+    __m128 w   = _mm_sub_ps(_mm_mul_ps(det_a, d), mat2_mul(c, a_b));
+    __m128 y   = _mm_sub_ps(_mm_mul_ps(det_b, c), mat2_mul_adj(d, a_b));
+    __m128 z   = _mm_sub_ps(_mm_mul_ps(det_c, b), mat2_mul_adj(a, d_c));
+
+    // |m| = |a||d| + |b||c| - tr((a#b)(d#c))
+    __m128 trace = _mm_mul_ps(a_b, _mm_shuffle_ps(d_c, d_c, _MM_SHUFFLE(3, 1, 2, 0)));
+    trace        = _mm_hadd_ps(trace, trace);
+    trace        = _mm_hadd_ps(trace, trace);
+    __m128 det   = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(det_a, det_d), _mm_mul_ps(det_b, det_c)), trace);
+
+    __m128 inv_det = _mm_div_ps(_mm_setr_ps(1.0f, -1.0f, -1.0f, 1.0f), det);
+    x              = _mm_mul_ps(x, inv_det);
+    y              = _mm_mul_ps(y, inv_det);
+    z              = _mm_mul_ps(z, inv_det);
+    w              = _mm_mul_ps(w, inv_det);
+
+    // Applies the adjugate of the blocks while reassembling them.
+    Mat4 out;
+    store(out.columns[0], _mm_shuffle_ps(x, y, _MM_SHUFFLE(1, 3, 1, 3)));
+    store(out.columns[1], _mm_shuffle_ps(x, y, _MM_SHUFFLE(0, 2, 0, 2)));
+    store(out.columns[2], _mm_shuffle_ps(z, w, _MM_SHUFFLE(1, 3, 1, 3)));
+    store(out.columns[3], _mm_shuffle_ps(z, w, _MM_SHUFFLE(0, 2, 0, 2)));
+    return out;
+}
+
+Aabb transform_aabb_sse(Mat4 const &m, Aabb const &bounds)
+{
+    __m128 const half     = _mm_set1_ps(0.5f);
+    __m128 const abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+
+    __m128 min    = load(bounds.min);
+    __m128 max    = load(bounds.max);
+    __m128 center = _mm_mul_ps(_mm_add_ps(min, max), half);
+    __m128 extent = _mm_mul_ps(_mm_sub_ps(max, min), half);
+
+    __m128 c0 = load(m.columns[0]);
+    __m128 c1 = load(m.columns[1]);
+    __m128 c2 = load(m.columns[2]);
+
+    __m128 new_center = madd(c0, splat<0>(center), load(m.columns[3]));
+    new_center        = madd(c1, splat<1>(center), new_center);
+    new_center        = madd(c2, splat<2>(center), new_center);
+
+    __m128 new_extent = _mm_mul_ps(_mm_and_ps(c0, abs_mask), splat<0>(extent));
+    new_extent        = madd(_mm_and_ps(c1, abs_mask), splat<1>(extent), new_extent);
+    new_extent        = madd(_mm_and_ps(c2, abs_mask), splat<2>(extent), new_extent);
+
+    // w stays unused.
+    Aabb out;
+    store(out.min, _mm_blend_ps(_mm_sub_ps(new_center, new_extent), _mm_setzero_ps(), 0x8));
+    store(out.max, _mm_blend_ps(_mm_add_ps(new_center, new_extent), _mm_setzero_ps(), 0x8));
+    return out;
+}
+#endif
+
+// The batch kernels are written once against the widest available vector.
+#if defined(LOOM_SIMD_AVX2)
+using Lanes                 = __m256;
+constexpr size_t lane_count = 8;
+
+Lanes lanes_load(float const *p)
+{
+    return _mm256_loadu_ps(p);
+}
+void lanes_store(float *p, Lanes v)
+{
+    _mm256_storeu_ps(p, v);
+}
+Lanes lanes_set(float f)
+{
+    return _mm256_set1_ps(f);
+}
+Lanes lanes_add(Lanes a, Lanes b)
+{
+    return _mm256_add_ps(a, b);
+}
+Lanes lanes_sub(Lanes a, Lanes b)
+{
+    return _mm256_sub_ps(a, b);
+}
+Lanes lanes_mul(Lanes a, Lanes b)
+{
+    return _mm256_mul_ps(a, b);
+}
+Lanes lanes_madd(Lanes a, Lanes b, Lanes c)
+{
+    return _mm256_fmadd_ps(a, b, c);
+}
+Lanes lanes_div(Lanes a, Lanes b)
+{
+    return _mm256_div_ps(a, b);
+}
+Lanes lanes_abs(Lanes v)
+{
+    return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), v);
+}
+
+/**
+ * @brief Stores the depth sort keys of eight points, see depth_sort_key_scalar.
+ */
+void store_depth_keys(uint64_t *keys, Lanes depth, uint32_t first_index)
+{
+    __m256i bits    = _mm256_castps_si256(depth);
+    __m256i flip    = _mm256_or_si256(_mm256_srai_epi32(bits, 31), _mm256_set1_epi32(INT32_MIN));
+    __m256i high    = _mm256_xor_si256(bits, _mm256_xor_si256(flip, _mm256_set1_epi32(-1)));
+    __m256i indices = _mm256_add_epi32(_mm256_set1_epi32(static_cast<int32_t>(first_index)), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+
+    // The unpacks interleave within the 128 bit halves, keys 0, 1, 4, 5 and 2, 3, 6, 7.
+    __m256i lo = _mm256_unpacklo_epi32(indices, high);
+    __m256i hi = _mm256_unpackhi_epi32(indices, high);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(keys), _mm256_permute2x128_si256(lo, hi, 0x20));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(keys + 4), _mm256_permute2x128_si256(lo, hi, 0x31));
+}
+
+/**
+ * @brief Stores the four components of a column of eight matrices.
+ */
+void store_column(Mat4 *out, int column, Lanes x, Lanes y, Lanes z, Lanes w)
+{
+    __m256 xy_lo = _mm256_unpacklo_ps(x, y);
+    __m256 xy_hi = _mm256_unpackhi_ps(x, y);
+    __m256 zw_lo = _mm256_unpacklo_ps(z, w);
+    __m256 zw_hi = _mm256_unpackhi_ps(z, w);
+
+    // Each register now holds the column of matrix i in its low and of matrix i + 4 in its high half.
+    __m256 m04 = _mm256_shuffle_ps(xy_lo, zw_lo, _MM_SHUFFLE(1, 0, 1, 0));
+    __m256 m15 = _mm256_shuffle_ps(xy_lo, zw_lo, _MM_SHUFFLE(3, 2, 3, 2));
+    __m256 m26 = _mm256_shuffle_ps(xy_hi, zw_hi, _MM_SHUFFLE(1, 0, 1, 0));
+    __m256 m37 = _mm256_shuffle_ps(xy_hi, zw_hi, _MM_SHUFFLE(3, 2, 3, 2));
+
+    store(out[0].columns[column], _mm256_castps256_ps128(m04));
+    store(out[1].columns[column], _mm256_castps256_ps128(m15));
+    store(out[2].columns[column], _mm256_castps256_ps128(m26));
+    store(out[3].columns[column], _mm256_castps256_ps128(m37));
+    store(out[4].columns[column], _mm256_extractf128_ps(m04, 1));
+    store(out[5].columns[column], _mm256_extractf128_ps(m15, 1));
+    store(out[6].columns[column], _mm256_extractf128_ps(m26, 1));
+    store(out[7].columns[column], _mm256_extractf128_ps(m37, 1));
+}
+
+/**
+ * @brief Multiplies two columns of b at once, with the columns of a broadcast to both halves.
+ */
+void multiply_wide(Mat4 const &a, Mat4 const &b, Mat4 &out)
+{
+    __m256 a0 = _mm256_broadcast_ps(reinterpret_cast<__m128 const *>(&a.columns[0]));
+    __m256 a1 = _mm256_broadcast_ps(reinterpret_cast<__m128 const *>(&a.columns[1]));
+    __m256 a2 = _mm256_broadcast_ps(reinterpret_cast<__m128 const *>(&a.columns[2]));
+    __m256 a3 = _mm256_broadcast_ps(reinterpret_cast<__m128 const *>(&a.columns[3]));
+
+    for (int c = 0; c < 4; c += 2)
+    {
+        __m256 bc = _mm256_loadu_ps(&b.columns[c].x);
+        __m256 r  = _mm256_mul_ps(a0, _mm256_shuffle_ps(bc, bc, _MM_SHUFFLE(0, 0, 0, 0)));
+        r         = _mm256_fmadd_ps(a1, _mm256_shuffle_ps(bc, bc, _MM_SHUFFLE(1, 1, 1, 1)), r);
+        r         = _mm256_fmadd_ps(a2, _mm256_shuffle_ps(bc, bc, _MM_SHUFFLE(2, 2, 2, 2)), r);
+        r         = _mm256_fmadd_ps(a3, _mm256_shuffle_ps(bc, bc, _MM_SHUFFLE(3, 3, 3, 3)), r);
+        _mm256_storeu_ps(&out.columns[c].x, r);
+    }
+}
+#elif defined(LOOM_SIMD_SSE4)
+using Lanes                 = __m128;
+constexpr size_t lane_count = 4;
+
+Lanes lanes_load(float const *p)
+{
+    return _mm_loadu_ps(p);
+}
+void lanes_store(float *p, Lanes v)
+{
+    _mm_storeu_ps(p, v);
+}
+Lanes lanes_set(float f)
+{
+    return _mm_set1_ps(f);
+}
+Lanes lanes_add(Lanes a, Lanes b)
+{
+    return _mm_add_ps(a, b);
+}
+Lanes lanes_sub(Lanes a, Lanes b)
+{
+    return _mm_sub_ps(a, b);
+}
+Lanes lanes_mul(Lanes a, Lanes b)
+{
+    return _mm_mul_ps(a, b);
+}
+Lanes lanes_madd(Lanes a, Lanes b, Lanes c)
+{
+    return madd(a, b, c);
+}
+Lanes lanes_div(Lanes a, Lanes b)
+{
+    return _mm_div_ps(a, b);
+}
+Lanes lanes_abs(Lanes v)
+{
+    return _mm_andnot_ps(_mm_set1_ps(-0.0f), v);
+}
+
+void store_depth_keys(uint64_t *keys, Lanes depth, uint32_t first_index)
+{
+    __m128i bits    = _mm_castps_si128(depth);
+    __m128i flip    = _mm_or_si128(_mm_srai_epi32(bits, 31), _mm_set1_epi32(INT32_MIN));
+    __m128i high    = _mm_xor_si128(bits, _mm_xor_si128(flip, _mm_set1_epi32(-1)));
+    __m128i indices = _mm_add_epi32(_mm_set1_epi32(static_cast<int32_t>(first_index)), _mm_setr_epi32(0, 1, 2, 3));
+
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(keys), _mm_unpacklo_epi32(indices, high));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(keys + 2), _mm_unpackhi_epi32(indices, high));
+}
+
+void store_column(Mat4 *out, int column, Lanes x, Lanes y, Lanes z, Lanes w)
+{
+    _MM_TRANSPOSE4_PS(x, y, z, w);
+    store(out[0].columns[column], x);
+    store(out[1].columns[column], y);
+    store(out[2].columns[column], z);
+    store(out[3].columns[column], w);
+}
+
+void multiply_wide(Mat4 const &a, Mat4 const &b, Mat4 &out)
+{
+    out = multiply_sse(a, b);
+}
+#endif
+}  // namespace
+
+Mat4 Mat4::from_glm(glm::mat4 const &matrix)
+{
+    Mat4 out;
+    std::memcpy(static_cast<void *>(&out), &matrix, sizeof(out));
+    return out;
+}
+
+glm::mat4 Mat4::to_glm() const
+{
+    glm::mat4 out;
+    std::memcpy(static_cast<void *>(&out), this, sizeof(out));
+    return out;
+}
+
+Mat4 multiply(Mat4 const &a, Mat4 const &b)
+{
+#if defined(LOOM_SIMD_SSE4)
+    return multiply_sse(a, b);
+#else
+    return multiply_scalar(a, b);
+#endif
+}
+
+Vec4 transform(Mat4 const &m, Vec4 const &v)
+{
+    Vec4 out;
+#if defined(LOOM_SIMD_SSE4)
+    store(out, combine(m, load(v)));
+#else
+    for (int r = 0; r < 4; r++)
+    {
+        get(out, r) = get(m.columns[0], r) * v.x + get(m.columns[1], r) * v.y + get(m.columns[2], r) * v.z + get(m.columns[3], r) * v.w;
+    }
+#endif
+    return out;
+}
+
+/**
+ * @brief The inverse of a general matrix, undefined for singular ones.
+ */
+Mat4 inverse(Mat4 const &m)
+{
+#if defined(LOOM_SIMD_SSE4)
+    return inverse_sse(m);
+#else
+    return inverse_scalar(m);
+#endif
+}
+
+/**
+ * @brief The matrix scaling, then rotating, then translating. The rotation must be normalized.
+ */
+Mat4 compose_trs(Vec4 const &translation, Quat const &rotation, Vec4 const &scale)
+{
+    return compose_trs_scalar(translation.x, translation.y, translation.z, rotation.x, rotation.y, rotation.z, rotation.w, scale.x, scale.y, scale.z);
+}
+
+/**
+ * @returns The bounds of the transformed corners of the bounds.
+ */
+Aabb transform_aabb(Mat4 const &m, Aabb const &bounds)
+{
+#if defined(LOOM_SIMD_SSE4)
+    return transform_aabb_sse(m, bounds);
+#else
+    Aabb out;
+    transform_aabb_scalar(m, &bounds.min.x, &bounds.max.x, &out.min.x, &out.max.x);
+    return out;
+#endif
+}
+
+/**
+ * @brief out[i] = a[i] * b[i], e.g. to propagate parent transforms. out may alias a or b.
+ */
+void multiply_batch(Mat4 const *a, Mat4 const *b, Mat4 *out, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+#if defined(LOOM_SIMD_SSE4)
+        Mat4 result;
+        multiply_wide(a[i], b[i], result);
+        out[i] = result;
+#else
+        out[i] = multiply_scalar(a[i], b[i]);
+#endif
+    }
+}
+
+/**
+ * @brief Composes the matrices of many transforms, one transform per vector lane.
+ */
+void compose_trs_batch(TransformStreams const &transforms, Mat4 *out, size_t count)
+{
+    size_t i = 0;
+
+#if defined(LOOM_SIMD_SSE4)
+    Lanes const one  = lanes_set(1.0f);
+    Lanes const two  = lanes_set(2.0f);
+    Lanes const zero = lanes_set(0.0f);
+
+    for (; i + lane_count <= count; i += lane_count)
+    {
+        Lanes qx = lanes_load(transforms.rotation[0] + i);
+        Lanes qy = lanes_load(transforms.rotation[1] + i);
+        Lanes qz = lanes_load(transforms.rotation[2] + i);
+        Lanes qw = lanes_load(transforms.rotation[3] + i);
+        Lanes sx = lanes_load(transforms.scale[0] + i);
+        Lanes sy = lanes_load(transforms.scale[1] + i);
+        Lanes sz = lanes_load(transforms.scale[2] + i);
+
+        Lanes xx = lanes_mul(qx, qx);
+        Lanes yy = lanes_mul(qy, qy);
+        Lanes zz = lanes_mul(qz, qz);
+        Lanes xy = lanes_mul(qx, qy);
+        Lanes xz = lanes_mul(qx, qz);
+        Lanes yz = lanes_mul(qy, qz);
+        Lanes wx = lanes_mul(qw, qx);
+        Lanes wy = lanes_mul(qw, qy);
+        Lanes wz = lanes_mul(qw, qz);
+
+        Lanes sx2 = lanes_mul(sx, two);
+        Lanes sy2 = lanes_mul(sy, two);
+        Lanes sz2 = lanes_mul(sz, two);
+
+        store_column(out + i, 0, lanes_mul(lanes_sub(one, lanes_mul(two, lanes_add(yy, zz))), sx), lanes_mul(lanes_add(xy, wz), sx2), lanes_mul(lanes_sub(xz, wy), sx2), zero);
+        store_column(out + i, 1, lanes_mul(lanes_sub(xy, wz), sy2), lanes_mul(lanes_sub(one, lanes_mul(two, lanes_add(xx, zz))), sy), lanes_mul(lanes_add(yz, wx), sy2), zero);
+        store_column(out + i, 2, lanes_mul(lanes_add(xz, wy), sz2), lanes_mul(lanes_sub(yz, wx), sz2), lanes_mul(lanes_sub(one, lanes_mul(two, lanes_add(xx, yy))), sz), zero);
+        store_column(out + i, 3, lanes_load(transforms.translation[0] + i), lanes_load(transforms.translation[1] + i), lanes_load(transforms.translation[2] + i), one);
+    }
+#endif
+
+    for (; i < count; i++)
+    {
+        out[i] = compose_trs_scalar(transforms.translation[0][i], transforms.translation[1][i], transforms.translation[2][i], transforms.rotation[0][i], transforms.rotation[1][i],
+                                    transforms.rotation[2][i], transforms.rotation[3][i], transforms.scale[0][i], transforms.scale[1][i], transforms.scale[2][i]);
+    }
+}
+
+/**
+ * @brief Transforms many bounds by the same matrix, one bound per vector lane.
+ */
+void transform_aabb_batch(Mat4 const &m, AabbStreams const &bounds, AabbStreams const &out, size_t count)
+{
+    size_t i = 0;
+
+#if defined(LOOM_SIMD_SSE4)
+    Lanes const half = lanes_set(0.5f);
+
+    Lanes elements[4][3];
+    Lanes abs_elements[3][3];
+    for (int c = 0; c < 4; c++)
+    {
+        for (int r = 0; r < 3; r++)
+        {
+            elements[c][r] = lanes_set(get(m.columns[c], r));
+            if (c < 3)
+            {
+                abs_elements[c][r] = lanes_abs(elements[c][r]);
+            }
+        }
+    }
+
+    for (; i + lane_count <= count; i += lane_count)
+    {
+        Lanes center[3], extent[3];
+        for (int k = 0; k < 3; k++)
+        {
+            Lanes min = lanes_load(bounds.min[k] + i);
+            Lanes max = lanes_load(bounds.max[k] + i);
+            center[k] = lanes_mul(lanes_add(min, max), half);
+            extent[k] = lanes_mul(lanes_sub(max, min), half);
+        }
+
+        for (int r = 0; r < 3; r++)
+        {
+            Lanes c = lanes_madd(elements[0][r], center[0], elements[3][r]);
+            c       = lanes_madd(elements[1][r], center[1], c);
+            c       = lanes_madd(elements[2][r], center[2], c);
+
+            Lanes e = lanes_mul(abs_elements[0][r], extent[0]);
+            e       = lanes_madd(abs_elements[1][r], extent[1], e);
+            e       = lanes_madd(abs_elements[2][r], extent[2], e);
+
+            lanes_store(out.min[r] + i, lanes_sub(c, e));
+            lanes_store(out.max[r] + i, lanes_add(c, e));
+        }
+    }
+#endif
+
+    for (; i < count; i++)
+    {
+        float min[3]     = {bounds.min[0][i], bounds.min[1][i], bounds.min[2][i]};
+        float max[3]     = {bounds.max[0][i], bounds.max[1][i], bounds.max[2][i]};
+        float out_min[3] = {};
+        float out_max[3] = {};
+        transform_aabb_scalar(m, min, max, out_min, out_max);
+        for (int k = 0; k < 3; k++)
+        {
+            out.min[k][i] = out_min[k];
+            out.max[k][i] = out_max[k];
+        }
+    }
+}
+
+/**
+ * @brief Writes the keys sorting many points from the farthest to the nearest, e.g. for transparent draws.
+ *
+ * The upper 32 bits order the depths after the projection, the lower ones are first_index plus the
+ * index of the point. Points behind the camera get meaningless keys.
+ */
+void depth_sort_keys_batch(Mat4 const &view_proj, PointStreams const &points, uint32_t first_index, uint64_t *keys, size_t count)
+{
+    size_t i = 0;
+
+#if defined(LOOM_SIMD_SSE4)
+    // Only the z and w rows of the projection matter for the depth.
+    Lanes z_row[4], w_row[4];
+    for (int c = 0; c < 4; c++)
+    {
+        z_row[c] = lanes_set(view_proj.columns[c].z);
+        w_row[c] = lanes_set(view_proj.columns[c].w);
+    }
+
+    for (; i + lane_count <= count; i += lane_count)
+    {
+        Lanes x = lanes_load(points.position[0] + i);
+        Lanes y = lanes_load(points.position[1] + i);
+        Lanes z = lanes_load(points.position[2] + i);
+
+        Lanes clip_z = lanes_madd(z_row[0], x, z_row[3]);
+        clip_z       = lanes_madd(z_row[1], y, clip_z);
+        clip_z       = lanes_madd(z_row[2], z, clip_z);
+
+        Lanes clip_w = lanes_madd(w_row[0], x, w_row[3]);
+        clip_w       = lanes_madd(w_row[1], y, clip_w);
+        clip_w       = lanes_madd(w_row[2], z, clip_w);
+
+        store_depth_keys(keys + i, lanes_div(clip_z, clip_w), first_index + static_cast<uint32_t>(i));
+    }
+#endif
+
+    for (; i < count; i++)
+    {
+        Vec4 clip = transform(view_proj, {points.position[0][i], points.position[1][i], points.position[2][i], 1.0f});
+        keys[i]   = depth_sort_key_scalar(clip.z / clip.w, first_index + static_cast<uint32_t>(i));
+    }
+}
+
+/**
+ * @returns The instruction set the math was built for.
+ */
+char const *get_simd_name()
+{
+#if defined(LOOM_SIMD_AVX2)
+    return "AVX2";
+#elif defined(LOOM_SIMD_SSE4)
+    return "SSE4.1";
+#else
+    return "scalar";
+#endif
+}
+}  // namespace math
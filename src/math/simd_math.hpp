@@ -0,0 +1,96 @@
+﻿#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+
+// The instruction set is chosen when building, see LOOM_SIMD in CMakeLists.txt. Without it, the
+// instruction sets the compiler targets are used.
+#if !defined(LOOM_SIMD_SCALAR)
+#    if !defined(LOOM_SIMD_AVX2) && defined(__AVX2__) && defined(__FMA__)
+#        define LOOM_SIMD_AVX2
+#    endif
+#    if !defined(LOOM_SIMD_SSE4) && (defined(LOOM_SIMD_AVX2) || defined(__SSE4_1__))
+#        define LOOM_SIMD_SSE4
+#    endif
+#endif
+
+/*
+ * Engine math for transforms, matrices and bounds.
+ *
+ * The types are laid out like their glm counterparts and convert to them for free, but are aligned
+ * for SIMD loads. Single operations use SSE4.1, the batch kernels process eight elements per
+ * iteration with AVX2 and four with SSE4.1. Everything has a scalar fallback, which also handles
+ * the elements left over by the batch kernels. LoomMathBench checks every kernel against glm and
+ * times it against glm.
+ */
+namespace math
+{
+struct alignas(16) Vec4
+{
+    float x = 0.0f;
+    float y = 0.0f;
+    float z = 0.0f;
+    float w = 0.0f;
+};
+
+/// @brief A rotation quaternion, w is the real part.
+struct alignas(16) Quat
+{
+    float x = 0.0f;
+    float y = 0.0f;
+    float z = 0.0f;
+    float w = 1.0f;
+};
+
+/// @brief A column-major 4x4 matrix, like glm::mat4.
+struct alignas(16) Mat4
+{
+    Vec4 columns[4] = {{1.0f, 0.0f, 0.0f, 0.0f}, {0.0f, 1.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 1.0f, 0.0f}, {0.0f, 0.0f, 0.0f, 1.0f}};
+
+    static Mat4 from_glm(glm::mat4 const &matrix);
+    glm::mat4   to_glm() const;
+};
+
+/// @brief Axis-aligned bounds, w is unused.
+struct Aabb
+{
+    Vec4 min;
+    Vec4 max;
+};
+
+/// @brief Translation, rotation and scale of many transforms as one stream per component.
+struct TransformStreams
+{
+    float const *translation[3];        // x, y, z
+    float const *rotation[4];           // x, y, z, w
+    float const *scale[3];
+};
+
+/// @brief Many bounds as one stream per component. The batch kernels may read and write the same streams.
+struct AabbStreams
+{
+    float *min[3];        // x, y, z
+    float *max[3];
+};
+
+/// @brief Many points as one stream per component.
+struct PointStreams
+{
+    float const *position[3];        // x, y, z
+};
+
+Mat4 multiply(Mat4 const &a, Mat4 const &b);
+Vec4 transform(Mat4 const &m, Vec4 const &v);
+Mat4 inverse(Mat4 const &m);
+Mat4 compose_trs(Vec4 const &translation, Quat const &rotation, Vec4 const &scale);
+Aabb transform_aabb(Mat4 const &m, Aabb const &bounds);
+
+void multiply_batch(Mat4 const *a, Mat4 const *b, Mat4 *out, size_t count);
+void compose_trs_batch(TransformStreams const &transforms, Mat4 *out, size_t count);
+void transform_aabb_batch(Mat4 const &m, AabbStreams const &bounds, AabbStreams const &out, size_t count);
+void depth_sort_keys_batch(Mat4 const &view_proj, PointStreams const &points, uint32_t first_index, uint64_t *keys, size_t count);
+
+char const *get_simd_name();
+}  // namespace math
@@ -0,0 +1,174 @@
+﻿#include "memory/allocation_counter.hpp"
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+// Plain integers are trivially destroyed, so allocations while a thread exits still find them.
+thread_local uint64_t allocation_count = 0;
+thread_local uint64_t allocation_bytes = 0;
+}  // namespace
+
+uint64_t get_heap_allocation_count()
+{
+    return allocation_count;
+}
+
+uint64_t get_heap_allocation_bytes()
+{
+    return allocation_bytes;
+}
+
+#if defined(LOOM_COUNT_ALLOCATIONS)
+bool is_heap_allocation_counting_enabled()
+{
+    return true;
+}
+
+namespace
+{
+void *counted_allocate(std::size_t size, std::size_t alignment)
+{
+    allocation_count++;
+    allocation_bytes += size;
+
+    size = size ? size : 1;
+#    if defined(_MSC_VER)
+    void *memory = alignment > alignof(std::max_align_t) ? _aligned_malloc(size, alignment) : std::malloc(size);
+#    else
+    // aligned_alloc wants the size to be a multiple of the alignment.
+    void *memory = alignment > alignof(std::max_align_t) ? std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment) : std::malloc(size);
+#    endif
+    return memory;
+}
+
+void counted_free(void *memory, std::size_t alignment) noexcept
+{
+#    if defined(_MSC_VER)
+    if (alignment > alignof(std::max_align_t))
+    {
+        _aligned_free(memory);
+        return;
+    }
+#    else
+    (void)alignment;
+#    endif
+    std::free(memory);
+}
+}  // namespace
+
+void *operator new(std::size_t size)
+{
+    if (void *memory = counted_allocate(size, alignof(std::max_align_t)))
+    {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment)
+{
+    if (void *memory = counted_allocate(size, static_cast<std::size_t>(alignment)))
+    {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size, std::align_val_t alignment)
+{
+    return operator new(size, alignment);
+}
+
+void *operator new(std::size_t size, std::nothrow_t const &) noexcept
+{
+    return counted_allocate(size, alignof(std::max_align_t));
+}
+
+void *operator new[](std::size_t size, std::nothrow_t const &) noexcept
+{
+    return counted_allocate(size, alignof(std::max_align_t));
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment, std::nothrow_t const &) noexcept
+{
+    return counted_allocate(size, static_cast<std::size_t>(alignment));
+}
+
+void *operator new[](std::size_t size, std::align_val_t alignment, std::nothrow_t const &) noexcept
+{
+    return counted_allocate(size, static_cast<std::size_t>(alignment));
+}
+
+void operator delete(void *memory) noexcept
+{
+    counted_free(memory, alignof(std::max_align_t));
+}
+
+void operator delete[](void *memory) noexcept
+{
+    counted_free(memory, alignof(std::max_align_t));
+}
+
+void operator delete(void *memory, std::size_t) noexcept
+{
+    counted_free(memory, alignof(std::max_align_t));
+}
+
+void operator delete[](void *memory, std::size_t) noexcept
+{
+    counted_free(memory, alignof(std::max_align_t));
+}
+
+void operator delete(void *memory, std::align_val_t alignment) noexcept
+{
+    counted_free(memory, static_cast<std::size_t>(alignment));
+}
+
+void operator delete[](void *memory, std::align_val_t alignment) noexcept
+{
+    counted_free(memory, static_cast<std::size_t>(alignment));
+}
+
+void operator delete(void *memory, std::size_t, std::align_val_t alignment) noexcept
+{
+    counted_free(memory, static_cast<std::size_t>(alignment));
+}
+
+void operator delete[](void *memory, std::size_t, std::align_val_t alignment) noexcept
+{
+    counted_free(memory, static_cast<std::size_t>(alignment));
+}
+
+void operator delete(void *memory, std::nothrow_t const &) noexcept
+{
+    counted_free(memory, alignof(std::max_align_t));
+}
+
+void operator delete[](void *memory, std::nothrow_t const &) noexcept
+{
+    counted_free(memory, alignof(std::max_align_t));
+}
+
+void operator delete(void *memory, std::align_val_t alignment, std::nothrow_t const &) noexcept
+{
+    counted_free(memory, static_cast<std::size_t>(alignment));
+}
+
+void operator delete[](void *memory, std::align_val_t alignment, std::nothrow_t const &) noexcept
+{
+    counted_free(memory, static_cast<std::size_t>(alignment));
+}
+#else
+bool is_heap_allocation_counting_enabled()
+{
+    return false;
+}
+#endif
@@ -0,0 +1,14 @@
+﻿#pragma once
+
+#include <cstdint>
+
+/*
+ * Counts the allocations made through the global operator new by the calling thread, to find heap
+ * allocations on paths which should use the frame arenas. Each thread has its own counts, so the
+ * allocations of workers, e.g. the texture streamer or the shader reloader, don't show up in the
+ * frame of the render thread. The counting replacement of operator new is only built with
+ * LOOM_COUNT_ALLOCATIONS, without it the counts stay 0.
+ */
+uint64_t get_heap_allocation_count();
+uint64_t get_heap_allocation_bytes();
+bool     is_heap_allocation_counting_enabled();
@@ -0,0 +1,186 @@
+﻿#include "memory/frame_arena.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <new>
+
+LinearArena::LinearArena(size_t block_size) :
+    block_size(block_size)
+{
+}
+
+LinearArena::~LinearArena()
+{
+    for (auto &block : blocks)
+    {
+        ::operator delete[](block.data, std::align_val_t(alignof(std::max_align_t)));
+    }
+}
+
+/**
+ * @returns Uninitialized memory, valid until the next reset.
+ */
+void *LinearArena::allocate(size_t size, size_t alignment)
+{
+    assert(alignment && !(alignment & (alignment - 1)));
+
+    if (!blocks.empty())
+    {
+        Block const &block   = blocks.back();
+        uintptr_t    address = reinterpret_cast<uintptr_t>(block.data) + offset;
+        size_t       padding = (alignment - address % alignment) % alignment;
+        if (offset + padding + size <= block.size)
+        {
+            offset += padding + size;
+            used.store(used.load(std::memory_order_relaxed) + padding + size, std::memory_order_relaxed);  // Only the allocating thread writes it.
+            return block.data + offset - size;
+        }
+    }
+
+    // Blocks are aligned to max_align_t, larger alignments may need padding.
+    add_block(std::max(block_size, size + alignment));
+    return allocate(size, alignment);
+}
+
+/**
+ * @brief Rewinds the arena. Everything allocated from it becomes invalid.
+ */
+void LinearArena::reset()
+{
+    // Merge the blocks, the next frame of the same size then fits into one.
+    if (blocks.size() > 1)
+    {
+        size_t merged = get_capacity();
+        for (auto &block : blocks)
+        {
+            ::operator delete[](block.data, std::align_val_t(alignof(std::max_align_t)));
+        }
+        blocks.clear();
+        capacity.store(0, std::memory_order_relaxed);
+        add_block(merged);
+    }
+
+    offset = 0;
+    used.store(0, std::memory_order_relaxed);
+}
+
+size_t LinearArena::get_used_bytes() const
+{
+    return used.load(std::memory_order_relaxed);
+}
+
+size_t LinearArena::get_capacity() const
+{
+    return capacity.load(std::memory_order_relaxed);
+}
+
+void LinearArena::add_block(size_t size)
+{
+    Block block;
+    block.data = static_cast<std::byte *>(::operator new[](size, std::align_val_t(alignof(std::max_align_t))));
+    block.size = size;
+    blocks.push_back(block);
+    offset = 0;
+    capacity.store(capacity.load(std::memory_order_relaxed) + size, std::memory_order_relaxed);
+}
+
+/**
+ * @param frame_count The number of frame slots, the frames in flight.
+ * @param block_size The initial size of each arena.
+ */
+void FrameArenas::prepare(uint32_t frame_count, size_t block_size)
+{
+    static std::atomic<uint64_t> next_generation{1};
+
+    this->frame_count = frame_count;
+    this->block_size  = block_size;
+    generation        = next_generation++;
+}
+
+/**
+ * @brief Frees all arenas. No thread may use them anymore.
+ */
+void FrameArenas::destroy()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    threads.clear();
+    generation = 0;
+}
+
+/**
+ * @brief Switches to a frame slot and resets its arenas on all threads. The GPU must have finished
+ *        the frame which used the slot before.
+ */
+void FrameArenas::begin_frame(uint32_t frame_index)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    this->frame_index = frame_index;
+    for (auto &thread : threads)
+    {
+        thread->frames[frame_index]->reset();
+    }
+}
+
+/**
+ * @returns The calling thread's arena for the current frame.
+ */
+LinearArena &FrameArenas::get_thread_arena()
+{
+    struct Cache
+    {
+        uint64_t      generation = 0;
+        ThreadArenas *arenas     = nullptr;
+    };
+    thread_local Cache cache;
+
+    if (cache.generation != generation)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        auto arenas = std::make_unique<ThreadArenas>();
+        for (uint32_t i = 0; i < frame_count; i++)
+        {
+            arenas->frames.push_back(std::make_unique<LinearArena>(block_size));
+        }
+
+        cache.generation = generation;
+        cache.arenas     = arenas.get();
+        threads.push_back(std::move(arenas));
+    }
+
+    return *cache.arenas->frames[frame_index];
+}
+
+/**
+ * @returns The bytes allocated in the current frame on all threads.
+ */
+size_t FrameArenas::get_used_bytes() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    size_t used = 0;
+    for (auto const &thread : threads)
+    {
+        used += thread->frames[frame_index]->get_used_bytes();
+    }
+    return used;
+}
+
+/**
+ * @returns The memory held by the arenas of all frames and threads.
+ */
+size_t FrameArenas::get_capacity() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    size_t capacity = 0;
+    for (auto const &thread : threads)
+    {
+        for (auto const &frame : thread->frames)
+        {
+            capacity += frame->get_capacity();
+        }
+    }
+    return capacity;
+}
@@ -0,0 +1,133 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/**
+ * @brief A bump allocator for data which lives until the arena is reset.
+ *
+ * Allocating advances an offset, freeing does nothing, resetting rewinds the offset. When a block
+ * runs out, another one is taken from the heap, and the next reset merges all blocks into one big
+ * enough for the whole peak, so a steady workload stops touching the heap after a few frames.
+ *
+ * Allocating and resetting aren't thread-safe, FrameArenas gives each thread arenas of its own. The
+ * used bytes and the capacity may be read from any thread while another allocates, e.g. for statistics.
+ */
+class LinearArena
+{
+public:
+    explicit LinearArena(size_t block_size);
+    ~LinearArena();
+
+    LinearArena(LinearArena const &)            = delete;
+    LinearArena &operator=(LinearArena const &) = delete;
+
+    void *allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+    void  reset();
+
+    template <typename T>
+    T *allocate_array(size_t count)
+    {
+        return static_cast<T *>(allocate(sizeof(T) * count, alignof(T)));
+    }
+
+    size_t get_used_bytes() const;
+    size_t get_capacity() const;
+
+private:
+    struct Block
+    {
+        std::byte *data = nullptr;
+        size_t     size = 0;
+    };
+
+    void add_block(size_t size);
+
+private:
+    std::vector<Block>  blocks;
+    size_t              block_size;
+    size_t              offset   = 0;        // Into the last block.
+    std::atomic<size_t> used     = 0;        // In all blocks since the last reset, including padding.
+    std::atomic<size_t> capacity = 0;        // Of all blocks.
+};
+
+/**
+ * @brief An STL allocator taking its memory from a LinearArena. Deallocating is a no-op, containers
+ *        that grow leave their old storage behind until the reset, so reserve them up front.
+ */
+template <typename T>
+class ArenaAllocator
+{
+public:
+    using value_type = T;
+
+    explicit ArenaAllocator(LinearArena &arena) noexcept :
+        arena(&arena)
+    {}
+
+    template <typename U>
+    ArenaAllocator(ArenaAllocator<U> const &other) noexcept :
+        arena(other.arena)
+    {}
+
+    T *allocate(size_t count)
+    {
+        return arena->allocate_array<T>(count);
+    }
+
+    void deallocate(T *, size_t) noexcept
+    {}
+
+    template <typename U>
+    bool operator==(ArenaAllocator<U> const &other) const noexcept
+    {
+        return arena == other.arena;
+    }
+
+private:
+    template <typename U>
+    friend class ArenaAllocator;
+
+    LinearArena *arena;
+};
+
+template <typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+/**
+ * @brief One linear arena per frame slot and thread, for the transient CPU data of a frame.
+ *
+ * Data allocated while recording a frame stays valid until the frame slot is reused, i.e. until
+ * the GPU finished the frame. Each thread allocates from its own arenas without locking, they are
+ * created on a thread's first use.
+ */
+class FrameArenas
+{
+public:
+    void prepare(uint32_t frame_count, size_t block_size = 256 * 1024);
+    void destroy();
+
+    void         begin_frame(uint32_t frame_index);
+    LinearArena &get_thread_arena();
+
+    size_t get_used_bytes() const;
+    size_t get_capacity() const;
+
+private:
+    struct ThreadArenas
+    {
+        std::vector<std::unique_ptr<LinearArena>> frames;        // Indexed by frame slot.
+    };
+
+private:
+    mutable std::mutex                         mutex;            // Guards the thread list, not the arenas.
+    std::vector<std::unique_ptr<ThreadArenas>> threads;
+    uint32_t                                   frame_count = 0;
+    std::atomic<uint32_t>                      frame_index = 0;
+    size_t                                     block_size  = 0;
+    std::atomic<uint64_t>                      generation  = 0;  // Tells the thread caches of different preparations apart.
+};
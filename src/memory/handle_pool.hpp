@@ -0,0 +1,247 @@
+﻿#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+template <typename T>
+class HandlePool;
+
+/**
+ * @brief A typed 32-bit reference into a HandlePool: a 20-bit slot index and a 12-bit generation.
+ *
+ * The generation of a slot advances whenever its value is destroyed, so a handle kept past the
+ * destruction no longer matches the slot. Generations skip zero, which makes the zero handle null.
+ */
+template <typename T>
+class Handle
+{
+public:
+    static constexpr uint32_t index_bits      = 20;
+    static constexpr uint32_t generation_bits = 12;
+    static constexpr uint32_t max_slots       = 1u << index_bits;
+    static constexpr uint32_t generation_mask = (1u << generation_bits) - 1;
+
+    Handle() = default;
+
+    uint32_t get_index() const
+    {
+        return value & (max_slots - 1);
+    }
+
+    uint32_t get_generation() const
+    {
+        return value >> index_bits;
+    }
+
+    uint32_t get_value() const
+    {
+        return value;
+    }
+
+    explicit operator bool() const
+    {
+        return value != 0;
+    }
+
+    bool operator==(Handle const &other) const = default;
+
+private:
+    friend class HandlePool<T>;
+
+    Handle(uint32_t index, uint32_t generation) :
+        value(index | (generation << index_bits))
+    {}
+
+private:
+    uint32_t value = 0;
+};
+
+/**
+ * @brief Owns values of one type densely packed in an array and hands out generation handles to them.
+ *
+ * Handles address a slot, the slot holds the position of the value in the dense array and the
+ * generation of its current occupant, so a lookup is two array reads. Destroying moves the last value
+ * into the gap, which keeps iteration over all live values a linear walk without holes, but moves
+ * values: keep handles, not pointers or references. Stale handles are caught by an assert in debug
+ * builds, is_valid and try_get check them in all builds.
+ */
+template <typename T>
+class HandlePool
+{
+public:
+    using HandleType = Handle<T>;
+
+    void reserve(size_t count)
+    {
+        values.reserve(count);
+        owners.reserve(count);
+        slots.reserve(count);
+    }
+
+    template <typename... Args>
+    HandleType create(Args &&...args)
+    {
+        uint32_t slot_index = allocate_slot();
+        Slot    &slot       = slots[slot_index];
+
+        slot.dense = static_cast<uint32_t>(values.size());
+        values.emplace_back(std::forward<Args>(args)...);
+        owners.push_back(slot_index);
+        return HandleType(slot_index, slot.generation);
+    }
+
+    void destroy(HandleType handle)
+    {
+        assert(is_valid(handle) && "Destroying a stale or null handle.");
+
+        uint32_t slot_index = handle.get_index();
+        uint32_t dense      = slots[slot_index].dense;
+        uint32_t last       = static_cast<uint32_t>(values.size() - 1);
+        if (dense != last)
+        {
+            values[dense]              = std::move(values[last]);
+            owners[dense]              = owners[last];
+            slots[owners[dense]].dense = dense;
+        }
+        values.pop_back();
+        owners.pop_back();
+        release_slot(slot_index);
+    }
+
+    void clear()
+    {
+        for (uint32_t slot_index : owners)
+        {
+            release_slot(slot_index);
+        }
+        values.clear();
+        owners.clear();
+    }
+
+    bool is_valid(HandleType handle) const
+    {
+        uint32_t slot_index = handle.get_index();
+        return handle && slot_index < slots.size() && slots[slot_index].generation == handle.get_generation() &&
+               slots[slot_index].dense != invalid_dense;
+    }
+
+    T &get(HandleType handle)
+    {
+        assert(is_valid(handle) && "Stale or null handle.");
+        return values[slots[handle.get_index()].dense];
+    }
+
+    T const &get(HandleType handle) const
+    {
+        assert(is_valid(handle) && "Stale or null handle.");
+        return values[slots[handle.get_index()].dense];
+    }
+
+    /// @brief Returns nullptr for stale and null handles, for callers which may outlive the value.
+    T *try_get(HandleType handle)
+    {
+        return is_valid(handle) ? &values[slots[handle.get_index()].dense] : nullptr;
+    }
+
+    /// @brief The handle of the value at a position of the dense array, for use while iterating.
+    HandleType get_handle(size_t dense) const
+    {
+        uint32_t slot_index = owners[dense];
+        return HandleType(slot_index, slots[slot_index].generation);
+    }
+
+    size_t size() const
+    {
+        return values.size();
+    }
+
+    bool empty() const
+    {
+        return values.empty();
+    }
+
+    auto begin()
+    {
+        return values.begin();
+    }
+
+    auto end()
+    {
+        return values.end();
+    }
+
+    auto begin() const
+    {
+        return values.begin();
+    }
+
+    auto end() const
+    {
+        return values.end();
+    }
+
+private:
+    static constexpr uint32_t invalid_dense = ~0u;
+
+    struct Slot
+    {
+        uint32_t dense      = invalid_dense;        // Position in the dense arrays, invalid_dense while free.
+        uint32_t generation = 1;
+        uint32_t next_free  = invalid_dense;
+    };
+
+    uint32_t allocate_slot()
+    {
+        if (free_head != invalid_dense)
+        {
+            uint32_t slot_index = free_head;
+            free_head           = slots[slot_index].next_free;
+            if (free_head == invalid_dense)
+            {
+                free_tail = invalid_dense;
+            }
+            return slot_index;
+        }
+
+        if (slots.size() == HandleType::max_slots)
+        {
+            throw std::runtime_error("HandlePool ran out of handle slots!");
+        }
+        slots.emplace_back();
+        return static_cast<uint32_t>(slots.size() - 1);
+    }
+
+    // Released slots are reused first in, first out, which spreads the reuse over all free slots
+    // and keeps the 12-bit generations from wrapping around early on a single slot.
+    void release_slot(uint32_t slot_index)
+    {
+        Slot &slot      = slots[slot_index];
+        slot.dense      = invalid_dense;
+        slot.generation = (slot.generation + 1) & HandleType::generation_mask;
+        if (slot.generation == 0)
+        {
+            slot.generation = 1;
+        }
+        slot.next_free = invalid_dense;
+
+        if (free_tail != invalid_dense)
+        {
+            slots[free_tail].next_free = slot_index;
+        }
+        else
+        {
+            free_head = slot_index;
+        }
+        free_tail = slot_index;
+    }
+
+private:
+    std::vector<T>        values;                         // Dense, in no particular order.
+    std::vector<uint32_t> owners;                         // The slot of each value.
+    std::vector<Slot>     slots;                          // Indexed by the handle index.
+    uint32_t              free_head = invalid_dense;
+    uint32_t              free_tail = invalid_dense;
+};
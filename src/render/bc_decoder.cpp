@@ -0,0 +1,247 @@
+﻿#include "render/bc_decoder.hpp"
+
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+
+namespace
+{
+using Block = std::array<uint8_t, 16 * 4>;        // 4x4 RGBA8 texels, row by row.
+
+uint16_t read_u16(uint8_t const *data)
+{
+    return static_cast<uint16_t>(data[0] | data[1] << 8);
+}
+
+void expand_565(uint16_t color, uint8_t *rgba)
+{
+    uint32_t r = (color >> 11) & 0x1f;
+    uint32_t g = (color >> 5) & 0x3f;
+    uint32_t b = color & 0x1f;
+
+    rgba[0] = static_cast<uint8_t>(r << 3 | r >> 2);
+    rgba[1] = static_cast<uint8_t>(g << 2 | g >> 4);
+    rgba[2] = static_cast<uint8_t>(b << 3 | b >> 2);
+    rgba[3] = 255;
+}
+
+/**
+ * @brief Decodes the 8 byte color part shared by BC1, BC2 and BC3.
+ * @param punch_through Whether c0 <= c1 selects the three color mode, only BC1 has it.
+ */
+void decode_color(uint8_t const *data, Block &block, bool punch_through, bool transparent_black)
+{
+    uint16_t c0 = read_u16(data);
+    uint16_t c1 = read_u16(data + 2);
+
+    std::array<std::array<uint8_t, 4>, 4> palette;
+    expand_565(c0, palette[0].data());
+    expand_565(c1, palette[1].data());
+
+    if (c0 > c1 || !punch_through)
+    {
+        for (int c = 0; c < 3; c++)
+        {
+            palette[2][c] = static_cast<uint8_t>((2 * palette[0][c] + palette[1][c]) / 3);
+            palette[3][c] = static_cast<uint8_t>((palette[0][c] + 2 * palette[1][c]) / 3);
+        }
+        palette[2][3] = 255;
+        palette[3][3] = 255;
+    }
+    else
+    {
+        for (int c = 0; c < 3; c++)
+        {
+            palette[2][c] = static_cast<uint8_t>((palette[0][c] + palette[1][c]) / 2);
+            palette[3][c] = 0;
+        }
+        palette[2][3] = 255;
+        palette[3][3] = transparent_black ? 0 : 255;
+    }
+
+    uint32_t indices = data[4] | data[5] << 8 | data[6] << 16 | static_cast<uint32_t>(data[7]) << 24;
+    for (uint32_t i = 0; i < 16; i++)
+    {
+        std::copy(palette[(indices >> (2 * i)) & 3].begin(), palette[(indices >> (2 * i)) & 3].end(), block.begin() + i * 4);
+    }
+}
+
+/**
+ * @brief Decodes an 8 byte interpolated single channel block, the alpha of BC3 and the channels of BC4 and BC5.
+ */
+void decode_channel(uint8_t const *data, Block &block, uint32_t channel)
+{
+    std::array<uint32_t, 8> palette;
+    palette[0] = data[0];
+    palette[1] = data[1];
+
+    if (palette[0] > palette[1])
+    {
+        for (uint32_t i = 1; i < 7; i++)
+        {
+            palette[i + 1] = ((7 - i) * palette[0] + i * palette[1]) / 7;
+        }
+    }
+    else
+    {
+        for (uint32_t i = 1; i < 5; i++)
+        {
+            palette[i + 1] = ((5 - i) * palette[0] + i * palette[1]) / 5;
+        }
+        palette[6] = 0;
+        palette[7] = 255;
+    }
+
+    uint64_t indices = 0;
+    for (uint32_t i = 0; i < 6; i++)
+    {
+        indices |= static_cast<uint64_t>(data[2 + i]) << (8 * i);
+    }
+
+    for (uint32_t i = 0; i < 16; i++)
+    {
+        block[i * 4 + channel] = static_cast<uint8_t>(palette[(indices >> (3 * i)) & 7]);
+    }
+}
+
+/**
+ * @brief Decodes the explicit 4 bit alpha of BC2.
+ */
+void decode_explicit_alpha(uint8_t const *data, Block &block)
+{
+    for (uint32_t i = 0; i < 16; i++)
+    {
+        uint32_t alpha   = (data[i / 2] >> (4 * (i % 2))) & 0xf;
+        block[i * 4 + 3] = static_cast<uint8_t>(alpha << 4 | alpha);
+    }
+}
+
+uint32_t get_block_size(vk::Format format)
+{
+    switch (format)
+    {
+        case vk::Format::eBc1RgbUnormBlock:
+        case vk::Format::eBc1RgbSrgbBlock:
+        case vk::Format::eBc1RgbaUnormBlock:
+        case vk::Format::eBc1RgbaSrgbBlock:
+        case vk::Format::eBc4UnormBlock:
+            return 8;
+        case vk::Format::eBc2UnormBlock:
+        case vk::Format::eBc2SrgbBlock:
+        case vk::Format::eBc3UnormBlock:
+        case vk::Format::eBc3SrgbBlock:
+        case vk::Format::eBc5UnormBlock:
+            return 16;
+        default:
+            return 0;
+    }
+}
+}  // namespace
+
+/**
+ * @returns The format the payload of the given format decodes to, or eUndefined if it can't be decoded.
+ */
+vk::Format get_bc_decoded_format(vk::Format format)
+{
+    switch (format)
+    {
+        case vk::Format::eBc1RgbSrgbBlock:
+        case vk::Format::eBc1RgbaSrgbBlock:
+        case vk::Format::eBc2SrgbBlock:
+        case vk::Format::eBc3SrgbBlock:
+            return vk::Format::eR8G8B8A8Srgb;
+        case vk::Format::eBc1RgbUnormBlock:
+        case vk::Format::eBc1RgbaUnormBlock:
+        case vk::Format::eBc2UnormBlock:
+        case vk::Format::eBc3UnormBlock:
+        case vk::Format::eBc4UnormBlock:
+        case vk::Format::eBc5UnormBlock:
+            return vk::Format::eR8G8B8A8Unorm;
+        default:
+            return vk::Format::eUndefined;
+    }
+}
+
+/**
+ * @brief Decodes one mip level.
+ *
+ * BC4 decodes to red and BC5 to red and green, with blue at 0 and alpha at 255 like the
+ * sampled values of the compressed formats.
+ * @returns extent.width * extent.height RGBA8 texels.
+ */
+std::vector<uint8_t> decode_bc(vk::Format format, vk::Extent2D const &extent, uint8_t const *data, size_t size)
+{
+    uint32_t block_size = get_block_size(format);
+    if (!block_size)
+    {
+        throw std::runtime_error("Unsupported format for BC decoding: " + vk::to_string(format));
+    }
+
+    uint32_t blocks_x = (extent.width + 3) / 4;
+    uint32_t blocks_y = (extent.height + 3) / 4;
+    if (size < static_cast<size_t>(blocks_x) * blocks_y * block_size)
+    {
+        throw std::runtime_error("BC payload is smaller than its extent.");
+    }
+
+    std::vector<uint8_t> texels(static_cast<size_t>(extent.width) * extent.height * 4);
+
+    for (uint32_t by = 0; by < blocks_y; by++)
+    {
+        for (uint32_t bx = 0; bx < blocks_x; bx++)
+        {
+            uint8_t const *src = data + (static_cast<size_t>(by) * blocks_x + bx) * block_size;
+
+            Block block{};
+            switch (format)
+            {
+                case vk::Format::eBc1RgbUnormBlock:
+                case vk::Format::eBc1RgbSrgbBlock:
+                    decode_color(src, block, true, false);
+                    break;
+                case vk::Format::eBc1RgbaUnormBlock:
+                case vk::Format::eBc1RgbaSrgbBlock:
+                    decode_color(src, block, true, true);
+                    break;
+                case vk::Format::eBc2UnormBlock:
+                case vk::Format::eBc2SrgbBlock:
+                    decode_color(src + 8, block, false, false);
+                    decode_explicit_alpha(src, block);
+                    break;
+                case vk::Format::eBc3UnormBlock:
+                case vk::Format::eBc3SrgbBlock:
+                    decode_color(src + 8, block, false, false);
+                    decode_channel(src, block, 3);
+                    break;
+                case vk::Format::eBc4UnormBlock:
+                    decode_channel(src, block, 0);
+                    for (uint32_t i = 0; i < 16; i++)
+                    {
+                        block[i * 4 + 3] = 255;
+                    }
+                    break;
+                case vk::Format::eBc5UnormBlock:
+                    decode_channel(src, block, 0);
+                    decode_channel(src + 8, block, 1);
+                    for (uint32_t i = 0; i < 16; i++)
+                    {
+                        block[i * 4 + 3] = 255;
+                    }
+                    break;
+                default:
+                    break;
+            }
+
+            // Blocks along the right and bottom edges extend past the image.
+            uint32_t width  = std::min(4u, extent.width - bx * 4);
+            uint32_t height = std::min(4u, extent.height - by * 4);
+            for (uint32_t y = 0; y < height; y++)
+            {
+                uint8_t *dst = texels.data() + ((static_cast<size_t>(by) * 4 + y) * extent.width + bx * 4) * 4;
+                std::copy_n(block.begin() + y * 16, width * 4, dst);
+            }
+        }
+    }
+
+    return texels;
+}
@@ -0,0 +1,15 @@
+﻿#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+#include <cstdint>
+#include <vector>
+
+/*
+ * CPU fallback for block-compressed textures on devices which can't sample them.
+ *
+ * Decodes the BC1 to BC5 formats into RGBA8, which every device can sample. BC6H, BC7 and ASTC are
+ * not covered, their payloads should be transcoded to a supported format instead.
+ */
+vk::Format           get_bc_decoded_format(vk::Format format);
+std::vector<uint8_t> decode_bc(vk::Format format, vk::Extent2D const &extent, uint8_t const *data, size_t size);
@@ -0,0 +1,202 @@
+﻿#include "render/bindless_heap.hpp"
+
+#include <common/logging.h>
+
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+
+/**
+ * @brief Creates the descriptor set, sized to the device limits for update-after-bind descriptors.
+ * @param frame_sync Defers the reuse of released indices until the frames using them completed.
+ */
+void BindlessHeap::prepare(vk::PhysicalDevice gpu, vk::Device device, DeviceDispatch const &dispatch, FrameSync &frame_sync)
+{
+    this->device     = device;
+    this->dispatch   = &dispatch;
+    this->frame_sync = &frame_sync;
+
+    auto properties = gpu.getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceVulkan12Properties>();
+    auto limits     = properties.get<vk::PhysicalDeviceVulkan12Properties>();
+
+    tables[static_cast<size_t>(Kind::eTexture)].type     = vk::DescriptorType::eSampledImage;
+    tables[static_cast<size_t>(Kind::eTexture)].capacity = std::min({16384u, limits.maxDescriptorSetUpdateAfterBindSampledImages, limits.maxPerStageDescriptorUpdateAfterBindSampledImages});
+    tables[static_cast<size_t>(Kind::eSampler)].type     = vk::DescriptorType::eSampler;
+    tables[static_cast<size_t>(Kind::eSampler)].capacity = std::min({256u, limits.maxDescriptorSetUpdateAfterBindSamplers, limits.maxPerStageDescriptorUpdateAfterBindSamplers});
+    tables[static_cast<size_t>(Kind::eBuffer)].type      = vk::DescriptorType::eStorageBuffer;
+    tables[static_cast<size_t>(Kind::eBuffer)].capacity  = std::min({4096u, limits.maxDescriptorSetUpdateAfterBindStorageBuffers, limits.maxPerStageDescriptorUpdateAfterBindStorageBuffers});
+
+    std::array<vk::DescriptorSetLayoutBinding, 3> bindings;
+    std::array<vk::DescriptorBindingFlags, 3>     binding_flags;
+    std::array<vk::DescriptorPoolSize, 3>         pool_sizes;
+    for (uint32_t i = 0; i < tables.size(); i++)
+    {
+        bindings[i]      = vk::DescriptorSetLayoutBinding(i, tables[i].type, tables[i].capacity, shader_stages);
+        binding_flags[i] = vk::DescriptorBindingFlagBits::ePartiallyBound | vk::DescriptorBindingFlagBits::eUpdateAfterBind | vk::DescriptorBindingFlagBits::eUpdateUnusedWhilePending;
+        pool_sizes[i]    = vk::DescriptorPoolSize(tables[i].type, tables[i].capacity);
+    }
+
+    vk::DescriptorSetLayoutBindingFlagsCreateInfo flags_info(binding_flags);
+    set_layout = device.createDescriptorSetLayout({vk::DescriptorSetLayoutCreateFlagBits::eUpdateAfterBindPool, bindings, &flags_info});
+
+    descriptor_pool = device.createDescriptorPool({vk::DescriptorPoolCreateFlagBits::eUpdateAfterBind, 1, pool_sizes});
+    descriptor_set  = device.allocateDescriptorSets({descriptor_pool, set_layout}).front();
+
+    vk::PushConstantRange push_range(shader_stages, 0, push_constant_size);
+    pipeline_layout = device.createPipelineLayout({{}, set_layout, push_range});
+
+    LOGI("Bindless heap: {} textures, {} samplers, {} buffers",
+         tables[static_cast<size_t>(Kind::eTexture)].capacity,
+         tables[static_cast<size_t>(Kind::eSampler)].capacity,
+         tables[static_cast<size_t>(Kind::eBuffer)].capacity);
+}
+
+void BindlessHeap::destroy()
+{
+    if (pipeline_layout)
+    {
+        device.destroyPipelineLayout(pipeline_layout);
+    }
+
+    // Destroying the pool frees the set.
+    if (descriptor_pool)
+    {
+        device.destroyDescriptorPool(descriptor_pool);
+    }
+
+    if (set_layout)
+    {
+        device.destroyDescriptorSetLayout(set_layout);
+    }
+
+    *this = BindlessHeap();
+}
+
+/**
+ * @brief Registers an image view sampled by shaders.
+ * @returns The stable index of the texture in the texture array.
+ */
+BindlessHeap::Index BindlessHeap::register_texture(vk::ImageView view, vk::ImageLayout layout)
+{
+    Index index = allocate(Kind::eTexture);
+    update_texture(index, view, layout);
+    return index;
+}
+
+BindlessHeap::Index BindlessHeap::register_sampler(vk::Sampler sampler)
+{
+    Index                   index = allocate(Kind::eSampler);
+    vk::DescriptorImageInfo image_info(sampler, nullptr, vk::ImageLayout::eUndefined);
+    write(Kind::eSampler, index, &image_info, nullptr);
+    return index;
+}
+
+BindlessHeap::Index BindlessHeap::register_buffer(vk::Buffer buffer, vk::DeviceSize offset, vk::DeviceSize range)
+{
+    Index                    index = allocate(Kind::eBuffer);
+    vk::DescriptorBufferInfo buffer_info(buffer, offset, range);
+    write(Kind::eBuffer, index, nullptr, &buffer_info);
+    return index;
+}
+
+/**
+ * @brief Points a registered texture at another view.
+ *
+ * Only valid while no frame in flight may sample the index. Textures which change while in use,
+ * like streamed ones, register the new view and release the old index instead.
+ */
+void BindlessHeap::update_texture(Index index, vk::ImageView view, vk::ImageLayout layout)
+{
+    vk::DescriptorImageInfo image_info(nullptr, view, layout);
+    write(Kind::eTexture, index, &image_info, nullptr);
+}
+
+/**
+ * @brief Releases an index. It is handed out again once the current frame has completed on the GPU.
+ */
+void BindlessHeap::release(Kind kind, Index index)
+{
+    assert(index != invalid_index);
+
+    tables[static_cast<size_t>(kind)].live--;
+    frame_sync->retire([this, kind, index]() { tables[static_cast<size_t>(kind)].free.push_back(index); });
+}
+
+/**
+ * @brief Binds the heap as set 0 of the shared pipeline layout.
+ */
+void BindlessHeap::bind(vk::CommandBuffer cmd, vk::PipelineBindPoint bind_point) const
+{
+    cmd.bindDescriptorSets(bind_point, pipeline_layout, 0, descriptor_set, {}, *dispatch);
+}
+
+vk::DescriptorSetLayout BindlessHeap::get_set_layout() const
+{
+    return set_layout;
+}
+
+vk::PipelineLayout BindlessHeap::get_pipeline_layout() const
+{
+    return pipeline_layout;
+}
+
+uint32_t BindlessHeap::get_live_count(Kind kind) const
+{
+    return tables[static_cast<size_t>(kind)].live;
+}
+
+/**
+ * @brief Checks that a shader only declares the bindings of the heap and fits into its push constants,
+ *        so it can be used with the shared pipeline layout.
+ */
+bool BindlessHeap::is_compatible(ShaderReflection const &reflection) const
+{
+    if (reflection.sets.size() > 1 || reflection.push_constant_size > push_constant_size)
+    {
+        return false;
+    }
+
+    for (auto const &set : reflection.sets)
+    {
+        for (auto const &binding : set)
+        {
+            if (binding.binding >= tables.size() || binding.descriptorType != tables[binding.binding].type ||
+                binding.descriptorCount > tables[binding.binding].capacity)
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+BindlessHeap::Index BindlessHeap::allocate(Kind kind)
+{
+    Table &table = tables[static_cast<size_t>(kind)];
+
+    Index index;
+    if (!table.free.empty())
+    {
+        index = table.free.back();
+        table.free.pop_back();
+    }
+    else if (table.next < table.capacity)
+    {
+        index = table.next++;
+    }
+    else
+    {
+        throw std::runtime_error("Bindless heap is full.");
+    }
+
+    table.live++;
+    return index;
+}
+
+void BindlessHeap::write(Kind kind, Index index, vk::DescriptorImageInfo const *image_info, vk::DescriptorBufferInfo const *buffer_info)
+{
+    Table const &table = tables[static_cast<size_t>(kind)];
+
+    vk::WriteDescriptorSet descriptor_write(descriptor_set, static_cast<uint32_t>(kind), index, 1, table.type, image_info, buffer_info);
+    device.updateDescriptorSets(descriptor_write, {});
+}
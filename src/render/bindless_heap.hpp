@@ -0,0 +1,82 @@
+﻿#pragma once
+
+#include "render/device_dispatch.hpp"
+#include "render/frame_sync.hpp"
+#include "render/shader_reflection.hpp"
+
+#include <array>
+#include <vector>
+
+/**
+ * @brief One descriptor set holding large arrays of all textures, samplers and storage buffers.
+ *
+ * Resources are registered once and addressed by a stable index, which draws pass to their shaders
+ * through push constants. The set is bound once per command buffer instead of a set per draw. The
+ * arrays are partially bound and updated after bind, so registering never invalidates recorded
+ * command buffers. A released index is only reused once the frames that might still access it
+ * have completed.
+ */
+class BindlessHeap
+{
+public:
+    using Index = uint32_t;
+
+    static constexpr Index    invalid_index      = ~0u;
+    static constexpr uint32_t push_constant_size = 128;        // The minimum maxPushConstantsSize.
+
+    static constexpr vk::ShaderStageFlags shader_stages = vk::ShaderStageFlagBits::eAllGraphics | vk::ShaderStageFlagBits::eCompute;
+
+    /// @brief The bindings of the set, shaders declare the arrays at these bindings.
+    enum class Kind
+    {
+        eTexture,        // binding 0, texture2D[]
+        eSampler,        // binding 1, sampler[]
+        eBuffer          // binding 2, buffer[]
+    };
+
+    void prepare(vk::PhysicalDevice gpu, vk::Device device, DeviceDispatch const &dispatch, FrameSync &frame_sync);
+    void destroy();
+
+    Index register_texture(vk::ImageView view, vk::ImageLayout layout = vk::ImageLayout::eShaderReadOnlyOptimal);
+    Index register_sampler(vk::Sampler sampler);
+    Index register_buffer(vk::Buffer buffer, vk::DeviceSize offset = 0, vk::DeviceSize range = VK_WHOLE_SIZE);
+    void  update_texture(Index index, vk::ImageView view, vk::ImageLayout layout = vk::ImageLayout::eShaderReadOnlyOptimal);
+    void  release(Kind kind, Index index);
+
+    void bind(vk::CommandBuffer cmd, vk::PipelineBindPoint bind_point) const;
+
+    template <typename T>
+    void push_constants(vk::CommandBuffer cmd, T const &constants) const
+    {
+        static_assert(sizeof(T) <= push_constant_size, "Push constants exceed the bindless pipeline layout.");
+        cmd.pushConstants(pipeline_layout, shader_stages, 0, sizeof(T), &constants, *dispatch);
+    }
+
+    vk::DescriptorSetLayout get_set_layout() const;
+    vk::PipelineLayout      get_pipeline_layout() const;
+    uint32_t                get_live_count(Kind kind) const;
+    bool                    is_compatible(ShaderReflection const &reflection) const;
+
+private:
+    struct Table
+    {
+        vk::DescriptorType type;
+        uint32_t           capacity = 0;
+        uint32_t           next     = 0;        // Indices from here on were never used.
+        uint32_t           live     = 0;
+        std::vector<Index> free;                // Released indices whose frames have completed.
+    };
+
+    Index allocate(Kind kind);
+    void  write(Kind kind, Index index, vk::DescriptorImageInfo const *image_info, vk::DescriptorBufferInfo const *buffer_info);
+
+private:
+    vk::Device              device;
+    DeviceDispatch const   *dispatch   = nullptr;   // Binds the heap and pushes the constants.
+    FrameSync              *frame_sync = nullptr;
+    vk::DescriptorSetLayout set_layout;
+    vk::DescriptorPool      descriptor_pool;
+    vk::DescriptorSet       descriptor_set;
+    vk::PipelineLayout      pipeline_layout;        // The set and push_constant_size bytes for all stages, shared by all pipelines.
+    std::array<Table, 3>    tables;                 // Indexed by Kind.
+};
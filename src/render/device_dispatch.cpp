@@ -0,0 +1,80 @@
+﻿#include "render/device_dispatch.hpp"
+
+#include <common/logging.h>
+
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+/**
+ * @brief Loads the functions, once the device exists.
+ * @param through_loader Loads the loader's trampolines instead of the device's own functions.
+ */
+void DeviceDispatch::load(vk::Instance instance, vk::PhysicalDevice gpu, vk::Device device, bool through_loader)
+{
+    this->through_loader = through_loader;
+
+    char const *missing       = nullptr;
+    auto        load_function = [&](auto &function, char const *name, bool required = true) {
+        PFN_vkVoidFunction address = through_loader ? instance.getProcAddr(name) : device.getProcAddr(name);
+        function                   = reinterpret_cast<std::remove_reference_t<decltype(function)>>(address);
+        if (!function && required && !missing)
+        {
+            missing = name;
+        }
+    };
+
+    load_function(vkAcquireNextImageKHR, "vkAcquireNextImageKHR");
+    load_function(vkAcquireNextImage2KHR, "vkAcquireNextImage2KHR", false);
+    load_function(vkQueuePresentKHR, "vkQueuePresentKHR");
+    load_function(vkQueueSubmit, "vkQueueSubmit");
+    load_function(vkWaitSemaphores, "vkWaitSemaphores");
+    load_function(vkGetSemaphoreCounterValue, "vkGetSemaphoreCounterValue");
+    load_function(vkResetCommandPool, "vkResetCommandPool");
+    load_function(vkResetQueryPool, "vkResetQueryPool");
+    load_function(vkGetQueryPoolResults, "vkGetQueryPoolResults");
+
+    load_function(vkBeginCommandBuffer, "vkBeginCommandBuffer");
+    load_function(vkEndCommandBuffer, "vkEndCommandBuffer");
+    load_function(vkCmdPipelineBarrier, "vkCmdPipelineBarrier");
+    load_function(vkCmdBeginRenderPass, "vkCmdBeginRenderPass");
+    load_function(vkCmdEndRenderPass, "vkCmdEndRenderPass");
+    load_function(vkCmdBindPipeline, "vkCmdBindPipeline");
+    load_function(vkCmdBindDescriptorSets, "vkCmdBindDescriptorSets");
+    load_function(vkCmdPushConstants, "vkCmdPushConstants");
+    load_function(vkCmdBindVertexBuffers, "vkCmdBindVertexBuffers");
+    load_function(vkCmdBindIndexBuffer, "vkCmdBindIndexBuffer");
+    load_function(vkCmdSetViewport, "vkCmdSetViewport");
+    load_function(vkCmdSetScissor, "vkCmdSetScissor");
+    load_function(vkCmdDrawIndexed, "vkCmdDrawIndexed");
+    load_function(vkCmdDrawIndexedIndirect, "vkCmdDrawIndexedIndirect");
+    load_function(vkCmdDispatch, "vkCmdDispatch");
+    load_function(vkCmdFillBuffer, "vkCmdFillBuffer");
+    load_function(vkCmdWriteTimestamp, "vkCmdWriteTimestamp");
+
+    // Dynamic rendering is optional, before Vulkan 1.3 the device may only have the extension's entry
+    // points. The loader returns trampolines for the core names of the instance's version whatever the
+    // device supports, so the name is chosen by the device's version rather than by what loads.
+    if (gpu.getProperties().apiVersion >= VK_API_VERSION_1_3)
+    {
+        load_function(vkCmdBeginRendering, "vkCmdBeginRendering", false);
+        load_function(vkCmdEndRendering, "vkCmdEndRendering", false);
+    }
+    else
+    {
+        load_function(vkCmdBeginRendering, "vkCmdBeginRenderingKHR", false);
+        load_function(vkCmdEndRendering, "vkCmdEndRenderingKHR", false);
+    }
+
+    if (missing)
+    {
+        throw std::runtime_error(std::string("failed to load the device function ") + missing + "!");
+    }
+
+    LOGI("Frame path: device functions {}", through_loader ? "called through the loader's trampolines" : "called directly");
+}
+
+bool DeviceDispatch::is_through_loader() const
+{
+    return through_loader;
+}
@@ -0,0 +1,64 @@
+﻿#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+/**
+ * @brief The device functions of the frame path, in one small table loaded once per device.
+ *
+ * Vulkan-Hpp calls through VULKAN_HPP_DEFAULT_DISPATCHER unless a call is given a dispatcher of its
+ * own. The default one is a global table of every function of the API, spread over hundreds of cache
+ * lines, of which a frame touches a few dozen. This table holds just those, next to each other, and
+ * is passed as the last argument of the calls recording and submitting the frames, e.g.
+ * cmd.drawIndexed(6, 1, 0, 0, 0, dispatch).
+ *
+ * The functions are loaded with vkGetDeviceProcAddr, so the calls go straight into the driver.
+ * Loaded through vkGetInstanceProcAddr instead, they are the loader's trampolines, which look up the
+ * device's own table on every call. LOOM_DISPATCH=loader loads them that way, to compare the two.
+ */
+class DeviceDispatch
+{
+public:
+    void load(vk::Instance instance, vk::PhysicalDevice gpu, vk::Device device, bool through_loader);
+    bool is_through_loader() const;
+
+    /// @brief Vulkan-Hpp checks that a dispatcher was built against the headers it is used with.
+    size_t getVkHeaderVersion() const
+    {
+        return VK_HEADER_VERSION;
+    }
+
+    // Presentation and submission.
+    PFN_vkAcquireNextImageKHR      vkAcquireNextImageKHR      = nullptr;
+    PFN_vkAcquireNextImage2KHR     vkAcquireNextImage2KHR     = nullptr;  // Only with a device group.
+    PFN_vkQueuePresentKHR          vkQueuePresentKHR          = nullptr;
+    PFN_vkQueueSubmit              vkQueueSubmit              = nullptr;
+    PFN_vkWaitSemaphores           vkWaitSemaphores           = nullptr;
+    PFN_vkGetSemaphoreCounterValue vkGetSemaphoreCounterValue = nullptr;
+    PFN_vkResetCommandPool         vkResetCommandPool         = nullptr;
+    PFN_vkResetQueryPool           vkResetQueryPool           = nullptr;
+    PFN_vkGetQueryPoolResults      vkGetQueryPoolResults      = nullptr;
+
+    // Recording.
+    PFN_vkBeginCommandBuffer       vkBeginCommandBuffer       = nullptr;
+    PFN_vkEndCommandBuffer         vkEndCommandBuffer         = nullptr;
+    PFN_vkCmdPipelineBarrier       vkCmdPipelineBarrier       = nullptr;
+    PFN_vkCmdBeginRenderPass       vkCmdBeginRenderPass       = nullptr;
+    PFN_vkCmdEndRenderPass         vkCmdEndRenderPass         = nullptr;
+    PFN_vkCmdBeginRendering        vkCmdBeginRendering        = nullptr;  // The KHR entry point before Vulkan 1.3.
+    PFN_vkCmdEndRendering          vkCmdEndRendering          = nullptr;
+    PFN_vkCmdBindPipeline          vkCmdBindPipeline          = nullptr;
+    PFN_vkCmdBindDescriptorSets    vkCmdBindDescriptorSets    = nullptr;
+    PFN_vkCmdPushConstants         vkCmdPushConstants         = nullptr;
+    PFN_vkCmdBindVertexBuffers     vkCmdBindVertexBuffers     = nullptr;
+    PFN_vkCmdBindIndexBuffer       vkCmdBindIndexBuffer       = nullptr;
+    PFN_vkCmdSetViewport           vkCmdSetViewport           = nullptr;
+    PFN_vkCmdSetScissor            vkCmdSetScissor            = nullptr;
+    PFN_vkCmdDrawIndexed           vkCmdDrawIndexed           = nullptr;
+    PFN_vkCmdDrawIndexedIndirect   vkCmdDrawIndexedIndirect   = nullptr;
+    PFN_vkCmdDispatch              vkCmdDispatch              = nullptr;
+    PFN_vkCmdFillBuffer            vkCmdFillBuffer            = nullptr;
+    PFN_vkCmdWriteTimestamp        vkCmdWriteTimestamp        = nullptr;
+
+private:
+    bool through_loader = false;
+};
@@ -0,0 +1,218 @@
+﻿#include "render/device_selection.hpp"
+
+#include "render/gpu_resources.hpp"
+
+#include <common/logging.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+
+namespace
+{
+// The type dominates the score, a feature outweighs any difference in memory.
+constexpr int64_t type_weight    = 1'000'000;
+constexpr int64_t feature_weight = 10'000;
+
+int64_t get_type_score(vk::PhysicalDeviceType type)
+{
+    switch (type)
+    {
+        case vk::PhysicalDeviceType::eDiscreteGpu:
+            return 4;
+        case vk::PhysicalDeviceType::eIntegratedGpu:
+            return 3;
+        case vk::PhysicalDeviceType::eVirtualGpu:
+            return 2;
+        case vk::PhysicalDeviceType::eCpu:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+/**
+ * @returns The number of optional features the engine uses which the device supports: indirect draws
+ *          in one call, anisotropic filtering, dynamic rendering and the memory budget.
+ */
+int64_t count_optional_features(vk::PhysicalDevice gpu, uint32_t api_version)
+{
+    vk::PhysicalDeviceFeatures features = gpu.getFeatures();
+
+    int64_t count = (features.multiDrawIndirect && features.drawIndirectFirstInstance) + features.samplerAnisotropy;
+
+    std::vector<vk::ExtensionProperties> extensions    = gpu.enumerateDeviceExtensionProperties();
+    auto                                 has_extension = [&extensions](char const *name) {
+        return std::any_of(extensions.begin(), extensions.end(), [name](vk::ExtensionProperties const &extension) { return strcmp(extension.extensionName, name) == 0; });
+    };
+
+    count += api_version >= VK_API_VERSION_1_3 || has_extension(VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME);
+    count += has_extension(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+    return count;
+}
+}  // namespace
+
+/**
+ * @brief Scores all physical devices of the instance.
+ * @param supports_present Whether a queue family of a device can present to the surface.
+ */
+std::vector<DeviceCandidate> rank_physical_devices(vk::Instance instance, std::function<bool(vk::PhysicalDevice, uint32_t)> const &supports_present)
+{
+    std::vector<vk::PhysicalDevice> gpus = instance.enumeratePhysicalDevices();
+
+    std::vector<DeviceCandidate> candidates;
+    for (uint32_t i = 0; i < gpus.size(); i++)
+    {
+        DeviceCandidate candidate;
+        candidate.gpu   = gpus[i];
+        candidate.index = i;
+
+        vk::PhysicalDeviceProperties properties = candidate.gpu.getProperties();
+        candidate.name                          = properties.deviceName.data();
+        candidate.type                          = properties.deviceType;
+        candidate.api_version                   = properties.apiVersion;
+
+        vk::PhysicalDeviceMemoryProperties memory_properties = candidate.gpu.getMemoryProperties();
+        for (uint32_t h = 0; h < memory_properties.memoryHeapCount; h++)
+        {
+            if (memory_properties.memoryHeaps[h].flags & vk::MemoryHeapFlagBits::eDeviceLocal)
+            {
+                candidate.local_bytes = std::max(candidate.local_bytes, memory_properties.memoryHeaps[h].size);
+            }
+        }
+
+        candidate.group_size = static_cast<uint32_t>(find_device_group(instance, candidate.gpu).size());
+
+        std::vector<vk::QueueFamilyProperties> queue_family_properties = candidate.gpu.getQueueFamilyProperties();
+        for (uint32_t j = 0; j < queue_family_properties.size() && candidate.queue_index == ~0u; j++)
+        {
+            vk::QueueFlags const required = vk::QueueFlagBits::eGraphics | vk::QueueFlagBits::eCompute;
+            if ((queue_family_properties[j].queueFlags & required) == required && supports_present(candidate.gpu, j))
+            {
+                candidate.queue_index = j;
+            }
+        }
+
+        if (candidate.api_version < VK_API_VERSION_1_2)
+        {
+            candidate.rejection = "Vulkan 1.2 is required";
+        }
+        else if (!candidate.gpu.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceVulkan12Features>().get<vk::PhysicalDeviceVulkan12Features>().timelineSemaphore)
+        {
+            candidate.rejection = "no timeline semaphores";
+        }
+        else if (candidate.queue_index == ~0u)
+        {
+            candidate.rejection = "no queue family with graphics, compute and presentation";
+        }
+        else
+        {
+            candidate.score = get_type_score(candidate.type) * type_weight + count_optional_features(candidate.gpu, candidate.api_version) * feature_weight +
+                              static_cast<int64_t>(std::min<vk::DeviceSize>(candidate.local_bytes >> 20, feature_weight - 1));
+        }
+
+        candidates.push_back(std::move(candidate));
+    }
+
+    // Equal devices keep their enumeration order.
+    std::stable_sort(candidates.begin(), candidates.end(), [](DeviceCandidate const &a, DeviceCandidate const &b) {
+        return a.is_usable() != b.is_usable() ? a.is_usable() : a.score > b.score;
+    });
+    return candidates;
+}
+
+void log_device_candidates(std::vector<DeviceCandidate> const &candidates)
+{
+    LOGI("Physical devices:");
+    for (auto const &candidate : candidates)
+    {
+        if (candidate.is_usable())
+        {
+            LOGI("\t[{}] {} ({}, {} MiB device-local, {} in its group): score {}",
+                 candidate.index,
+                 candidate.name,
+                 vk::to_string(candidate.type),
+                 candidate.local_bytes >> 20,
+                 candidate.group_size,
+                 candidate.score);
+        }
+        else
+        {
+            LOGI("\t[{}] {} ({}): rejected, {}", candidate.index, candidate.name, vk::to_string(candidate.type), candidate.rejection);
+        }
+    }
+}
+
+std::vector<vk::PhysicalDevice> find_device_group(vk::Instance instance, vk::PhysicalDevice gpu)
+{
+    std::vector<vk::PhysicalDevice> devices = {gpu};
+    for (auto const &group : instance.enumeratePhysicalDeviceGroups())
+    {
+        auto begin = group.physicalDevices.begin();
+        auto end   = begin + group.physicalDeviceCount;
+        if (std::find(begin, end, gpu) != end)
+        {
+            std::copy_if(begin, end, std::back_inserter(devices), [gpu](vk::PhysicalDevice device) { return device != gpu; });
+        }
+    }
+    return devices;
+}
+
+/**
+ * @brief Checks that work submitted for one device of a group runs on that device and sees its own
+ *        instance of device-local memory, which alternate-frame rendering relies on.
+ *
+ * Each device fills its instance of a device-local buffer with its own value and copies it into its
+ * slot of a host-visible buffer. Runs at startup whenever frames alternate between several devices,
+ * a driver which runs the work elsewhere or shares the instances fails it.
+ * @returns Whether every device wrote its own value.
+ */
+bool check_device_group(vk::PhysicalDevice gpu, vk::Device device, GpuQueue const &queue, uint32_t device_count)
+{
+    BufferData per_device = BufferData::CreateBufferData(gpu, device, MemoryCategory::eOther, sizeof(uint32_t),
+                                                         vk::BufferUsageFlagBits::eTransferSrc | vk::BufferUsageFlagBits::eTransferDst, vk::MemoryPropertyFlagBits::eDeviceLocal);
+    BufferData readback   = BufferData::CreateBufferData(gpu, device, MemoryCategory::eOther, sizeof(uint32_t) * device_count, vk::BufferUsageFlagBits::eTransferDst);
+    std::span<uint32_t> values = readback.view<uint32_t>(0, device_count);
+    std::fill(values.begin(), values.end(), 0u);
+
+    vk::CommandPool                command_pool = device.createCommandPool(vk::CommandPoolCreateInfo({}, queue.familyIndex));
+    std::vector<vk::CommandBuffer> cmds         = device.allocateCommandBuffers(vk::CommandBufferAllocateInfo(command_pool, vk::CommandBufferLevel::ePrimary, device_count));
+    std::vector<uint32_t>          masks(device_count);
+    for (uint32_t i = 0; i < device_count; i++)
+    {
+        masks[i] = 1u << i;
+
+        vk::DeviceGroupCommandBufferBeginInfo device_group_begin_info(masks[i]);
+        cmds[i].begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit, nullptr, &device_group_begin_info));
+        cmds[i].fillBuffer(per_device.buffer, 0, sizeof(uint32_t), i + 1);
+        vk::MemoryBarrier fill_barrier(vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eTransferRead);
+        cmds[i].pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eTransfer, {}, fill_barrier, {}, {});
+        cmds[i].copyBuffer(per_device.buffer, readback.buffer, vk::BufferCopy(0, sizeof(uint32_t) * i, sizeof(uint32_t)));
+        vk::MemoryBarrier host_barrier(vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eHostRead);
+        cmds[i].pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eHost, {}, host_barrier, {}, {});
+        cmds[i].end();
+    }
+
+    // Each command buffer runs on the device of its mask, in its own batch.
+    vk::DeviceGroupSubmitInfo device_group_info({}, masks, {});
+    vk::SubmitInfo            submit_info({}, {}, cmds, {}, &device_group_info);
+    vk::Fence                 fence = device.createFence({});
+    queue.queue.submit(submit_info, fence);
+    bool const completed = device.waitForFences(fence, VK_TRUE, UINT64_MAX) == vk::Result::eSuccess;
+
+    bool passed = completed;
+    for (uint32_t i = 0; i < device_count && completed; i++)
+    {
+        if (values[i] != i + 1)
+        {
+            LOGE("Device group self-check: device {} wrote {} instead of {}.", i, values[i], i + 1);
+            passed = false;
+        }
+    }
+
+    device.destroyFence(fence);
+    device.destroyCommandPool(command_pool);
+    per_device.clear(device);
+    readback.clear(device);
+    return passed;
+}
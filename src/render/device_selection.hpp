@@ -0,0 +1,47 @@
+﻿#pragma once
+
+#include "render/gpu_queue.hpp"
+
+#include <vulkan/vulkan.hpp>
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+/// @brief A physical device, what the engine would use of it and how well it suits the engine.
+struct DeviceCandidate
+{
+    vk::PhysicalDevice     gpu;
+    uint32_t               index       = 0;              // The index in the instance's enumeration, which LOOM_DEVICE_INDEX selects by.
+    std::string            name;
+    vk::PhysicalDeviceType type        = vk::PhysicalDeviceType::eOther;
+    uint32_t               api_version = 0;
+    vk::DeviceSize         local_bytes = 0;              // The size of the largest device-local heap.
+    uint32_t               queue_index = ~0u;            // A queue family with graphics, compute and presentation.
+    uint32_t               group_size  = 1;              // The physical devices in the device group of the device.
+    int64_t                score       = 0;
+    std::string            rejection;                    // Why the engine can't run on the device, empty if it can.
+
+    bool is_usable() const
+    {
+        return rejection.empty();
+    }
+};
+
+/*
+ * The candidates are ranked by score, the usable ones first. Discrete devices score above integrated,
+ * virtual and CPU devices, the optional features the engine uses come next and the device-local memory
+ * breaks ties. A device is rejected if it is older than Vulkan 1.2, lacks timeline semaphores or has no
+ * queue family with graphics, compute and presentation.
+ */
+std::vector<DeviceCandidate> rank_physical_devices(vk::Instance instance, std::function<bool(vk::PhysicalDevice, uint32_t)> const &supports_present);
+void                         log_device_candidates(std::vector<DeviceCandidate> const &candidates);
+
+/**
+ * @returns The physical devices of the device group of a device, the device itself first, or only the
+ *          device if it isn't part of a group of several devices.
+ */
+std::vector<vk::PhysicalDevice> find_device_group(vk::Instance instance, vk::PhysicalDevice gpu);
+
+bool check_device_group(vk::PhysicalDevice gpu, vk::Device device, GpuQueue const &queue, uint32_t device_count);
@@ -0,0 +1,330 @@
+﻿#include "render/frame_capture.hpp"
+
+#include <common/logging.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+
+namespace
+{
+double to_milliseconds(std::chrono::steady_clock::duration duration)
+{
+    return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+char const *get_format_name(ImageFileFormat file_format)
+{
+    return get_file_extension(file_format) + 1;
+}
+}  // namespace
+
+/**
+ * @brief Starts the workers, the readback buffers are created by resize.
+ * @param dispatch Polls the readbacks every frame.
+ * @param format The format of the captured images, captures are disabled if it can't be written in the file format.
+ * @param interval Frames between captures, 1 captures every frame.
+ * @param buffer_count The readback buffers, the frames in flight plus the images being written at once.
+ */
+void FrameCapture::prepare(vk::PhysicalDevice gpu, vk::Device device, DeviceDispatch const &dispatch, GpuQueue &queue, vk::Format format, std::string const &output_dir, ImageFileFormat file_format,
+                           uint32_t interval, uint32_t buffer_count, uint32_t thread_count)
+{
+    if (!is_encodable(file_format, format))
+    {
+        LOGW("Frame capture: images of format {} can't be written as {}, capture is disabled.", vk::to_string(format), get_format_name(file_format));
+        return;
+    }
+
+    this->gpu         = gpu;
+    this->device      = device;
+    this->dispatch    = &dispatch;
+    this->queue       = &queue;
+    this->format      = format;
+    this->output_dir  = output_dir;
+    this->file_format = file_format;
+    this->interval    = std::max(interval, 1u);
+    std::filesystem::create_directories(output_dir);
+
+    // The workers read every byte of the buffers, which is slow from write-combined memory. Host-cached memory is
+    // only used if the readback buffers may live in it, the memory types a buffer may use don't depend on its size,
+    // so a small one tells. Every buffer may use a host-visible and coherent type.
+    vk::Buffer const probe     = device.createBuffer(vk::BufferCreateInfo({}, 4, vk::BufferUsageFlagBits::eTransferDst));
+    uint32_t const   type_bits = device.getBufferMemoryRequirements(probe).memoryTypeBits;
+    device.destroyBuffer(probe);
+
+    vk::PhysicalDeviceMemoryProperties memory_properties = gpu.getMemoryProperties();
+    memory_flags = vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent;
+    for (uint32_t i = 0; i < memory_properties.memoryTypeCount; i++)
+    {
+        if ((type_bits & (1u << i)) &&
+            (memory_properties.memoryTypes[i].propertyFlags & (memory_flags | vk::MemoryPropertyFlagBits::eHostCached)) == (memory_flags | vk::MemoryPropertyFlagBits::eHostCached))
+        {
+            memory_flags |= vk::MemoryPropertyFlagBits::eHostCached;
+            break;
+        }
+    }
+
+    readbacks = std::vector<Readback>(std::max(buffer_count, 1u));
+    running   = true;
+    for (uint32_t i = 0; i < std::max(thread_count, 1u); i++)
+    {
+        workers.emplace_back(&FrameCapture::run, this);
+    }
+
+    LOGI("Frame capture: every {} frames into {} as {}, {} readback buffers, {} writer threads", this->interval, output_dir, get_format_name(file_format), readbacks.size(),
+         workers.size());
+}
+
+/**
+ * @brief Writes the captured images and releases everything. The device must be idle.
+ */
+void FrameCapture::destroy()
+{
+    if (readbacks.empty())
+    {
+        return;
+    }
+
+    {
+        std::lock_guard lock(mutex);
+        collect(queue->submitted);
+        running = false;
+    }
+    condition.notify_all();
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+    workers.clear();
+
+    for (auto &readback : readbacks)
+    {
+        readback.buffer.clear(device);
+    }
+    readbacks.clear();
+}
+
+/**
+ * @brief Recreates the readback buffers for an image extent, after the images in them were written. The device must be idle.
+ */
+void FrameCapture::resize(vk::Extent2D const &extent)
+{
+    if (readbacks.empty() || extent == this->extent)
+    {
+        return;
+    }
+
+    {
+        std::unique_lock lock(mutex);
+        if (collect(queue->submitted))
+        {
+            condition.notify_all();
+        }
+        condition.wait(lock, [this] { return is_idle(); });
+    }
+
+    this->extent = extent;
+    for (auto &readback : readbacks)
+    {
+        readback.buffer.clear(device);
+        readback.buffer = BufferData::CreateBufferData(gpu, device, MemoryCategory::eStaging, vk::DeviceSize(extent.width) * extent.height * get_texel_size(format),
+                                                       vk::BufferUsageFlagBits::eTransferDst, memory_flags);
+    }
+
+    if (file_format == ImageFileFormat::eRaw)
+    {
+        LOGI("Frame capture: raw images are {}x{} {}", extent.width, extent.height, vk::to_string(format));
+    }
+}
+
+/**
+ * @brief Hands the readbacks whose copies completed to the workers, and decides whether the frame is captured.
+ */
+void FrameCapture::begin_frame(uint64_t frame_number)
+{
+    if (readbacks.empty())
+    {
+        return;
+    }
+
+    auto const start = std::chrono::steady_clock::now();
+
+    this->frame_number = frame_number;
+    capturing          = frame_number % interval == 0;
+    recorded           = ~0u;
+
+    uint64_t const completed = device.getSemaphoreCounterValue(queue->timeline, *dispatch);
+    bool           ready;
+    {
+        std::lock_guard lock(mutex);
+        ready = collect(completed);
+        frames++;
+    }
+    if (ready)
+    {
+        condition.notify_all();
+    }
+
+    frame_time += std::chrono::steady_clock::now() - start;
+}
+
+/**
+ * @brief Copies the image into a free readback buffer, if the frame is captured. Recorded into the frame's last submission.
+ * @param image The image with all its writes completed, in transfer source layout.
+ */
+void FrameCapture::record(vk::CommandBuffer cmd, vk::Image image)
+{
+    if (!capturing)
+    {
+        return;
+    }
+
+    auto const start = std::chrono::steady_clock::now();
+    {
+        std::lock_guard lock(mutex);
+        auto            readback = std::find_if(readbacks.begin(), readbacks.end(), [](Readback const &candidate) { return candidate.state == State::eFree; });
+        if (readback == readbacks.end())
+        {
+            dropped++;
+        }
+        else
+        {
+            readback->state        = State::eRecorded;
+            readback->frame_number = frame_number;
+            recorded               = static_cast<uint32_t>(readback - readbacks.begin());
+        }
+    }
+
+    if (recorded != ~0u)
+    {
+        vk::BufferImageCopy region(0, 0, 0, vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, 0, 0, 1), vk::Offset3D(), vk::Extent3D(extent, 1));
+        cmd.copyImageToBuffer(image, vk::ImageLayout::eTransferSrcOptimal, readbacks[recorded].buffer.buffer, region);
+
+        // Reaching the timeline value doesn't make the copy visible to the host, the barrier does.
+        vk::MemoryBarrier barrier(vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eHostRead);
+        cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eHost, {}, barrier, {}, {});
+    }
+
+    capturing = false;
+    frame_time += std::chrono::steady_clock::now() - start;
+}
+
+/**
+ * @brief Sets the timeline value the copy of the frame completes with.
+ */
+void FrameCapture::end_frame(uint64_t timeline_value)
+{
+    if (recorded == ~0u)
+    {
+        return;
+    }
+
+    std::lock_guard lock(mutex);
+    readbacks[recorded].state          = State::eSubmitted;
+    readbacks[recorded].timeline_value = timeline_value;
+    recorded                           = ~0u;
+    captured++;
+}
+
+bool FrameCapture::is_enabled() const
+{
+    return !readbacks.empty();
+}
+
+/**
+ * @brief Logs what the capture costs the render thread and the workers since the last report.
+ */
+void FrameCapture::log_statistics()
+{
+    if (readbacks.empty())
+    {
+        return;
+    }
+
+    std::lock_guard lock(mutex);
+    uint64_t const images = written - reported;
+    LOGI("Frame capture: {} frames captured, {} dropped, {} written, {} failed, {:.3f} ms per frame on the render thread, {:.2f} ms per image on the writers",
+         captured,
+         dropped,
+         written,
+         failed,
+         frames ? to_milliseconds(frame_time) / frames : 0.0,
+         images ? to_milliseconds(write_time) / images : 0.0);
+
+    reported   = written;
+    frames     = 0;
+    frame_time = {};
+    write_time = {};
+}
+
+/**
+ * @brief Marks the submitted readbacks up to a timeline value ready for the workers. The mutex must be held.
+ * @returns Whether any readback became ready.
+ */
+bool FrameCapture::collect(uint64_t completed_value)
+{
+    bool ready = false;
+    for (auto &readback : readbacks)
+    {
+        if (readback.state == State::eSubmitted && readback.timeline_value <= completed_value)
+        {
+            readback.state = State::eReady;
+            ready          = true;
+        }
+    }
+    return ready;
+}
+
+/**
+ * @returns Whether no readback is waiting for the GPU or a worker. The mutex must be held.
+ */
+bool FrameCapture::is_idle() const
+{
+    return std::all_of(readbacks.begin(), readbacks.end(), [](Readback const &readback) { return readback.state == State::eFree; });
+}
+
+/**
+ * @brief A worker, encodes and writes the ready readbacks straight from their mapping until the capture is destroyed.
+ */
+void FrameCapture::run()
+{
+    std::unique_lock lock(mutex);
+    while (true)
+    {
+        auto ready = readbacks.end();
+        condition.wait(lock, [&] {
+            ready = std::find_if(readbacks.begin(), readbacks.end(), [](Readback const &readback) { return readback.state == State::eReady; });
+            return !running || ready != readbacks.end();
+        });
+        if (ready == readbacks.end())
+        {
+            return;
+        }
+
+        ready->state = State::eWriting;
+        lock.unlock();
+
+        auto const start = std::chrono::steady_clock::now();
+
+        char name[32];
+        std::snprintf(name, sizeof(name), "frame_%06llu", static_cast<unsigned long long>(ready->frame_number));
+        std::string const path = (std::filesystem::path(output_dir) / name).string() + get_file_extension(file_format);
+
+        // Raw files are the mapped texels themselves.
+        std::span<uint8_t const> texels(static_cast<uint8_t const *>(ready->buffer.mapped), ready->buffer.size);
+        bool const               success = file_format == ImageFileFormat::eRaw ? write_file_atomically(path, texels)
+                                                                                 : write_file_atomically(path, encode_image(file_format, format, extent, texels.data(), texels.size()));
+        if (!success)
+        {
+            LOGE("Frame capture: failed to write {}", path);
+        }
+
+        auto const duration = std::chrono::steady_clock::now() - start;
+
+        lock.lock();
+        ready->state = State::eFree;
+        write_time += duration;
+        (success ? written : failed)++;
+        condition.notify_all();
+    }
+}
@@ -0,0 +1,89 @@
+﻿#pragma once
+
+#include "render/device_dispatch.hpp"
+#include "render/gpu_queue.hpp"
+#include "render/gpu_resources.hpp"
+#include "render/image_encoding.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Captures rendered frames into image files without stalling the frame.
+ *
+ * A captured frame copies its image into one of a pool of host-visible readback buffers, at the end of
+ * the frame's own submission, so the image only needs transfer source usage. The buffers are polled on
+ * the queue's timeline, and once the copy completed, worker threads encode and write the image straight
+ * from the mapped buffer, which then returns to the pool. The render thread never waits and never
+ * allocates: a frame is dropped from the capture when no buffer is free, because the GPU or the
+ * workers fall behind.
+ */
+class FrameCapture
+{
+public:
+    void prepare(vk::PhysicalDevice gpu, vk::Device device, DeviceDispatch const &dispatch, GpuQueue &queue, vk::Format format, std::string const &output_dir, ImageFileFormat file_format,
+                 uint32_t interval, uint32_t buffer_count, uint32_t thread_count);
+    void destroy();
+    void resize(vk::Extent2D const &extent);
+
+    void begin_frame(uint64_t frame_number);
+    void record(vk::CommandBuffer cmd, vk::Image image);
+    void end_frame(uint64_t timeline_value);
+
+    bool is_enabled() const;
+    void log_statistics();
+
+private:
+    enum class State
+    {
+        eFree,
+        eRecorded,           // Copied into by the current frame.
+        eSubmitted,          // Waits for its timeline value.
+        eReady,              // Completed, waits for a worker.
+        eWriting
+    };
+
+    struct Readback
+    {
+        BufferData buffer;
+        State      state          = State::eFree;
+        uint64_t   frame_number   = 0;
+        uint64_t   timeline_value = 0;
+    };
+
+    bool collect(uint64_t completed_value);
+    bool is_idle() const;
+    void run();
+
+private:
+    vk::PhysicalDevice                  gpu;
+    vk::Device                          device;
+    DeviceDispatch const               *dispatch     = nullptr;
+    GpuQueue                           *queue        = nullptr;
+    vk::Format                          format       = vk::Format::eUndefined;
+    vk::Extent2D                        extent;
+    std::string                         output_dir;
+    ImageFileFormat                     file_format  = ImageFileFormat::ePng;
+    vk::MemoryPropertyFlags             memory_flags;                           // Host-cached where there is such memory, reading uncached memory is slow.
+    uint32_t                            interval     = 1;                       // Frames between captures.
+    uint64_t                            frame_number = 0;                       // The current frame.
+    bool                                capturing    = false;                   // Whether the current frame is due for capture.
+    uint32_t                            recorded     = ~0u;                     // The readback the current frame copies into, ~0u if none.
+    std::vector<std::thread>            workers;
+    std::mutex                          mutex;                                  // Guards the readback states and everything below.
+    std::condition_variable             condition;                              // Signals ready readbacks to the workers, and freed ones to resize.
+    std::vector<Readback>               readbacks;
+    bool                                running      = false;
+    uint64_t                            captured     = 0;                       // Frames copied into a readback.
+    uint64_t                            dropped      = 0;                       // Frames due for capture without a free readback.
+    uint64_t                            written      = 0;
+    uint64_t                            failed       = 0;
+    uint64_t                            frames       = 0;                       // Frames since the last report.
+    uint64_t                            reported     = 0;                       // The images written at the last report.
+    std::chrono::steady_clock::duration frame_time{};                           // Spent on the render thread since the last report.
+    std::chrono::steady_clock::duration write_time{};                           // Spent encoding and writing since the last report, over all workers.
+};
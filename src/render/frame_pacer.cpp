@@ -0,0 +1,115 @@
+﻿#include "render/frame_pacer.hpp"
+
+#include <algorithm>
+#include <thread>
+
+namespace
+{
+// The sleeps end at least this long before a frame start, where sleeps are as precise as that.
+constexpr std::chrono::microseconds min_margin(250);
+
+double to_milliseconds(FramePacer::Clock::duration duration)
+{
+    return std::chrono::duration<double, std::milli>(duration).count();
+}
+}  // namespace
+
+/**
+ * @param frames_per_second The target rate, 0 for none, the frames then start as soon as the previous one ended.
+ */
+void FramePacer::set_target_rate(double frames_per_second)
+{
+    period     = frames_per_second > 0.0 ? std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / frames_per_second)) : Clock::duration::zero();
+    next_start = {};
+}
+
+double FramePacer::get_target_rate() const
+{
+    return period.count() ? 1.0 / std::chrono::duration<double>(period).count() : 0.0;
+}
+
+/**
+ * @brief Waits until the next frame starts, called before anything of the frame is done.
+ */
+void FramePacer::wait()
+{
+    Clock::time_point now = Clock::now();
+    if (period.count())
+    {
+        if (next_start == Clock::time_point() || now >= next_start + period)
+        {
+            // The previous frame missed whole intervals, the next ones are scheduled from now.
+            if (next_start != Clock::time_point())
+            {
+                dropped += static_cast<uint64_t>((now - next_start) / period);
+            }
+            next_start = now;
+        }
+
+        // Sleep most of the way, then spin on the clock. The margin follows the worst overshoot closely, and
+        // shrinks slowly while the sleeps are more precise than it.
+        Clock::time_point const wake = next_start - margin;
+        if (wake > now)
+        {
+            std::this_thread::sleep_for(wake - now);
+            Clock::time_point const woken     = Clock::now();
+            Clock::duration const   overshoot = woken - wake;
+            margin                            = overshoot > margin ? overshoot + min_margin : margin - (margin - overshoot) / 16;
+            margin                            = std::clamp<Clock::duration>(margin, min_margin, period / 2);
+            slept += woken - now;
+            now = woken;
+        }
+
+        Clock::time_point const spin_start = now;
+        while (now < next_start)
+        {
+            std::this_thread::yield();
+            now = Clock::now();
+        }
+        spun += now - spin_start;
+        next_start += period;
+    }
+
+    // The frame time is the time between frame starts, the first frame has none.
+    if (last_start != Clock::time_point())
+    {
+        double const frame_time = to_milliseconds(now - last_start);
+        double const deviation  = frame_time - mean;
+        frames++;
+        mean += deviation / frames;
+        squares += deviation * (frame_time - mean);
+        min = frames == 1 ? frame_time : std::min(min, frame_time);
+        max = std::max(max, frame_time);
+    }
+    last_start = now;
+}
+
+FramePacer::Statistics FramePacer::get_statistics() const
+{
+    Statistics statistics;
+    statistics.frames   = frames;
+    statistics.dropped  = dropped;
+    statistics.mean     = mean;
+    statistics.variance = frames > 1 ? squares / (frames - 1) : 0.0;
+    statistics.min      = min;
+    statistics.max      = max;
+    statistics.slept    = to_milliseconds(slept);
+    statistics.spun     = to_milliseconds(spun);
+    statistics.margin   = to_milliseconds(margin);
+    return statistics;
+}
+
+/**
+ * @brief Starts a new statistics window, the schedule and the sleep margin are kept.
+ */
+void FramePacer::reset_statistics()
+{
+    frames  = 0;
+    dropped = 0;
+    mean    = 0.0;
+    squares = 0.0;
+    min     = 0.0;
+    max     = 0.0;
+    slept   = {};
+    spun    = {};
+}
@@ -0,0 +1,56 @@
+﻿#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+/**
+ * @brief Paces the frames to a target rate, so the loop doesn't render frames nobody gets to see.
+ *
+ * Every frame starts one period after the previous one. Sleeps overshoot by up to the scheduler's
+ * granularity, so the pacer sleeps until a margin before the start and spins the rest of the way.
+ * The margin adapts to the overshoot the sleeps actually have. A frame which takes longer than whole
+ * periods drops those intervals, and the schedule restarts from its end instead of rushing frames to
+ * catch up.
+ *
+ * The time between frame starts is what the frames are seen with, its variance shows uneven pacing.
+ */
+class FramePacer
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /// @brief The frames since the last reset, times are in milliseconds.
+    struct Statistics
+    {
+        uint64_t frames   = 0;
+        uint64_t dropped  = 0;        // Intervals missed by frames which took longer than a period, only with a target rate.
+        double   mean     = 0.0;      // The time between frame starts.
+        double   variance = 0.0;      // Of the time between frame starts, in square milliseconds.
+        double   min      = 0.0;
+        double   max      = 0.0;
+        double   slept    = 0.0;      // Waiting for the frame starts, in total.
+        double   spun     = 0.0;
+        double   margin   = 0.0;      // How long before a frame start the sleeps currently end.
+    };
+
+    void   set_target_rate(double frames_per_second);
+    double get_target_rate() const;
+    void   wait();
+
+    Statistics get_statistics() const;
+    void       reset_statistics();
+
+private:
+    Clock::duration   period{};                // Zero without a target rate.
+    Clock::duration   margin = std::chrono::milliseconds(1);
+    Clock::time_point next_start;              // When the next frame starts, unset until the first frame.
+    Clock::time_point last_start;
+    uint64_t          frames  = 0;
+    uint64_t          dropped = 0;
+    double            mean    = 0.0;           // Running mean and sum of squared deviations of the frame times, by Welford.
+    double            squares = 0.0;
+    double            min     = 0.0;
+    double            max     = 0.0;
+    Clock::duration   slept{};
+    Clock::duration   spun{};
+};
@@ -0,0 +1,120 @@
+﻿#include "render/frame_sync.hpp"
+
+#include <cassert>
+
+/**
+ * @param dispatch Waits for the frames.
+ */
+void FrameSync::prepare(vk::Device device, DeviceDispatch const &dispatch, GpuQueue &graphics_queue, uint32_t frames_in_flight)
+{
+    assert(frames_in_flight > 0);
+
+    this->device         = device;
+    this->dispatch       = &dispatch;
+    this->graphics_queue = &graphics_queue;
+
+    slots.resize(frames_in_flight);
+    for (auto &slot : slots)
+    {
+        slot.acquire_semaphore = device.createSemaphore({});
+    }
+}
+
+/**
+ * @brief Waits for the GPU to finish all frames, runs all retired deleters and destroys the semaphores.
+ */
+void FrameSync::destroy()
+{
+    wait_idle();
+
+    for (auto &slot : slots)
+    {
+        device.destroySemaphore(slot.acquire_semaphore);
+    }
+    slots.clear();
+}
+
+/**
+ * @brief Starts the next frame, waiting until the frame which last used its slot completed.
+ * @returns The index of the frame slot.
+ */
+uint32_t FrameSync::begin_frame()
+{
+    frame_number++;
+
+    Slot const &slot = slots[get_frame_index()];
+    if (slot.timeline_value)
+    {
+        (void)device.waitSemaphores(vk::SemaphoreWaitInfo({}, graphics_queue->timeline, slot.timeline_value), UINT64_MAX, *dispatch);
+    }
+
+    // Frames complete in order, so every frame up to the one which used this slot is done.
+    if (frame_number > slots.size())
+    {
+        run_retired(frame_number - slots.size());
+    }
+
+    return get_frame_index();
+}
+
+/**
+ * @brief Ends the current frame.
+ * @param timeline_value The graphics timeline value signaled by the last submission of the frame, which waited for all other queues.
+ */
+void FrameSync::end_frame(uint64_t timeline_value)
+{
+    slots[get_frame_index()].timeline_value = timeline_value;
+}
+
+/**
+ * @brief Runs the deleter once the GPU finished the current frame, e.g. to destroy an object it may still use.
+ */
+void FrameSync::retire(std::function<void()> deleter)
+{
+    retired.push_back({frame_number, std::move(deleter)});
+}
+
+/**
+ * @brief Waits for all submitted frames to complete and runs all retired deleters.
+ */
+void FrameSync::wait_idle()
+{
+    for (auto const &slot : slots)
+    {
+        if (slot.timeline_value)
+        {
+            (void)device.waitSemaphores(vk::SemaphoreWaitInfo({}, graphics_queue->timeline, slot.timeline_value), UINT64_MAX, *dispatch);
+        }
+    }
+
+    run_retired(frame_number);
+}
+
+uint64_t FrameSync::get_frame_number() const
+{
+    return frame_number;
+}
+
+uint32_t FrameSync::get_frame_index() const
+{
+    return static_cast<uint32_t>(frame_number % slots.size());
+}
+
+uint32_t FrameSync::get_frames_in_flight() const
+{
+    return static_cast<uint32_t>(slots.size());
+}
+
+vk::Semaphore FrameSync::get_acquire_semaphore() const
+{
+    return slots[get_frame_index()].acquire_semaphore;
+}
+
+void FrameSync::run_retired(uint64_t completed_frame)
+{
+    while (!retired.empty() && retired.front().frame_number <= completed_frame)
+    {
+        retired.front().deleter();
+        retired.pop_front();
+    }
+}
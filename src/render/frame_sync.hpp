@@ -0,0 +1,56 @@
+﻿#pragma once
+
+#include "render/device_dispatch.hpp"
+#include "render/gpu_queue.hpp"
+
+#include <deque>
+#include <functional>
+#include <vector>
+
+/**
+ * @brief Paces the frames in flight on the graphics queue's timeline semaphore.
+ *
+ * Every frame has a monotonically increasing number and remembers the timeline value its last
+ * submission signals. Starting frame N waits for that value of frame N - frames_in_flight, which
+ * makes the frame slot's command buffers and acquire semaphore reusable, and runs the deleters
+ * retired up to that frame. There are no fences to reset and no semaphores to recycle.
+ */
+class FrameSync
+{
+public:
+    void prepare(vk::Device device, DeviceDispatch const &dispatch, GpuQueue &graphics_queue, uint32_t frames_in_flight);
+    void destroy();
+
+    uint32_t begin_frame();
+    void     end_frame(uint64_t timeline_value);
+    void     retire(std::function<void()> deleter);
+    void     wait_idle();
+
+    uint64_t      get_frame_number() const;
+    uint32_t      get_frame_index() const;
+    uint32_t      get_frames_in_flight() const;
+    vk::Semaphore get_acquire_semaphore() const;
+
+private:
+    struct Slot
+    {
+        uint64_t      timeline_value = 0;        // Signaled by the last submission of the frame using the slot.
+        vk::Semaphore acquire_semaphore;         // Binary, the swapchain can't signal timelines.
+    };
+
+    struct Retired
+    {
+        uint64_t              frame_number;
+        std::function<void()> deleter;
+    };
+
+    void run_retired(uint64_t completed_frame);
+
+private:
+    vk::Device            device;
+    DeviceDispatch const *dispatch       = nullptr;
+    GpuQueue             *graphics_queue = nullptr;
+    std::vector<Slot>     slots;
+    std::deque<Retired>   retired;                 // Ordered by frame number.
+    uint64_t              frame_number   = 0;      // The current frame, the first frame is 1.
+};
@@ -0,0 +1,222 @@
+﻿#include "render/gpu_memory.hpp"
+
+#include <common/logging.h>
+
+#include <array>
+#include <atomic>
+#include <stdexcept>
+
+namespace
+{
+constexpr size_t category_count = static_cast<size_t>(MemoryCategory::eCount);
+
+// Without VK_EXT_memory_budget, the share of a heap the engine plans to use at most.
+constexpr vk::DeviceSize estimated_budget_percent = 80;
+
+std::array<std::array<std::atomic<uint64_t>, category_count>, VK_MAX_MEMORY_HEAPS> heap_usage{};
+}  // namespace
+
+char const *get_memory_category_name(MemoryCategory category)
+{
+    switch (category)
+    {
+        case MemoryCategory::eMeshes:
+            return "meshes";
+        case MemoryCategory::eTextures:
+            return "textures";
+        case MemoryCategory::eRenderTargets:
+            return "render_targets";
+        case MemoryCategory::eStaging:
+            return "staging";
+        case MemoryCategory::eOther:
+        case MemoryCategory::eCount:
+            break;
+    }
+    return "other";
+}
+
+/**
+ * @brief Allocates device memory and accounts it.
+ * @param heap The heap of the memory type the allocation is made from.
+ */
+vk::DeviceMemory allocate_device_memory(vk::Device device, vk::MemoryAllocateInfo const &info, uint32_t heap, MemoryCategory category)
+{
+    vk::DeviceMemory memory;
+    vk::Result       result = device.allocateMemory(&info, nullptr, &memory);
+    if (result != vk::Result::eSuccess)
+    {
+        LOGE("Failed to allocate {} KiB of {} memory from heap {}, the engine uses {} KiB of it: {}",
+             info.allocationSize / 1024,
+             get_memory_category_name(category),
+             heap,
+             get_heap_memory_usage(heap) / 1024,
+             vk::to_string(result));
+        throw std::runtime_error("failed to allocate device memory!");
+    }
+
+    heap_usage[heap][static_cast<size_t>(category)].fetch_add(info.allocationSize, std::memory_order_relaxed);
+    return memory;
+}
+
+/**
+ * @brief Frees device memory allocated by allocate_device_memory, with the size, heap and category it was allocated with.
+ */
+void free_device_memory(vk::Device device, vk::DeviceMemory memory, vk::DeviceSize size, uint32_t heap, MemoryCategory category)
+{
+    device.freeMemory(memory);
+    heap_usage[heap][static_cast<size_t>(category)].fetch_sub(size, std::memory_order_relaxed);
+}
+
+/**
+ * @returns The memory the engine allocated for a category, over all heaps.
+ */
+vk::DeviceSize get_device_memory_usage(MemoryCategory category)
+{
+    vk::DeviceSize usage = 0;
+    for (auto const &categories : heap_usage)
+    {
+        usage += categories[static_cast<size_t>(category)].load(std::memory_order_relaxed);
+    }
+    return usage;
+}
+
+/**
+ * @returns The memory the engine allocated from a heap, over all categories.
+ */
+vk::DeviceSize get_heap_memory_usage(uint32_t heap)
+{
+    vk::DeviceSize usage = 0;
+    for (auto const &category : heap_usage[heap])
+    {
+        usage += category.load(std::memory_order_relaxed);
+    }
+    return usage;
+}
+
+/**
+ * @param budget_extension Whether VK_EXT_memory_budget is enabled on the device.
+ */
+void MemoryBudget::prepare(vk::PhysicalDevice gpu, bool budget_extension)
+{
+    this->gpu              = gpu;
+    this->budget_extension = budget_extension;
+
+    vk::PhysicalDeviceMemoryProperties memory_properties = gpu.getMemoryProperties();
+    heaps.resize(memory_properties.memoryHeapCount);
+    for (uint32_t i = 0; i < memory_properties.memoryHeapCount; i++)
+    {
+        heaps[i].size         = memory_properties.memoryHeaps[i].size;
+        heaps[i].budget       = heaps[i].size * estimated_budget_percent / 100;
+        heaps[i].device_local = static_cast<bool>(memory_properties.memoryHeaps[i].flags & vk::MemoryHeapFlagBits::eDeviceLocal);
+    }
+
+    update();
+}
+
+/**
+ * @brief Queries the current budget and usage of the heaps. Cheap enough to call every frame.
+ */
+void MemoryBudget::update()
+{
+    if (budget_extension)
+    {
+        auto        properties = gpu.getMemoryProperties2<vk::PhysicalDeviceMemoryProperties2, vk::PhysicalDeviceMemoryBudgetPropertiesEXT>();
+        auto const &budget     = properties.get<vk::PhysicalDeviceMemoryBudgetPropertiesEXT>();
+        for (uint32_t i = 0; i < heaps.size(); i++)
+        {
+            heaps[i].budget = budget.heapBudget[i];
+            heaps[i].usage  = budget.heapUsage[i];
+        }
+    }
+
+    for (uint32_t i = 0; i < heaps.size(); i++)
+    {
+        heaps[i].tracked = get_heap_memory_usage(i);
+        if (!budget_extension)
+        {
+            heaps[i].usage = heaps[i].tracked;
+        }
+    }
+}
+
+/**
+ * @returns How much more device-local memory the process can use, negative if it is over budget.
+ */
+int64_t MemoryBudget::get_headroom() const
+{
+    int64_t headroom = 0;
+    for (auto const &heap : heaps)
+    {
+        if (heap.device_local)
+        {
+            headroom += static_cast<int64_t>(heap.budget) - static_cast<int64_t>(heap.usage);
+        }
+    }
+    return headroom;
+}
+
+std::vector<MemoryBudget::Heap> const &MemoryBudget::get_heaps() const
+{
+    return heaps;
+}
+
+bool MemoryBudget::has_budget_extension() const
+{
+    return budget_extension;
+}
+
+void MemoryBudget::log_statistics() const
+{
+    LOGI("Device memory, {}:", budget_extension ? "budget reported by the driver" : "budget estimated");
+    for (uint32_t i = 0; i < heaps.size(); i++)
+    {
+        Heap const &heap = heaps[i];
+        LOGI("  heap {}{}: {:.1f} of {:.1f} MiB budget used, {:.1f} MiB by the engine, {:.1f} MiB heap size",
+             i,
+             heap.device_local ? " (device local)" : "",
+             heap.usage / (1024.0 * 1024.0),
+             heap.budget / (1024.0 * 1024.0),
+             heap.tracked / (1024.0 * 1024.0),
+             heap.size / (1024.0 * 1024.0));
+    }
+
+    for (size_t c = 0; c < category_count; c++)
+    {
+        MemoryCategory category = static_cast<MemoryCategory>(c);
+        LOGI("  {:<16} {:.1f} MiB", get_memory_category_name(category), get_device_memory_usage(category) / (1024.0 * 1024.0));
+    }
+}
+
+/**
+ * @returns The heaps and the usage per category as a JSON object, sizes in bytes.
+ */
+std::string MemoryBudget::to_json() const
+{
+    std::string json = "{\"budget_extension\":";
+    json += budget_extension ? "true" : "false";
+
+    json += ",\"heaps\":[";
+    for (size_t i = 0; i < heaps.size(); i++)
+    {
+        Heap const &heap = heaps[i];
+        json += i ? ",{" : "{";
+        json += "\"size\":" + std::to_string(heap.size);
+        json += ",\"budget\":" + std::to_string(heap.budget);
+        json += ",\"usage\":" + std::to_string(heap.usage);
+        json += ",\"tracked\":" + std::to_string(heap.tracked);
+        json += ",\"device_local\":";
+        json += heap.device_local ? "true}" : "false}";
+    }
+
+    json += "],\"categories\":{";
+    for (size_t c = 0; c < category_count; c++)
+    {
+        MemoryCategory category = static_cast<MemoryCategory>(c);
+        json += c ? ",\"" : "\"";
+        json += get_memory_category_name(category);
+        json += "\":" + std::to_string(get_device_memory_usage(category));
+    }
+    json += "}}";
+
+    return json;
+}
@@ -0,0 +1,63 @@
+﻿#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/// @brief What device memory is used for, allocations are accounted per category.
+enum class MemoryCategory : uint32_t
+{
+    eMeshes,             // Vertex and index buffers.
+    eTextures,           // Streamed textures.
+    eRenderTargets,      // Attachments and other images the GPU renders or computes into.
+    eStaging,            // Host-visible upload buffers.
+    eOther,              // Per-object data, culling buffers and everything else.
+    eCount
+};
+
+char const *get_memory_category_name(MemoryCategory category);
+
+/*
+ * All device memory of the engine is allocated and freed through these, which account it per memory
+ * heap and category on all threads. A failed allocation logs the accounting before it throws.
+ */
+vk::DeviceMemory allocate_device_memory(vk::Device device, vk::MemoryAllocateInfo const &info, uint32_t heap, MemoryCategory category);
+void             free_device_memory(vk::Device device, vk::DeviceMemory memory, vk::DeviceSize size, uint32_t heap, MemoryCategory category);
+vk::DeviceSize   get_device_memory_usage(MemoryCategory category);
+vk::DeviceSize   get_heap_memory_usage(uint32_t heap);
+
+/**
+ * @brief The memory budget of each heap, for streaming systems to decide how much they may keep resident.
+ *
+ * With VK_EXT_memory_budget the driver reports the budget and the usage of the whole process, which
+ * includes memory allocated outside the engine and changes as other processes come and go. Without it
+ * the budget is estimated from the heap size and the usage is what the engine accounted.
+ */
+class MemoryBudget
+{
+public:
+    struct Heap
+    {
+        vk::DeviceSize size         = 0;
+        vk::DeviceSize budget       = 0;        // What the process can use before allocations fail or start paging.
+        vk::DeviceSize usage        = 0;        // What the process uses.
+        vk::DeviceSize tracked      = 0;        // What the engine allocated.
+        bool           device_local = false;
+    };
+
+    void prepare(vk::PhysicalDevice gpu, bool budget_extension);
+    void update();
+
+    int64_t                  get_headroom() const;
+    std::vector<Heap> const &get_heaps() const;
+    bool                     has_budget_extension() const;
+    void                     log_statistics() const;
+    std::string              to_json() const;
+
+private:
+    vk::PhysicalDevice gpu;
+    bool               budget_extension = false;
+    std::vector<Heap>  heaps;                        // Sized by prepare, so updating never allocates.
+};
@@ -0,0 +1,230 @@
+﻿#include "render/gpu_profiler.hpp"
+
+#include <common/logging.h>
+
+#include <algorithm>
+
+/**
+ * @brief Queries the timestamp support of the device. Profiling is disabled without host query resets.
+ * @param dispatch Writes, resets and reads the queries of the frames.
+ */
+void GpuProfiler::prepare(vk::PhysicalDevice gpu, vk::Device device, DeviceDispatch const &dispatch)
+{
+    this->device   = device;
+    this->dispatch = &dispatch;
+
+    auto features    = gpu.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceVulkan12Features>();
+    supported        = features.get<vk::PhysicalDeviceVulkan12Features>().hostQueryReset;
+    timestamp_period = gpu.getProperties().limits.timestampPeriod;
+
+    for (auto const &family : gpu.getQueueFamilyProperties())
+    {
+        valid_masks.push_back(family.timestampValidBits >= 64 ? ~0ull : (1ull << family.timestampValidBits) - 1);
+    }
+
+    if (!supported)
+    {
+        LOGW("Host query reset is not supported, GPU profiling is disabled.");
+    }
+}
+
+/**
+ * @brief Replaces the profiled scopes and recreates the queries. The device must be idle.
+ */
+void GpuProfiler::configure(uint32_t frame_count, std::vector<Scope> scopes)
+{
+    destroy_query_pools();
+
+    this->scopes = std::move(scopes);
+    totals.assign(this->scopes.size(), Totals());
+    sample_count = 0;
+    frame_ms     = 0.0;
+    overlap_ms   = 0.0;
+    previous_graphics.clear();
+    previous_graphics.reserve(this->scopes.size());
+    graphics.clear();
+    graphics.reserve(this->scopes.size());
+    results.resize(this->scopes.size() * 4);
+    intervals.resize(this->scopes.size());
+    valid.resize(this->scopes.size());
+
+    if (!supported || this->scopes.empty())
+    {
+        return;
+    }
+
+    uint32_t query_count = static_cast<uint32_t>(this->scopes.size()) * 2;
+    for (uint32_t i = 0; i < frame_count; i++)
+    {
+        query_pools.push_back(device.createQueryPool({{}, vk::QueryType::eTimestamp, query_count}));
+        device.resetQueryPool(query_pools.back(), 0, query_count);
+    }
+    pending.assign(frame_count, false);
+}
+
+void GpuProfiler::destroy()
+{
+    destroy_query_pools();
+    scopes.clear();
+}
+
+/**
+ * @brief Starts writing the queries of a frame slot. The previous frame using the slot must have completed.
+ */
+void GpuProfiler::begin_frame(uint32_t frame_index)
+{
+    current_frame = frame_index;
+    if (query_pools.empty())
+    {
+        return;
+    }
+
+    if (pending[frame_index])
+    {
+        collect(frame_index);
+    }
+
+    device.resetQueryPool(query_pools[frame_index], 0, static_cast<uint32_t>(scopes.size()) * 2, *dispatch);
+    pending[frame_index] = true;
+}
+
+void GpuProfiler::begin_scope(vk::CommandBuffer cmd, uint32_t scope)
+{
+    if (!query_pools.empty() && valid_masks[scopes[scope].queue_family])
+    {
+        cmd.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, query_pools[current_frame], scope * 2, *dispatch);
+    }
+}
+
+void GpuProfiler::end_scope(vk::CommandBuffer cmd, uint32_t scope)
+{
+    if (!query_pools.empty() && valid_masks[scopes[scope].queue_family])
+    {
+        cmd.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, query_pools[current_frame], scope * 2 + 1, *dispatch);
+    }
+}
+
+/**
+ * @brief Reads back the timestamps of a frame slot and accumulates them into the current report.
+ *
+ * The overlap is the time async scopes ran while a graphics scope of the same or the previous
+ * frame was running, the latter being where work submitted early to another queue usually lands.
+ */
+void GpuProfiler::collect(uint32_t frame_index)
+{
+    uint32_t query_count = static_cast<uint32_t>(scopes.size()) * 2;
+
+    // Each query is followed by its availability, scopes on queues without timestamps are never written.
+    (void)device.getQueryPoolResults(query_pools[frame_index],
+                                     0,
+                                     query_count,
+                                     results.size() * sizeof(uint64_t),
+                                     results.data(),
+                                     2 * sizeof(uint64_t),
+                                     vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWithAvailability,
+                                     *dispatch);
+
+    std::fill(valid.begin(), valid.end(), false);
+    uint64_t frame_begin = ~0ull;
+    uint64_t frame_end   = 0;
+
+    for (size_t i = 0; i < scopes.size(); i++)
+    {
+        uint64_t const *query = &results[i * 4];
+        if (!query[1] || !query[3])
+        {
+            continue;
+        }
+
+        uint64_t mask = valid_masks[scopes[i].queue_family];
+        intervals[i]  = {query[0] & mask, query[2] & mask};
+        valid[i]      = true;
+        frame_begin   = std::min(frame_begin, intervals[i].begin);
+        frame_end     = std::max(frame_end, intervals[i].end);
+    }
+
+    if (frame_end <= frame_begin)
+    {
+        return;
+    }
+
+    double const ms_per_tick = timestamp_period / 1e6;
+
+    graphics.clear();
+    for (size_t i = 0; i < scopes.size(); i++)
+    {
+        if (valid[i])
+        {
+            totals[i].begin_ms += (intervals[i].begin - frame_begin) * ms_per_tick;
+            totals[i].duration_ms += (intervals[i].end - intervals[i].begin) * ms_per_tick;
+            if (!scopes[i].async)
+            {
+                graphics.push_back(intervals[i]);
+            }
+        }
+    }
+
+    for (size_t i = 0; i < scopes.size(); i++)
+    {
+        if (!valid[i] || !scopes[i].async)
+        {
+            continue;
+        }
+
+        for (auto const *others : {&graphics, &previous_graphics})
+        {
+            for (Interval const &other : *others)
+            {
+                uint64_t begin = std::max(intervals[i].begin, other.begin);
+                uint64_t end   = std::min(intervals[i].end, other.end);
+                if (begin < end)
+                {
+                    overlap_ms += (end - begin) * ms_per_tick;
+                }
+            }
+        }
+    }
+
+    frame_ms += (frame_end - frame_begin) * ms_per_tick;
+    std::swap(previous_graphics, graphics);
+    sample_count++;
+}
+
+void GpuProfiler::destroy_query_pools()
+{
+    for (auto pool : query_pools)
+    {
+        device.destroyQueryPool(pool);
+    }
+    query_pools.clear();
+    pending.clear();
+}
+
+/**
+ * @brief Logs the averaged timings once report_interval frames were collected, and starts over.
+ *
+ * Not called while collecting, so the frame itself never formats log messages.
+ */
+void GpuProfiler::report()
+{
+    if (sample_count < report_interval)
+    {
+        return;
+    }
+
+    LOGI("GPU timings, averaged over {} frames:", sample_count);
+    for (size_t i = 0; i < scopes.size(); i++)
+    {
+        LOGI("  {:<16} {:<8} start {:8.3f} ms, duration {:8.3f} ms",
+             scopes[i].name,
+             scopes[i].queue_name,
+             totals[i].begin_ms / sample_count,
+             totals[i].duration_ms / sample_count);
+    }
+    LOGI("  frame {:.3f} ms, async compute overlapped graphics for {:.3f} ms", frame_ms / sample_count, overlap_ms / sample_count);
+
+    totals.assign(scopes.size(), Totals());
+    sample_count = 0;
+    frame_ms     = 0.0;
+    overlap_ms   = 0.0;
+}
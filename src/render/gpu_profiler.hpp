@@ -0,0 +1,75 @@
+﻿#pragma once
+
+#include "render/device_dispatch.hpp"
+
+#include <vulkan/vulkan.hpp>
+
+#include <string>
+#include <vector>
+
+/**
+ * @brief Measures GPU time per scope with timestamp queries, across all queues of a frame.
+ *
+ * Each frame slot owns its queries, which are read back once the slot is reused, so reading never
+ * stalls. Scopes on different queues share the device timebase, so the report shows how long the
+ * async compute scopes ran alongside graphics work, including the previous frame's.
+ */
+class GpuProfiler
+{
+public:
+    struct Scope
+    {
+        std::string name;
+        std::string queue_name;
+        uint32_t    queue_family = 0;
+        bool        async        = false;        // Runs on a queue other than the graphics queue.
+    };
+
+    void prepare(vk::PhysicalDevice gpu, vk::Device device, DeviceDispatch const &dispatch);
+    void configure(uint32_t frame_count, std::vector<Scope> scopes);
+    void destroy();
+
+    void begin_frame(uint32_t frame_index);
+    void begin_scope(vk::CommandBuffer cmd, uint32_t scope);
+    void end_scope(vk::CommandBuffer cmd, uint32_t scope);
+    void report();
+
+private:
+    struct Interval
+    {
+        uint64_t begin = 0;
+        uint64_t end   = 0;
+    };
+
+    struct Totals
+    {
+        double begin_ms    = 0.0;        // Relative to the first timestamp of the frame.
+        double duration_ms = 0.0;
+    };
+
+    void collect(uint32_t frame_index);
+    void destroy_query_pools();
+
+private:
+    vk::Device                 device;
+    DeviceDispatch const      *dispatch         = nullptr;
+    std::vector<vk::QueryPool> query_pools;                // One per frame slot, two queries per scope.
+    std::vector<bool>          pending;                    // Whether the slot was written since it was last read.
+    std::vector<Scope>         scopes;
+    std::vector<uint64_t>      valid_masks;                // The valid timestamp bits of each queue family.
+    float                      timestamp_period = 1.0f;    // Nanoseconds per tick.
+    bool                       supported        = false;
+    uint32_t                   current_frame    = 0;
+    uint32_t                   sample_count     = 0;
+    uint32_t                   report_interval  = 300;     // Frames averaged per report.
+    std::vector<Totals>        totals;
+    double                     frame_ms         = 0.0;
+    double                     overlap_ms       = 0.0;
+    std::vector<Interval>      previous_graphics;          // Graphics scopes of the previously collected frame.
+
+    // Scratch space of collect, sized by configure so collecting never allocates.
+    std::vector<uint64_t>      results;
+    std::vector<Interval>      intervals;
+    std::vector<bool>          valid;
+    std::vector<Interval>      graphics;
+};
@@ -0,0 +1,49 @@
+﻿#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+/**
+ * @brief A device queue with the timeline semaphore signaled by its submissions.
+ *
+ * Every submission signals the next value of the timeline, so work on other queues can wait for
+ * any earlier submission by value, without having to own a semaphore per dependency.
+ */
+class GpuQueue
+{
+public:
+    vk::Queue     queue;
+    uint32_t      familyIndex = ~0u;
+    vk::Semaphore timeline;
+    uint64_t      submitted   = 0;        // The value signaled by the last submission.
+
+    static GpuQueue CreateGpuQueue(vk::Device const &device, uint32_t familyIndex)
+    {
+        GpuQueue gpuQueue;
+        gpuQueue.queue       = device.getQueue(familyIndex, 0);
+        gpuQueue.familyIndex = familyIndex;
+
+        vk::SemaphoreTypeCreateInfo typeInfo(vk::SemaphoreType::eTimeline, 0);
+        gpuQueue.timeline = device.createSemaphore(vk::SemaphoreCreateInfo({}, &typeInfo));
+
+        return gpuQueue;
+    }
+
+    explicit operator bool() const
+    {
+        return !!queue;
+    }
+
+    /// @brief Reserves the value signaled by the next submission.
+    uint64_t next_value()
+    {
+        return ++submitted;
+    }
+
+    void clear(const vk::Device &device)
+    {
+        if (timeline)
+            device.destroySemaphore(timeline);
+
+        *this = GpuQueue();
+    }
+};
@@ -0,0 +1,134 @@
+﻿#include "render/gpu_radix_sort.hpp"
+
+#include "render/shader_variants.hpp"
+
+#include <algorithm>
+
+namespace
+{
+constexpr uint32_t group_size   = 256;        // The local size of radix_sort.comp.
+constexpr uint32_t digit_bits   = 4;
+constexpr uint32_t digit_values = 1 << digit_bits;
+}  // namespace
+
+/**
+ * @brief Creates the pipeline and the buffers for up to capacity keys.
+ * @param spirv The compiled radix_sort.comp.
+ */
+void GpuRadixSort::prepare(vk::PhysicalDevice gpu, vk::Device device, DeviceDispatch const &dispatch, LayoutCache &layout_cache, std::span<uint32_t const> spirv, uint32_t capacity)
+{
+    this->device   = device;
+    this->dispatch = &dispatch;
+    this->capacity = std::max(capacity, 1u);
+
+    ShaderReflection reflection = reflect_shader(spirv);
+    if (reflection.push_constant_size != sizeof(SortPushConstants))
+    {
+        throw std::runtime_error("radix sort push constants don't match the shader!");
+    }
+
+    vk::DescriptorSetLayout set_layout = layout_cache.get_set_layout(reflection.sets.at(0));
+    pipeline_layout                    = layout_cache.get_pipeline_layout({reflection});
+    pipeline                           = create_compute_pipeline(device, spirv, pipeline_layout);
+
+    vk::DescriptorPoolSize pool_size(vk::DescriptorType::eStorageBuffer, 10);
+    descriptor_pool = device.createDescriptorPool({{}, 2, pool_size});
+
+    std::array<vk::DescriptorSetLayout, 2> set_layouts = {set_layout, set_layout};
+    std::vector<vk::DescriptorSet>         allocated   = device.allocateDescriptorSets({descriptor_pool, set_layouts});
+    std::copy(allocated.begin(), allocated.end(), sets.begin());
+
+    vk::DeviceSize const       size  = sizeof(uint32_t) * this->capacity;
+    vk::BufferUsageFlags const usage = vk::BufferUsageFlagBits::eStorageBuffer;
+    for (uint32_t i = 0; i < 2; i++)
+    {
+        key_buffers[i]   = BufferData::CreateBufferData(gpu, device, MemoryCategory::eOther, size, usage, vk::MemoryPropertyFlagBits::eDeviceLocal);
+        value_buffers[i] = BufferData::CreateBufferData(gpu, device, MemoryCategory::eOther, size, usage, vk::MemoryPropertyFlagBits::eDeviceLocal);
+    }
+
+    uint32_t const group_count = (this->capacity + group_size - 1) / group_size;
+    offset_buffer              = BufferData::CreateBufferData(gpu, device, MemoryCategory::eOther, sizeof(uint32_t) * digit_values * group_count, usage,
+                                                              vk::MemoryPropertyFlagBits::eDeviceLocal);
+
+    std::vector<vk::DescriptorBufferInfo> buffer_infos;
+    std::vector<vk::WriteDescriptorSet>   writes;
+    buffer_infos.reserve(10);
+    for (uint32_t i = 0; i < 2; i++)
+    {
+        // Keys in, values in, keys out, values out, offsets.
+        std::array<vk::Buffer, 5> buffers = {key_buffers[i].buffer, value_buffers[i].buffer, key_buffers[1 - i].buffer, value_buffers[1 - i].buffer, offset_buffer.buffer};
+        for (uint32_t binding = 0; binding < buffers.size(); binding++)
+        {
+            buffer_infos.emplace_back(buffers[binding], 0, VK_WHOLE_SIZE);
+            writes.emplace_back(sets[i], binding, 0, vk::DescriptorType::eStorageBuffer, nullptr, buffer_infos.back());
+        }
+    }
+    device.updateDescriptorSets(writes, {});
+}
+
+void GpuRadixSort::destroy()
+{
+    if (!device)
+    {
+        return;
+    }
+
+    for (uint32_t i = 0; i < 2; i++)
+    {
+        key_buffers[i].clear(device);
+        value_buffers[i].clear(device);
+    }
+    offset_buffer.clear(device);
+
+    device.destroyDescriptorPool(descriptor_pool);
+    device.destroyPipeline(pipeline);
+
+    device = nullptr;
+}
+
+/**
+ * @brief Records the sort of the first count keys and values of the key and value buffers, at most the capacity.
+ */
+void GpuRadixSort::record(vk::CommandBuffer cmd, uint32_t count)
+{
+    count = std::min(count, capacity);
+    if (count == 0)
+    {
+        return;
+    }
+
+    SortPushConstants constants;
+    constants.count       = count;
+    constants.group_count = (count + group_size - 1) / group_size;
+
+    // Every dispatch reads what the one before wrote, and overwrites what the one before read.
+    vk::MemoryBarrier barrier(vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite);
+
+    cmd.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline, *dispatch);
+    for (uint32_t pass = 0; pass < 32 / digit_bits; pass++)
+    {
+        constants.shift = pass * digit_bits;
+        cmd.bindDescriptorSets(vk::PipelineBindPoint::eCompute, pipeline_layout, 0, sets[pass % 2], {}, *dispatch);
+
+        for (uint32_t phase = 0; phase < 3; phase++)
+        {
+            constants.phase = phase;
+            cmd.pushConstants(pipeline_layout, vk::ShaderStageFlagBits::eCompute, 0, sizeof(constants), &constants, *dispatch);
+            cmd.dispatch(phase == 1 ? 1 : constants.group_count, 1, 1, *dispatch);
+            if (pass + 1 < 32 / digit_bits || phase < 2)
+            {
+                cmd.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader, {}, barrier, {}, {}, *dispatch);
+            }
+        }
+    }
+}
+
+vk::Buffer GpuRadixSort::get_key_buffer() const
+{
+    return key_buffers[0].buffer;
+}
+
+vk::Buffer GpuRadixSort::get_value_buffer() const
+{
+    return value_buffers[0].buffer;
+}
@@ -0,0 +1,53 @@
+﻿#pragma once
+
+#include "render/device_dispatch.hpp"
+#include "render/gpu_resources.hpp"
+#include "render/layout_cache.hpp"
+
+#include <array>
+#include <span>
+
+/**
+ * @brief Sorts 32-bit keys with 32-bit values on the GPU, for lists which never leave it, e.g. GPU-driven draws.
+ *
+ * A least significant digit radix sort by four bit digits, eight passes of three dispatches each. The
+ * first counts the digits of every workgroup's keys, the second scans the counts of all workgroups into
+ * offsets, the third scatters every key to its digit's offset plus its rank among the workgroup's keys
+ * of the digit, which keeps the sort stable. The passes ping-pong between two pairs of buffers and end
+ * in the first pair again, where the keys and values are written before and read after the sort.
+ *
+ * The sort records its own barriers between the dispatches, the ones before and after it are up to
+ * the caller, e.g. the render graph.
+ */
+class GpuRadixSort
+{
+public:
+    void prepare(vk::PhysicalDevice gpu, vk::Device device, DeviceDispatch const &dispatch, LayoutCache &layout_cache, std::span<uint32_t const> spirv, uint32_t capacity);
+    void destroy();
+
+    void record(vk::CommandBuffer cmd, uint32_t count);
+
+    vk::Buffer get_key_buffer() const;
+    vk::Buffer get_value_buffer() const;
+
+private:
+    struct SortPushConstants
+    {
+        uint32_t count;
+        uint32_t shift;               // The digit of the pass.
+        uint32_t phase;               // 0 counts, 1 scans, 2 scatters.
+        uint32_t group_count;
+    };
+
+private:
+    vk::Device                       device;
+    DeviceDispatch const            *dispatch = nullptr;
+    vk::PipelineLayout               pipeline_layout;        // Belongs to the layout cache.
+    vk::Pipeline                     pipeline;
+    vk::DescriptorPool               descriptor_pool;
+    std::array<vk::DescriptorSet, 2> sets;                  // From the first pair of buffers into the second and back.
+    std::array<BufferData, 2>        key_buffers;
+    std::array<BufferData, 2>        value_buffers;
+    BufferData                       offset_buffer;          // The digit counts of the workgroups, scanned into offsets in place.
+    uint32_t                         capacity = 0;
+};
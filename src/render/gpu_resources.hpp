@@ -0,0 +1,226 @@
+﻿#pragma once
+
+#include "memory/handle_pool.hpp"
+#include "render/gpu_memory.hpp"
+
+#include <vulkan/vulkan.hpp>
+
+#include <cassert>
+#include <cstring>
+#include <ranges>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+static uint32_t findMemoryType(vk::PhysicalDeviceMemoryProperties const& memoryProperties, uint32_t typeBits, vk::MemoryPropertyFlags requirementsMask)
+{
+    uint32_t typeIndex = uint32_t(~0);
+    for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++)
+    {
+        if ((typeBits & 1) && ((memoryProperties.memoryTypes[i].propertyFlags & requirementsMask) == requirementsMask))
+        {
+            typeIndex = i;
+            break;
+        }
+        typeBits >>= 1;
+    }
+    assert(typeIndex != uint32_t(~0));
+    return typeIndex;
+}
+
+class BufferData
+{
+public:
+    vk::Buffer                 buffer;
+    vk::DeviceMemory           deviceMemory;
+    vk::DeviceSize             size           = 0;
+    void                      *mapped         = nullptr;  // Host-coherent buffers stay mapped for their lifetime.
+    vk::DeviceSize             memorySize     = 0;
+    uint32_t                   memoryHeap     = 0;
+    MemoryCategory             memoryCategory = MemoryCategory::eOther;
+
+    static BufferData CreateBufferData(vk::PhysicalDevice const &physicalDevice,
+                          vk::Device const         &device,
+                          MemoryCategory            category,
+                          vk::DeviceSize            size,
+                          vk::BufferUsageFlags      usage,
+                          vk::MemoryPropertyFlags   propertyFlags = vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+                          std::vector<uint32_t> const &queueFamilyIndices = {})
+    {
+        BufferData bufferData;
+
+        // Buffers used by more than one queue family are shared concurrently.
+        vk::BufferCreateInfo bufferInfo{};
+        bufferInfo.size = size;
+        bufferInfo.usage = usage;
+        bufferInfo.sharingMode = queueFamilyIndices.size() > 1 ? vk::SharingMode::eConcurrent : vk::SharingMode::eExclusive;
+        if (bufferInfo.sharingMode == vk::SharingMode::eConcurrent)
+        {
+            bufferInfo.setQueueFamilyIndices(queueFamilyIndices);
+        }
+
+        if (device.createBuffer(&bufferInfo, nullptr, &bufferData.buffer) != vk::Result::eSuccess)
+        {
+            throw std::runtime_error("failed to create vertex buffer!");
+        }
+
+        // alloc gpu mem
+
+        vk::MemoryRequirements memRequirements;
+        device.getBufferMemoryRequirements(bufferData.buffer, &memRequirements);
+
+        vk::PhysicalDeviceMemoryProperties memoryProperties = physicalDevice.getMemoryProperties();
+
+        vk::MemoryAllocateInfo allocInfo{};
+        allocInfo.allocationSize = memRequirements.size;
+        allocInfo.memoryTypeIndex = findMemoryType(memoryProperties, memRequirements.memoryTypeBits, propertyFlags);
+
+        bufferData.memorySize     = allocInfo.allocationSize;
+        bufferData.memoryHeap     = memoryProperties.memoryTypes[allocInfo.memoryTypeIndex].heapIndex;
+        bufferData.memoryCategory = category;
+        bufferData.deviceMemory   = allocate_device_memory(device, allocInfo, bufferData.memoryHeap, category);
+
+        device.bindBufferMemory(bufferData.buffer, bufferData.deviceMemory, 0);
+
+        // Writes go straight into the mapping, coherent memory needs no flushes.
+        bufferData.size = size;
+        if (propertyFlags & vk::MemoryPropertyFlagBits::eHostCoherent)
+        {
+            bufferData.mapped = device.mapMemory(bufferData.deviceMemory, 0, VK_WHOLE_SIZE);
+        }
+
+        return bufferData;
+    }
+
+    void clear(const vk::Device& device)
+    {
+        if (buffer)
+            device.destroyBuffer(buffer);
+
+        if (deviceMemory)
+            free_device_memory(device, deviceMemory, memorySize, memoryHeap, memoryCategory);
+
+        *this = BufferData();
+    }
+
+    /**
+     * @brief A typed view of the mapped buffer, to write elements in place.
+     * @param offset The byte offset of the first element, aligned for DataType.
+     * @param count The number of elements, which must fit into the buffer.
+     */
+    template <typename DataType>
+    std::span<DataType> view(vk::DeviceSize offset, size_t count) const
+    {
+        static_assert(std::is_trivially_copyable_v<DataType>, "Buffers hold trivially copyable data only.");
+        assert(mapped && "only host-coherent buffers are mapped");
+        assert(offset % alignof(DataType) == 0 && offset + sizeof(DataType) * count <= size);
+
+        return std::span<DataType>(reinterpret_cast<DataType *>(static_cast<uint8_t *>(mapped) + offset), count);
+    }
+
+    /// @brief Copies elements into the mapped buffer at a byte offset.
+    template <typename DataType>
+    void upload(std::span<DataType const> data, vk::DeviceSize offset = 0)
+    {
+        memcpy(view<DataType>(offset, data.size()).data(), data.data(), data.size_bytes());
+    }
+
+    /// @brief Copies a contiguous range, e.g. a vector or an array, into the mapped buffer at a byte offset.
+    template <std::ranges::contiguous_range Range>
+    void upload(Range const &data, vk::DeviceSize offset = 0)
+    {
+        upload(std::span<std::ranges::range_value_t<Range> const>(data), offset);
+    }
+};
+
+class ImageData
+{
+public:
+    vk::Image        image;
+    vk::DeviceMemory deviceMemory;
+    vk::ImageView    view;          // A view over all mip levels of the image.
+    vk::Format       format    = vk::Format::eUndefined;
+    vk::Extent2D     extent;
+    uint32_t         mipLevels      = 1;
+    vk::DeviceSize   memorySize     = 0;
+    uint32_t         memoryHeap     = 0;
+    MemoryCategory   memoryCategory = MemoryCategory::eOther;
+
+    static ImageData CreateImageData(vk::PhysicalDevice const &physicalDevice,
+                                     vk::Device const         &device,
+                                     MemoryCategory            category,
+                                     vk::Format                format,
+                                     vk::Extent2D const       &extent,
+                                     uint32_t                  mipLevels,
+                                     vk::ImageUsageFlags       usage,
+                                     vk::ImageAspectFlags      aspect,
+                                     vk::MemoryPropertyFlags   propertyFlags = vk::MemoryPropertyFlagBits::eDeviceLocal,
+                                     std::vector<uint32_t> const &queueFamilyIndices = {},
+                                     vk::SampleCountFlagBits   samples = vk::SampleCountFlagBits::e1)
+    {
+        ImageData imageData;
+        imageData.format    = format;
+        imageData.extent    = extent;
+        imageData.mipLevels = mipLevels;
+
+        vk::ImageCreateInfo imageInfo({},
+                                      vk::ImageType::e2D,
+                                      format,
+                                      vk::Extent3D(extent, 1),
+                                      mipLevels,
+                                      1,
+                                      samples,
+                                      vk::ImageTiling::eOptimal,
+                                      usage,
+                                      vk::SharingMode::eExclusive,
+                                      {},
+                                      vk::ImageLayout::eUndefined);
+
+        // Images used by more than one queue family are shared concurrently.
+        if (queueFamilyIndices.size() > 1)
+        {
+            imageInfo.setSharingMode(vk::SharingMode::eConcurrent);
+            imageInfo.setQueueFamilyIndices(queueFamilyIndices);
+        }
+
+        imageData.image = device.createImage(imageInfo);
+
+        vk::MemoryRequirements memRequirements = device.getImageMemoryRequirements(imageData.image);
+
+        vk::PhysicalDeviceMemoryProperties memoryProperties = physicalDevice.getMemoryProperties();
+
+        vk::MemoryAllocateInfo allocInfo{};
+        allocInfo.allocationSize  = memRequirements.size;
+        allocInfo.memoryTypeIndex = findMemoryType(memoryProperties, memRequirements.memoryTypeBits, propertyFlags);
+
+        imageData.memorySize     = allocInfo.allocationSize;
+        imageData.memoryHeap     = memoryProperties.memoryTypes[allocInfo.memoryTypeIndex].heapIndex;
+        imageData.memoryCategory = category;
+        imageData.deviceMemory   = allocate_device_memory(device, allocInfo, imageData.memoryHeap, category);
+
+        device.bindImageMemory(imageData.image, imageData.deviceMemory, 0);
+
+        vk::ImageViewCreateInfo viewInfo({}, imageData.image, vk::ImageViewType::e2D, format, {}, {aspect, 0, mipLevels, 0, 1});
+        imageData.view = device.createImageView(viewInfo);
+
+        return imageData;
+    }
+
+    void clear(const vk::Device &device)
+    {
+        if (view)
+            device.destroyImageView(view);
+
+        if (image)
+            device.destroyImage(image);
+
+        if (deviceMemory)
+            free_device_memory(device, deviceMemory, memorySize, memoryHeap, memoryCategory);
+
+        *this = ImageData();
+    }
+};
+
+using BufferHandle = Handle<BufferData>;
+using ImageHandle  = Handle<ImageData>;
@@ -0,0 +1,340 @@
+﻿#include "render/hiz_culling.hpp"
+
+#include "render/shader_variants.hpp"
+
+#include <algorithm>
+#include <array>
+
+namespace
+{
+uint32_t previous_power_of_two(uint32_t value)
+{
+    uint32_t result = 1;
+    while (result * 2 <= value)
+    {
+        result *= 2;
+    }
+    return result;
+}
+}  // namespace
+
+/**
+ * @brief Creates the culling pipelines and uploads the objects to test.
+ * @param dispatch Records the culling and the draws.
+ * @param layout_cache Provides the layouts the shaders declare, it owns them.
+ * @param reduce_spirv The compiled hiz_reduce.comp.
+ * @param cull_spirv The compiled hiz_cull.comp.
+ * @param queue_families The queue families the culling and the draws run on, the buffers they share are concurrent if these differ.
+ */
+void HiZCulling::prepare(vk::PhysicalDevice gpu, vk::Device device, DeviceDispatch const &dispatch, LayoutCache &layout_cache, std::span<uint32_t const> reduce_spirv,
+                         std::span<uint32_t const> cull_spirv, std::vector<CullObject> const &objects, std::vector<uint32_t> const &queue_families)
+{
+    this->gpu      = gpu;
+    this->device   = device;
+    this->dispatch = &dispatch;
+    object_count = static_cast<uint32_t>(objects.size());
+
+    // Without multiDrawIndirect we have to issue one indirect draw per object.
+    multi_draw_indirect = gpu.getFeatures().multiDrawIndirect;
+
+    // Draws carry their object index as first instance where supported, so shaders can look up per-object data.
+    instance_ids = gpu.getFeatures().drawIndirectFirstInstance;
+
+    // The layouts are the ones the shaders declare, the push constants must match the structs recorded with them.
+    ShaderReflection reduce_reflection = reflect_shader(reduce_spirv);
+    ShaderReflection cull_reflection   = reflect_shader(cull_spirv);
+    if (reduce_reflection.push_constant_size != sizeof(ReducePushConstants) || cull_reflection.push_constant_size != sizeof(CullPushConstants))
+    {
+        throw std::runtime_error("culling push constants don't match the shaders!");
+    }
+
+    reduce_set_layout      = layout_cache.get_set_layout(reduce_reflection.sets.at(0));
+    cull_set_layout        = layout_cache.get_set_layout(cull_reflection.sets.at(0));
+    reduce_pipeline_layout = layout_cache.get_pipeline_layout({reduce_reflection});
+    cull_pipeline_layout   = layout_cache.get_pipeline_layout({cull_reflection});
+
+    reduce_pipeline = create_compute_pipeline(device, reduce_spirv, reduce_pipeline_layout);
+    cull_pipeline   = create_compute_pipeline(device, cull_spirv, cull_pipeline_layout);
+
+    // Enough sets for a 16 level pyramid plus the culling set, reset on every resize.
+    std::array<vk::DescriptorPoolSize, 3> pool_sizes = {{
+        {vk::DescriptorType::eCombinedImageSampler, 17},
+        {        vk::DescriptorType::eStorageImage, 16},
+        {       vk::DescriptorType::eStorageBuffer,  4},
+    }};
+    descriptor_pool = device.createDescriptorPool({{}, 17, pool_sizes});
+
+    sampler = device.createSampler({{},
+                                    vk::Filter::eNearest,
+                                    vk::Filter::eNearest,
+                                    vk::SamplerMipmapMode::eNearest,
+                                    vk::SamplerAddressMode::eClampToEdge,
+                                    vk::SamplerAddressMode::eClampToEdge,
+                                    vk::SamplerAddressMode::eClampToEdge,
+                                    0.0f,
+                                    false,
+                                    1.0f,
+                                    false,
+                                    vk::CompareOp::eNever,
+                                    0.0f,
+                                    VK_LOD_CLAMP_NONE});
+
+    vk::DeviceSize draws_size = sizeof(vk::DrawIndexedIndirectCommand) * object_count;
+
+    object_buffer = BufferData::CreateBufferData(gpu, device, MemoryCategory::eOther, sizeof(CullObject) * object_count, vk::BufferUsageFlagBits::eStorageBuffer);
+    object_buffer.upload(objects);
+
+    visibility_buffer = BufferData::CreateBufferData(gpu, device, MemoryCategory::eOther, sizeof(uint32_t) * object_count, vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst, vk::MemoryPropertyFlagBits::eDeviceLocal, queue_families);
+    early_draw_buffer = BufferData::CreateBufferData(gpu, device, MemoryCategory::eOther, draws_size, vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer, vk::MemoryPropertyFlagBits::eDeviceLocal, queue_families);
+    late_draw_buffer  = BufferData::CreateBufferData(gpu, device, MemoryCategory::eOther, draws_size, vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer, vk::MemoryPropertyFlagBits::eDeviceLocal, queue_families);
+
+    cleared_devices = 0;
+}
+
+/**
+ * @brief (Re)builds the depth pyramid for a new depth attachment.
+ * @param depth_view The depth attachment, sampled in eShaderReadOnlyOptimal layout.
+ */
+void HiZCulling::resize(vk::ImageView depth_view, vk::Extent2D const &depth_extent)
+{
+    teardown_pyramid();
+
+    this->depth_extent = depth_extent;
+
+    // The pyramid is a power of two so every level after the first is an exact 2x2 reduction.
+    vk::Extent2D pyramid_extent(previous_power_of_two(depth_extent.width), previous_power_of_two(depth_extent.height));
+    uint32_t     levels = 1;
+    while ((std::max(pyramid_extent.width, pyramid_extent.height) >> levels) > 0)
+    {
+        levels++;
+    }
+    levels = std::min(levels, 16u);
+
+    pyramid = ImageData::CreateImageData(gpu,
+                                         device,
+                                         MemoryCategory::eRenderTargets,
+                                         vk::Format::eR32Sfloat,
+                                         pyramid_extent,
+                                         levels,
+                                         vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eSampled,
+                                         vk::ImageAspectFlagBits::eColor);
+
+    std::vector<vk::DescriptorSetLayout> set_layouts(levels, reduce_set_layout);
+    set_layouts.push_back(cull_set_layout);
+    std::vector<vk::DescriptorSet> sets = device.allocateDescriptorSets({descriptor_pool, set_layouts});
+
+    cull_set = sets.back();
+    sets.pop_back();
+    reduce_sets = std::move(sets);
+
+    for (uint32_t level = 0; level < levels; level++)
+    {
+        pyramid_mip_views.push_back(device.createImageView({{}, pyramid.image, vk::ImageViewType::e2D, pyramid.format, {}, {vk::ImageAspectFlagBits::eColor, level, 1, 0, 1}}));
+    }
+
+    std::vector<vk::DescriptorImageInfo> src_infos;
+    std::vector<vk::DescriptorImageInfo> dst_infos;
+    src_infos.reserve(levels);
+    dst_infos.reserve(levels);
+
+    std::vector<vk::WriteDescriptorSet> writes;
+    for (uint32_t level = 0; level < levels; level++)
+    {
+        if (level == 0)
+        {
+            src_infos.emplace_back(sampler, depth_view, vk::ImageLayout::eShaderReadOnlyOptimal);
+        }
+        else
+        {
+            src_infos.emplace_back(sampler, pyramid_mip_views[level - 1], vk::ImageLayout::eGeneral);
+        }
+        dst_infos.emplace_back(nullptr, pyramid_mip_views[level], vk::ImageLayout::eGeneral);
+
+        writes.emplace_back(reduce_sets[level], 0, 0, vk::DescriptorType::eCombinedImageSampler, src_infos.back());
+        writes.emplace_back(reduce_sets[level], 1, 0, vk::DescriptorType::eStorageImage, dst_infos.back());
+    }
+
+    std::array<vk::DescriptorBufferInfo, 4> buffer_infos = {{
+        {    object_buffer.buffer, 0, VK_WHOLE_SIZE},
+        {visibility_buffer.buffer, 0, VK_WHOLE_SIZE},
+        {early_draw_buffer.buffer, 0, VK_WHOLE_SIZE},
+        { late_draw_buffer.buffer, 0, VK_WHOLE_SIZE},
+    }};
+    for (uint32_t binding = 0; binding < buffer_infos.size(); binding++)
+    {
+        writes.emplace_back(cull_set, binding, 0, vk::DescriptorType::eStorageBuffer, nullptr, buffer_infos[binding]);
+    }
+
+    vk::DescriptorImageInfo pyramid_info(sampler, pyramid.view, vk::ImageLayout::eGeneral);
+    writes.emplace_back(cull_set, 4, 0, vk::DescriptorType::eCombinedImageSampler, pyramid_info);
+
+    device.updateDescriptorSets(writes, {});
+}
+
+void HiZCulling::destroy()
+{
+    if (!device)
+    {
+        return;
+    }
+
+    teardown_pyramid();
+
+    object_buffer.clear(device);
+    visibility_buffer.clear(device);
+    early_draw_buffer.clear(device);
+    late_draw_buffer.clear(device);
+
+    device.destroySampler(sampler);
+    device.destroyDescriptorPool(descriptor_pool);
+    device.destroyPipeline(reduce_pipeline);
+    device.destroyPipeline(cull_pipeline);
+
+    device = nullptr;
+}
+
+/**
+ * @brief Records phase one culling: emits draws for the objects visible in the previous frame.
+ * @param device_mask The devices of the group the command buffer runs on, 0 without a device group.
+ */
+void HiZCulling::record_early_cull(vk::CommandBuffer cmd, glm::mat4 const &view_proj, uint32_t device_mask)
+{
+    // Each device of a group has its own copy of the visibility buffer, which is cleared by the first
+    // frame running on the device. With alternate-frame rendering, that is a later frame for all but one.
+    uint32_t const devices = device_mask ? device_mask : 1u;
+    if (devices & ~cleared_devices)
+    {
+        // Nothing was visible before the first frame, phase two will catch everything.
+        cmd.fillBuffer(visibility_buffer.buffer, 0, VK_WHOLE_SIZE, 0, *dispatch);
+        vk::MemoryBarrier fill_barrier(vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite);
+        cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eComputeShader, {}, fill_barrier, {}, {}, *dispatch);
+        cleared_devices |= devices;
+    }
+
+    record_cull(cmd, view_proj, 0);
+}
+
+/**
+ * @brief Records phase two culling: builds the depth pyramid from the phase one depth and tests every object.
+ */
+void HiZCulling::record_late_cull(vk::CommandBuffer cmd, glm::mat4 const &view_proj)
+{
+    record_pyramid(cmd);
+    record_cull(cmd, view_proj, 1);
+}
+
+void HiZCulling::draw_early(vk::CommandBuffer cmd) const
+{
+    draw(cmd, early_draw_buffer);
+}
+
+void HiZCulling::draw_late(vk::CommandBuffer cmd) const
+{
+    draw(cmd, late_draw_buffer);
+}
+
+vk::Buffer HiZCulling::get_visibility_buffer() const
+{
+    return visibility_buffer.buffer;
+}
+
+vk::Buffer HiZCulling::get_early_draw_buffer() const
+{
+    return early_draw_buffer.buffer;
+}
+
+vk::Buffer HiZCulling::get_late_draw_buffer() const
+{
+    return late_draw_buffer.buffer;
+}
+
+void HiZCulling::draw(vk::CommandBuffer cmd, BufferData const &draws) const
+{
+    if (multi_draw_indirect)
+    {
+        cmd.drawIndexedIndirect(draws.buffer, 0, object_count, sizeof(vk::DrawIndexedIndirectCommand), *dispatch);
+    }
+    else
+    {
+        for (uint32_t i = 0; i < object_count; i++)
+        {
+            cmd.drawIndexedIndirect(draws.buffer, sizeof(vk::DrawIndexedIndirectCommand) * i, 1, sizeof(vk::DrawIndexedIndirectCommand), *dispatch);
+        }
+    }
+}
+
+void HiZCulling::record_cull(vk::CommandBuffer cmd, glm::mat4 const &view_proj, uint32_t phase)
+{
+    CullPushConstants constants;
+    constants.view_proj    = view_proj;
+    constants.pyramid_size = glm::vec2(pyramid.extent.width, pyramid.extent.height);
+    constants.object_count = object_count;
+    constants.phase        = phase;
+    constants.instance_ids = instance_ids ? 1 : 0;
+
+    cmd.bindPipeline(vk::PipelineBindPoint::eCompute, cull_pipeline, *dispatch);
+    cmd.bindDescriptorSets(vk::PipelineBindPoint::eCompute, cull_pipeline_layout, 0, cull_set, {}, *dispatch);
+    cmd.pushConstants(cull_pipeline_layout, vk::ShaderStageFlagBits::eCompute, 0, sizeof(constants), &constants, *dispatch);
+    cmd.dispatch((object_count + 63) / 64, 1, 1, *dispatch);
+}
+
+void HiZCulling::record_pyramid(vk::CommandBuffer cmd)
+{
+    // The pyramid is rebuilt from scratch every frame, so its previous contents can be discarded.
+    vk::ImageMemoryBarrier to_general({},
+                                      vk::AccessFlagBits::eShaderWrite,
+                                      vk::ImageLayout::eUndefined,
+                                      vk::ImageLayout::eGeneral,
+                                      VK_QUEUE_FAMILY_IGNORED,
+                                      VK_QUEUE_FAMILY_IGNORED,
+                                      pyramid.image,
+                                      {vk::ImageAspectFlagBits::eColor, 0, pyramid.mipLevels, 0, 1});
+    cmd.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader, {}, {}, {}, to_general, *dispatch);
+
+    cmd.bindPipeline(vk::PipelineBindPoint::eCompute, reduce_pipeline, *dispatch);
+
+    vk::Extent2D src_extent = depth_extent;
+    for (uint32_t level = 0; level < pyramid.mipLevels; level++)
+    {
+        vk::Extent2D dst_extent(std::max(pyramid.extent.width >> level, 1u), std::max(pyramid.extent.height >> level, 1u));
+
+        ReducePushConstants constants;
+        constants.src_size = glm::ivec2(src_extent.width, src_extent.height);
+        constants.dst_size = glm::ivec2(dst_extent.width, dst_extent.height);
+
+        cmd.bindDescriptorSets(vk::PipelineBindPoint::eCompute, reduce_pipeline_layout, 0, reduce_sets[level], {}, *dispatch);
+        cmd.pushConstants(reduce_pipeline_layout, vk::ShaderStageFlagBits::eCompute, 0, sizeof(constants), &constants, *dispatch);
+        cmd.dispatch((dst_extent.width + 7) / 8, (dst_extent.height + 7) / 8, 1, *dispatch);
+
+        // The next level reads the one we just wrote.
+        vk::ImageMemoryBarrier level_barrier(vk::AccessFlagBits::eShaderWrite,
+                                             vk::AccessFlagBits::eShaderRead,
+                                             vk::ImageLayout::eGeneral,
+                                             vk::ImageLayout::eGeneral,
+                                             VK_QUEUE_FAMILY_IGNORED,
+                                             VK_QUEUE_FAMILY_IGNORED,
+                                             pyramid.image,
+                                             {vk::ImageAspectFlagBits::eColor, level, 1, 0, 1});
+        cmd.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader, {}, {}, {}, level_barrier, *dispatch);
+
+        src_extent = dst_extent;
+    }
+}
+
+void HiZCulling::teardown_pyramid()
+{
+    for (auto view : pyramid_mip_views)
+    {
+        device.destroyImageView(view);
+    }
+    pyramid_mip_views.clear();
+
+    pyramid.clear(device);
+
+    if (descriptor_pool)
+    {
+        device.resetDescriptorPool(descriptor_pool);
+    }
+    reduce_sets.clear();
+    cull_set = nullptr;
+}
@@ -0,0 +1,97 @@
+﻿#pragma once
+
+#include "render/device_dispatch.hpp"
+#include "render/gpu_resources.hpp"
+#include "render/layout_cache.hpp"
+
+#include <glm/glm.hpp>
+
+#include <span>
+#include <vector>
+
+/// @brief Per-object data consumed by the culling compute shader, laid out to match std430.
+struct CullObject
+{
+    glm::vec4 aabb_min;           // World-space bounds, w is unused.
+    glm::vec4 aabb_max;
+    uint32_t  index_count;        // The indexed draw emitted when the object is visible.
+    uint32_t  first_index;
+    int32_t   vertex_offset;
+    uint32_t  padding = 0;
+};
+
+/**
+ * @brief Two-phase hierarchical-Z occlusion culling.
+ *
+ * Phase one draws the objects that were visible last frame. Their depth is reduced into a
+ * max-depth mip pyramid, every object is then tested against it and phase two draws the objects
+ * that became visible this frame, so disocclusions never pop in a frame late. The visibility
+ * results are kept on the GPU and feed phase one of the next frame.
+ *
+ * The barriers between the culling phases and the draws are left to the render graph, which sees
+ * the visibility and draw buffers as imported resources.
+ */
+class HiZCulling
+{
+public:
+    void prepare(vk::PhysicalDevice gpu, vk::Device device, DeviceDispatch const &dispatch, LayoutCache &layout_cache, std::span<uint32_t const> reduce_spirv,
+                 std::span<uint32_t const> cull_spirv, std::vector<CullObject> const &objects, std::vector<uint32_t> const &queue_families);
+    void resize(vk::ImageView depth_view, vk::Extent2D const &depth_extent);
+    void destroy();
+
+    void record_early_cull(vk::CommandBuffer cmd, glm::mat4 const &view_proj, uint32_t device_mask);
+    void record_late_cull(vk::CommandBuffer cmd, glm::mat4 const &view_proj);
+    void draw_early(vk::CommandBuffer cmd) const;
+    void draw_late(vk::CommandBuffer cmd) const;
+
+    vk::Buffer get_visibility_buffer() const;
+    vk::Buffer get_early_draw_buffer() const;
+    vk::Buffer get_late_draw_buffer() const;
+
+private:
+    struct CullPushConstants
+    {
+        glm::mat4  view_proj;
+        glm::vec2  pyramid_size;
+        uint32_t   object_count;
+        uint32_t   phase;
+        uint32_t   instance_ids;
+    };
+
+    struct ReducePushConstants
+    {
+        glm::ivec2 src_size;
+        glm::ivec2 dst_size;
+    };
+
+    void draw(vk::CommandBuffer cmd, BufferData const &draws) const;
+    void record_cull(vk::CommandBuffer cmd, glm::mat4 const &view_proj, uint32_t phase);
+    void record_pyramid(vk::CommandBuffer cmd);
+    void teardown_pyramid();
+
+private:
+    vk::PhysicalDevice             gpu;
+    vk::Device                     device;
+    DeviceDispatch const          *dispatch = nullptr;
+    vk::DescriptorSetLayout        reduce_set_layout;       // The layouts belong to the layout cache.
+    vk::DescriptorSetLayout        cull_set_layout;
+    vk::PipelineLayout             reduce_pipeline_layout;
+    vk::PipelineLayout             cull_pipeline_layout;
+    vk::Pipeline                   reduce_pipeline;
+    vk::Pipeline                   cull_pipeline;
+    vk::DescriptorPool             descriptor_pool;
+    vk::Sampler                    sampler;                 // Nearest sampler used for depth and pyramid reads.
+    BufferData                     object_buffer;           // The CullObject array.
+    BufferData                     visibility_buffer;       // One uint per object, written by the late phase.
+    BufferData                     early_draw_buffer;       // vk::DrawIndexedIndirectCommand per object for phase one.
+    BufferData                     late_draw_buffer;        // vk::DrawIndexedIndirectCommand per object for phase two.
+    uint32_t                       object_count           = 0;
+    bool                           multi_draw_indirect    = false;
+    bool                           instance_ids           = false;    // Draws start at their object index as instance.
+    uint32_t                       cleared_devices        = 0;        // The devices of the group whose copy of the visibility buffer was cleared.
+    ImageData                      pyramid;                 // R32 max-depth pyramid.
+    std::vector<vk::ImageView>     pyramid_mip_views;
+    std::vector<vk::DescriptorSet> reduce_sets;             // One set per pyramid level.
+    vk::DescriptorSet              cull_set;
+    vk::Extent2D                   depth_extent;
+};
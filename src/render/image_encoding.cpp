@@ -0,0 +1,319 @@
+﻿#include "render/image_encoding.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+#include <stb_image_write.h>
+
+namespace
+{
+bool is_bgra(vk::Format format)
+{
+    return format == vk::Format::eB8G8R8A8Unorm || format == vk::Format::eB8G8R8A8Srgb;
+}
+
+void write_u32_le(std::vector<uint8_t> &out, uint32_t value)
+{
+    out.insert(out.end(), {static_cast<uint8_t>(value), static_cast<uint8_t>(value >> 8), static_cast<uint8_t>(value >> 16), static_cast<uint8_t>(value >> 24)});
+}
+
+void write_u64_le(std::vector<uint8_t> &out, uint64_t value)
+{
+    write_u32_le(out, static_cast<uint32_t>(value));
+    write_u32_le(out, static_cast<uint32_t>(value >> 32));
+}
+
+/**
+ * @brief Appends an EXR header attribute.
+ */
+void write_attribute(std::vector<uint8_t> &out, char const *name, char const *type, std::vector<uint8_t> const &value)
+{
+    out.insert(out.end(), name, name + std::char_traits<char>::length(name) + 1);
+    out.insert(out.end(), type, type + std::char_traits<char>::length(type) + 1);
+    write_u32_le(out, static_cast<uint32_t>(value.size()));
+    out.insert(out.end(), value.begin(), value.end());
+}
+
+/**
+ * @brief Converts a float to half, rounding to nearest. Values beyond the half range become infinity.
+ */
+uint16_t to_half(float value)
+{
+    uint32_t const bits     = std::bit_cast<uint32_t>(value);
+    uint16_t const sign     = static_cast<uint16_t>((bits >> 16) & 0x8000);
+    int32_t const  exponent = static_cast<int32_t>((bits >> 23) & 0xff) - 127 + 15;
+    uint32_t       mantissa = bits & 0x7fffff;
+
+    if (exponent <= 0)
+    {
+        // Subnormal, or too small for a half.
+        if (exponent < -10)
+        {
+            return sign;
+        }
+        mantissa |= 0x800000;
+        uint32_t const shift = static_cast<uint32_t>(14 - exponent);
+        return static_cast<uint16_t>(sign | ((mantissa >> shift) + ((mantissa >> (shift - 1)) & 1)));
+    }
+    if (exponent >= 31)
+    {
+        return static_cast<uint16_t>(sign | 0x7c00);
+    }
+
+    // A rounding carry into the exponent is still the correctly rounded half.
+    return static_cast<uint16_t>(sign | ((static_cast<uint32_t>(exponent) << 10 | mantissa >> 13) + ((mantissa >> 12) & 1)));
+}
+}  // namespace
+
+bool parse_image_file_format(std::string_view name, ImageFileFormat &file_format)
+{
+    if (name == "png")
+    {
+        file_format = ImageFileFormat::ePng;
+    }
+    else if (name == "exr")
+    {
+        file_format = ImageFileFormat::eExr;
+    }
+    else if (name == "raw")
+    {
+        file_format = ImageFileFormat::eRaw;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+char const *get_file_extension(ImageFileFormat file_format)
+{
+    switch (file_format)
+    {
+        case ImageFileFormat::ePng:
+            return ".png";
+        case ImageFileFormat::eExr:
+            return ".exr";
+        default:
+            return ".raw";
+    }
+}
+
+/**
+ * @returns The bytes per texel of the formats images are read back in, 0 for any other format.
+ */
+uint32_t get_texel_size(vk::Format format)
+{
+    switch (format)
+    {
+        case vk::Format::eR8G8B8A8Unorm:
+        case vk::Format::eR8G8B8A8Srgb:
+        case vk::Format::eB8G8R8A8Unorm:
+        case vk::Format::eB8G8R8A8Srgb:
+        case vk::Format::eA2B10G10R10UnormPack32:
+        case vk::Format::eA2R10G10B10UnormPack32:
+            return 4;
+        case vk::Format::eR16G16B16A16Sfloat:
+            return 8;
+        default:
+            return 0;
+    }
+}
+
+bool is_encodable(ImageFileFormat file_format, vk::Format format)
+{
+    switch (file_format)
+    {
+        case ImageFileFormat::ePng:
+            return is_png_encodable(format);
+        case ImageFileFormat::eExr:
+            return is_png_encodable(format) || format == vk::Format::eR16G16B16A16Sfloat;
+        default:
+            return get_texel_size(format) != 0;
+    }
+}
+
+bool is_png_encodable(vk::Format format)
+{
+    return format == vk::Format::eR8G8B8A8Unorm || format == vk::Format::eR8G8B8A8Srgb || is_bgra(format);
+}
+
+/**
+ * @brief Encodes an image as PNG.
+ * @param data The rows of the image without padding between them.
+ * @returns The PNG file.
+ */
+std::vector<uint8_t> encode_png(vk::Format format, vk::Extent2D const &extent, uint8_t const *data, size_t size)
+{
+    size_t const row_size = size_t(extent.width) * 4;
+    if (!is_png_encodable(format) || size < row_size * extent.height)
+    {
+        throw std::runtime_error("Image can't be encoded as PNG.");
+    }
+
+    // stb takes RGBA, BGRA images are swizzled into a copy.
+    std::vector<uint8_t> rgba;
+    if (is_bgra(format))
+    {
+        rgba.assign(data, data + row_size * extent.height);
+        for (size_t i = 0; i < rgba.size(); i += 4)
+        {
+            std::swap(rgba[i], rgba[i + 2]);
+        }
+        data = rgba.data();
+    }
+
+    std::vector<uint8_t> png;
+    auto                 append = [](void *context, void *bytes, int length) {
+        std::vector<uint8_t> &out = *static_cast<std::vector<uint8_t> *>(context);
+        out.insert(out.end(), static_cast<uint8_t *>(bytes), static_cast<uint8_t *>(bytes) + length);
+    };
+    if (!stbi_write_png_to_func(append, &png, static_cast<int>(extent.width), static_cast<int>(extent.height), 4, data, static_cast<int>(row_size)))
+    {
+        throw std::runtime_error("Failed to encode the PNG.");
+    }
+    return png;
+}
+
+/**
+ * @brief Encodes an image as single-part scanline EXR with half-float RGBA channels.
+ * @param data The rows of the image without padding between them.
+ * @returns The EXR file.
+ */
+std::vector<uint8_t> encode_exr(vk::Format format, vk::Extent2D const &extent, uint8_t const *data, size_t size)
+{
+    if (!is_encodable(ImageFileFormat::eExr, format) || size < size_t(extent.width) * extent.height * get_texel_size(format) || !extent.width || !extent.height)
+    {
+        throw std::runtime_error("Image can't be encoded as EXR.");
+    }
+
+    // The channels are stored in alphabetical order, A, B, G, R, by their texel offsets.
+    bool const                    half_float = format == vk::Format::eR16G16B16A16Sfloat;
+    std::array<uint32_t, 4> const channels   = is_bgra(format) ? std::array<uint32_t, 4>{3, 0, 1, 2} : std::array<uint32_t, 4>{3, 2, 1, 0};
+
+    // 8-bit channels convert through a table, color channels of sRGB formats to linear.
+    bool const                srgb = format == vk::Format::eR8G8B8A8Srgb || format == vk::Format::eB8G8R8A8Srgb;
+    std::array<uint16_t, 256> unorm_halves;
+    std::array<uint16_t, 256> color_halves;
+    for (uint32_t i = 0; i < 256; i++)
+    {
+        float const value = i / 255.0f;
+        unorm_halves[i]   = to_half(value);
+        color_halves[i]   = srgb ? to_half(value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f)) : unorm_halves[i];
+    }
+
+    std::vector<uint8_t> exr = {0x76, 0x2f, 0x31, 0x01, 2, 0, 0, 0};
+
+    std::vector<uint8_t> channel_list;
+    for (char const *name : {"A", "B", "G", "R"})
+    {
+        channel_list.insert(channel_list.end(), {static_cast<uint8_t>(name[0]), 0});
+        write_u32_le(channel_list, 1);        // Half.
+        channel_list.insert(channel_list.end(), {0, 0, 0, 0});
+        write_u32_le(channel_list, 1);        // No subsampling.
+        write_u32_le(channel_list, 1);
+    }
+    channel_list.push_back(0);
+
+    std::vector<uint8_t> window;
+    write_u32_le(window, 0);
+    write_u32_le(window, 0);
+    write_u32_le(window, extent.width - 1);
+    write_u32_le(window, extent.height - 1);
+
+    std::vector<uint8_t> one;
+    write_u32_le(one, std::bit_cast<uint32_t>(1.0f));
+
+    write_attribute(exr, "channels", "chlist", channel_list);
+    write_attribute(exr, "compression", "compression", {0});
+    write_attribute(exr, "dataWindow", "box2i", window);
+    write_attribute(exr, "displayWindow", "box2i", window);
+    write_attribute(exr, "lineOrder", "lineOrder", {0});
+    write_attribute(exr, "pixelAspectRatio", "float", one);
+    write_attribute(exr, "screenWindowCenter", "v2f", std::vector<uint8_t>(8, 0));
+    write_attribute(exr, "screenWindowWidth", "float", one);
+    exr.push_back(0);
+
+    // Uncompressed files have a block per scanline, the offset table locates each of them.
+    size_t const line_size  = size_t(extent.width) * 4 * sizeof(uint16_t);
+    size_t const first_line = exr.size() + size_t(extent.height) * sizeof(uint64_t);
+    for (uint32_t y = 0; y < extent.height; y++)
+    {
+        write_u64_le(exr, first_line + (line_size + 8) * y);
+    }
+    exr.resize(first_line + (line_size + 8) * extent.height);
+
+    size_t const row_size = size_t(extent.width) * get_texel_size(format);
+    for (uint32_t y = 0; y < extent.height; y++)
+    {
+        // The lines start at any byte, the halves are copied rather than stored through a pointer. EXR is
+        // little-endian, like every platform we run on.
+        uint8_t       *line      = exr.data() + first_line + (line_size + 8) * y;
+        uint32_t const header[2] = {y, static_cast<uint32_t>(line_size)};
+        std::memcpy(line, header, sizeof(header));
+        line += sizeof(header);
+
+        uint8_t const *row = data + row_size * y;
+        for (uint32_t c = 0; c < 4; c++)
+        {
+            for (uint32_t x = 0; x < extent.width; x++, line += sizeof(uint16_t))
+            {
+                if (half_float)
+                {
+                    std::memcpy(line, row + (size_t(x) * 4 + channels[c]) * sizeof(uint16_t), sizeof(uint16_t));
+                }
+                else
+                {
+                    uint8_t const value = row[size_t(x) * 4 + channels[c]];
+                    std::memcpy(line, c == 0 ? &unorm_halves[value] : &color_halves[value], sizeof(uint16_t));
+                }
+            }
+        }
+    }
+    return exr;
+}
+
+/**
+ * @brief Encodes an image into the file format, raw files are the data itself.
+ * @param data The rows of the image without padding between them.
+ */
+std::vector<uint8_t> encode_image(ImageFileFormat file_format, vk::Format format, vk::Extent2D const &extent, uint8_t const *data, size_t size)
+{
+    switch (file_format)
+    {
+        case ImageFileFormat::ePng:
+            return encode_png(format, extent, data, size);
+        case ImageFileFormat::eExr:
+            return encode_exr(format, extent, data, size);
+        default:
+            return std::vector<uint8_t>(data, data + std::min(size, size_t(extent.width) * extent.height * get_texel_size(format)));
+    }
+}
+
+/**
+ * @brief Writes a file next to its path and renames it into place once complete, so whoever watches the
+ *        directory never sees a partial file.
+ * @returns Whether the file was written.
+ */
+bool write_file_atomically(std::string const &path, std::span<uint8_t const> data)
+{
+    std::string const temp_path = path + ".part";
+    {
+        std::ofstream file(temp_path, std::ios::binary);
+        file.write(reinterpret_cast<char const *>(data.data()), static_cast<std::streamsize>(data.size()));
+        if (!file)
+        {
+            return false;
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::rename(temp_path, path, error);
+    return !error;
+}
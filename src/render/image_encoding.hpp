@@ -0,0 +1,37 @@
+﻿#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/*
+ * Encodes images read back from the GPU into files.
+ *
+ * PNG takes 8-bit RGBA and BGRA images, the channels are written in RGBA order. It is encoded by
+ * stb_image_write, which filters and deflates the rows.
+ *
+ * EXR takes the same formats and 16-bit float RGBA, it is written as uncompressed half-float scanlines.
+ * sRGB images are converted to linear, as EXR viewers expect.
+ *
+ * Raw files are the texels as read back, rows without padding, for tools which know the format and extent.
+ */
+enum class ImageFileFormat
+{
+    ePng,
+    eExr,
+    eRaw
+};
+
+bool                 parse_image_file_format(std::string_view name, ImageFileFormat &file_format);
+char const          *get_file_extension(ImageFileFormat file_format);
+uint32_t             get_texel_size(vk::Format format);
+bool                 is_encodable(ImageFileFormat file_format, vk::Format format);
+bool                 is_png_encodable(vk::Format format);
+std::vector<uint8_t> encode_png(vk::Format format, vk::Extent2D const &extent, uint8_t const *data, size_t size);
+std::vector<uint8_t> encode_exr(vk::Format format, vk::Extent2D const &extent, uint8_t const *data, size_t size);
+std::vector<uint8_t> encode_image(ImageFileFormat file_format, vk::Format format, vk::Extent2D const &extent, uint8_t const *data, size_t size);
+bool                 write_file_atomically(std::string const &path, std::span<uint8_t const> data);
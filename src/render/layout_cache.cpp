@@ -0,0 +1,170 @@
+﻿#include "render/layout_cache.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace
+{
+void add_handle(std::vector<uint32_t> &key, uint64_t handle)
+{
+    key.push_back(static_cast<uint32_t>(handle));
+    key.push_back(static_cast<uint32_t>(handle >> 32));
+}
+}  // namespace
+
+size_t LayoutCache::KeyHash::operator()(Key const &key) const
+{
+    // FNV-1a over the words.
+    uint64_t hash = 14695981039346656037ull;
+    for (uint32_t word : key)
+    {
+        hash = (hash ^ word) * 1099511628211ull;
+    }
+    return static_cast<size_t>(hash);
+}
+
+void LayoutCache::prepare(vk::Device device)
+{
+    this->device = device;
+}
+
+void LayoutCache::destroy()
+{
+    for (auto const &[key, layout] : pipeline_layouts)
+    {
+        device.destroyPipelineLayout(layout);
+    }
+    for (auto const &[key, layout] : set_layouts)
+    {
+        device.destroyDescriptorSetLayout(layout);
+    }
+    pipeline_layouts.clear();
+    set_layouts.clear();
+}
+
+/**
+ * @brief Returns the set layout of the bindings, creating it on first use.
+ * @param bindings The bindings sorted by binding number, without immutable samplers.
+ */
+vk::DescriptorSetLayout LayoutCache::get_set_layout(std::vector<vk::DescriptorSetLayoutBinding> const &bindings)
+{
+    Key key;
+    key.reserve(bindings.size() * 4);
+    for (auto const &binding : bindings)
+    {
+        key.insert(key.end(), {binding.binding, static_cast<uint32_t>(binding.descriptorType), binding.descriptorCount, static_cast<uint32_t>(binding.stageFlags)});
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto it = set_layouts.find(key);
+    if (it == set_layouts.end())
+    {
+        it = set_layouts.emplace(std::move(key), device.createDescriptorSetLayout({{}, bindings})).first;
+    }
+    return it->second;
+}
+
+/**
+ * @brief Returns the pipeline layout of the set layouts and push constant ranges, creating it on first use.
+ */
+vk::PipelineLayout LayoutCache::get_pipeline_layout(std::vector<vk::DescriptorSetLayout> const &set_layouts, std::vector<vk::PushConstantRange> const &push_constant_ranges)
+{
+    Key key;
+    key.reserve(set_layouts.size() * 2 + push_constant_ranges.size() * 3 + 1);
+    key.push_back(static_cast<uint32_t>(set_layouts.size()));
+    for (auto set_layout : set_layouts)
+    {
+        add_handle(key, reinterpret_cast<uint64_t>(static_cast<VkDescriptorSetLayout>(set_layout)));
+    }
+    for (auto const &range : push_constant_ranges)
+    {
+        key.insert(key.end(), {static_cast<uint32_t>(range.stageFlags), range.offset, range.size});
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto it = pipeline_layouts.find(key);
+    if (it == pipeline_layouts.end())
+    {
+        it = pipeline_layouts.emplace(std::move(key), device.createPipelineLayout({{}, set_layouts, push_constant_ranges})).first;
+    }
+    return it->second;
+}
+
+/**
+ * @brief Returns the pipeline layout of the interface the stages of a pipeline declare.
+ *
+ * The bindings of all stages are merged, a binding used by several stages is visible to all of
+ * them. All stages share one push constant range. Runtime arrays have no size to create a layout
+ * with, shaders using them belong to the bindless heap's layout instead.
+ */
+vk::PipelineLayout LayoutCache::get_pipeline_layout(std::vector<ShaderReflection> const &stages)
+{
+    std::vector<std::vector<vk::DescriptorSetLayoutBinding>> sets;
+    vk::PushConstantRange                                    push_constant_range;
+    for (auto const &stage : stages)
+    {
+        if (sets.size() < stage.sets.size())
+        {
+            sets.resize(stage.sets.size());
+        }
+
+        for (size_t set = 0; set < stage.sets.size(); set++)
+        {
+            for (auto const &binding : stage.sets[set])
+            {
+                if (binding.descriptorCount == 0)
+                {
+                    throw std::runtime_error("Runtime descriptor arrays need an explicit layout.");
+                }
+
+                auto it = std::find_if(sets[set].begin(), sets[set].end(), [&binding](auto const &other) { return other.binding == binding.binding; });
+                if (it == sets[set].end())
+                {
+                    sets[set].push_back(binding);
+                }
+                else if (it->descriptorType != binding.descriptorType || it->descriptorCount != binding.descriptorCount)
+                {
+                    throw std::runtime_error("Shader stages declare different resources at the same binding.");
+                }
+                else
+                {
+                    it->stageFlags |= binding.stageFlags;
+                }
+            }
+        }
+
+        if (stage.push_constant_size)
+        {
+            push_constant_range.stageFlags |= stage.stage;
+            push_constant_range.size = std::max(push_constant_range.size, stage.push_constant_size);
+        }
+    }
+
+    std::vector<vk::DescriptorSetLayout> set_layouts;
+    for (auto &set : sets)
+    {
+        std::sort(set.begin(), set.end(), [](auto const &a, auto const &b) { return a.binding < b.binding; });
+        set_layouts.push_back(get_set_layout(set));
+    }
+
+    std::vector<vk::PushConstantRange> push_constant_ranges;
+    if (push_constant_range.size)
+    {
+        push_constant_ranges.push_back(push_constant_range);
+    }
+    return get_pipeline_layout(set_layouts, push_constant_ranges);
+}
+
+size_t LayoutCache::get_set_layout_count() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return set_layouts.size();
+}
+
+size_t LayoutCache::get_pipeline_layout_count() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return pipeline_layouts.size();
+}
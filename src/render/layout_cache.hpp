@@ -0,0 +1,43 @@
+﻿#pragma once
+
+#include "render/shader_reflection.hpp"
+
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief Creates descriptor set and pipeline layouts once per distinct description.
+ *
+ * Layouts are looked up by a hash of their description, so pipelines whose shaders declare the
+ * same interface share the layout objects. The cache owns the layouts, they live until destroy.
+ * Safe to use from several threads.
+ */
+class LayoutCache
+{
+public:
+    void prepare(vk::Device device);
+    void destroy();
+
+    vk::DescriptorSetLayout get_set_layout(std::vector<vk::DescriptorSetLayoutBinding> const &bindings);
+    vk::PipelineLayout      get_pipeline_layout(std::vector<vk::DescriptorSetLayout> const &set_layouts, std::vector<vk::PushConstantRange> const &push_constant_ranges);
+    vk::PipelineLayout      get_pipeline_layout(std::vector<ShaderReflection> const &stages);
+
+    size_t get_set_layout_count() const;
+    size_t get_pipeline_layout_count() const;
+
+private:
+    // Layouts are described by a sequence of words, compared as a whole on hash collisions.
+    using Key = std::vector<uint32_t>;
+
+    struct KeyHash
+    {
+        size_t operator()(Key const &key) const;
+    };
+
+private:
+    vk::Device                                                device;
+    mutable std::mutex                                        mutex;
+    std::unordered_map<Key, vk::DescriptorSetLayout, KeyHash> set_layouts;
+    std::unordered_map<Key, vk::PipelineLayout, KeyHash>      pipeline_layouts;
+};
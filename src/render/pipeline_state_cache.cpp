@@ -0,0 +1,326 @@
+﻿#include "render/pipeline_state_cache.hpp"
+
+#include <common/logging.h>
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+namespace
+{
+constexpr uint32_t manifest_magic   = 0x4d4f5350;        // "PSOM"
+constexpr uint32_t manifest_version = 1;
+
+std::vector<uint8_t> read_file(std::string const &path)
+{
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file)
+    {
+        return {};
+    }
+    std::vector<uint8_t> data(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+    file.read(reinterpret_cast<char *>(data.data()), data.size());
+    return file ? data : std::vector<uint8_t>();
+}
+
+bool write_file(std::string const &path, void const *data, size_t size)
+{
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(static_cast<char const *>(data), size);
+    return static_cast<bool>(file);
+}
+}  // namespace
+
+/**
+ * @brief The color blend state of a blend mode, writing all channels.
+ */
+vk::PipelineColorBlendAttachmentState get_blend_attachment(BlendMode blend_mode)
+{
+    vk::PipelineColorBlendAttachmentState blend_attachment;
+    blend_attachment.colorWriteMask = vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG | vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA;
+
+    switch (blend_mode)
+    {
+        case BlendMode::eOpaque:
+            break;
+        case BlendMode::eAlpha:
+            blend_attachment.setBlendEnable(true)
+                .setSrcColorBlendFactor(vk::BlendFactor::eOne)
+                .setDstColorBlendFactor(vk::BlendFactor::eOneMinusSrcAlpha)
+                .setSrcAlphaBlendFactor(vk::BlendFactor::eOne)
+                .setDstAlphaBlendFactor(vk::BlendFactor::eOneMinusSrcAlpha);
+            break;
+        case BlendMode::eAdditive:
+            blend_attachment.setBlendEnable(true)
+                .setSrcColorBlendFactor(vk::BlendFactor::eOne)
+                .setDstColorBlendFactor(vk::BlendFactor::eOne)
+                .setSrcAlphaBlendFactor(vk::BlendFactor::eZero)
+                .setDstAlphaBlendFactor(vk::BlendFactor::eOne);
+            break;
+    }
+    return blend_attachment;
+}
+
+size_t PipelineStateCache::StateHash::operator()(GraphicsPipelineState const &state) const
+{
+    // FNV-1a over the bytes of the state.
+    uint8_t bytes[sizeof(GraphicsPipelineState)];
+    std::memcpy(bytes, &state, sizeof(state));
+
+    uint64_t hash = 14695981039346656037ull;
+    for (uint8_t byte : bytes)
+    {
+        hash = (hash ^ byte) * 1099511628211ull;
+    }
+    return static_cast<size_t>(hash);
+}
+
+/**
+ * @brief Loads the driver's pipeline cache and starts the workers.
+ * @param builder Creates the pipeline of a state, it is called on the worker threads.
+ * @param directory Where the manifest and the driver's cache are kept between runs.
+ */
+void PipelineStateCache::prepare(vk::Device device, FrameSync &frame_sync, Builder builder, std::string const &directory)
+{
+    this->device        = device;
+    this->frame_sync    = &frame_sync;
+    this->builder       = std::move(builder);
+    manifest_path       = directory + "/pipelines.manifest";
+    pipeline_cache_path = directory + "/pipelines.cache";
+
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+
+    // The driver validates the header of the data and starts empty if it was written by another driver or device.
+    std::vector<uint8_t> cache_data = read_file(pipeline_cache_path);
+    pipeline_cache                  = device.createPipelineCache({{}, cache_data.size(), cache_data.data()});
+
+    // Pipeline creation mostly runs on one core, a few workers keep up with a prewarm without starving the frame.
+    uint32_t worker_count = std::clamp(std::thread::hardware_concurrency() / 4, 1u, 4u);
+    running               = true;
+    for (uint32_t i = 0; i < worker_count; i++)
+    {
+        workers.emplace_back(&PipelineStateCache::run, this);
+    }
+}
+
+/**
+ * @brief Stops the workers, records the manifest and the driver's cache and destroys the pipelines.
+ *        The GPU must be idle.
+ */
+void PipelineStateCache::destroy()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = false;
+        jobs.clear();
+    }
+    condition.notify_all();
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+    workers.clear();
+
+    if (!device)
+    {
+        return;
+    }
+
+    std::vector<uint32_t> manifest = {manifest_magic, manifest_version, static_cast<uint32_t>(sizeof(GraphicsPipelineState)), static_cast<uint32_t>(used.size())};
+    for (auto const &state : used)
+    {
+        size_t offset = manifest.size();
+        manifest.resize(offset + sizeof(GraphicsPipelineState) / sizeof(uint32_t));
+        std::memcpy(manifest.data() + offset, &state, sizeof(state));
+    }
+    if (!write_file(manifest_path, manifest.data(), manifest.size() * sizeof(uint32_t)))
+    {
+        LOGW("Failed to write the pipeline manifest {}.", manifest_path);
+    }
+
+    std::vector<uint8_t> cache_data = device.getPipelineCacheData(pipeline_cache);
+    if (!write_file(pipeline_cache_path, cache_data.data(), cache_data.size()))
+    {
+        LOGW("Failed to write the pipeline cache {}.", pipeline_cache_path);
+    }
+
+    for (auto const &[state, entry] : entries)
+    {
+        if (entry.pipeline)
+        {
+            device.destroyPipeline(entry.pipeline);
+        }
+    }
+    entries.clear();
+    used.clear();
+    device.destroyPipelineCache(pipeline_cache);
+
+    device         = nullptr;
+    frame_sync     = nullptr;
+    builder        = nullptr;
+    pipeline_cache = nullptr;
+    generation     = 0;
+    enabled        = true;
+}
+
+/**
+ * @brief Queues the states recorded in the manifest of the previous run.
+ */
+void PipelineStateCache::prewarm()
+{
+    std::vector<uint8_t> data = read_file(manifest_path);
+
+    uint32_t header[4] = {};
+    if (data.size() >= sizeof(header))
+    {
+        std::memcpy(header, data.data(), sizeof(header));
+    }
+    if (header[0] != manifest_magic || header[1] != manifest_version || header[2] != sizeof(GraphicsPipelineState) ||
+        data.size() != sizeof(header) + size_t(header[3]) * sizeof(GraphicsPipelineState))
+    {
+        if (!data.empty())
+        {
+            LOGW("Pipeline manifest {} is outdated, not prewarming.", manifest_path);
+        }
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    for (uint32_t i = 0; i < header[3]; i++)
+    {
+        GraphicsPipelineState state;
+        std::memcpy(&state, data.data() + sizeof(header) + i * sizeof(GraphicsPipelineState), sizeof(state));
+        if (entries.try_emplace(state).second)
+        {
+            queue(state);
+        }
+    }
+    LOGI("Prewarming {} pipelines.", header[3]);
+}
+
+/**
+ * @brief Returns the pipeline of a state, or the fallback while it is being created.
+ *
+ * A state seen for the first time is queued for the workers and recorded for the manifest, all later
+ * calls are one hash lookup.
+ */
+vk::Pipeline PipelineStateCache::get(GraphicsPipelineState const &state, vk::Pipeline fallback)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (!enabled)
+    {
+        return fallback;
+    }
+
+    auto [it, inserted] = entries.try_emplace(state);
+    if (inserted)
+    {
+        queue(state);
+    }
+    if (!it->second.used)
+    {
+        it->second.used = true;
+        used.insert(state);
+    }
+    return it->second.pipeline ? it->second.pipeline : fallback;
+}
+
+/**
+ * @brief Drops all pipelines, e.g. after their shaders changed. The frames in flight may still use
+ *        them, so they are retired. The recorded states are kept for the manifest.
+ */
+void PipelineStateCache::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    generation++;
+    jobs.clear();
+    for (auto const &[state, entry] : entries)
+    {
+        if (entry.pipeline)
+        {
+            frame_sync->retire([device = device, pipeline = entry.pipeline]() { device.destroyPipeline(pipeline); });
+        }
+    }
+    entries.clear();
+}
+
+/**
+ * @brief While disabled, get always returns the fallback and creates nothing.
+ */
+void PipelineStateCache::set_enabled(bool enabled)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    this->enabled = enabled;
+}
+
+vk::PipelineCache PipelineStateCache::get_pipeline_cache() const
+{
+    return pipeline_cache;
+}
+
+size_t PipelineStateCache::get_ready_count() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return std::count_if(entries.begin(), entries.end(), [](auto const &entry) { return !entry.second.pending; });
+}
+
+size_t PipelineStateCache::get_pending_count() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return entries.size() - std::count_if(entries.begin(), entries.end(), [](auto const &entry) { return !entry.second.pending; });
+}
+
+/// @brief Queues a state for the workers, the caller holds the mutex.
+void PipelineStateCache::queue(GraphicsPipelineState const &state)
+{
+    jobs.push_back(state);
+    condition.notify_one();
+}
+
+void PipelineStateCache::run()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true)
+    {
+        condition.wait(lock, [this]() { return !running || !jobs.empty(); });
+        if (!running)
+        {
+            return;
+        }
+
+        GraphicsPipelineState state          = jobs.front();
+        uint64_t              job_generation = generation;
+        jobs.pop_front();
+        lock.unlock();
+
+        vk::Pipeline pipeline;
+        try
+        {
+            pipeline = builder(state);
+        }
+        catch (std::exception const &e)
+        {
+            LOGE("Failed to create the pipeline of program {}, drawing with the fallback. Error: {}", state.program, e.what());
+        }
+
+        lock.lock();
+        auto it = entries.find(state);
+        if (job_generation != generation || it == entries.end())
+        {
+            if (pipeline)
+            {
+                device.destroyPipeline(pipeline);
+            }
+            continue;
+        }
+
+        // A failed state stays in the cache without a pipeline, so it isn't retried every frame.
+        it->second.pipeline = pipeline;
+        it->second.pending  = false;
+    }
+}
@@ -0,0 +1,115 @@
+﻿#pragma once
+
+#include "render/frame_sync.hpp"
+#include "render/shader_variants.hpp"
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+enum class BlendMode : uint32_t
+{
+    eOpaque,
+    eAlpha,              // Premultiplied alpha.
+    eAdditive
+};
+
+/**
+ * @brief Everything a graphics pipeline is created from, the key of the PipelineStateCache.
+ *
+ * The state is hashed and recorded as raw bytes, so it holds no pointers or padding. Which shaders
+ * a program and which render pass an index stand for is up to the builder of the cache, they must
+ * mean the same in every run for the manifest to stay valid.
+ */
+struct GraphicsPipelineState
+{
+    uint32_t              program          = 0;        // The shaders.
+    VariantKey            vertex_variant   = 0;
+    VariantKey            fragment_variant = 0;
+    uint32_t              vertex_layout    = 0;        // The vertex struct the buffers hold.
+    uint32_t              render_pass      = 0;        // A class of compatible render passes.
+    vk::PrimitiveTopology topology         = vk::PrimitiveTopology::eTriangleList;
+    vk::PolygonMode       polygon_mode     = vk::PolygonMode::eFill;
+    vk::CullModeFlags     cull_mode        = vk::CullModeFlagBits::eBack;
+    vk::FrontFace         front_face       = vk::FrontFace::eClockwise;
+    vk::Bool32            depth_test       = VK_TRUE;
+    vk::Bool32            depth_write      = VK_TRUE;
+    vk::CompareOp         depth_compare    = vk::CompareOp::eLessOrEqual;
+    BlendMode             blend_mode       = BlendMode::eOpaque;
+
+    bool operator==(GraphicsPipelineState const &other) const = default;
+};
+
+static_assert(std::has_unique_object_representations_v<GraphicsPipelineState>, "Pipeline states are hashed and recorded as bytes.");
+
+vk::PipelineColorBlendAttachmentState get_blend_attachment(BlendMode blend_mode);
+
+/**
+ * @brief Creates graphics pipelines by state on worker threads, so frames never wait for the driver.
+ *
+ * A state which isn't ready yet is queued and the draw uses a fallback pipeline until then. get locks,
+ * so it is meant to be called once per frame and state, not per draw. The states used in a run are
+ * recorded into a manifest, and the next run starts creating them right away. The driver's pipeline
+ * cache is kept next to it, so recreating them is cheap.
+ */
+class PipelineStateCache
+{
+public:
+    /// @brief Creates the pipeline of a state, on a worker thread.
+    using Builder = std::function<vk::Pipeline(GraphicsPipelineState const &state)>;
+
+    void prepare(vk::Device device, FrameSync &frame_sync, Builder builder, std::string const &directory);
+    void destroy();
+
+    void         prewarm();
+    vk::Pipeline get(GraphicsPipelineState const &state, vk::Pipeline fallback);
+    void         clear();
+    void         set_enabled(bool enabled);
+
+    vk::PipelineCache get_pipeline_cache() const;
+    size_t            get_ready_count() const;
+    size_t            get_pending_count() const;
+
+private:
+    struct StateHash
+    {
+        size_t operator()(GraphicsPipelineState const &state) const;
+    };
+
+    struct Entry
+    {
+        vk::Pipeline pipeline;
+        bool         pending = true;
+        bool         used    = false;        // Recorded into the manifest, prewarmed states may not be used in this run.
+    };
+
+    void queue(GraphicsPipelineState const &state);
+    void run();
+
+private:
+    using Entries = std::unordered_map<GraphicsPipelineState, Entry, StateHash>;
+    using States  = std::unordered_set<GraphicsPipelineState, StateHash>;
+
+    vk::Device                        device;
+    FrameSync                        *frame_sync = nullptr;
+    Builder                           builder;
+    std::string                       manifest_path;
+    std::string                       pipeline_cache_path;
+    vk::PipelineCache                 pipeline_cache;                // The driver's cache, shared by all pipelines.
+    std::vector<std::thread>          workers;
+    mutable std::mutex                mutex;                         // Guards everything below.
+    std::condition_variable           condition;
+    Entries                           entries;
+    States                            used;                          // Recorded into the manifest.
+    std::deque<GraphicsPipelineState> jobs;
+    uint64_t                          generation = 0;                // Advanced by clear, older results are dropped.
+    bool                              running    = false;
+    bool                              enabled    = true;
+};
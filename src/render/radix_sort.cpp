@@ -0,0 +1,282 @@
+﻿#include "render/radix_sort.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(LOOM_SIMD_SSE4)
+#    include <immintrin.h>
+#endif
+
+namespace
+{
+constexpr uint32_t digit_count = 8;        // Eight bit digits of a 64-bit key.
+
+uint32_t get_digit(uint64_t key, uint32_t digit)
+{
+    return static_cast<uint32_t>(key >> (digit * 8)) & 0xff;
+}
+
+/**
+ * @brief The AND and the OR of all keys, the bits which differ between them are set in one but not the other.
+ */
+void reduce_bits(uint64_t const *keys, size_t count, uint64_t &and_bits, uint64_t &or_bits)
+{
+    and_bits = ~0ull;
+    or_bits  = 0;
+    size_t i = 0;
+
+#if defined(LOOM_SIMD_AVX2)
+    __m256i and_lanes = _mm256_set1_epi64x(-1);
+    __m256i or_lanes  = _mm256_setzero_si256();
+    for (; i + 4 <= count; i += 4)
+    {
+        __m256i lanes = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(keys + i));
+        and_lanes     = _mm256_and_si256(and_lanes, lanes);
+        or_lanes      = _mm256_or_si256(or_lanes, lanes);
+    }
+    alignas(32) uint64_t and_parts[4], or_parts[4];
+    _mm256_store_si256(reinterpret_cast<__m256i *>(and_parts), and_lanes);
+    _mm256_store_si256(reinterpret_cast<__m256i *>(or_parts), or_lanes);
+    for (int k = 0; k < 4; k++)
+    {
+        and_bits &= and_parts[k];
+        or_bits |= or_parts[k];
+    }
+#elif defined(LOOM_SIMD_SSE4)
+    __m128i and_lanes = _mm_set1_epi64x(-1);
+    __m128i or_lanes  = _mm_setzero_si128();
+    for (; i + 2 <= count; i += 2)
+    {
+        __m128i lanes = _mm_loadu_si128(reinterpret_cast<__m128i const *>(keys + i));
+        and_lanes     = _mm_and_si128(and_lanes, lanes);
+        or_lanes      = _mm_or_si128(or_lanes, lanes);
+    }
+    and_bits = static_cast<uint64_t>(_mm_extract_epi64(and_lanes, 0)) & static_cast<uint64_t>(_mm_extract_epi64(and_lanes, 1));
+    or_bits  = static_cast<uint64_t>(_mm_extract_epi64(or_lanes, 0)) | static_cast<uint64_t>(_mm_extract_epi64(or_lanes, 1));
+#endif
+
+    for (; i < count; i++)
+    {
+        and_bits &= keys[i];
+        or_bits |= keys[i];
+    }
+}
+
+bool is_constant(uint64_t varying_bits, uint32_t digit)
+{
+    return get_digit(varying_bits, digit) == 0;
+}
+}  // namespace
+
+/**
+ * @brief Starts the workers.
+ * @param thread_count The threads sorting large arrays, including the calling thread. 1 sorts everything on the calling thread.
+ */
+void RadixSorter::prepare(uint32_t thread_count)
+{
+    thread_count = std::max(thread_count, 1u);
+    threads      = std::vector<ThreadState>(thread_count);
+    barrier      = std::make_unique<std::barrier<>>(thread_count);
+    running      = true;
+    for (uint32_t i = 1; i < thread_count; i++)
+    {
+        workers.emplace_back(&RadixSorter::run, this, i);
+    }
+}
+
+void RadixSorter::destroy()
+{
+    if (!running)
+    {
+        return;
+    }
+
+    // The workers wake up to find there is nothing left to sort.
+    running = false;
+    if (!workers.empty())
+    {
+        barrier->arrive_and_wait();
+    }
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+    workers.clear();
+    barrier.reset();
+    threads.clear();
+    scratch = {};
+}
+
+/**
+ * @brief Grows the scratch buffer for count keys up front, e.g. so the first frame sorting them doesn't allocate.
+ */
+void RadixSorter::reserve(size_t count)
+{
+    if (count > scratch.size())
+    {
+        scratch.resize(count);
+    }
+}
+
+/**
+ * @brief Sorts the keys ascending, on all threads if there are enough keys.
+ */
+void RadixSorter::sort(std::span<uint64_t> keys)
+{
+    reserve(keys.size());
+
+    if (workers.empty() || keys.size() < parallel_threshold)
+    {
+        sort_serial(keys);
+        return;
+    }
+
+    // The barrier publishes the keys to the workers, and the last one in sort_range their results to us.
+    this->keys = keys;
+    barrier->arrive_and_wait();
+    sort_range(0);
+    this->keys = {};
+}
+
+uint32_t RadixSorter::get_thread_count() const
+{
+    return static_cast<uint32_t>(threads.size());
+}
+
+/**
+ * @brief Sorts on the calling thread, counting all digits in one sweep since the counts don't change between passes.
+ */
+void RadixSorter::sort_serial(std::span<uint64_t> keys)
+{
+    uint64_t and_bits, or_bits;
+    reduce_bits(keys.data(), keys.size(), and_bits, or_bits);
+    uint64_t const varying_bits = and_bits ^ or_bits;
+    if (!varying_bits)
+    {
+        return;
+    }
+
+    Histogram histograms[digit_count] = {};
+    for (uint64_t key : keys)
+    {
+        for (uint32_t digit = 0; digit < digit_count; digit++)
+        {
+            histograms[digit][get_digit(key, digit)]++;
+        }
+    }
+
+    uint64_t *src = keys.data();
+    uint64_t *dst = scratch.data();
+    for (uint32_t digit = 0; digit < digit_count; digit++)
+    {
+        if (is_constant(varying_bits, digit))
+        {
+            continue;
+        }
+
+        uint32_t offsets[256];
+        uint32_t sum = 0;
+        for (uint32_t bucket = 0; bucket < 256; bucket++)
+        {
+            offsets[bucket] = sum;
+            sum += histograms[digit][bucket];
+        }
+
+        for (size_t i = 0; i < keys.size(); i++)
+        {
+            dst[offsets[get_digit(src[i], digit)]++] = src[i];
+        }
+        std::swap(src, dst);
+    }
+
+    if (src != keys.data())
+    {
+        std::memcpy(keys.data(), src, keys.size_bytes());
+    }
+}
+
+/**
+ * @brief The share of a thread in sorting the keys in parallel. Every thread takes the same steps, so they meet at the barrier.
+ */
+void RadixSorter::sort_range(uint32_t thread)
+{
+    uint32_t const thread_count = static_cast<uint32_t>(threads.size());
+    size_t const   begin        = keys.size() * thread / thread_count;
+    size_t const   end          = keys.size() * (thread + 1) / thread_count;
+    ThreadState   &state        = threads[thread];
+
+    reduce_bits(keys.data() + begin, end - begin, state.and_bits, state.or_bits);
+    barrier->arrive_and_wait();
+
+    uint64_t and_bits = ~0ull;
+    uint64_t or_bits  = 0;
+    for (auto const &other : threads)
+    {
+        and_bits &= other.and_bits;
+        or_bits |= other.or_bits;
+    }
+    uint64_t const varying_bits = and_bits ^ or_bits;
+
+    uint64_t *src = keys.data();
+    uint64_t *dst = scratch.data();
+    for (uint32_t digit = 0; digit < digit_count; digit++)
+    {
+        if (is_constant(varying_bits, digit))
+        {
+            continue;
+        }
+
+        state.histogram = {};
+        for (size_t i = begin; i < end; i++)
+        {
+            state.histogram[get_digit(src[i], digit)]++;
+        }
+        barrier->arrive_and_wait();
+
+        // A range's keys of a digit go after the keys of all lower digits, and after the keys of the same digit in the ranges before.
+        uint32_t offsets[256];
+        uint32_t sum = 0;
+        for (uint32_t bucket = 0; bucket < 256; bucket++)
+        {
+            for (uint32_t other = 0; other < thread_count; other++)
+            {
+                if (other == thread)
+                {
+                    offsets[bucket] = sum;
+                }
+                sum += threads[other].histogram[bucket];
+            }
+        }
+
+        for (size_t i = begin; i < end; i++)
+        {
+            dst[offsets[get_digit(src[i], digit)]++] = src[i];
+        }
+        std::swap(src, dst);
+
+        // The next pass reads all of this one's output, and counts into the histograms this one still reads.
+        barrier->arrive_and_wait();
+    }
+
+    if (src != keys.data())
+    {
+        std::memcpy(keys.data() + begin, src + begin, (end - begin) * sizeof(uint64_t));
+    }
+    barrier->arrive_and_wait();
+}
+
+/**
+ * @brief A worker, sorts its range of every parallel sort until the sorter is destroyed.
+ */
+void RadixSorter::run(uint32_t thread)
+{
+    while (true)
+    {
+        barrier->arrive_and_wait();
+        if (!running)
+        {
+            return;
+        }
+        sort_range(thread);
+    }
+}
@@ -0,0 +1,57 @@
+﻿#pragma once
+
+#include <array>
+#include <barrier>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Sorts 64-bit keys ascending with a least significant digit radix sort, in parallel on its own workers.
+ *
+ * Every pass counts the keys by an eight bit digit, then scatters them stably into a scratch buffer
+ * in the order of the digit. Digits which are the same in all keys are found by reducing the keys
+ * with SIMD and skipped, e.g. the upper index bits of depth sort keys.
+ *
+ * Large arrays are split into one contiguous range per thread. Every thread counts its range, then
+ * scatters it to offsets derived from the counts of all ranges, so the result is the same as on one
+ * thread. The threads meet at a barrier between the steps, the calling thread takes part. The
+ * scratch buffer only grows, so sorting no more keys than before doesn't allocate.
+ */
+class RadixSorter
+{
+public:
+    static constexpr size_t parallel_threshold = 16 * 1024;        // Fewer keys are sorted on the calling thread alone.
+
+    void prepare(uint32_t thread_count);
+    void destroy();
+    void reserve(size_t count);
+
+    void     sort(std::span<uint64_t> keys);
+    uint32_t get_thread_count() const;
+
+private:
+    using Histogram = std::array<uint32_t, 256>;
+
+    /// @brief What a thread shares with the others, on its own cache lines.
+    struct alignas(64) ThreadState
+    {
+        Histogram histogram;
+        uint64_t  and_bits = 0;        // Of the keys of the thread's range.
+        uint64_t  or_bits  = 0;
+    };
+
+    void sort_serial(std::span<uint64_t> keys);
+    void sort_range(uint32_t thread);
+    void run(uint32_t thread);
+
+private:
+    std::vector<std::thread>        workers;
+    std::unique_ptr<std::barrier<>> barrier;                   // The workers and the calling thread.
+    std::vector<ThreadState>        threads;                   // One per worker and the calling thread.
+    std::vector<uint64_t>           scratch;
+    std::span<uint64_t>             keys;                      // The keys sorted in parallel, set before the workers start.
+    bool                            running = false;
+};
@@ -0,0 +1,885 @@
+﻿#include "render/render_graph.hpp"
+
+#include <common/hpp_vk_common.h>
+#include <common/logging.h>
+
+#include <algorithm>
+#include <bit>
+
+namespace
+{
+struct AccessInfo
+{
+    vk::PipelineStageFlags stage;
+    vk::AccessFlags        access;
+    vk::ImageLayout        layout;
+    vk::ImageUsageFlags    usage;
+};
+
+AccessInfo get_access_info(RenderGraph::Access access)
+{
+    switch (access)
+    {
+        case RenderGraph::Access::eColorAttachment:
+            return {vk::PipelineStageFlagBits::eColorAttachmentOutput,
+                    vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eColorAttachmentWrite,
+                    vk::ImageLayout::eColorAttachmentOptimal,
+                    vk::ImageUsageFlagBits::eColorAttachment};
+        case RenderGraph::Access::eDepthAttachment:
+            return {vk::PipelineStageFlagBits::eEarlyFragmentTests | vk::PipelineStageFlagBits::eLateFragmentTests,
+                    vk::AccessFlagBits::eDepthStencilAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentWrite,
+                    vk::ImageLayout::eDepthStencilAttachmentOptimal,
+                    vk::ImageUsageFlagBits::eDepthStencilAttachment};
+        case RenderGraph::Access::eDepthAttachmentReadOnly:
+            return {vk::PipelineStageFlagBits::eEarlyFragmentTests | vk::PipelineStageFlagBits::eLateFragmentTests,
+                    vk::AccessFlagBits::eDepthStencilAttachmentRead,
+                    vk::ImageLayout::eDepthStencilReadOnlyOptimal,
+                    vk::ImageUsageFlagBits::eDepthStencilAttachment};
+        case RenderGraph::Access::eDepthResolve:
+            // Depth resolves happen at the end of the render pass, in the color attachment output stage.
+            return {vk::PipelineStageFlagBits::eColorAttachmentOutput | vk::PipelineStageFlagBits::eLateFragmentTests,
+                    vk::AccessFlagBits::eColorAttachmentWrite | vk::AccessFlagBits::eDepthStencilAttachmentWrite,
+                    vk::ImageLayout::eDepthStencilAttachmentOptimal,
+                    vk::ImageUsageFlagBits::eDepthStencilAttachment};
+        case RenderGraph::Access::eSampledCompute:
+            return {vk::PipelineStageFlagBits::eComputeShader, vk::AccessFlagBits::eShaderRead, vk::ImageLayout::eShaderReadOnlyOptimal, vk::ImageUsageFlagBits::eSampled};
+        case RenderGraph::Access::eSampledFragment:
+            return {vk::PipelineStageFlagBits::eFragmentShader, vk::AccessFlagBits::eShaderRead, vk::ImageLayout::eShaderReadOnlyOptimal, vk::ImageUsageFlagBits::eSampled};
+        case RenderGraph::Access::eStorageCompute:
+            return {vk::PipelineStageFlagBits::eComputeShader, vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite, vk::ImageLayout::eGeneral, vk::ImageUsageFlagBits::eStorage};
+        case RenderGraph::Access::eIndirectBuffer:
+            return {vk::PipelineStageFlagBits::eDrawIndirect, vk::AccessFlagBits::eIndirectCommandRead, vk::ImageLayout::eUndefined, {}};
+        case RenderGraph::Access::eTransferSrc:
+            return {vk::PipelineStageFlagBits::eTransfer, vk::AccessFlagBits::eTransferRead, vk::ImageLayout::eTransferSrcOptimal, vk::ImageUsageFlagBits::eTransferSrc};
+        case RenderGraph::Access::eTransferDst:
+            return {vk::PipelineStageFlagBits::eTransfer, vk::AccessFlagBits::eTransferWrite, vk::ImageLayout::eTransferDstOptimal, vk::ImageUsageFlagBits::eTransferDst};
+    }
+    return {};
+}
+
+/**
+ * @brief Finds a lazily allocated memory type, which tile-based GPUs only commit memory of as it is needed.
+ * @returns The memory type index, or ~0u if the device has none.
+ */
+uint32_t find_lazy_memory_type(vk::PhysicalDeviceMemoryProperties const &memory_properties, uint32_t type_bits)
+{
+    vk::MemoryPropertyFlags const required = vk::MemoryPropertyFlagBits::eDeviceLocal | vk::MemoryPropertyFlagBits::eLazilyAllocated;
+    for (uint32_t i = 0; i < memory_properties.memoryTypeCount; i++)
+    {
+        if ((type_bits & (1u << i)) && (memory_properties.memoryTypes[i].propertyFlags & required) == required)
+        {
+            return i;
+        }
+    }
+    return ~0u;
+}
+
+void record_barriers(vk::CommandBuffer cmd, DeviceDispatch const &dispatch, vk::PipelineStageFlags src_stage, vk::PipelineStageFlags dst_stage,
+                     std::vector<vk::BufferMemoryBarrier> const &buffers, std::vector<vk::ImageMemoryBarrier> const &images)
+{
+    if (!buffers.empty() || !images.empty())
+    {
+        cmd.pipelineBarrier(src_stage, dst_stage, {}, {}, buffers, images, dispatch);
+    }
+}
+}  // namespace
+
+RenderGraph::PassBuilder &RenderGraph::PassBuilder::read(ResourceHandle resource, Access access)
+{
+    graph.passes[pass].accesses.push_back({resource, access, false});
+    return *this;
+}
+
+RenderGraph::PassBuilder &RenderGraph::PassBuilder::write(ResourceHandle resource, Access access)
+{
+    graph.passes[pass].accesses.push_back({resource, access, true});
+    return *this;
+}
+
+/**
+ * @brief Keeps the pass alive even if nothing reads what it writes.
+ */
+RenderGraph::PassBuilder &RenderGraph::PassBuilder::side_effect()
+{
+    graph.passes[pass].side_effect = true;
+    return *this;
+}
+
+/**
+ * @brief Declares an image owned by the graph, only valid during the frame.
+ * @returns A handle to the image. Its contents are undefined at its first use every frame.
+ */
+RenderGraph::ResourceHandle RenderGraph::create_image(std::string name, ImageDesc const &desc)
+{
+    Resource resource;
+    resource.name = std::move(name);
+    resource.kind = ResourceKind::eTransientImage;
+    resource.desc = desc;
+    resources.push_back(std::move(resource));
+    return static_cast<ResourceHandle>(resources.size() - 1);
+}
+
+/**
+ * @brief Declares an image owned outside of the graph, such as a swapchain image.
+ * @param initial_layout The layout of the image when the frame starts.
+ * @param final_layout The layout the image is transitioned to after its last use.
+ * @param available_stage The stage the image becomes available at, e.g. the stage waiting on the acquire semaphore.
+ */
+RenderGraph::ResourceHandle RenderGraph::import_image(std::string name, vk::ImageAspectFlags aspect, vk::ImageLayout initial_layout, vk::ImageLayout final_layout, vk::PipelineStageFlags available_stage)
+{
+    Resource resource;
+    resource.name                      = std::move(name);
+    resource.kind                      = ResourceKind::eImportedImage;
+    resource.desc.aspect               = aspect;
+    resource.final_layout              = final_layout;
+    resource.initial_state.layout      = initial_layout;
+    resource.initial_state.write_stage = available_stage;
+    resources.push_back(std::move(resource));
+    return static_cast<ResourceHandle>(resources.size() - 1);
+}
+
+/**
+ * @brief Declares a buffer owned outside of the graph. Its accesses are synchronized across frames.
+ */
+RenderGraph::ResourceHandle RenderGraph::import_buffer(std::string name, vk::Buffer buffer)
+{
+    Resource resource;
+    resource.name   = std::move(name);
+    resource.kind   = ResourceKind::eImportedBuffer;
+    resource.buffer = buffer;
+    resources.push_back(std::move(resource));
+    return static_cast<ResourceHandle>(resources.size() - 1);
+}
+
+/**
+ * @brief Adds a pass. Passes execute in the order they were added.
+ * @param queue The queue the pass runs on. Imported resources used on more than one queue must be created with concurrent sharing.
+ */
+RenderGraph::PassBuilder RenderGraph::add_pass(std::string name, ExecuteFunc execute, QueueType queue)
+{
+    Pass pass;
+    pass.name    = std::move(name);
+    pass.execute = std::move(execute);
+    pass.queue   = queue;
+    passes.push_back(std::move(pass));
+    return PassBuilder(*this, static_cast<PassHandle>(passes.size() - 1));
+}
+
+/**
+ * @brief Marks a resource as a result of the frame, the passes writing it are never culled.
+ */
+void RenderGraph::set_output(ResourceHandle resource)
+{
+    resources[resource].output = true;
+}
+
+/**
+ * @brief Culls unused passes, creates the transient images and derives the barriers between passes.
+ * @param dispatch Records and submits the frames.
+ * @param frame_count The number of frame slots, each has its own command buffers.
+ * @param compute_queue The async compute queue, async compute passes run on the graphics queue if it is invalid.
+ * @param profiler If not null, receives a timestamp scope per pass.
+ */
+void RenderGraph::compile(vk::PhysicalDevice gpu, vk::Device device, DeviceDispatch const &dispatch, uint32_t frame_count, GpuQueue &graphics_queue, GpuQueue &compute_queue,
+                          GpuProfiler *profiler)
+{
+    this->device         = device;
+    this->dispatch       = &dispatch;
+    this->graphics_queue = &graphics_queue;
+    this->compute_queue  = compute_queue ? &compute_queue : nullptr;
+    this->profiler       = profiler;
+
+    cull_passes();
+    create_batches();
+
+    for (uint32_t i = 0; i < passes.size(); i++)
+    {
+        if (passes[i].culled)
+        {
+            continue;
+        }
+
+        for (auto const &access : passes[i].accesses)
+        {
+            Resource &resource  = resources[access.resource];
+            resource.first_pass = std::min(resource.first_pass, i);
+            resource.last_pass  = std::max(resource.last_pass, i);
+            resource.usage |= get_access_info(access.access).usage;
+            resource.queue_mask |= 1u << static_cast<uint32_t>(passes[i].queue);
+        }
+    }
+
+    create_transient_images();
+
+    vk::PhysicalDeviceMemoryProperties memory_properties = gpu.getMemoryProperties();
+    for (auto &block : memory_blocks)
+    {
+        // Lazy images fall back to ordinary device memory on GPUs without lazily allocated memory.
+        uint32_t memory_type = block.lazy ? find_lazy_memory_type(memory_properties, block.type_bits) : ~0u;
+        if (memory_type == ~0u)
+        {
+            block.lazy  = false;
+            memory_type = findMemoryType(memory_properties, block.type_bits, vk::MemoryPropertyFlagBits::eDeviceLocal);
+        }
+        block.heap   = memory_properties.memoryTypes[memory_type].heapIndex;
+        block.memory = allocate_device_memory(device, {block.size, memory_type}, block.heap, MemoryCategory::eRenderTargets);
+
+        for (ResourceHandle handle : block.resources)
+        {
+            Resource &resource = resources[handle];
+            device.bindImageMemory(resource.image, block.memory, 0);
+            resource.view = device.createImageView({{}, resource.image, vk::ImageViewType::e2D, resource.desc.format, {}, {resource.desc.aspect, 0, resource.desc.mip_levels, 0, 1}});
+        }
+
+        statistics.allocated_bytes += block.size;
+        if (block.lazy)
+        {
+            statistics.lazy_bytes += block.size;
+        }
+    }
+
+    // Walk the frame once to find the state every resource is left in, so the next frame (or the next
+    // image sharing its memory) can synchronize against it.
+    std::vector<State> states;
+    simulate(states, false);
+
+    for (auto &resource : resources)
+    {
+        if (resource.kind == ResourceKind::eImportedBuffer)
+        {
+            resource.initial_state = states[&resource - resources.data()];
+        }
+    }
+
+    for (auto &block : memory_blocks)
+    {
+        for (size_t i = 0; i < block.resources.size(); i++)
+        {
+            ResourceHandle previous = block.resources[(i + block.resources.size() - 1) % block.resources.size()];
+            State         &initial  = resources[block.resources[i]].initial_state;
+
+            // Transient contents are discarded, so only the execution and memory dependency remains.
+            initial              = State();
+            initial.write_stage  = states[previous].write_stage | states[previous].read_stages;
+            initial.write_access = states[previous].write_access;
+            initial.batch        = states[previous].batch;
+        }
+    }
+
+    simulate(states, true);
+
+    // The value of the last batch marks the end of the frame, so it also waits for the last batch of the other queue.
+    for (uint32_t i = 0; i + 1 < batches.size(); i++)
+    {
+        if (batches[i].queue != batches.back().queue)
+        {
+            add_wait(static_cast<uint32_t>(batches.size() - 1), i);
+        }
+    }
+
+    statistics.queue_wait_count = 0;
+    for (auto const &batch : batches)
+    {
+        statistics.queue_wait_count += static_cast<uint32_t>(batch.waits.size());
+    }
+
+    frame_commands.resize(frame_count);
+    for (auto &commands : frame_commands)
+    {
+        for (auto const &batch : batches)
+        {
+            vk::CommandPool &pool = commands.pools[static_cast<size_t>(batch.queue)];
+            if (!pool)
+            {
+                pool = device.createCommandPool({vk::CommandPoolCreateFlagBits::eTransient, get_queue(batch.queue).familyIndex});
+            }
+            commands.command_buffers.push_back(vkb::common::allocate_command_buffer(device, pool));
+        }
+    }
+
+    if (profiler)
+    {
+        std::vector<GpuProfiler::Scope> scopes;
+        for (auto const &pass : passes)
+        {
+            bool const async = pass.queue == QueueType::eAsyncCompute;
+            scopes.push_back({pass.name, async ? "compute" : "graphics", get_queue(pass.queue).familyIndex, async});
+        }
+        profiler->configure(frame_count, std::move(scopes));
+    }
+
+    LOGI("Render graph: {} passes ({} culled) in {} submissions with {} queue waits, {} barriers, transient memory {} KiB allocated for {} KiB requested ({} KiB saved by aliasing, {} KiB lazily allocated)",
+         statistics.pass_count,
+         statistics.culled_pass_count,
+         statistics.batch_count,
+         statistics.queue_wait_count,
+         statistics.barrier_count,
+         statistics.allocated_bytes / 1024,
+         statistics.transient_bytes / 1024,
+         statistics.get_aliasing_savings() / 1024,
+         statistics.lazy_bytes / 1024);
+}
+
+/**
+ * @brief Records the passes that survived culling with their barriers, and submits every batch to its queue.
+ *
+ * Batches wait on the timeline values the batches they depend on signaled last. For a batch later in
+ * the frame, that is still the value of the previous frame.
+ * @returns The graphics timeline value signaled by the last submission, which waits for all other queues.
+ */
+uint64_t RenderGraph::submit(RenderGraphFrame const &frame)
+{
+    FrameCommands &commands = frame_commands[frame.frame_index];
+    for (auto pool : commands.pools)
+    {
+        if (pool)
+        {
+            device.resetCommandPool(pool, {}, *dispatch);
+        }
+    }
+
+    if (profiler)
+    {
+        profiler->begin_frame(frame.frame_index);
+    }
+
+    RenderGraphContext context{nullptr, frame.swapchain_index};
+    bool               acquired = false;
+
+    for (uint32_t b = 0; b < batches.size(); b++)
+    {
+        Batch     &batch = batches[b];
+        GpuQueue  &queue = get_queue(batch.queue);
+        bool const last  = b + 1 == batches.size();
+
+        auto const recording = std::chrono::steady_clock::now();
+
+        context.cmd = commands.command_buffers[b];
+        // With a device group, the commands only run on the frame's device.
+        vk::DeviceGroupCommandBufferBeginInfo device_group_begin_info(frame.device_mask);
+        context.cmd.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit, nullptr, frame.device_mask ? &device_group_begin_info : nullptr), *dispatch);
+
+        for (uint32_t index : batch.passes)
+        {
+            Pass &pass = passes[index];
+
+            for (size_t i = 0; i < pass.barriers.images.size(); i++)
+            {
+                pass.barriers.images[i].image = resources[pass.barriers.image_resources[i]].image;
+            }
+            record_barriers(context.cmd, *dispatch, pass.barriers.src_stage, pass.barriers.dst_stage, pass.barriers.buffers, pass.barriers.images);
+
+            if (profiler)
+            {
+                profiler->begin_scope(context.cmd, index);
+            }
+            pass.execute(context);
+            if (profiler)
+            {
+                profiler->end_scope(context.cmd, index);
+            }
+        }
+
+        if (last)
+        {
+            for (size_t i = 0; i < final_barriers.images.size(); i++)
+            {
+                final_barriers.images[i].image = resources[final_barriers.image_resources[i]].image;
+            }
+            record_barriers(context.cmd, *dispatch, final_barriers.src_stage, final_barriers.dst_stage, final_barriers.buffers, final_barriers.images);
+        }
+
+        context.cmd.end(*dispatch);
+
+        // Binary semaphores ignore their timeline value.
+        std::array<vk::Semaphore, 4>          wait_semaphores;
+        std::array<uint64_t, 4>               wait_values;
+        std::array<vk::PipelineStageFlags, 4> wait_stages;
+        uint32_t                              wait_count = 0;
+
+        assert(batch.waits.size() + 2 < wait_semaphores.size());
+        for (uint32_t producer : batch.waits)
+        {
+            wait_semaphores[wait_count] = get_queue(batches[producer].queue).timeline;
+            wait_values[wait_count]     = batches[producer].value;
+            wait_stages[wait_count]     = vk::PipelineStageFlagBits::eAllCommands;
+            wait_count++;
+        }
+
+        if (!acquired && batch.queue == QueueType::eGraphics)
+        {
+            if (frame.wait_semaphore)
+            {
+                wait_semaphores[wait_count] = frame.wait_semaphore;
+                wait_values[wait_count]     = 0;
+                wait_stages[wait_count]     = frame.wait_stage;
+                wait_count++;
+            }
+            if (frame.dependency_semaphore)
+            {
+                wait_semaphores[wait_count] = frame.dependency_semaphore;
+                wait_values[wait_count]     = frame.dependency_value;
+                wait_stages[wait_count]     = frame.dependency_stage;
+                wait_count++;
+            }
+            acquired = true;
+        }
+
+        batch.value = queue.next_value();
+
+        std::array<vk::Semaphore, 2> signal_semaphores = {queue.timeline, frame.signal_semaphore};
+        std::array<uint64_t, 2>      signal_values     = {batch.value, 0};
+        uint32_t                     signal_count      = last && frame.signal_semaphore ? 2 : 1;
+
+        vk::TimelineSemaphoreSubmitInfo timeline_info(wait_count, wait_values.data(), signal_count, signal_values.data());
+        vk::SubmitInfo submit_info(wait_count, wait_semaphores.data(), wait_stages.data(), 1, &context.cmd, signal_count, signal_semaphores.data(), &timeline_info);
+
+        // The frame's device waits and signals all semaphores.
+        std::array<uint32_t, 4>   device_indices;
+        vk::DeviceGroupSubmitInfo device_group_info(wait_count, device_indices.data(), 1, &frame.device_mask, signal_count, device_indices.data());
+        if (frame.device_mask)
+        {
+            device_indices.fill(static_cast<uint32_t>(std::countr_zero(frame.device_mask)));
+            timeline_info.pNext = &device_group_info;
+        }
+
+        auto const submitting = std::chrono::steady_clock::now();
+        queue.queue.submit(submit_info, {}, *dispatch);
+
+        cpu_timings.recording += submitting - recording;
+        cpu_timings.submitting += std::chrono::steady_clock::now() - submitting;
+        cpu_timings.submissions++;
+    }
+    cpu_timings.frames++;
+
+    return batches.empty() ? graphics_queue->submitted : batches.back().value;
+}
+
+/**
+ * @brief Destroys the transient resources and forgets all declarations.
+ */
+void RenderGraph::reset()
+{
+    for (auto &resource : resources)
+    {
+        if (resource.kind == ResourceKind::eTransientImage)
+        {
+            if (resource.view)
+            {
+                device.destroyImageView(resource.view);
+            }
+            if (resource.image)
+            {
+                device.destroyImage(resource.image);
+            }
+        }
+    }
+
+    for (auto &block : memory_blocks)
+    {
+        free_device_memory(device, block.memory, block.size, block.heap, MemoryCategory::eRenderTargets);
+    }
+
+    // Destroying the pools frees their command buffers.
+    for (auto &commands : frame_commands)
+    {
+        for (auto pool : commands.pools)
+        {
+            if (pool)
+            {
+                device.destroyCommandPool(pool);
+            }
+        }
+    }
+
+    resources.clear();
+    passes.clear();
+    batches.clear();
+    frame_commands.clear();
+    memory_blocks.clear();
+    final_barriers = Barriers();
+    statistics     = Statistics();
+}
+
+void RenderGraph::set_imported_image(ResourceHandle resource, vk::Image image)
+{
+    assert(resources[resource].kind == ResourceKind::eImportedImage);
+    resources[resource].image = image;
+}
+
+vk::ImageView RenderGraph::get_image_view(ResourceHandle resource) const
+{
+    return resources[resource].view;
+}
+
+RenderGraph::Statistics const &RenderGraph::get_statistics() const
+{
+    return statistics;
+}
+
+RenderGraph::CpuTimings const &RenderGraph::get_cpu_timings() const
+{
+    return cpu_timings;
+}
+
+void RenderGraph::reset_cpu_timings()
+{
+    cpu_timings = CpuTimings();
+}
+
+/**
+ * @brief Queries how much of the lazily allocated memory the driver actually committed so far.
+ */
+vk::DeviceSize RenderGraph::get_committed_lazy_bytes() const
+{
+    vk::DeviceSize committed = 0;
+    for (auto const &block : memory_blocks)
+    {
+        if (block.lazy)
+        {
+            committed += device.getMemoryCommitment(block.memory);
+        }
+    }
+    return committed;
+}
+
+/**
+ * @brief Culls the passes whose writes are never read by a live pass or an output, walking back from the outputs.
+ */
+void RenderGraph::cull_passes()
+{
+    std::vector<bool> needed(resources.size(), false);
+    for (size_t i = 0; i < resources.size(); i++)
+    {
+        needed[i] = resources[i].output;
+    }
+
+    for (auto pass = passes.rbegin(); pass != passes.rend(); ++pass)
+    {
+        bool alive = pass->side_effect || std::any_of(pass->accesses.begin(),
+                                                      pass->accesses.end(),
+                                                      [&needed](ResourceAccess const &access) { return access.write && needed[access.resource]; });
+
+        pass->culled = !alive;
+        if (!alive)
+        {
+            statistics.culled_pass_count++;
+            continue;
+        }
+
+        for (auto const &access : pass->accesses)
+        {
+            if (!access.write)
+            {
+                needed[access.resource] = true;
+            }
+        }
+    }
+
+    statistics.pass_count = static_cast<uint32_t>(passes.size());
+}
+
+/**
+ * @brief Groups consecutive live passes on the same queue into batches.
+ */
+void RenderGraph::create_batches()
+{
+    batches.clear();
+    for (uint32_t i = 0; i < passes.size(); i++)
+    {
+        Pass &pass = passes[i];
+        if (pass.culled)
+        {
+            continue;
+        }
+
+        if (pass.queue == QueueType::eAsyncCompute && !compute_queue)
+        {
+            pass.queue = QueueType::eGraphics;
+        }
+
+        if (batches.empty() || batches.back().queue != pass.queue)
+        {
+            batches.push_back({pass.queue, {}, {}, 0});
+        }
+        batches.back().passes.push_back(i);
+        pass.batch = static_cast<uint32_t>(batches.size() - 1);
+    }
+
+    // The last batch presents and its timeline value marks the end of the frame.
+    assert(batches.empty() || batches.back().queue == QueueType::eGraphics);
+
+    statistics.batch_count = static_cast<uint32_t>(batches.size());
+}
+
+/**
+ * @brief Creates the transient images and assigns them to memory blocks.
+ *
+ * Images are placed largest first into the first block with a compatible memory type whose
+ * images are all dead by the time the new one is first used. Lazy images only share blocks with
+ * other lazy images.
+ */
+void RenderGraph::create_transient_images()
+{
+    std::vector<uint32_t> queue_families = {graphics_queue->familyIndex};
+    if (compute_queue)
+    {
+        queue_families.push_back(compute_queue->familyIndex);
+    }
+
+    std::vector<ResourceHandle> transients;
+    for (ResourceHandle handle = 0; handle < resources.size(); handle++)
+    {
+        Resource &resource = resources[handle];
+        if (resource.kind != ResourceKind::eTransientImage || resource.first_pass == ~0u)
+        {
+            continue;
+        }
+
+        // Images used on both queues are shared concurrently rather than transferring their ownership back and forth.
+        bool const concurrent = resource.queue_mask == 3u;
+
+        // Lazy images never leave the attachments, their memory only needs to exist on tile-based GPUs when it is spilled.
+        if (resource.desc.lazy)
+        {
+            resource.usage |= vk::ImageUsageFlagBits::eTransientAttachment;
+        }
+
+        resource.image = device.createImage({{},
+                                             vk::ImageType::e2D,
+                                             resource.desc.format,
+                                             vk::Extent3D(resource.desc.extent, 1),
+                                             resource.desc.mip_levels,
+                                             1,
+                                             resource.desc.samples,
+                                             vk::ImageTiling::eOptimal,
+                                             resource.usage,
+                                             concurrent ? vk::SharingMode::eConcurrent : vk::SharingMode::eExclusive,
+                                             concurrent ? static_cast<uint32_t>(queue_families.size()) : 0u,
+                                             concurrent ? queue_families.data() : nullptr,
+                                             vk::ImageLayout::eUndefined});
+
+        resource.memory_requirements = device.getImageMemoryRequirements(resource.image);
+        statistics.transient_bytes += resource.memory_requirements.size;
+        transients.push_back(handle);
+    }
+
+    std::sort(transients.begin(),
+              transients.end(),
+              [this](ResourceHandle a, ResourceHandle b) { return resources[a].memory_requirements.size > resources[b].memory_requirements.size; });
+
+    for (ResourceHandle handle : transients)
+    {
+        Resource const &resource = resources[handle];
+
+        auto block = std::find_if(memory_blocks.begin(),
+                                  memory_blocks.end(),
+                                  [this, &resource](MemoryBlock const &candidate)
+                                  {
+                                      if (candidate.lazy != resource.desc.lazy || !(candidate.type_bits & resource.memory_requirements.memoryTypeBits))
+                                      {
+                                          return false;
+                                      }
+                                      return std::none_of(candidate.resources.begin(),
+                                                          candidate.resources.end(),
+                                                          [this, &resource](ResourceHandle other)
+                                                          {
+                                                              return resources[other].first_pass <= resource.last_pass && resource.first_pass <= resources[other].last_pass;
+                                                          });
+                                  });
+
+        if (block == memory_blocks.end())
+        {
+            block       = memory_blocks.emplace(memory_blocks.end());
+            block->lazy = resource.desc.lazy;
+        }
+
+        block->size = std::max(block->size, resource.memory_requirements.size);
+        block->type_bits &= resource.memory_requirements.memoryTypeBits;
+        block->resources.push_back(handle);
+    }
+
+    for (auto &block : memory_blocks)
+    {
+        std::sort(block.resources.begin(),
+                  block.resources.end(),
+                  [this](ResourceHandle a, ResourceHandle b) { return resources[a].first_pass < resources[b].first_pass; });
+    }
+}
+
+/**
+ * @brief Walks the live passes in order, tracking the state of every resource.
+ * @param states Receives the state of every resource after the last pass.
+ * @param record If true, the barriers of every pass and the final transitions are recorded.
+ */
+void RenderGraph::simulate(std::vector<State> &states, bool record)
+{
+    states.clear();
+    for (auto const &resource : resources)
+    {
+        states.push_back(resource.initial_state);
+    }
+
+    if (record)
+    {
+        statistics.barrier_count = 0;
+    }
+
+    for (auto &pass : passes)
+    {
+        if (pass.culled)
+        {
+            continue;
+        }
+
+        if (record)
+        {
+            pass.barriers = Barriers();
+        }
+
+        for (auto const &access : pass.accesses)
+        {
+            add_barrier(pass, access.resource, states[access.resource], access, record);
+        }
+    }
+
+    if (!record)
+    {
+        return;
+    }
+
+    final_barriers = Barriers();
+    for (ResourceHandle handle = 0; handle < resources.size(); handle++)
+    {
+        Resource const &resource = resources[handle];
+        State const    &state    = states[handle];
+        if (resource.kind != ResourceKind::eImportedImage || resource.final_layout == vk::ImageLayout::eUndefined || resource.final_layout == state.layout)
+        {
+            continue;
+        }
+
+        final_barriers.src_stage |= state.write_stage | state.read_stages;
+        final_barriers.dst_stage |= vk::PipelineStageFlagBits::eBottomOfPipe;
+        final_barriers.images.emplace_back(state.write_access,
+                                           vk::AccessFlags(),
+                                           state.layout,
+                                           resource.final_layout,
+                                           VK_QUEUE_FAMILY_IGNORED,
+                                           VK_QUEUE_FAMILY_IGNORED,
+                                           nullptr,
+                                           vk::ImageSubresourceRange(resource.desc.aspect, 0, VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS));
+        final_barriers.image_resources.push_back(handle);
+        statistics.barrier_count++;
+    }
+}
+
+/**
+ * @brief Adds the barrier needed before an access, if any, and updates the resource state.
+ *
+ * Writes and layout transitions wait for all previous reads and writes. Reads in the same layout
+ * only wait for the last write, and only once per stage and access.
+ */
+void RenderGraph::add_barrier(Pass &pass, ResourceHandle handle, State &state, ResourceAccess const &access, bool record)
+{
+    Resource const  &resource = resources[handle];
+    AccessInfo const info     = get_access_info(access.access);
+    bool const       is_image = resource.kind != ResourceKind::eImportedBuffer;
+
+    auto emit = [&](vk::PipelineStageFlags src_stage, vk::AccessFlags src_access, vk::ImageLayout old_layout)
+    {
+        if (!record)
+        {
+            return;
+        }
+
+        pass.barriers.src_stage |= src_stage ? src_stage : vk::PipelineStageFlags(vk::PipelineStageFlagBits::eTopOfPipe);
+        pass.barriers.dst_stage |= info.stage;
+
+        if (is_image)
+        {
+            pass.barriers.images.emplace_back(src_access,
+                                              info.access,
+                                              old_layout,
+                                              info.layout,
+                                              VK_QUEUE_FAMILY_IGNORED,
+                                              VK_QUEUE_FAMILY_IGNORED,
+                                              nullptr,
+                                              vk::ImageSubresourceRange(resource.desc.aspect, 0, VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS));
+            pass.barriers.image_resources.push_back(handle);
+        }
+        else
+        {
+            pass.barriers.buffers.emplace_back(src_access, info.access, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, resource.buffer, 0, VK_WHOLE_SIZE);
+        }
+
+        statistics.barrier_count++;
+    };
+
+    // The timeline wait makes all work of the other queue available and visible, only a layout transition is left to do.
+    if (state.batch != ~0u && batches[state.batch].queue != batches[pass.batch].queue)
+    {
+        if (record)
+        {
+            add_wait(pass.batch, state.batch);
+        }
+
+        vk::ImageLayout layout = state.layout;
+        state                  = State();
+        state.layout           = layout;
+    }
+    state.batch = pass.batch;
+
+    bool const layout_change = is_image && state.layout != info.layout;
+
+    if (access.write || layout_change)
+    {
+        if (layout_change || state.write_stage || state.read_stages)
+        {
+            emit(state.write_stage | state.read_stages, state.write_access, state.layout);
+        }
+
+        // A layout transition counts as a write, later readers in other stages have to wait for it.
+        state.layout         = is_image ? info.layout : state.layout;
+        state.write_stage    = info.stage;
+        state.write_access   = access.write ? info.access : vk::AccessFlags();
+        state.read_stages    = access.write ? vk::PipelineStageFlags() : info.stage;
+        state.visible_stages = info.stage;
+        state.visible_access = info.access;
+        return;
+    }
+
+    bool const visible = (state.visible_stages & info.stage) == info.stage && (state.visible_access & info.access) == info.access;
+    if (state.write_stage && !visible)
+    {
+        emit(state.write_stage, state.write_access, state.layout);
+        state.visible_stages |= info.stage;
+        state.visible_access |= info.access;
+    }
+
+    state.read_stages |= info.stage;
+}
+
+/**
+ * @brief Makes a batch wait for a batch on another queue, keeping only the most recent one per queue.
+ * @param producer The batch to wait for. Batches after the waiting one signal their value of the previous frame.
+ */
+void RenderGraph::add_wait(uint32_t batch, uint32_t producer)
+{
+    auto age = [this, batch](uint32_t other) { return other < batch ? batch - other : batch + static_cast<uint32_t>(batches.size()) - other; };
+
+    auto &waits    = batches[batch].waits;
+    auto  existing = std::find_if(waits.begin(), waits.end(), [this, producer](uint32_t other) { return batches[other].queue == batches[producer].queue; });
+    if (existing == waits.end())
+    {
+        waits.push_back(producer);
+    }
+    else if (age(producer) < age(*existing))
+    {
+        *existing = producer;
+    }
+}
+
+GpuQueue &RenderGraph::get_queue(QueueType queue)
+{
+    return queue == QueueType::eAsyncCompute && compute_queue ? *compute_queue : *graphics_queue;
+}
@@ -0,0 +1,263 @@
+﻿#pragma once
+
+#include "render/device_dispatch.hpp"
+#include "render/gpu_profiler.hpp"
+#include "render/gpu_queue.hpp"
+#include "render/gpu_resources.hpp"
+
+#include <array>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+
+/// @brief What a pass gets to record its commands with.
+struct RenderGraphContext
+{
+    vk::CommandBuffer cmd;
+    uint32_t          swapchain_index;        // The swapchain image rendered this frame.
+};
+
+/// @brief The frame a render graph is submitted for, and how it synchronizes with presentation.
+struct RenderGraphFrame
+{
+    uint32_t               frame_index;          // Selects the command buffers, the previous frame using them must have completed.
+    uint32_t               swapchain_index;
+    vk::Semaphore          wait_semaphore;       // Waited on by the first graphics submission, e.g. the acquire semaphore.
+    vk::PipelineStageFlags wait_stage;
+    vk::Semaphore          signal_semaphore;     // Signaled by the last submission, e.g. the release semaphore.
+    vk::Semaphore          dependency_semaphore; // A timeline also waited on by the first graphics submission, e.g. of texture uploads.
+    uint64_t               dependency_value = 0;
+    vk::PipelineStageFlags dependency_stage;
+    uint32_t               device_mask      = 0; // The physical device of a device group the frame runs on, 0 without a device group.
+};
+
+/**
+ * @brief A frame graph of passes which declare the resources they read and write.
+ *
+ * Compiling the graph culls the passes that don't contribute to an output, derives the minimal set of
+ * barriers and layout transitions between the remaining passes, and places transient images whose
+ * lifetimes don't overlap in the same memory. Passes only record their own work, they never have to
+ * know what ran before or after them.
+ *
+ * Passes can be scheduled on an async compute queue. Consecutive passes on the same queue form a
+ * batch, which is submitted on its own and signals the queue's timeline semaphore. Batches wait on
+ * the timeline of the other queue only where a resource actually crosses queues, which lets compute
+ * work overlap graphics work of the same or the previous frame.
+ */
+class RenderGraph
+{
+public:
+    using ResourceHandle = uint32_t;
+    using PassHandle     = uint32_t;
+    using ExecuteFunc    = std::function<void(RenderGraphContext const &)>;
+
+    /// @brief How a pass accesses a resource. Determines the pipeline stages, access masks and image layout.
+    enum class QueueType
+    {
+        eGraphics,
+        eAsyncCompute        // Runs on the graphics queue if there is no dedicated compute queue.
+    };
+
+    enum class Access
+    {
+        eColorAttachment,
+        eDepthAttachment,
+        eDepthAttachmentReadOnly,
+        eDepthResolve,       // The single-sample target a multisampled depth attachment is resolved into.
+        eSampledCompute,
+        eSampledFragment,
+        eStorageCompute,
+        eIndirectBuffer,
+        eTransferSrc,
+        eTransferDst
+    };
+
+    struct ImageDesc
+    {
+        vk::Format              format = vk::Format::eUndefined;
+        vk::Extent2D            extent;
+        vk::ImageAspectFlags    aspect;
+        uint32_t                mip_levels = 1;
+        vk::SampleCountFlagBits samples    = vk::SampleCountFlagBits::e1;
+        bool                    lazy       = false;        // Only ever an attachment, backed by lazily allocated memory where there is such.
+    };
+
+    struct Statistics
+    {
+        uint32_t       pass_count        = 0;
+        uint32_t       culled_pass_count = 0;
+        uint32_t       barrier_count     = 0;
+        uint32_t       batch_count       = 0;        // Submissions per frame.
+        uint32_t       queue_wait_count  = 0;        // Semaphore waits between queues per frame.
+        vk::DeviceSize transient_bytes   = 0;        // Sum of the memory requirements of all transient images.
+        vk::DeviceSize allocated_bytes   = 0;        // Memory actually allocated for them after aliasing.
+        vk::DeviceSize lazy_bytes        = 0;        // Of the allocated memory, what is lazily allocated and only committed as needed.
+
+        vk::DeviceSize get_aliasing_savings() const
+        {
+            return transient_bytes - allocated_bytes;
+        }
+    };
+
+    /// @brief What recording and submitting the frames cost the CPU, since the timings were last reset.
+    struct CpuTimings
+    {
+        uint64_t                            frames      = 0;
+        uint64_t                            submissions = 0;
+        std::chrono::steady_clock::duration recording{};        // The passes and their barriers.
+        std::chrono::steady_clock::duration submitting{};       // In vkQueueSubmit.
+    };
+
+    /// @brief Declares the resource accesses of a pass, returned by add_pass.
+    class PassBuilder
+    {
+    public:
+        PassBuilder &read(ResourceHandle resource, Access access);
+        PassBuilder &write(ResourceHandle resource, Access access);
+        PassBuilder &side_effect();
+
+    private:
+        friend class RenderGraph;
+        PassBuilder(RenderGraph &graph, PassHandle pass) :
+            graph(graph), pass(pass)
+        {}
+
+        RenderGraph &graph;
+        PassHandle   pass;
+    };
+
+    ResourceHandle create_image(std::string name, ImageDesc const &desc);
+    ResourceHandle import_image(std::string name, vk::ImageAspectFlags aspect, vk::ImageLayout initial_layout, vk::ImageLayout final_layout, vk::PipelineStageFlags available_stage);
+    ResourceHandle import_buffer(std::string name, vk::Buffer buffer);
+    PassBuilder    add_pass(std::string name, ExecuteFunc execute, QueueType queue = QueueType::eGraphics);
+    void           set_output(ResourceHandle resource);
+
+    void     compile(vk::PhysicalDevice gpu, vk::Device device, DeviceDispatch const &dispatch, uint32_t frame_count, GpuQueue &graphics_queue, GpuQueue &compute_queue,
+                     GpuProfiler *profiler = nullptr);
+    uint64_t submit(RenderGraphFrame const &frame);
+    void     reset();
+
+    void              set_imported_image(ResourceHandle resource, vk::Image image);
+    vk::ImageView     get_image_view(ResourceHandle resource) const;
+    Statistics const &get_statistics() const;
+    vk::DeviceSize    get_committed_lazy_bytes() const;
+    CpuTimings const &get_cpu_timings() const;
+    void              reset_cpu_timings();
+
+private:
+    struct ResourceAccess
+    {
+        ResourceHandle resource;
+        Access         access;
+        bool           write;
+    };
+
+    /// @brief The barriers recorded before a pass, batched into a single vkCmdPipelineBarrier.
+    struct Barriers
+    {
+        vk::PipelineStageFlags               src_stage;
+        vk::PipelineStageFlags               dst_stage;
+        std::vector<vk::ImageMemoryBarrier>  images;
+        std::vector<ResourceHandle>          image_resources;        // The resource of each image barrier, imported images are patched per frame.
+        std::vector<vk::BufferMemoryBarrier> buffers;
+    };
+
+    struct Pass
+    {
+        std::string                 name;
+        ExecuteFunc                 execute;
+        std::vector<ResourceAccess> accesses;
+        QueueType                   queue       = QueueType::eGraphics;
+        bool                        side_effect = false;
+        bool                        culled      = false;
+        uint32_t                    batch       = 0;
+        Barriers                    barriers;
+    };
+
+    /// @brief Consecutive live passes on the same queue, submitted together.
+    struct Batch
+    {
+        QueueType             queue;
+        std::vector<uint32_t> passes;
+        std::vector<uint32_t> waits;              // At most one batch per other queue, a later batch is one of the previous frame.
+        uint64_t              value = 0;          // The timeline value signaled by the last submission of the batch.
+    };
+
+    /// @brief The command buffers of a frame slot, one per batch.
+    struct FrameCommands
+    {
+        std::array<vk::CommandPool, 2> pools;     // Indexed by QueueType.
+        std::vector<vk::CommandBuffer> command_buffers;
+    };
+
+    /// @brief The synchronization state of a resource while walking the passes.
+    struct State
+    {
+        vk::ImageLayout        layout = vk::ImageLayout::eUndefined;
+        vk::PipelineStageFlags write_stage;           // Stages of the last write or layout transition.
+        vk::AccessFlags        write_access;
+        vk::PipelineStageFlags read_stages;           // Stages which read since the last write.
+        vk::PipelineStageFlags visible_stages;        // Stages the last write was already made visible to.
+        vk::AccessFlags        visible_access;
+        uint32_t               batch = ~0u;           // The batch of the last access, to find accesses crossing queues.
+    };
+
+    enum class ResourceKind
+    {
+        eTransientImage,
+        eImportedImage,
+        eImportedBuffer
+    };
+
+    struct Resource
+    {
+        std::string            name;
+        ResourceKind           kind;
+        ImageDesc              desc;
+        vk::ImageUsageFlags    usage;                 // Accumulated from the declared accesses.
+        vk::Image              image;
+        vk::ImageView          view;
+        vk::Buffer             buffer;
+        vk::ImageLayout        final_layout = vk::ImageLayout::eUndefined;
+        State                  initial_state;
+        bool                   output      = false;
+        uint32_t               first_pass  = ~0u;
+        uint32_t               last_pass   = 0;
+        uint32_t               queue_mask  = 0;       // The queues accessing the resource, by QueueType bit.
+        vk::MemoryRequirements memory_requirements;
+    };
+
+    struct MemoryBlock
+    {
+        vk::DeviceMemory            memory;
+        vk::DeviceSize              size      = 0;
+        uint32_t                    type_bits = ~0u;
+        uint32_t                    heap      = 0;
+        bool                        lazy      = false;
+        std::vector<ResourceHandle> resources;        // Ordered by first use.
+    };
+
+    void cull_passes();
+    void create_batches();
+    void create_transient_images();
+    void add_wait(uint32_t batch, uint32_t producer);
+    GpuQueue &get_queue(QueueType queue);
+    void simulate(std::vector<State> &states, bool record);
+    void add_barrier(Pass &pass, ResourceHandle resource, State &state, ResourceAccess const &access, bool record);
+
+private:
+    vk::Device                 device;
+    DeviceDispatch const      *dispatch       = nullptr;      // Records and submits the frames.
+    GpuQueue                  *graphics_queue = nullptr;
+    GpuQueue                  *compute_queue  = nullptr;      // Null without a dedicated compute queue.
+    GpuProfiler               *profiler       = nullptr;
+    std::vector<Resource>      resources;
+    std::vector<Pass>          passes;
+    std::vector<Batch>         batches;
+    std::vector<FrameCommands> frame_commands;               // One per frame slot.
+    std::vector<MemoryBlock>   memory_blocks;
+    Barriers                   final_barriers;               // Transitions imported images to their final layout.
+    Statistics                 statistics;
+    CpuTimings                 cpu_timings;
+};
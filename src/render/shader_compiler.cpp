@@ -0,0 +1,56 @@
+﻿#include "render/shader_compiler.hpp"
+
+#include <core/hpp_shader_module.h>
+#include <hpp_glsl_compiler.h>
+#include <platform/filesystem.h>
+
+#include <map>
+#include <stdexcept>
+
+/**
+ * @brief Derives the shader stage from the extension of a GLSL file name.
+ */
+vk::ShaderStageFlagBits get_shader_stage(std::string const &name)
+{
+    static const std::map<std::string, vk::ShaderStageFlagBits> shader_stage_map = {
+        {"comp",                vk::ShaderStageFlagBits::eCompute},
+        {"frag",               vk::ShaderStageFlagBits::eFragment},
+        {"geom",               vk::ShaderStageFlagBits::eGeometry},
+        {"tesc",    vk::ShaderStageFlagBits::eTessellationControl},
+        {"tese", vk::ShaderStageFlagBits::eTessellationEvaluation},
+        {"vert",                 vk::ShaderStageFlagBits::eVertex}
+    };
+
+    // Extract extension name from the glsl shader file
+    std::string file_ext = name.substr(name.find_last_of(".") + 1);
+
+    auto stageIt = shader_stage_map.find(file_ext);
+    if (stageIt == shader_stage_map.end())
+    {
+        throw std::runtime_error("File extension `" + file_ext + "` does not have a vulkan shader stage.");
+    }
+    return stageIt->second;
+}
+
+/**
+ * @brief Compiles a GLSL shader to SPIR-V. Safe to call from any thread, but one compilation at a time.
+ * @param name The file name of the shader, relative to the shaders directory.
+ * @param spirv Receives the SPIR-V code.
+ * @param info_log Receives the errors and warnings of the compiler.
+ * @param defines The preprocessor defines of the variant, "NAME" or "NAME=VALUE".
+ * @returns Whether the compilation succeeded.
+ */
+bool compile_glsl(std::string const &name, std::vector<uint32_t> &spirv, std::string &info_log, std::vector<std::string> const &defines)
+{
+    vk::ShaderStageFlagBits stage = get_shader_stage(name);
+
+    vkb::core::HPPShaderVariant variant;
+    for (auto const &define : defines)
+    {
+        variant.add_define(define);
+    }
+
+    vkb::HPPGLSLCompiler glsl_compiler;
+    auto                 buffer = vkb::fs::read_shader_binary(name);
+    return glsl_compiler.compile_to_spirv(stage, buffer, "main", variant, spirv, info_log);
+}
@@ -0,0 +1,16 @@
+﻿#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+#include <string>
+#include <vector>
+
+/// @brief A GLSL file and the defines of one of its variants.
+struct ShaderSource
+{
+    std::string              name;           // Relative to the shaders directory.
+    std::vector<std::string> defines;
+};
+
+vk::ShaderStageFlagBits get_shader_stage(std::string const &name);
+bool                    compile_glsl(std::string const &name, std::vector<uint32_t> &spirv, std::string &info_log, std::vector<std::string> const &defines = {});
@@ -0,0 +1,121 @@
+﻿#include "render/shader_reflection.hpp"
+
+#include <spirv_cross.hpp>
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace
+{
+vk::ShaderStageFlagBits get_stage(spv::ExecutionModel model)
+{
+    switch (model)
+    {
+        case spv::ExecutionModelVertex:
+            return vk::ShaderStageFlagBits::eVertex;
+        case spv::ExecutionModelTessellationControl:
+            return vk::ShaderStageFlagBits::eTessellationControl;
+        case spv::ExecutionModelTessellationEvaluation:
+            return vk::ShaderStageFlagBits::eTessellationEvaluation;
+        case spv::ExecutionModelGeometry:
+            return vk::ShaderStageFlagBits::eGeometry;
+        case spv::ExecutionModelFragment:
+            return vk::ShaderStageFlagBits::eFragment;
+        case spv::ExecutionModelGLCompute:
+            return vk::ShaderStageFlagBits::eCompute;
+        default:
+            throw std::runtime_error("Unsupported shader execution model.");
+    }
+}
+
+vk::Format get_vertex_format(spirv_cross::SPIRType const &type)
+{
+    static const vk::Format float_formats[] = {vk::Format::eR32Sfloat, vk::Format::eR32G32Sfloat, vk::Format::eR32G32B32Sfloat, vk::Format::eR32G32B32A32Sfloat};
+    static const vk::Format int_formats[]   = {vk::Format::eR32Sint, vk::Format::eR32G32Sint, vk::Format::eR32G32B32Sint, vk::Format::eR32G32B32A32Sint};
+    static const vk::Format uint_formats[]  = {vk::Format::eR32Uint, vk::Format::eR32G32Uint, vk::Format::eR32G32B32Uint, vk::Format::eR32G32B32A32Uint};
+
+    if (type.width != 32 || type.vecsize < 1 || type.vecsize > 4 || type.columns != 1)
+    {
+        throw std::runtime_error("Vertex inputs must be 32-bit scalars or vectors.");
+    }
+
+    switch (type.basetype)
+    {
+        case spirv_cross::SPIRType::Float:
+            return float_formats[type.vecsize - 1];
+        case spirv_cross::SPIRType::Int:
+            return int_formats[type.vecsize - 1];
+        case spirv_cross::SPIRType::UInt:
+            return uint_formats[type.vecsize - 1];
+        default:
+            throw std::runtime_error("Unsupported vertex input type.");
+    }
+}
+
+void add_bindings(spirv_cross::Compiler const &compiler, spirv_cross::SmallVector<spirv_cross::Resource> const &resources, vk::DescriptorType type,
+                  ShaderReflection &reflection)
+{
+    for (auto const &resource : resources)
+    {
+        uint32_t set     = compiler.get_decoration(resource.id, spv::DecorationDescriptorSet);
+        uint32_t binding = compiler.get_decoration(resource.id, spv::DecorationBinding);
+
+        // Texel buffers are images of the buffer dimension.
+        auto const        &resource_type = compiler.get_type(resource.type_id);
+        vk::DescriptorType binding_type  = type;
+        if (resource_type.basetype == spirv_cross::SPIRType::Image && resource_type.image.dim == spv::DimBuffer)
+        {
+            binding_type = type == vk::DescriptorType::eStorageImage ? vk::DescriptorType::eStorageTexelBuffer : vk::DescriptorType::eUniformTexelBuffer;
+        }
+
+        // Only the outermost dimension of arrays of resources is allowed, 0 means a runtime array.
+        uint32_t count = resource_type.array.empty() ? 1 : resource_type.array.back();
+
+        if (reflection.sets.size() <= set)
+        {
+            reflection.sets.resize(set + 1);
+        }
+        reflection.sets[set].emplace_back(binding, binding_type, count, reflection.stage);
+    }
+}
+}  // namespace
+
+/**
+ * @brief Reflects the descriptor bindings, push constants and vertex inputs of a SPIR-V module.
+ */
+ShaderReflection reflect_shader(std::span<uint32_t const> spirv)
+{
+    spirv_cross::Compiler compiler(spirv.data(), spirv.size());
+
+    ShaderReflection reflection;
+    reflection.stage = get_stage(compiler.get_execution_model());
+
+    spirv_cross::ShaderResources resources = compiler.get_shader_resources();
+    add_bindings(compiler, resources.uniform_buffers, vk::DescriptorType::eUniformBuffer, reflection);
+    add_bindings(compiler, resources.storage_buffers, vk::DescriptorType::eStorageBuffer, reflection);
+    add_bindings(compiler, resources.sampled_images, vk::DescriptorType::eCombinedImageSampler, reflection);
+    add_bindings(compiler, resources.separate_images, vk::DescriptorType::eSampledImage, reflection);
+    add_bindings(compiler, resources.separate_samplers, vk::DescriptorType::eSampler, reflection);
+    add_bindings(compiler, resources.storage_images, vk::DescriptorType::eStorageImage, reflection);
+    add_bindings(compiler, resources.subpass_inputs, vk::DescriptorType::eInputAttachment, reflection);
+    for (auto &set : reflection.sets)
+    {
+        std::sort(set.begin(), set.end(), [](auto const &a, auto const &b) { return a.binding < b.binding; });
+    }
+
+    for (auto const &resource : resources.push_constant_buffers)
+    {
+        reflection.push_constant_size = static_cast<uint32_t>(compiler.get_declared_struct_size(compiler.get_type(resource.base_type_id)));
+    }
+
+    if (reflection.stage == vk::ShaderStageFlagBits::eVertex)
+    {
+        for (auto const &resource : resources.stage_inputs)
+        {
+            reflection.vertex_inputs.push_back({compiler.get_decoration(resource.id, spv::DecorationLocation), get_vertex_format(compiler.get_type(resource.type_id))});
+        }
+        std::sort(reflection.vertex_inputs.begin(), reflection.vertex_inputs.end(), [](auto const &a, auto const &b) { return a.location < b.location; });
+    }
+
+    return reflection;
+}
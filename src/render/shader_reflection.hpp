@@ -0,0 +1,27 @@
+﻿#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+#include <span>
+#include <vector>
+
+/**
+ * @brief The resource interface of a SPIR-V module, as declared by the shader.
+ *
+ * Bindings of runtime arrays have a descriptorCount of 0, their size is up to the layout.
+ */
+struct ShaderReflection
+{
+    struct VertexInput
+    {
+        uint32_t   location;
+        vk::Format format;
+    };
+
+    vk::ShaderStageFlagBits                                  stage;
+    std::vector<std::vector<vk::DescriptorSetLayoutBinding>> sets;                          // Indexed by set, sorted by binding.
+    uint32_t                                                 push_constant_size = 0;
+    std::vector<VertexInput>                                 vertex_inputs;                 // Of vertex shaders, sorted by location.
+};
+
+ShaderReflection reflect_shader(std::span<uint32_t const> spirv);
@@ -0,0 +1,256 @@
+﻿#include "render/shader_reloader.hpp"
+
+#include <common/logging.h>
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+
+#if defined(__linux__)
+#    include <poll.h>
+#    include <sys/inotify.h>
+#    include <unistd.h>
+#endif
+
+namespace
+{
+constexpr int poll_interval_ms = 100;        // How long the worker waits for changes before checking whether to stop.
+constexpr int settle_ms        = 50;         // Editors save in bursts of events, a change is handled once they settle.
+}  // namespace
+
+void ShaderReloader::prepare(vk::Device device, FrameSync &frame_sync)
+{
+    this->device     = device;
+    this->frame_sync = &frame_sync;
+}
+
+/**
+ * @brief Stops the worker and destroys the pipelines which were never swapped in. The swapped in
+ *        pipelines belong to their owners.
+ */
+void ShaderReloader::destroy()
+{
+    running = false;
+    if (worker.joinable())
+    {
+        worker.join();
+    }
+
+#if defined(__linux__)
+    if (watch_fd != -1)
+    {
+        close(watch_fd);
+        watch_fd = -1;
+    }
+#endif
+
+    for (auto const &entry : rebuilt)
+    {
+        device.destroyPipeline(entry.pipeline);
+    }
+    rebuilt.clear();
+    programs.clear();
+}
+
+/**
+ * @brief Registers a pipeline to rebuild when one of its shaders changes. Only valid before start.
+ * @param pipeline The pipeline to replace, it must outlive the reloader.
+ * @param shaders The shader files and the defines of the variants the pipeline uses.
+ * @param builder Creates the pipeline from the modules of the shaders, it runs on the worker thread.
+ */
+void ShaderReloader::add_pipeline(vk::Pipeline &pipeline, std::vector<ShaderSource> shaders, PipelineBuilder builder)
+{
+    assert(!running);
+    programs.push_back({&pipeline, std::move(shaders), std::move(builder)});
+}
+
+/**
+ * @brief Starts watching the directory of the registered shaders on the worker thread.
+ */
+void ShaderReloader::start(std::string const &directory)
+{
+    this->directory = directory;
+
+#if defined(__linux__)
+    // Editors often save by renaming a temporary file over the source, which is a move, not a write.
+    watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watch_fd == -1 || inotify_add_watch(watch_fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) == -1)
+    {
+        LOGW("Failed to watch {}, shaders are not reloaded.", directory);
+        return;
+    }
+#else
+    for (auto const &program : programs)
+    {
+        for (auto const &shader : program.shaders)
+        {
+            std::error_code error;
+            write_times[shader.name] = std::filesystem::last_write_time(std::filesystem::path(directory) / shader.name, error);
+        }
+    }
+#endif
+
+    running = true;
+    worker  = std::thread(&ShaderReloader::run, this);
+}
+
+/**
+ * @brief Swaps the rebuilt pipelines in. Call at the start of a frame, before recording uses them.
+ * @returns The number of pipelines swapped in.
+ */
+uint32_t ShaderReloader::update()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    for (auto const &entry : rebuilt)
+    {
+        Program     &program = programs[entry.program];
+        vk::Pipeline previous = *program.pipeline;
+        *program.pipeline     = entry.pipeline;
+        if (previous)
+        {
+            frame_sync->retire([device = device, previous]() { device.destroyPipeline(previous); });
+        }
+        LOGI("Reloaded the pipeline of {}.", program.shaders.front().name);
+    }
+
+    uint32_t count = static_cast<uint32_t>(rebuilt.size());
+    rebuilt.clear();
+    return count;
+}
+
+void ShaderReloader::run()
+{
+    std::vector<std::string> changed;
+    while (running)
+    {
+        changed.clear();
+        if (!wait_for_changes(changed))
+        {
+            continue;
+        }
+
+        for (size_t i = 0; i < programs.size(); i++)
+        {
+            auto const &shaders = programs[i].shaders;
+            if (std::any_of(shaders.begin(), shaders.end(), [&changed](ShaderSource const &shader) { return std::binary_search(changed.begin(), changed.end(), shader.name); }))
+            {
+                rebuild(i);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Waits up to poll_interval_ms for changes in the directory.
+ * @param changed Receives the sorted names of the changed files.
+ * @returns Whether any file changed.
+ */
+bool ShaderReloader::wait_for_changes(std::vector<std::string> &changed)
+{
+#if defined(__linux__)
+    pollfd poll_fd{watch_fd, POLLIN, 0};
+    if (poll(&poll_fd, 1, poll_interval_ms) <= 0)
+    {
+        return false;
+    }
+
+    do
+    {
+        alignas(inotify_event) char buffer[4096];
+        ssize_t                     length;
+        while ((length = read(watch_fd, buffer, sizeof(buffer))) > 0)
+        {
+            for (char *event_ptr = buffer; event_ptr < buffer + length;)
+            {
+                auto const *event = reinterpret_cast<inotify_event const *>(event_ptr);
+                if (event->len)
+                {
+                    changed.emplace_back(event->name);
+                }
+                event_ptr += sizeof(inotify_event) + event->len;
+            }
+        }
+    } while (poll(&poll_fd, 1, settle_ms) > 0);
+#else
+    std::this_thread::sleep_for(std::chrono::milliseconds(poll_interval_ms));
+
+    for (auto &[shader, write_time] : write_times)
+    {
+        std::error_code error;
+        auto            current = std::filesystem::last_write_time(std::filesystem::path(directory) / shader, error);
+        if (!error && current != write_time)
+        {
+            write_time = current;
+            changed.push_back(shader);
+        }
+    }
+    if (!changed.empty())
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(settle_ms));
+    }
+#endif
+
+    std::sort(changed.begin(), changed.end());
+    changed.erase(std::unique(changed.begin(), changed.end()), changed.end());
+    return !changed.empty();
+}
+
+/**
+ * @brief Compiles the shaders of a program and creates its pipeline on the worker thread.
+ */
+void ShaderReloader::rebuild(size_t program_index)
+{
+    Program const &program = programs[program_index];
+
+    std::vector<vk::ShaderModule> modules;
+    std::vector<ShaderReflection> reflections;
+    vk::Pipeline                  pipeline;
+    try
+    {
+        for (auto const &shader : program.shaders)
+        {
+            std::vector<uint32_t> spirv;
+            std::string           info_log;
+            if (!compile_glsl(shader.name, spirv, info_log, shader.defines))
+            {
+                LOGE("Failed to compile shader {}, keeping the previous pipeline. Error: {}", shader.name, info_log);
+                break;
+            }
+            reflections.push_back(reflect_shader(spirv));
+            modules.push_back(device.createShaderModule({{}, spirv}));
+        }
+
+        if (modules.size() == program.shaders.size())
+        {
+            pipeline = program.builder(modules, reflections);
+        }
+    }
+    catch (std::exception const &e)
+    {
+        LOGE("Failed to rebuild the pipeline of {}, keeping the previous one. Error: {}", program.shaders.front().name, e.what());
+    }
+
+    for (auto module : modules)
+    {
+        device.destroyShaderModule(module);
+    }
+
+    if (!pipeline)
+    {
+        return;
+    }
+
+    // A pipeline rebuilt twice before a frame swapped it in was never used.
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = std::find_if(rebuilt.begin(), rebuilt.end(), [program_index](Rebuilt const &entry) { return entry.program == program_index; });
+    if (it != rebuilt.end())
+    {
+        device.destroyPipeline(it->pipeline);
+        it->pipeline = pipeline;
+    }
+    else
+    {
+        rebuilt.push_back({program_index, pipeline});
+    }
+}
@@ -0,0 +1,69 @@
+﻿#pragma once
+
+#include "render/frame_sync.hpp"
+#include "render/shader_compiler.hpp"
+#include "render/shader_reflection.hpp"
+
+#include <atomic>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Rebuilds pipelines in the background when their GLSL sources change on disk.
+ *
+ * A worker thread watches the shaders directory, with inotify on Linux and by polling the write
+ * times elsewhere. When a source of a registered pipeline changes, the worker compiles all of its
+ * shaders and creates the new pipeline, the frame loop only swaps finished pipelines in at the
+ * start of a frame and retires the old ones once the frames using them have completed. A shader
+ * which fails to compile is logged and the previous pipeline stays in use.
+ */
+class ShaderReloader
+{
+public:
+    /// @brief Creates a pipeline from the modules and reflections of the registered shaders, in their order, on the worker thread.
+    using PipelineBuilder = std::function<vk::Pipeline(std::vector<vk::ShaderModule> const &modules, std::vector<ShaderReflection> const &reflections)>;
+
+    void prepare(vk::Device device, FrameSync &frame_sync);
+    void destroy();
+
+    void     add_pipeline(vk::Pipeline &pipeline, std::vector<ShaderSource> shaders, PipelineBuilder builder);
+    void     start(std::string const &directory);
+    uint32_t update();
+
+private:
+    struct Program
+    {
+        vk::Pipeline             *pipeline = nullptr;        // Swapped by update.
+        std::vector<ShaderSource> shaders;
+        PipelineBuilder           builder;
+    };
+
+    struct Rebuilt
+    {
+        size_t       program;
+        vk::Pipeline pipeline;
+    };
+
+    void run();
+    bool wait_for_changes(std::vector<std::string> &changed);
+    void rebuild(size_t program_index);
+
+private:
+    using WriteTimes = std::map<std::string, std::filesystem::file_time_type>;
+
+    vk::Device           device;
+    FrameSync           *frame_sync = nullptr;
+    std::string          directory;
+    std::vector<Program> programs;                   // Fixed once the worker runs.
+    std::thread          worker;
+    std::atomic<bool>    running    = false;
+    int                  watch_fd   = -1;            // The inotify instance, Linux only.
+    WriteTimes           write_times;                // Of the watched shaders, polled where there is no inotify.
+    std::mutex           mutex;                      // Guards rebuilt.
+    std::vector<Rebuilt> rebuilt;                    // Finished on the worker, not yet swapped in.
+};
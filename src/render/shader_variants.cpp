@@ -0,0 +1,346 @@
+﻿#include "render/shader_variants.hpp"
+
+#include "render/shader_compiler.hpp"
+
+#include <common/logging.h>
+
+#include <filesystem>
+#include <fstream>
+
+#if !defined(_WIN32)
+#    include <fcntl.h>
+#    include <sys/mman.h>
+#    include <sys/stat.h>
+#    include <unistd.h>
+#endif
+
+namespace
+{
+constexpr uint32_t bundle_magic   = 0x42565053;        // "SPVB"
+constexpr uint32_t bundle_version = 1;
+constexpr size_t   max_name       = 56;
+
+struct BundleHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t shader_count;
+    uint32_t variant_count;
+    uint32_t permutation_hash;        // Tells bundles baked with other features apart.
+};
+
+struct BundleShader
+{
+    char     name[max_name];          // Null-terminated.
+    uint32_t first_variant;
+    uint32_t variant_count;
+};
+
+struct BundleVariant
+{
+    uint32_t offset;
+    uint32_t word_count;
+};
+
+uint32_t hash_permutations(std::vector<ShaderPermutation> const &permutations)
+{
+    // FNV-1a over the shader names and features, in order.
+    uint32_t hash = 2166136261u;
+    auto     add  = [&hash](std::string const &text) {
+        for (char c : text)
+        {
+            hash = (hash ^ static_cast<uint8_t>(c)) * 16777619u;
+        }
+        hash = (hash ^ 0xffu) * 16777619u;
+    };
+    for (auto const &permutation : permutations)
+    {
+        add(permutation.shader);
+        for (auto const &feature : permutation.features)
+        {
+            add(feature);
+        }
+    }
+    return hash;
+}
+}  // namespace
+
+/**
+ * @brief Returns the defines of the features set in a variant key.
+ */
+std::vector<std::string> get_variant_defines(ShaderPermutation const &permutation, VariantKey key)
+{
+    std::vector<std::string> defines;
+    for (uint32_t i = 0; i < permutation.features.size(); i++)
+    {
+        if (key & (1u << i))
+        {
+            defines.push_back(permutation.features[i]);
+        }
+    }
+    return defines;
+}
+
+/**
+ * @brief Checks whether a bundle exists and is newer than all of its sources.
+ */
+bool is_shader_bundle_current(std::string const &path, std::string const &shader_directory, std::vector<ShaderPermutation> const &permutations)
+{
+    std::error_code error;
+    auto            bundle_time = std::filesystem::last_write_time(path, error);
+    if (error)
+    {
+        return false;
+    }
+
+    for (auto const &permutation : permutations)
+    {
+        auto source_time = std::filesystem::last_write_time(std::filesystem::path(shader_directory) / permutation.shader, error);
+        if (error || bundle_time < source_time)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Compiles all variants of the shaders and writes them into a bundle.
+ *
+ * The bundle is written next to the path and renamed over it, so a bundle which is mapped or
+ * read concurrently is never seen half written.
+ * @returns Whether all variants compiled.
+ */
+bool bake_shader_bundle(std::string const &path, std::vector<ShaderPermutation> const &permutations)
+{
+    std::vector<BundleShader>          shaders;
+    std::vector<BundleVariant>         variants;
+    std::vector<std::vector<uint32_t>> code;
+
+    for (auto const &permutation : permutations)
+    {
+        if (permutation.shader.size() >= max_name || permutation.features.size() > ShaderPermutation::max_features)
+        {
+            LOGE("Shader {} has too long a name or too many features for a bundle.", permutation.shader);
+            return false;
+        }
+
+        BundleShader shader{};
+        std::memcpy(shader.name, permutation.shader.data(), permutation.shader.size());
+        shader.first_variant = static_cast<uint32_t>(variants.size());
+        shader.variant_count = 1u << permutation.features.size();
+        shaders.push_back(shader);
+
+        for (VariantKey key = 0; key < shader.variant_count; key++)
+        {
+            std::vector<uint32_t> spirv;
+            std::string           info_log;
+            if (!compile_glsl(permutation.shader, spirv, info_log, get_variant_defines(permutation, key)))
+            {
+                LOGE("Failed to compile variant {} of shader {}, Error: {}", key, permutation.shader, info_log);
+                return false;
+            }
+            variants.push_back({0, static_cast<uint32_t>(spirv.size())});
+            code.push_back(std::move(spirv));
+        }
+    }
+
+    BundleHeader header{bundle_magic, bundle_version, static_cast<uint32_t>(shaders.size()), static_cast<uint32_t>(variants.size()), hash_permutations(permutations)};
+
+    // The code follows the tables, SPIR-V words stay 4-byte aligned since all tables are.
+    uint32_t offset = static_cast<uint32_t>(sizeof(BundleHeader) + sizeof(BundleShader) * shaders.size() + sizeof(BundleVariant) * variants.size());
+    for (auto &variant : variants)
+    {
+        variant.offset = offset;
+        offset += variant.word_count * sizeof(uint32_t);
+    }
+
+    std::string   temporary_path = path + ".tmp";
+    std::ofstream file(temporary_path, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<char const *>(&header), sizeof(header));
+    file.write(reinterpret_cast<char const *>(shaders.data()), sizeof(BundleShader) * shaders.size());
+    file.write(reinterpret_cast<char const *>(variants.data()), sizeof(BundleVariant) * variants.size());
+    for (auto const &spirv : code)
+    {
+        file.write(reinterpret_cast<char const *>(spirv.data()), spirv.size() * sizeof(uint32_t));
+    }
+    file.close();
+    if (!file)
+    {
+        LOGE("Failed to write shader bundle {}.", temporary_path);
+        return false;
+    }
+
+    std::error_code error;
+    std::filesystem::rename(temporary_path, path, error);
+    if (error)
+    {
+        LOGE("Failed to replace shader bundle {}: {}", path, error.message());
+        return false;
+    }
+
+    LOGI("Baked {} variants of {} shaders into {}.", variants.size(), shaders.size(), path);
+    return true;
+}
+
+/**
+ * @brief Creates a compute pipeline from a variant, e.g. of the bundle. The layout must be the one the shader declares.
+ */
+vk::Pipeline create_compute_pipeline(vk::Device device, std::span<uint32_t const> spirv, vk::PipelineLayout layout)
+{
+    vk::ShaderModule              module = device.createShaderModule({{}, spirv.size_bytes(), spirv.data()});
+    vk::ComputePipelineCreateInfo pipeline_info({}, {{}, vk::ShaderStageFlagBits::eCompute, module, "main"}, layout);
+
+    vk::ResultValue<vk::Pipeline> result = device.createComputePipeline(nullptr, pipeline_info);
+    device.destroyShaderModule(module);
+    if (result.result != vk::Result::eSuccess)
+    {
+        throw std::runtime_error("failed to create compute pipeline!");
+    }
+    return result.value;
+}
+
+ShaderBundle::~ShaderBundle()
+{
+    close();
+}
+
+/**
+ * @brief Maps a bundle and validates it against the permutations it was baked with.
+ * @returns False if the file is missing, malformed or was baked with other permutations.
+ */
+bool ShaderBundle::open(std::string const &path, std::vector<ShaderPermutation> const &permutations)
+{
+    close();
+
+#if defined(_WIN32)
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file)
+    {
+        return false;
+    }
+    file_data.resize(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+    file.read(reinterpret_cast<char *>(file_data.data()), file_data.size());
+    data = file_data.data();
+    size = file_data.size();
+#else
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+    {
+        return false;
+    }
+    struct stat status;
+    if (fstat(fd, &status) == 0 && status.st_size > 0)
+    {
+        void *mapping = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping != MAP_FAILED)
+        {
+            data = static_cast<uint8_t const *>(mapping);
+            size = static_cast<size_t>(status.st_size);
+        }
+    }
+    ::close(fd);
+#endif
+
+    BundleHeader header{};
+    if (size >= sizeof(header))
+    {
+        std::memcpy(&header, data, sizeof(header));
+    }
+
+    size_t tables_size = sizeof(BundleHeader) + sizeof(BundleShader) * header.shader_count + sizeof(BundleVariant) * header.variant_count;
+    if (header.magic != bundle_magic || header.version != bundle_version || header.permutation_hash != hash_permutations(permutations) || size < tables_size)
+    {
+        LOGW("Shader bundle {} is outdated or malformed.", path);
+        close();
+        return false;
+    }
+
+    auto const *bundle_shaders = reinterpret_cast<BundleShader const *>(data + sizeof(BundleHeader));
+    variants                   = reinterpret_cast<Variant const *>(bundle_shaders + header.shader_count);
+    for (uint32_t i = 0; i < header.shader_count; i++)
+    {
+        BundleShader const &shader = bundle_shaders[i];
+
+        // Written so it can't overflow, the counts come from the file.
+        if (shader.first_variant > header.variant_count || shader.variant_count > header.variant_count - shader.first_variant)
+        {
+            LOGW("Shader bundle {} is malformed, shader {} has variants past the variant table.", path, i);
+            close();
+            return false;
+        }
+        shaders.push_back({shader.first_variant, shader.variant_count});
+        shader_ids.emplace(std::string(shader.name, strnlen(shader.name, max_name)), i);
+    }
+
+    for (uint32_t i = 0; i < header.variant_count; i++)
+    {
+        if (variants[i].offset + size_t(variants[i].word_count) * sizeof(uint32_t) > size)
+        {
+            LOGW("Shader bundle {} is truncated.", path);
+            close();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void ShaderBundle::close()
+{
+#if !defined(_WIN32)
+    if (data)
+    {
+        munmap(const_cast<uint8_t *>(data), size);
+    }
+#endif
+    data     = nullptr;
+    size     = 0;
+    variants = nullptr;
+    file_data.clear();
+    shaders.clear();
+    shader_ids.clear();
+}
+
+/**
+ * @returns The id of a shader for get_spirv, or invalid_shader if the bundle doesn't contain it.
+ */
+uint32_t ShaderBundle::get_shader_id(std::string const &shader) const
+{
+    auto it = shader_ids.find(shader);
+    return it != shader_ids.end() ? it->second : invalid_shader;
+}
+
+/**
+ * @returns The code of a variant, empty if the shader or the variant doesn't exist.
+ */
+std::span<uint32_t const> ShaderBundle::get_spirv(uint32_t shader_id, VariantKey key) const
+{
+    if (shader_id >= shaders.size() || key >= shaders[shader_id].variant_count)
+    {
+        return {};
+    }
+
+    Variant const &variant = variants[shaders[shader_id].first_variant + key];
+    return {reinterpret_cast<uint32_t const *>(data + variant.offset), variant.word_count};
+}
+
+std::span<uint32_t const> ShaderBundle::get_spirv(std::string const &shader, VariantKey key) const
+{
+    return get_spirv(get_shader_id(shader), key);
+}
+
+/**
+ * @returns A module of the variant, or a null handle if the bundle doesn't contain it.
+ */
+vk::ShaderModule ShaderBundle::create_shader_module(vk::Device device, std::string const &shader, VariantKey key) const
+{
+    auto spirv = get_spirv(shader, key);
+    if (spirv.empty())
+    {
+        LOGE("Shader bundle has no variant {} of {}.", key, shader);
+        return nullptr;
+    }
+    return device.createShaderModule({{}, spirv.size_bytes(), spirv.data()});
+}
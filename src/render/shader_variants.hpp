@@ -0,0 +1,122 @@
+﻿#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+#include <cstring>
+#include <span>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief The features of a shader which are compiled into separate variants.
+ *
+ * Each feature is a define, bit i of a variant key sets features[i]. Features change the code the
+ * compiler sees, for choices which can't be made by specialization constants, e.g. resources a
+ * variant doesn't declare. Every combination is compiled, so a shader has 2^features variants.
+ */
+struct ShaderPermutation
+{
+    static constexpr uint32_t max_features = 8;
+
+    std::string              shader;        // Relative to the shaders directory.
+    std::vector<std::string> features;
+};
+
+using VariantKey = uint32_t;
+
+std::vector<std::string> get_variant_defines(ShaderPermutation const &permutation, VariantKey key);
+bool                     is_shader_bundle_current(std::string const &path, std::string const &shader_directory, std::vector<ShaderPermutation> const &permutations);
+bool                     bake_shader_bundle(std::string const &path, std::vector<ShaderPermutation> const &permutations);
+vk::Pipeline             create_compute_pipeline(vk::Device device, std::span<uint32_t const> spirv, vk::PipelineLayout layout);
+
+/**
+ * @brief The SPIR-V of all variants of a set of shaders, memory-mapped from one file.
+ *
+ * The file holds a header, a table of shaders, a table of variants and the code. The variants of
+ * a shader are consecutive and ordered by key, so a lookup is an index into the variant table.
+ * Resolve shader names to ids once with get_shader_id to skip the hash lookup of the name.
+ */
+class ShaderBundle
+{
+public:
+    static constexpr uint32_t invalid_shader = ~0u;
+
+    ShaderBundle() = default;
+    ~ShaderBundle();
+
+    ShaderBundle(ShaderBundle const &)            = delete;
+    ShaderBundle &operator=(ShaderBundle const &) = delete;
+
+    bool open(std::string const &path, std::vector<ShaderPermutation> const &permutations);
+    void close();
+
+    uint32_t                  get_shader_id(std::string const &shader) const;
+    std::span<uint32_t const> get_spirv(uint32_t shader_id, VariantKey key) const;
+    std::span<uint32_t const> get_spirv(std::string const &shader, VariantKey key) const;
+    vk::ShaderModule          create_shader_module(vk::Device device, std::string const &shader, VariantKey key) const;
+
+private:
+    struct Variant
+    {
+        uint32_t offset;            // In bytes from the start of the file.
+        uint32_t word_count;
+    };
+
+    struct Shader
+    {
+        uint32_t first_variant;
+        uint32_t variant_count;
+    };
+
+private:
+    uint8_t const                            *data = nullptr;
+    size_t                                    size = 0;
+    std::vector<uint8_t>                      file_data;        // The file contents where it can't be mapped.
+    std::vector<Shader>                       shaders;
+    Variant const                            *variants = nullptr;
+    std::unordered_map<std::string, uint32_t> shader_ids;
+};
+
+/**
+ * @brief Collects the values of a stage's specialization constants.
+ *
+ * Specialization constants are cheap variants: the driver folds them when it creates the
+ * pipeline, without a separate SPIR-V module per value. Pass get_info to the shader stage, the
+ * object must outlive the pipeline creation.
+ */
+class SpecializationConstants
+{
+public:
+    template <typename T>
+    SpecializationConstants &set(uint32_t constant_id, T value)
+    {
+        static_assert(std::is_trivially_copyable_v<T> && sizeof(T) <= 8, "Specialization constants are scalars.");
+
+        // Booleans are 32-bit in SPIR-V.
+        if constexpr (std::is_same_v<T, bool>)
+        {
+            return set<vk::Bool32>(constant_id, value ? VK_TRUE : VK_FALSE);
+        }
+        else
+        {
+            uint32_t offset = static_cast<uint32_t>(data.size());
+            data.resize(offset + sizeof(T));
+            std::memcpy(data.data() + offset, &value, sizeof(T));
+            entries.emplace_back(constant_id, offset, sizeof(T));
+            return *this;
+        }
+    }
+
+    vk::SpecializationInfo const *get_info()
+    {
+        info = vk::SpecializationInfo(static_cast<uint32_t>(entries.size()), entries.data(), data.size(), data.data());
+        return entries.empty() ? nullptr : &info;
+    }
+
+private:
+    std::vector<vk::SpecializationMapEntry> entries;
+    std::vector<uint8_t>                    data;
+    vk::SpecializationInfo                  info;
+};
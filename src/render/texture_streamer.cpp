@@ -0,0 +1,630 @@
+﻿#include "render/texture_streamer.hpp"
+
+#include "render/bc_decoder.hpp"
+
+#include <common/logging.h>
+
+#include <ktx.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <memory>
+#include <stdexcept>
+
+namespace
+{
+constexpr uint32_t       tail_extent        = 128;                   // Levels this size and smaller are always resident.
+constexpr uint64_t       idle_frames        = 120;                   // Textures not requested for this long drop to their tail.
+constexpr vk::DeviceSize upload_frame_bytes = 32ull * 1024 * 1024;   // Streamed in per frame at most, unless a single chain is larger.
+
+bool is_sampleable(vk::PhysicalDevice gpu, vk::Format format)
+{
+    return !!(gpu.getFormatProperties(format).optimalTilingFeatures & vk::FormatFeatureFlagBits::eSampledImage);
+}
+
+/**
+ * @brief Transcodes a Basis Universal payload to the best format the device samples.
+ *
+ * BC7 and ASTC keep the most quality, BC3 is supported nearly everywhere on desktop and RGBA32
+ * always works. libktx picks the sRGB variant from the transfer function of the file.
+ */
+void transcode(vk::PhysicalDevice gpu, ktxTexture2 *ktx_texture)
+{
+    struct Target
+    {
+        ktx_transcode_fmt_e transcode_format;
+        vk::Format          format;
+    };
+
+    const std::array<Target, 4> targets = {{
+        {KTX_TTF_BC7_RGBA, vk::Format::eBc7UnormBlock},
+        {KTX_TTF_ASTC_4x4_RGBA, vk::Format::eAstc4x4UnormBlock},
+        {KTX_TTF_BC3_RGBA, vk::Format::eBc3UnormBlock},
+        {KTX_TTF_RGBA32, vk::Format::eR8G8B8A8Unorm},
+    }};
+
+    for (auto const &target : targets)
+    {
+        if (is_sampleable(gpu, target.format))
+        {
+            KTX_error_code result = ktxTexture2_TranscodeBasis(ktx_texture, target.transcode_format, 0);
+            if (result != KTX_SUCCESS)
+            {
+                throw std::runtime_error(std::string("Failed to transcode texture: ") + ktxErrorString(result));
+            }
+            return;
+        }
+    }
+
+    throw std::runtime_error("No transcode target is supported by the device.");
+}
+}  // namespace
+
+/**
+ * @param dispatch Polls the uploads every frame.
+ * @param upload_queue The queue uploads are submitted on, preferably a dedicated transfer queue.
+ * @param graphics_queue_family The family sampling the textures, they are shared with the upload queue.
+ * @param frame_arenas Must be switched to the current frame slot before update.
+ * @param budget The device memory the streamed levels may use.
+ */
+void TextureStreamer::prepare(vk::PhysicalDevice gpu, vk::Device device, DeviceDispatch const &dispatch, GpuQueue &upload_queue, uint32_t graphics_queue_family, BindlessHeap &heap, FrameSync &frame_sync,
+                              FrameArenas &frame_arenas, vk::DeviceSize budget)
+{
+    this->gpu          = gpu;
+    this->device       = device;
+    this->dispatch     = &dispatch;
+    this->upload_queue = &upload_queue;
+    this->heap         = &heap;
+    this->frame_sync   = &frame_sync;
+    this->frame_arenas = &frame_arenas;
+    this->budget       = budget;
+
+    queue_families = {upload_queue.familyIndex};
+    if (graphics_queue_family != upload_queue.familyIndex)
+    {
+        queue_families.push_back(graphics_queue_family);
+    }
+
+    command_pool = device.createCommandPool({vk::CommandPoolCreateFlagBits::eTransient, upload_queue.familyIndex});
+
+    // The device enables anisotropic filtering wherever it is supported.
+    vk::PhysicalDeviceFeatures   features   = gpu.getFeatures();
+    vk::PhysicalDeviceProperties properties = gpu.getProperties();
+
+    vk::SamplerCreateInfo sampler_info({},
+                                       vk::Filter::eLinear,
+                                       vk::Filter::eLinear,
+                                       vk::SamplerMipmapMode::eLinear,
+                                       vk::SamplerAddressMode::eRepeat,
+                                       vk::SamplerAddressMode::eRepeat,
+                                       vk::SamplerAddressMode::eRepeat,
+                                       0.0f,
+                                       features.samplerAnisotropy,
+                                       std::min(16.0f, properties.limits.maxSamplerAnisotropy),
+                                       false,
+                                       vk::CompareOp::eNever,
+                                       0.0f,
+                                       VK_LOD_CLAMP_NONE);
+    sampler       = device.createSampler(sampler_info);
+    sampler_index = heap.register_sampler(sampler);
+
+    // The placeholder is tiny, wait for it right away.
+    std::vector<Level> white = {
+        {{1, 1}, {255, 255, 255, 255}}
+    };
+    Upload upload = record_upload(vk::Format::eR8G8B8A8Unorm, white, 0);
+    (void)device.waitSemaphores(vk::SemaphoreWaitInfo({}, upload_queue.timeline, upload.value), UINT64_MAX);
+
+    placeholder       = upload.image;
+    placeholder_index = heap.register_texture(placeholder.view);
+    last_upload_value = upload.value;
+
+    upload.staging.clear(device);
+    device.freeCommandBuffers(command_pool, upload.cmd);
+}
+
+/**
+ * @brief Destroys all textures. The GPU must be idle.
+ */
+void TextureStreamer::destroy()
+{
+    for (auto &upload : uploads)
+    {
+        upload.image.clear(device);
+        upload.staging.clear(device);
+    }
+
+    for (auto &texture : textures)
+    {
+        texture.image.clear(device);
+    }
+
+    placeholder.clear(device);
+
+    if (sampler)
+    {
+        device.destroySampler(sampler);
+    }
+
+    // Destroying the pool frees the command buffers of pending uploads.
+    if (command_pool)
+    {
+        device.destroyCommandPool(command_pool);
+    }
+
+    *this = TextureStreamer();
+}
+
+/**
+ * @brief Loads a KTX2 texture into system memory and streams in its mip tail.
+ *
+ * Only 2D textures with a single layer and face are supported. The texture samples as the
+ * placeholder until its tail is resident.
+ */
+TextureStreamer::TextureHandle TextureStreamer::load(std::string const &path)
+{
+    return add(read(gpu, path));
+}
+
+/**
+ * @brief Reads a KTX2 texture into system memory, transcoded or decoded to a format the device samples.
+ *        Doesn't touch the streamer, so textures can be read on any thread and added later.
+ */
+TextureStreamer::TextureFile TextureStreamer::read(vk::PhysicalDevice gpu, std::string const &path)
+{
+    ktxTexture2   *loaded = nullptr;
+    KTX_error_code result = ktxTexture2_CreateFromNamedFile(path.c_str(), KTX_TEXTURE_CREATE_LOAD_IMAGE_DATA_BIT, &loaded);
+    if (result != KTX_SUCCESS)
+    {
+        throw std::runtime_error("Failed to load texture " + path + ": " + ktxErrorString(result));
+    }
+
+    std::unique_ptr<ktxTexture2, void (*)(ktxTexture2 *)> ktx_texture(loaded, [](ktxTexture2 *texture) { ktxTexture_Destroy(ktxTexture(texture)); });
+
+    if (ktx_texture->numDimensions != 2 || ktx_texture->numLayers != 1 || ktx_texture->numFaces != 1)
+    {
+        throw std::runtime_error("Texture " + path + " is not a single 2D image.");
+    }
+
+    TextureFile file;
+    file.name = path;
+
+    if (ktxTexture2_NeedsTranscoding(ktx_texture.get()))
+    {
+        transcode(gpu, ktx_texture.get());
+        file.cpu_decoded = true;
+    }
+
+    vk::Format format = static_cast<vk::Format>(ktx_texture->vkFormat);
+    if (format == vk::Format::eUndefined)
+    {
+        throw std::runtime_error("Texture " + path + " has no Vulkan format.");
+    }
+
+    // Devices without BC support get the BC1-5 formats decoded.
+    vk::Format decoded_format = vk::Format::eUndefined;
+    if (!is_sampleable(gpu, format))
+    {
+        decoded_format = get_bc_decoded_format(format);
+        if (decoded_format == vk::Format::eUndefined)
+        {
+            throw std::runtime_error("Texture " + path + " has the unsupported format " + vk::to_string(format) + ".");
+        }
+        file.cpu_decoded = true;
+    }
+    file.format = decoded_format != vk::Format::eUndefined ? decoded_format : format;
+
+    uint8_t const *data = ktxTexture_GetData(ktxTexture(ktx_texture.get()));
+    file.levels.resize(ktx_texture->numLevels);
+    for (uint32_t l = 0; l < file.levels.size(); l++)
+    {
+        ktx_size_t offset = 0;
+        ktxTexture_GetImageOffset(ktxTexture(ktx_texture.get()), l, 0, 0, &offset);
+        ktx_size_t size = ktxTexture_GetImageSize(ktxTexture(ktx_texture.get()), l);
+
+        Level &level = file.levels[l];
+        level.extent = vk::Extent2D(std::max(1u, ktx_texture->baseWidth >> l), std::max(1u, ktx_texture->baseHeight >> l));
+        if (decoded_format != vk::Format::eUndefined)
+        {
+            level.data = decode_bc(format, level.extent, data + offset, size);
+        }
+        else
+        {
+            level.data.assign(data + offset, data + offset + size);
+        }
+    }
+
+    return file;
+}
+
+/**
+ * @brief Streams in the mip tail of a texture read with read().
+ */
+TextureStreamer::TextureHandle TextureStreamer::add(TextureFile file)
+{
+    Texture texture;
+    texture.name        = std::move(file.name);
+    texture.format      = file.format;
+    texture.levels      = std::move(file.levels);
+    texture.cpu_decoded = file.cpu_decoded;
+
+    // The tail starts at the first level within the tail extent, or is just the last level.
+    uint32_t level_count = static_cast<uint32_t>(texture.levels.size());
+    texture.tail_mip     = level_count - 1;
+    for (uint32_t l = 0; l < level_count; l++)
+    {
+        if (std::max(texture.levels[l].extent.width, texture.levels[l].extent.height) <= tail_extent)
+        {
+            texture.tail_mip = l;
+            break;
+        }
+    }
+
+    texture.resident_mip = level_count;
+    texture.target_mip   = level_count;
+    texture.desired_mip  = texture.tail_mip;
+    texture.last_request = frame_sync->get_frame_number();
+
+    TextureHandle handle = static_cast<TextureHandle>(textures.size());
+    textures.push_back(std::move(texture));
+
+    // The tail is resident regardless of the budget.
+    submit_upload(handle, textures[handle].tail_mip);
+
+    Texture const &added = textures[handle];
+    LOGI("Texture {}: {}x{}, {} levels, {}{}", added.name, added.levels[0].extent.width, added.levels[0].extent.height, level_count, vk::to_string(added.format),
+         added.cpu_decoded ? " (decoded)" : "");
+
+    return handle;
+}
+
+/**
+ * @brief Declares that the texture is visible this frame.
+ * @param screen_size The size in pixels the texture covers along its longest side on screen.
+ */
+void TextureStreamer::request(TextureHandle texture, float screen_size)
+{
+    Texture &t     = textures[texture];
+    t.screen_size  = std::max(t.screen_size, screen_size);
+    t.last_request = frame_sync->get_frame_number();
+}
+
+/**
+ * @brief Binds the completed uploads and adjusts the residency to this frame's requests. Call once per frame,
+ *        after the requests and before reading the bindless indices.
+ */
+void TextureStreamer::update()
+{
+    complete_uploads();
+    plan_residency();
+}
+
+/**
+ * @brief Changes the budget. Lowering it trims the least recently requested textures over the next frames.
+ */
+void TextureStreamer::set_budget(vk::DeviceSize budget)
+{
+    this->budget = budget;
+}
+
+/**
+ * @returns The bindless index to sample the texture with this frame, it changes whenever the residency does.
+ */
+BindlessHeap::Index TextureStreamer::get_bindless_index(TextureHandle texture) const
+{
+    Texture const &t = textures[texture];
+    return t.index != BindlessHeap::invalid_index ? t.index : placeholder_index;
+}
+
+BindlessHeap::Index TextureStreamer::get_sampler_index() const
+{
+    return sampler_index;
+}
+
+TextureStats TextureStreamer::get_stats(TextureHandle texture) const
+{
+    Texture const &t = textures[texture];
+
+    TextureStats stats;
+    stats.name           = t.name;
+    stats.format         = t.format;
+    stats.mip_count      = static_cast<uint32_t>(t.levels.size());
+    stats.resident_mip   = t.resident_mip;
+    stats.desired_mip    = t.desired_mip;
+    stats.resident_bytes = t.image_bytes;
+    stats.full_bytes     = get_chain_bytes(t, 0);
+    stats.cpu_decoded    = t.cpu_decoded;
+    return stats;
+}
+
+vk::DeviceSize TextureStreamer::get_resident_bytes() const
+{
+    vk::DeviceSize bytes = 0;
+    for (auto const &texture : textures)
+    {
+        bytes += texture.image_bytes;
+    }
+    return bytes;
+}
+
+/**
+ * @returns The upload queue's timeline, frames sampling the textures wait on get_upload_value of it.
+ */
+vk::Semaphore TextureStreamer::get_upload_semaphore() const
+{
+    return upload_queue->timeline;
+}
+
+/**
+ * @returns The timeline value of the last upload whose image is bound.
+ */
+uint64_t TextureStreamer::get_upload_value() const
+{
+    return last_upload_value;
+}
+
+void TextureStreamer::log_statistics() const
+{
+    LOGI("Texture streaming: {} textures, {:.1f} of {:.1f} MiB resident, {} uploads pending", textures.size(), get_resident_bytes() / (1024.0 * 1024.0),
+         budget / (1024.0 * 1024.0), uploads.size());
+
+    for (TextureHandle handle = 0; handle < textures.size(); handle++)
+    {
+        TextureStats stats = get_stats(handle);
+        LOGI("  {}: mip {} resident, {} desired of {}, {:.1f} of {:.1f} MiB", stats.name, stats.resident_mip, stats.desired_mip, stats.mip_count,
+             stats.resident_bytes / (1024.0 * 1024.0), stats.full_bytes / (1024.0 * 1024.0));
+    }
+}
+
+/**
+ * @brief Binds the images of the uploads which completed on the GPU.
+ *
+ * Frames in flight still sample the previous image through the previous index, so the image and
+ * the index are retired with the current frame instead of the descriptor being rewritten.
+ */
+void TextureStreamer::complete_uploads()
+{
+    if (uploads.empty())
+    {
+        return;
+    }
+
+    uint64_t completed = device.getSemaphoreCounterValue(upload_queue->timeline, *dispatch);
+
+    size_t done = 0;
+    for (; done < uploads.size() && uploads[done].value <= completed; done++)
+    {
+        Upload  &upload  = uploads[done];
+        Texture &texture = textures[upload.texture];
+
+        if (texture.index != BindlessHeap::invalid_index)
+        {
+            heap->release(BindlessHeap::Kind::eTexture, texture.index);
+        }
+        if (texture.image.image)
+        {
+            frame_sync->retire([device = device, image = texture.image]() mutable { image.clear(device); });
+        }
+
+        texture.image        = upload.image;
+        texture.index        = heap->register_texture(texture.image.view);
+        texture.image_bytes  = device.getImageMemoryRequirements(texture.image.image).size;
+        texture.resident_mip = upload.first_mip;
+        texture.uploading    = false;
+        last_upload_value    = upload.value;
+
+        upload.staging.clear(device);
+        device.freeCommandBuffers(command_pool, upload.cmd);
+    }
+
+    uploads.erase(uploads.begin(), uploads.begin() + done);
+}
+
+/**
+ * @brief Drops the finest planned level of the least recently requested texture which has levels above its tail.
+ * @param requested_before Only textures last requested before this frame are trimmed.
+ * @returns false if there is no such texture.
+ */
+bool TextureStreamer::evict(uint64_t requested_before)
+{
+    TextureHandle victim = ~0u;
+    for (TextureHandle handle = 0; handle < textures.size(); handle++)
+    {
+        Texture const &t = textures[handle];
+        if (!t.uploading && t.target_mip < t.tail_mip && t.last_request < requested_before && (victim == ~0u || t.last_request < textures[victim].last_request))
+        {
+            victim = handle;
+        }
+    }
+
+    if (victim == ~0u)
+    {
+        return false;
+    }
+
+    submit_upload(victim, textures[victim].target_mip + 1);
+    return true;
+}
+
+/**
+ * @brief Derives the desired level of each texture and schedules the uploads towards it.
+ *
+ * Levels finer than desired are dropped right away. Finer levels are streamed in for the textures
+ * requested most recently and most undersampled first, as far as the budget and the per frame
+ * upload limit allow.
+ */
+void TextureStreamer::plan_residency()
+{
+    uint64_t frame = frame_sync->get_frame_number();
+
+    // A texture covering n pixels needs the level which is about n texels wide.
+    for (auto &texture : textures)
+    {
+        if (texture.last_request == frame)
+        {
+            vk::Extent2D const &extent = texture.levels[0].extent;
+            float               ratio  = static_cast<float>(std::max(extent.width, extent.height)) / std::max(texture.screen_size, 1.0f);
+            uint32_t            mip    = ratio > 1.0f ? static_cast<uint32_t>(std::floor(std::log2(ratio))) : 0;
+            texture.desired_mip        = std::min(mip, texture.tail_mip);
+        }
+        else if (frame - texture.last_request > idle_frames)
+        {
+            texture.desired_mip = texture.tail_mip;
+        }
+        texture.screen_size = 0.0f;
+    }
+
+    for (TextureHandle handle = 0; handle < textures.size(); handle++)
+    {
+        Texture const &texture = textures[handle];
+        if (!texture.uploading && texture.target_mip < texture.desired_mip)
+        {
+            submit_upload(handle, texture.desired_mip);
+        }
+    }
+
+    // A lowered budget trims the textures not requested this frame first, then the visible ones.
+    while (committed_bytes > budget && (evict(frame) || evict(frame + 1)))
+    {
+    }
+
+    ArenaVector<TextureHandle> candidates{ArenaAllocator<TextureHandle>(frame_arenas->get_thread_arena())};
+    candidates.reserve(textures.size());
+    for (TextureHandle handle = 0; handle < textures.size(); handle++)
+    {
+        Texture const &texture = textures[handle];
+        if (!texture.uploading && texture.target_mip > texture.desired_mip)
+        {
+            candidates.push_back(handle);
+        }
+    }
+
+    std::sort(candidates.begin(), candidates.end(), [this](TextureHandle a, TextureHandle b) {
+        Texture const &ta = textures[a];
+        Texture const &tb = textures[b];
+        if (ta.last_request != tb.last_request)
+        {
+            return ta.last_request > tb.last_request;
+        }
+        return ta.target_mip - ta.desired_mip > tb.target_mip - tb.desired_mip;
+    });
+
+    vk::DeviceSize uploaded = 0;
+    for (TextureHandle handle : candidates)
+    {
+        Texture const &texture = textures[handle];
+
+        // Make room by trimming textures requested less recently, else settle for a coarser level.
+        uint32_t first_mip = texture.desired_mip;
+        for (; first_mip < texture.target_mip; first_mip++)
+        {
+            vk::DeviceSize needed = get_chain_bytes(texture, first_mip) - get_chain_bytes(texture, texture.target_mip);
+            while (committed_bytes + needed > budget && evict(texture.last_request))
+            {
+            }
+            if (committed_bytes + needed <= budget)
+            {
+                break;
+            }
+        }
+
+        if (first_mip == texture.target_mip)
+        {
+            continue;
+        }
+
+        vk::DeviceSize bytes = get_chain_bytes(texture, first_mip);
+        if (uploaded && uploaded + bytes > upload_frame_bytes)
+        {
+            break;
+        }
+
+        submit_upload(handle, first_mip);
+        uploaded += bytes;
+    }
+}
+
+/**
+ * @brief Creates an image with the levels from first_mip on and submits their upload.
+ */
+TextureStreamer::Upload TextureStreamer::record_upload(vk::Format format, std::vector<Level> const &levels, uint32_t first_mip)
+{
+    Upload upload;
+    upload.image = ImageData::CreateImageData(gpu, device, MemoryCategory::eTextures, format, levels[first_mip].extent, static_cast<uint32_t>(levels.size()) - first_mip,
+                                              vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst, vk::ImageAspectFlagBits::eColor,
+                                              vk::MemoryPropertyFlagBits::eDeviceLocal, queue_families);
+
+    // Offsets are aligned to 16 bytes, a multiple of every texel block size.
+    ArenaVector<vk::BufferImageCopy> regions{ArenaAllocator<vk::BufferImageCopy>(frame_arenas->get_thread_arena())};
+    vk::DeviceSize                   size = 0;
+    regions.reserve(levels.size() - first_mip);
+    for (uint32_t l = first_mip; l < levels.size(); l++)
+    {
+        vk::ImageSubresourceLayers subresource(vk::ImageAspectFlagBits::eColor, l - first_mip, 0, 1);
+        regions.push_back(vk::BufferImageCopy(size, 0, 0, subresource, {0, 0, 0}, vk::Extent3D(levels[l].extent, 1)));
+        size = (size + levels[l].data.size() + 15) & ~vk::DeviceSize(15);
+    }
+
+    upload.staging = BufferData::CreateBufferData(gpu, device, MemoryCategory::eStaging, size, vk::BufferUsageFlagBits::eTransferSrc);
+
+    for (uint32_t l = first_mip; l < levels.size(); l++)
+    {
+        upload.staging.upload(levels[l].data, regions[l - first_mip].bufferOffset);
+    }
+
+    upload.cmd = device.allocateCommandBuffers({command_pool, vk::CommandBufferLevel::ePrimary, 1}).front();
+    upload.cmd.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+
+    vk::ImageSubresourceRange range(vk::ImageAspectFlagBits::eColor, 0, upload.image.mipLevels, 0, 1);
+    vk::ImageMemoryBarrier    to_transfer({}, vk::AccessFlagBits::eTransferWrite, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal,
+                                          VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, upload.image.image, range);
+    upload.cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTransfer, {}, {}, {}, to_transfer);
+
+    upload.cmd.copyBufferToImage(upload.staging.buffer, upload.image.image, vk::ImageLayout::eTransferDstOptimal, regions);
+
+    // Sampling waits on the upload's timeline value, which makes the copies visible.
+    vk::ImageMemoryBarrier to_shader(vk::AccessFlagBits::eTransferWrite, {}, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eShaderReadOnlyOptimal,
+                                     VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, upload.image.image, range);
+    upload.cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eBottomOfPipe, {}, {}, {}, to_shader);
+
+    upload.cmd.end();
+
+    upload.value = upload_queue->next_value();
+
+    vk::TimelineSemaphoreSubmitInfo timeline_info(0, nullptr, 1, &upload.value);
+    vk::SubmitInfo                  submit_info(0, nullptr, nullptr, 1, &upload.cmd, 1, &upload_queue->timeline, &timeline_info);
+    upload_queue->queue.submit(submit_info);
+
+    return upload;
+}
+
+/**
+ * @brief Plans the residency of a texture from first_mip on and submits its upload.
+ */
+void TextureStreamer::submit_upload(TextureHandle handle, uint32_t first_mip)
+{
+    Texture &texture = textures[handle];
+
+    committed_bytes    = committed_bytes + get_chain_bytes(texture, first_mip) - get_chain_bytes(texture, texture.target_mip);
+    texture.target_mip = first_mip;
+    texture.uploading  = true;
+
+    Upload upload    = record_upload(texture.format, texture.levels, first_mip);
+    upload.texture   = handle;
+    upload.first_mip = first_mip;
+    uploads.push_back(std::move(upload));
+}
+
+/**
+ * @returns The size of the levels from first_mip on, as stored in system memory.
+ */
+vk::DeviceSize TextureStreamer::get_chain_bytes(Texture const &texture, uint32_t first_mip) const
+{
+    vk::DeviceSize bytes = 0;
+    for (uint32_t l = first_mip; l < texture.levels.size(); l++)
+    {
+        bytes += texture.levels[l].data.size();
+    }
+    return bytes;
+}
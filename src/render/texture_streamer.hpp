@@ -0,0 +1,133 @@
+﻿#pragma once
+
+#include "memory/frame_arena.hpp"
+#include "render/bindless_heap.hpp"
+#include "render/gpu_resources.hpp"
+
+#include <string>
+#include <vector>
+
+/// @brief Residency of a streamed texture, see TextureStreamer::get_stats.
+struct TextureStats
+{
+    std::string    name;
+    vk::Format     format;                     // The format on the GPU, after transcoding or decoding.
+    uint32_t       mip_count      = 0;
+    uint32_t       resident_mip   = 0;         // The finest resident level, mip_count while the placeholder is bound.
+    uint32_t       desired_mip    = 0;         // The finest level the screen-space demand asks for.
+    vk::DeviceSize resident_bytes = 0;         // The memory of the resident levels.
+    vk::DeviceSize full_bytes     = 0;         // The size of all levels.
+    bool           cpu_decoded    = false;     // The payload was transcoded or decoded on the CPU.
+};
+
+/**
+ * @brief Streams the mips of KTX2 textures by screen-space demand, within a memory budget.
+ *
+ * Block-compressed payloads (BC1-7, ASTC) are uploaded as they are. Basis Universal payloads are
+ * transcoded to the best compressed format the device samples, and BC1-5 are decoded to RGBA8 on
+ * devices without BC support. All levels stay in system memory, the GPU holds a mip chain from the
+ * resident level down.
+ *
+ * Every frame the finest level each texture needs follows from its screen-space size. Textures
+ * which are not requested for a while drop to their mip tail. A residency change creates a new
+ * image with the new chain and uploads it on the transfer queue. Once the upload completed the
+ * texture gets a new bindless index, so frames in flight keep sampling the old image until it is
+ * retired. Finer levels are only streamed in while the resident memory stays within the budget,
+ * the least recently requested textures are trimmed first to make room.
+ */
+class TextureStreamer
+{
+public:
+    using TextureHandle = uint32_t;
+
+    struct Level
+    {
+        vk::Extent2D         extent;
+        std::vector<uint8_t> data;
+    };
+
+    /// @brief A texture read into system memory, which isn't streamed yet.
+    struct TextureFile
+    {
+        std::string        name;
+        vk::Format         format      = vk::Format::eUndefined;
+        std::vector<Level> levels;
+        bool               cpu_decoded = false;
+    };
+
+    static TextureFile read(vk::PhysicalDevice gpu, std::string const &path);
+
+    void prepare(vk::PhysicalDevice gpu, vk::Device device, DeviceDispatch const &dispatch, GpuQueue &upload_queue, uint32_t graphics_queue_family, BindlessHeap &heap, FrameSync &frame_sync,
+                 FrameArenas &frame_arenas, vk::DeviceSize budget);
+    void destroy();
+
+    TextureHandle load(std::string const &path);
+    TextureHandle add(TextureFile file);
+    void          request(TextureHandle texture, float screen_size);
+    void          update();
+    void          set_budget(vk::DeviceSize budget);
+
+    BindlessHeap::Index get_bindless_index(TextureHandle texture) const;
+    BindlessHeap::Index get_sampler_index() const;
+    TextureStats        get_stats(TextureHandle texture) const;
+    vk::DeviceSize      get_resident_bytes() const;
+    vk::Semaphore       get_upload_semaphore() const;
+    uint64_t            get_upload_value() const;
+    void                log_statistics() const;
+
+private:
+    struct Texture
+    {
+        std::string         name;
+        vk::Format          format       = vk::Format::eUndefined;
+        std::vector<Level>  levels;
+        bool                cpu_decoded  = false;
+        ImageData           image;                       // The resident levels, empty while the placeholder is bound.
+        BindlessHeap::Index index        = BindlessHeap::invalid_index;
+        vk::DeviceSize      image_bytes  = 0;
+        uint32_t            resident_mip = 0;            // levels.size() while nothing is resident.
+        uint32_t            desired_mip  = 0;
+        uint32_t            tail_mip     = 0;            // The coarse levels from here on are always resident.
+        uint32_t            target_mip   = 0;            // The residency planned for, resident_mip unless an upload is pending.
+        float               screen_size  = 0.0f;         // The largest size requested this frame.
+        uint64_t            last_request = 0;            // The frame the texture was last requested in.
+        bool                uploading    = false;
+    };
+
+    struct Upload
+    {
+        TextureHandle     texture   = 0;
+        uint32_t          first_mip = 0;
+        ImageData         image;
+        BufferData        staging;
+        vk::CommandBuffer cmd;
+        uint64_t          value     = 0;                 // The upload queue's timeline value signaled on completion.
+    };
+
+    void           complete_uploads();
+    bool           evict(uint64_t requested_before);
+    void           plan_residency();
+    Upload         record_upload(vk::Format format, std::vector<Level> const &levels, uint32_t first_mip);
+    void           submit_upload(TextureHandle texture, uint32_t first_mip);
+    vk::DeviceSize get_chain_bytes(Texture const &texture, uint32_t first_mip) const;
+
+private:
+    vk::PhysicalDevice         gpu;
+    vk::Device                 device;
+    DeviceDispatch const      *dispatch          = nullptr;
+    GpuQueue                  *upload_queue      = nullptr;
+    BindlessHeap              *heap              = nullptr;
+    FrameSync                 *frame_sync        = nullptr;
+    FrameArenas               *frame_arenas      = nullptr;                      // The scratch space of planning and recording uploads.
+    std::vector<uint32_t>      queue_families;                                   // The families sharing the images, the upload and graphics queue.
+    vk::CommandPool            command_pool;
+    vk::Sampler                sampler;                                          // Trilinear, anisotropic where supported.
+    BindlessHeap::Index        sampler_index     = BindlessHeap::invalid_index;
+    ImageData                  placeholder;                                      // A white texel bound until the first levels are resident.
+    BindlessHeap::Index        placeholder_index = BindlessHeap::invalid_index;
+    std::vector<Texture>       textures;
+    std::vector<Upload>        uploads;                                          // In submission order.
+    vk::DeviceSize             budget            = 0;
+    vk::DeviceSize             committed_bytes   = 0;                            // The chain sizes of the planned residency of all textures.
+    uint64_t                   last_upload_value = 0;                            // The last upload whose image was bound.
+};
@@ -0,0 +1,264 @@
+﻿#include "render/transparent_queue.hpp"
+
+#include "math/simd_math.hpp"
+#include "render/shader_variants.hpp"
+
+#include <common/logging.h>
+
+#include <array>
+
+namespace
+{
+double to_milliseconds(std::chrono::steady_clock::duration duration)
+{
+    return std::chrono::duration<double, std::milli>(duration).count();
+}
+}  // namespace
+
+/**
+ * @brief Takes the objects and starts the sorter.
+ * @param thread_count The threads sorting on the CPU, including the calling thread.
+ * @param dispatch Records the sort on the GPU and the draws.
+ */
+void TransparentQueue::prepare(std::vector<TransparentObject> const &objects, uint32_t thread_count, DeviceDispatch const &dispatch)
+{
+    this->objects  = objects;
+    this->dispatch = &dispatch;
+
+    for (uint32_t k = 0; k < 3; k++)
+    {
+        centers[k].resize(objects.size());
+        for (size_t i = 0; i < objects.size(); i++)
+        {
+            centers[k][i] = objects[i].center[k];
+        }
+    }
+
+    keys.resize(objects.size());
+    sorter.prepare(thread_count);
+    sorter.reserve(objects.size());
+}
+
+/**
+ * @brief Sorts the draws on the GPU instead, for frames whose draws come from indirect buffers.
+ *        The draws select their object data by their first instance, without support for that they stay on the CPU.
+ * @param sort_spirv The compiled transparent_sort.comp.
+ * @param radix_spirv The compiled radix_sort.comp.
+ */
+void TransparentQueue::prepare_gpu_sort(vk::PhysicalDevice gpu, vk::Device device, LayoutCache &layout_cache, std::span<uint32_t const> sort_spirv,
+                                        std::span<uint32_t const> radix_spirv)
+{
+    if (objects.empty())
+    {
+        return;
+    }
+
+    vk::PhysicalDeviceFeatures features = gpu.getFeatures();
+    if (!features.drawIndirectFirstInstance)
+    {
+        LOGW("Transparent sort: indirect draws can't select their object data on this device, sorting on the CPU.");
+        return;
+    }
+
+    this->device        = device;
+    multi_draw_indirect = features.multiDrawIndirect;
+
+    ShaderReflection reflection = reflect_shader(sort_spirv);
+    if (reflection.push_constant_size != sizeof(SortPushConstants))
+    {
+        throw std::runtime_error("transparent sort push constants don't match the shader!");
+    }
+
+    vk::DescriptorSetLayout set_layout = layout_cache.get_set_layout(reflection.sets.at(0));
+    pipeline_layout                    = layout_cache.get_pipeline_layout({reflection});
+    pipeline                           = create_compute_pipeline(device, sort_spirv, pipeline_layout);
+
+    uint32_t const object_count = static_cast<uint32_t>(objects.size());
+    gpu_sort.prepare(gpu, device, *dispatch, layout_cache, radix_spirv, object_count);
+
+    object_buffer = BufferData::CreateBufferData(gpu, device, MemoryCategory::eOther, sizeof(TransparentObject) * object_count, vk::BufferUsageFlagBits::eStorageBuffer);
+    object_buffer.upload(objects);
+
+    draw_buffer = BufferData::CreateBufferData(gpu, device, MemoryCategory::eOther, sizeof(vk::DrawIndexedIndirectCommand) * object_count,
+                                               vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer, vk::MemoryPropertyFlagBits::eDeviceLocal);
+
+    vk::DescriptorPoolSize pool_size(vk::DescriptorType::eStorageBuffer, 4);
+    descriptor_pool = device.createDescriptorPool({{}, 1, pool_size});
+    set             = device.allocateDescriptorSets({descriptor_pool, set_layout}).front();
+
+    std::array<vk::DescriptorBufferInfo, 4> buffer_infos = {{
+        {       object_buffer.buffer, 0, VK_WHOLE_SIZE},
+        {  gpu_sort.get_key_buffer(), 0, VK_WHOLE_SIZE},
+        {gpu_sort.get_value_buffer(), 0, VK_WHOLE_SIZE},
+        {         draw_buffer.buffer, 0, VK_WHOLE_SIZE},
+    }};
+    std::vector<vk::WriteDescriptorSet> writes;
+    for (uint32_t binding = 0; binding < buffer_infos.size(); binding++)
+    {
+        writes.emplace_back(set, binding, 0, vk::DescriptorType::eStorageBuffer, nullptr, buffer_infos[binding]);
+    }
+    device.updateDescriptorSets(writes, {});
+
+    LOGI("Transparent sort: {} draws sorted on the GPU", object_count);
+}
+
+void TransparentQueue::destroy()
+{
+    sorter.destroy();
+
+    if (!device)
+    {
+        return;
+    }
+
+    gpu_sort.destroy();
+    object_buffer.clear(device);
+    draw_buffer.clear(device);
+    device.destroyDescriptorPool(descriptor_pool);
+    device.destroyPipeline(pipeline);
+
+    device = nullptr;
+}
+
+/**
+ * @brief Sorts the draws on the CPU from the farthest to the nearest for a camera.
+ */
+void TransparentQueue::sort(glm::mat4 const &view_proj)
+{
+    if (objects.empty())
+    {
+        return;
+    }
+
+    auto const start = std::chrono::steady_clock::now();
+    math::depth_sort_keys_batch(math::Mat4::from_glm(view_proj), {{centers[0].data(), centers[1].data(), centers[2].data()}}, 0, keys.data(), keys.size());
+
+    auto const sorting = std::chrono::steady_clock::now();
+    sorter.sort(keys);
+
+    key_time += sorting - start;
+    sort_time += std::chrono::steady_clock::now() - sorting;
+    sorts++;
+}
+
+/**
+ * @brief Records the draws in the order of the last sort, with the transparent pipeline bound.
+ */
+void TransparentQueue::draw(vk::CommandBuffer cmd)
+{
+    auto const start = std::chrono::steady_clock::now();
+    for (uint64_t key : keys)
+    {
+        TransparentObject const &object = objects[static_cast<uint32_t>(key)];
+        cmd.drawIndexed(object.index_count, 1, object.first_index, object.vertex_offset, object.instance, *dispatch);
+    }
+
+    draw_time += std::chrono::steady_clock::now() - start;
+    draws += keys.size();
+}
+
+/**
+ * @brief Records the sort on the GPU, which writes the draw buffer. The barrier before the draws is up to the render graph.
+ */
+void TransparentQueue::record_gpu_sort(vk::CommandBuffer cmd, glm::mat4 const &view_proj)
+{
+    SortPushConstants constants;
+    constants.view_proj    = view_proj;
+    constants.object_count = static_cast<uint32_t>(objects.size());
+    constants.phase        = 0;
+
+    // The last frame's draws were emitted from the keys this frame overwrites.
+    vk::MemoryBarrier barrier(vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite);
+    cmd.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader, {}, barrier, {}, {}, *dispatch);
+
+    cmd.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline, *dispatch);
+    cmd.bindDescriptorSets(vk::PipelineBindPoint::eCompute, pipeline_layout, 0, set, {}, *dispatch);
+    cmd.pushConstants(pipeline_layout, vk::ShaderStageFlagBits::eCompute, 0, sizeof(constants), &constants, *dispatch);
+    cmd.dispatch((constants.object_count + 63) / 64, 1, 1, *dispatch);
+    cmd.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader, {}, barrier, {}, {}, *dispatch);
+
+    gpu_sort.record(cmd, constants.object_count);
+    cmd.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader, {}, barrier, {}, {}, *dispatch);
+
+    // The sort bound its own pipeline and set.
+    constants.phase = 1;
+    cmd.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline, *dispatch);
+    cmd.bindDescriptorSets(vk::PipelineBindPoint::eCompute, pipeline_layout, 0, set, {}, *dispatch);
+    cmd.pushConstants(pipeline_layout, vk::ShaderStageFlagBits::eCompute, 0, sizeof(constants), &constants, *dispatch);
+    cmd.dispatch((constants.object_count + 63) / 64, 1, 1, *dispatch);
+}
+
+/**
+ * @brief Records the draws the GPU sorted, with the transparent pipeline bound.
+ */
+void TransparentQueue::draw_gpu_sorted(vk::CommandBuffer cmd) const
+{
+    uint32_t const object_count = static_cast<uint32_t>(objects.size());
+    if (multi_draw_indirect)
+    {
+        cmd.drawIndexedIndirect(draw_buffer.buffer, 0, object_count, sizeof(vk::DrawIndexedIndirectCommand), *dispatch);
+    }
+    else
+    {
+        for (uint32_t i = 0; i < object_count; i++)
+        {
+            cmd.drawIndexedIndirect(draw_buffer.buffer, sizeof(vk::DrawIndexedIndirectCommand) * i, 1, sizeof(vk::DrawIndexedIndirectCommand), *dispatch);
+        }
+    }
+}
+
+bool TransparentQueue::is_empty() const
+{
+    return objects.empty();
+}
+
+bool TransparentQueue::is_gpu_sorted() const
+{
+    return static_cast<bool>(device);
+}
+
+std::span<TransparentObject const> TransparentQueue::get_objects() const
+{
+    return objects;
+}
+
+vk::Buffer TransparentQueue::get_draw_buffer() const
+{
+    return draw_buffer.buffer;
+}
+
+/**
+ * @brief Logs what sorting cost the frames since the last report. LoomSortBench compares the radix sort with std::sort.
+ */
+void TransparentQueue::log_statistics()
+{
+    if (objects.empty())
+    {
+        return;
+    }
+
+    if (is_gpu_sorted())
+    {
+        LOGI("Transparent sort: {} draws, sorted on the GPU in the transparent_sort pass", objects.size());
+    }
+    if (sorts)
+    {
+        LOGI("Transparent sort: {} draws, {:.3f} ms generating keys and {:.3f} ms radix sorting on {} threads per sort",
+             objects.size(),
+             to_milliseconds(key_time) / sorts,
+             to_milliseconds(sort_time) / sorts,
+             sorter.get_thread_count());
+    }
+    if (draws)
+    {
+        LOGI("Transparent draws: {:.3f} us per draw recorded, the device functions {}",
+             to_milliseconds(draw_time) * 1000.0 / draws,
+             dispatch->is_through_loader() ? "called through the loader's trampolines" : "called directly");
+    }
+
+    sorts     = 0;
+    key_time  = {};
+    sort_time = {};
+    draws     = 0;
+    draw_time = {};
+}
@@ -0,0 +1,82 @@
+﻿#pragma once
+
+#include "render/device_dispatch.hpp"
+#include "render/gpu_radix_sort.hpp"
+#include "render/gpu_resources.hpp"
+#include "render/layout_cache.hpp"
+#include "render/radix_sort.hpp"
+
+#include <glm/glm.hpp>
+
+#include <chrono>
+#include <span>
+#include <vector>
+
+/// @brief A transparent object, laid out to match std430 for transparent_sort.comp.
+struct TransparentObject
+{
+    glm::vec4 center;             // The point the object is sorted by, w is unused.
+    uint32_t  index_count;        // The indexed draw of the object.
+    uint32_t  first_index;
+    int32_t   vertex_offset;
+    uint32_t  instance;           // Selects the object data.
+};
+
+/**
+ * @brief The transparent draws, drawn after the opaque ones from the farthest to the nearest.
+ *
+ * Blending needs the draws in order, so they are sorted by the depth of their centers every frame.
+ * On the CPU the keys are generated with SIMD and sorted by a parallel RadixSorter, then the draws
+ * are recorded in their order. Lists which are GPU-driven stay on the GPU: transparent_sort.comp
+ * writes the keys, a GpuRadixSort sorts them and the draws are emitted into an indirect buffer, which
+ * the render graph sees as an imported resource.
+ *
+ * Objects which intersect can't be ordered per object, they still blend in the wrong order.
+ */
+class TransparentQueue
+{
+public:
+    void prepare(std::vector<TransparentObject> const &objects, uint32_t thread_count, DeviceDispatch const &dispatch);
+    void prepare_gpu_sort(vk::PhysicalDevice gpu, vk::Device device, LayoutCache &layout_cache, std::span<uint32_t const> sort_spirv, std::span<uint32_t const> radix_spirv);
+    void destroy();
+
+    void sort(glm::mat4 const &view_proj);
+    void draw(vk::CommandBuffer cmd);
+    void record_gpu_sort(vk::CommandBuffer cmd, glm::mat4 const &view_proj);
+    void draw_gpu_sorted(vk::CommandBuffer cmd) const;
+
+    bool                               is_empty() const;
+    bool                               is_gpu_sorted() const;
+    std::span<TransparentObject const> get_objects() const;
+    vk::Buffer                         get_draw_buffer() const;
+    void                               log_statistics();
+
+private:
+    struct SortPushConstants
+    {
+        glm::mat4 view_proj;
+        uint32_t  object_count;
+        uint32_t  phase;
+    };
+
+private:
+    DeviceDispatch const               *dispatch            = nullptr;
+    std::vector<TransparentObject>      objects;
+    std::vector<float>                  centers[3];                   // The centers as one stream per component, for the SIMD key generation.
+    std::vector<uint64_t>               keys;                         // Sorted from the farthest to the nearest, the object index in the low bits.
+    RadixSorter                         sorter;
+    uint64_t                            sorts               = 0;
+    std::chrono::steady_clock::duration key_time{};
+    std::chrono::steady_clock::duration sort_time{};
+    uint64_t                            draws               = 0;      // Recorded on the CPU.
+    std::chrono::steady_clock::duration draw_time{};
+    vk::Device                          device;                       // Null without the GPU sort.
+    GpuRadixSort                        gpu_sort;
+    vk::PipelineLayout                  pipeline_layout;              // Belongs to the layout cache.
+    vk::Pipeline                        pipeline;
+    vk::DescriptorPool                  descriptor_pool;
+    vk::DescriptorSet                   set;
+    BufferData                          object_buffer;                // The TransparentObject array.
+    BufferData                          draw_buffer;                  // vk::DrawIndexedIndirectCommand per object, from far to near.
+    bool                                multi_draw_indirect = false;
+};
@@ -0,0 +1,125 @@
+﻿#pragma once
+
+#include "render/shader_reflection.hpp"
+
+#include <glm/glm.hpp>
+#include <vulkan/vulkan.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+/// @brief The Vulkan format of a vertex attribute of type T, undefined for types without one.
+template <typename T>
+inline constexpr vk::Format vertex_format_v = vk::Format::eUndefined;
+
+template <>
+inline constexpr vk::Format vertex_format_v<float> = vk::Format::eR32Sfloat;
+template <>
+inline constexpr vk::Format vertex_format_v<glm::vec2> = vk::Format::eR32G32Sfloat;
+template <>
+inline constexpr vk::Format vertex_format_v<glm::vec3> = vk::Format::eR32G32B32Sfloat;
+template <>
+inline constexpr vk::Format vertex_format_v<glm::vec4> = vk::Format::eR32G32B32A32Sfloat;
+template <>
+inline constexpr vk::Format vertex_format_v<int32_t> = vk::Format::eR32Sint;
+template <>
+inline constexpr vk::Format vertex_format_v<glm::ivec2> = vk::Format::eR32G32Sint;
+template <>
+inline constexpr vk::Format vertex_format_v<glm::ivec3> = vk::Format::eR32G32B32Sint;
+template <>
+inline constexpr vk::Format vertex_format_v<glm::ivec4> = vk::Format::eR32G32B32A32Sint;
+template <>
+inline constexpr vk::Format vertex_format_v<uint32_t> = vk::Format::eR32Uint;
+template <>
+inline constexpr vk::Format vertex_format_v<glm::uvec2> = vk::Format::eR32G32Uint;
+template <>
+inline constexpr vk::Format vertex_format_v<glm::uvec3> = vk::Format::eR32G32B32Uint;
+template <>
+inline constexpr vk::Format vertex_format_v<glm::uvec4> = vk::Format::eR32G32B32A32Uint;
+
+/// @brief An attribute of a vertex struct, declared with LOOM_VERTEX_ATTRIBUTE.
+struct VertexAttribute
+{
+    uint32_t   location;
+    vk::Format format;
+    uint32_t   offset;
+    uint32_t   size;
+};
+
+/// @brief Declares the member of a vertex struct which feeds a vertex shader input location.
+#define LOOM_VERTEX_ATTRIBUTE(vertex, member, location) \
+    VertexAttribute{location, vertex_format_v<decltype(vertex::member)>, static_cast<uint32_t>(offsetof(vertex, member)), static_cast<uint32_t>(sizeof(vertex::member))}
+
+/**
+ * @brief The layout of a vertex struct in a vertex buffer binding, known at compile time.
+ *
+ * Layouts are constexpr, so is_valid can check them with a static_assert: every attribute needs a
+ * format, must stay within the struct and must neither overlap another attribute nor share its
+ * location. Whether a vertex shader consumes the layout is only known once its SPIR-V is loaded,
+ * matches checks it against the shader's reflection when the pipeline is created.
+ */
+template <typename Vertex, size_t AttributeCount>
+struct VertexLayout
+{
+    static constexpr uint32_t stride = sizeof(Vertex);
+
+    std::array<VertexAttribute, AttributeCount> attributes;
+
+    constexpr vk::VertexInputBindingDescription get_binding(uint32_t binding, vk::VertexInputRate input_rate = vk::VertexInputRate::eVertex) const
+    {
+        return vk::VertexInputBindingDescription(binding, stride, input_rate);
+    }
+
+    constexpr std::array<vk::VertexInputAttributeDescription, AttributeCount> get_attributes(uint32_t binding) const
+    {
+        std::array<vk::VertexInputAttributeDescription, AttributeCount> descriptions{};
+        for (size_t i = 0; i < AttributeCount; i++)
+        {
+            descriptions[i] = vk::VertexInputAttributeDescription(attributes[i].location, binding, attributes[i].format, attributes[i].offset);
+        }
+        return descriptions;
+    }
+
+    constexpr bool is_valid() const
+    {
+        for (size_t i = 0; i < AttributeCount; i++)
+        {
+            VertexAttribute const &attribute = attributes[i];
+            if (attribute.format == vk::Format::eUndefined || attribute.offset + attribute.size > stride)
+            {
+                return false;
+            }
+
+            for (size_t j = 0; j < i; j++)
+            {
+                VertexAttribute const &other = attributes[j];
+                if (other.location == attribute.location || (other.offset < attribute.offset + attribute.size && attribute.offset < other.offset + other.size))
+                {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    /// @brief Checks that every input of a vertex shader is fed by an attribute of the same format.
+    bool matches(ShaderReflection const &reflection) const
+    {
+        return std::all_of(reflection.vertex_inputs.begin(),
+                           reflection.vertex_inputs.end(),
+                           [this](ShaderReflection::VertexInput const &input)
+                           {
+                               return std::any_of(attributes.begin(),
+                                                  attributes.end(),
+                                                  [&input](VertexAttribute const &attribute) { return attribute.location == input.location && attribute.format == input.format; });
+                           });
+    }
+};
+
+template <typename Vertex, typename... Attributes>
+constexpr VertexLayout<Vertex, sizeof...(Attributes)> make_vertex_layout(Attributes const &...attributes)
+{
+    return {{attributes...}};
+}